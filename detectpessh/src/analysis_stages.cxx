@@ -0,0 +1,63 @@
+#include "analysis_stages.hpp"
+#include <cstdio>
+
+const char *stageName(AnalysisStage stage) {
+  switch (stage) {
+  case AnalysisStage::Headers:
+    return "headers";
+  case AnalysisStage::Imports:
+    return "imports";
+  case AnalysisStage::DataSections:
+    return "data sections";
+  case AnalysisStage::FullScan:
+    return "full scan";
+  case AnalysisStage::Similarity:
+    return "similarity";
+  default:
+    return "-";
+  }
+}
+
+void StageStats::record(AnalysisStage stage, bool hit, bool decided,
+                        uint64_t nanoseconds) {
+  Counters &counters = stages[static_cast<size_t>(stage)];
+  counters.runs.fetch_add(1, std::memory_order_relaxed);
+  counters.hits.fetch_add(hit, std::memory_order_relaxed);
+  counters.decided.fetch_add(decided, std::memory_order_relaxed);
+  counters.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+uint64_t StageStats::runs(AnalysisStage stage) const {
+  return stages[static_cast<size_t>(stage)].runs.load(std::memory_order_relaxed);
+}
+
+uint64_t StageStats::nanoseconds(AnalysisStage stage) const {
+  return stages[static_cast<size_t>(stage)].nanoseconds.load(
+      std::memory_order_relaxed);
+}
+
+void StageStats::print(std::ostream &out) const {
+  out << "\n=== Stage Statistics ===\n";
+  out << "stage               runs   hit rate  decided   avg time\n";
+  for (size_t i = 0; i < STAGE_COUNT; i++) {
+    const Counters &counters = stages[i];
+    uint64_t runs = counters.runs.load(std::memory_order_relaxed);
+    double hitRate =
+        runs == 0 ? 0.0
+                  : 100.0 * counters.hits.load(std::memory_order_relaxed) / runs;
+    double averageMicros =
+        runs == 0 ? 0.0
+                  : counters.nanoseconds.load(std::memory_order_relaxed) /
+                        1000.0 / runs;
+
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-14s %9llu   %6.1f%%  %7llu  %8.1fus\n",
+                  stageName(static_cast<AnalysisStage>(i)),
+                  static_cast<unsigned long long>(runs), hitRate,
+                  static_cast<unsigned long long>(
+                      counters.decided.load(std::memory_order_relaxed)),
+                  averageMicros);
+    out << line;
+  }
+  out.flush();
+}
@@ -0,0 +1,48 @@
+#ifndef ANALYSIS_STAGES_H__
+#define ANALYSIS_STAGES_H__
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Stages of PESSHDetector::isSSHClient(), in the order they run: cheapest
+// first, so most verdicts are settled before the whole file is touched
+enum class AnalysisStage : uint8_t {
+  Headers,      // PE headers, section table, file size
+  Imports,      // import and delay-load directories
+  DataSections, // string scan of non-executable initialized data sections
+  FullScan,     // string scan of the rest of the file
+  Similarity,   // fuzzy hash of the whole file, known client lookup
+  Count
+};
+
+constexpr size_t STAGE_COUNT = static_cast<size_t>(AnalysisStage::Count);
+
+const char *stageName(AnalysisStage stage);
+
+/**
+ * How often each stage runs, adds to the score and settles the verdict,
+ * and how long it takes. Shared by any number of detectors, so the stage
+ * order can be tuned on a whole corpus.
+ */
+class StageStats {
+private:
+  struct Counters {
+    std::atomic<uint64_t> runs{0};
+    std::atomic<uint64_t> hits{0};    // runs that added to the score
+    std::atomic<uint64_t> decided{0}; // runs after which the verdict was fixed
+    std::atomic<uint64_t> nanoseconds{0};
+  };
+
+  std::array<Counters, STAGE_COUNT> stages;
+
+public:
+  void record(AnalysisStage stage, bool hit, bool decided,
+              uint64_t nanoseconds);
+  uint64_t runs(AnalysisStage stage) const;
+  uint64_t nanoseconds(AnalysisStage stage) const;
+  void print(std::ostream &out) const;
+};
+#endif
@@ -0,0 +1,198 @@
+// Weighted Windows API names looked up through a compile-time perfect hash
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#ifndef API_HASH_H__
+#define API_HASH_H__
+
+struct WeightedApi {
+  std::string_view name;
+  size_t weight;
+};
+
+// APIs an SSH client typically imports. Names are case sensitive, exactly as
+// they appear in the hint/name table of the import directory.
+inline constexpr std::array<WeightedApi, 34> sshApiTable = {{
+    // Winsock
+    {"WSAStartup", 3},
+    {"WSAConnect", 6},
+    {"WSAAsyncSelect", 6},
+    {"WSAEventSelect", 4},
+    {"WSASocketW", 4},
+    {"WSASocketA", 4},
+    {"WSAIoctl", 3},
+    {"connect", 4},
+    {"socket", 3},
+    {"getaddrinfo", 4},
+    {"GetAddrInfoW", 4},
+    {"gethostbyname", 3},
+    {"select", 2},
+    {"recv", 2},
+    {"send", 2},
+    // CryptoAPI / CNG
+    {"CryptAcquireContextA", 6},
+    {"CryptAcquireContextW", 6},
+    {"CryptGenRandom", 6},
+    {"CryptProtectMemory", 5},
+    {"CryptUnprotectMemory", 5},
+    {"CryptProtectData", 4},
+    {"SystemFunction036", 5}, // RtlGenRandom
+    {"BCryptGenRandom", 6},
+    {"BCryptOpenAlgorithmProvider", 5},
+    {"BCryptHashData", 4},
+    {"NCryptOpenStorageProvider", 4},
+    {"CertOpenStore", 3},
+    {"CertFindCertificateInStore", 3},
+    // credentials, agent forwarding and consoles
+    {"CredReadW", 4},
+    {"CreateNamedPipeW", 3},
+    {"GetUserNameA", 2},
+    {"CreatePseudoConsole", 5},
+    {"SetConsoleMode", 3},
+    {"ReadConsoleInputW", 2},
+}};
+
+// Winsock exports that are commonly imported by ordinal only.
+struct OrdinalApi {
+  uint16_t ordinal;
+  std::string_view name;
+};
+
+inline constexpr std::array<OrdinalApi, 13> winsockOrdinals = {{
+    {1, "accept"},
+    {2, "bind"},
+    {3, "closesocket"},
+    {4, "connect"},
+    {9, "htons"},
+    {16, "recv"},
+    {18, "select"},
+    {19, "send"},
+    {23, "socket"},
+    {52, "gethostbyname"},
+    {111, "WSAGetLastError"},
+    {115, "WSAStartup"},
+    {116, "WSACleanup"},
+}};
+
+namespace apihash {
+
+constexpr uint32_t fnv1a(std::string_view str, uint32_t seed) {
+  uint32_t hash = 2166136261u ^ seed;
+  for (char c : str) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 16777619u;
+  }
+  // murmur3 finalizer, so the seed reaches the low bits used as the slot
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35u;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+constexpr uint8_t foldAscii(char c) {
+  uint8_t b = static_cast<uint8_t>(c);
+  return b >= 'A' && b <= 'Z' ? b + 32 : b;
+}
+
+// fnv1a of str with ASCII letters lower-cased, for case-insensitive lookups
+constexpr uint32_t fnv1aFolded(std::string_view str) {
+  uint32_t hash = 2166136261u;
+  for (char c : str) {
+    hash ^= foldAscii(c);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+constexpr bool equalsFolded(std::string_view a, std::string_view b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++) {
+    if (foldAscii(a[i]) != foldAscii(b[i]))
+      return false;
+  }
+  return true;
+}
+
+// smallest power of two with at least twice as many slots as keys
+constexpr size_t slotCountFor(size_t keys) {
+  size_t slots = 1;
+  while (slots < keys * 2)
+    slots <<= 1;
+  return slots;
+}
+
+inline constexpr size_t slotCount = slotCountFor(sshApiTable.size());
+
+// Search for a seed that puts every key in a distinct slot.
+constexpr uint32_t findSeed() {
+  for (uint32_t seed = 1; seed < 1u << 20; seed++) {
+    std::array<bool, slotCount> used{};
+    bool collision = false;
+    for (const auto &api : sshApiTable) {
+      size_t slot = fnv1a(api.name, seed) & (slotCount - 1);
+      if (used[slot]) {
+        collision = true;
+        break;
+      }
+      used[slot] = true;
+    }
+    if (!collision)
+      return seed;
+  }
+  return 0;
+}
+
+inline constexpr uint32_t seed = findSeed();
+static_assert(seed != 0, "no perfect hash seed for sshApiTable");
+
+// slot -> index into sshApiTable, -1 for empty slots
+constexpr std::array<int16_t, slotCount> buildSlots() {
+  std::array<int16_t, slotCount> slots{};
+  for (auto &slot : slots)
+    slot = -1;
+  for (size_t i = 0; i < sshApiTable.size(); i++)
+    slots[fnv1a(sshApiTable[i].name, seed) & (slotCount - 1)] =
+        static_cast<int16_t>(i);
+  return slots;
+}
+
+inline constexpr std::array<int16_t, slotCount> slots = buildSlots();
+
+/**
+ * Look up an imported function name in sshApiTable.
+ * One hash and at most one comparison, no allocation.
+ *
+ * @param name the imported function name
+ * @return index into sshApiTable, or -1 if the name is not a weighted API
+ */
+constexpr int lookup(std::string_view name) {
+  int index = slots[fnv1a(name, seed) & (slotCount - 1)];
+  if (index < 0 || sshApiTable[index].name != name)
+    return -1;
+  return index;
+}
+
+/**
+ * Resolve a Winsock ordinal import to its exported name.
+ * @return the export name, or an empty view for unknown ordinals
+ */
+constexpr std::string_view winsockOrdinalName(uint16_t ordinal) {
+  for (const auto &entry : winsockOrdinals) {
+    if (entry.ordinal == ordinal)
+      return entry.name;
+  }
+  return {};
+}
+
+static_assert(lookup("WSAConnect") >= 0);
+static_assert(lookup("BCryptGenRandom") >= 0);
+static_assert(lookup("ExitProcess") < 0);
+static_assert(equalsFolded("WS2_32.dll", "ws2_32.DLL"));
+static_assert(!equalsFolded("\xC0", "\xE0"));
+
+} // namespace apihash
+#endif
@@ -1,109 +1,28 @@
 #include "detectpessh.hpp"
 
-PESSHDetector::PESSHDetector() {
-  loadDLLMapFromConfig();
-  loadSSHMapFromConfig();
-}
+PESSHDetector::PESSHDetector()
+    : rules(RuleSet::load(RuleSet::DEFAULT_DLL_MAP, RuleSet::DEFAULT_SSH_MAP)) {}
 
 PESSHDetector::PESSHDetector(std::string dllMapConfigPath,
                              std::string sshMapConfigPath)
-    : dllMapFilePath(dllMapConfigPath), sshMapFilePath(sshMapConfigPath) {
-  loadDLLMapFromConfig();
-  loadSSHMapFromConfig();
-}
-
-bool PESSHDetector::fileExists(const std::string &path) {
-  return std::filesystem::exists(path);
-}
-
-void PESSHDetector::setDefaultDLLMap() {
-  sshLibrariesMap = {
-      {"ws2_32.dll", 12},   {"wsock32.dll", 12},  {"wininet.dll", 12},
-      {"crypt32.dll", 12},  {"advapi32.dll", 12}, {"bcrypt.dll", 12},
-      {"libssl", 12},       {"libcrypto", 12},    {"openssl", 12},
-      {"libeay32.dll", 12}, {"ssleay32.dll", 12}, {"ncrypt.dll", 12},
-      {"cryptsp.dll", 12}};
-}
-void PESSHDetector::setDefaultSSHMap() {
-  sshStringsMap = {
-      {"ssh", 25},         {"openssh", 25},     {"putty", 25},
-      {"PUTTY", 25},       {"ssh-rsa", 25},     {"ssh-dss", 25},
-      {"ssh-ed25519", 15}, {"ecdsa-sha2", 25},  {"id_rsa", 12},
-      {"id_dsa", 19},      {"known_hosts", 25}, {"authorized_keys", 12},
-      {".ssh", 20},        {"~/.ssh", 20},      {"%USERPROFILE%\\.ssh", 25},
-      {"ssh-keygen", 20},  {"ssh-add", 19},     {"ssh-agent", 20},
-      {"SecureShell", 20}, {"terminal", 12},    {"sftp", 18},
-      {"scp", 20}};
-}
-
-// Trim whitespace from both ends of a string
-std::string PESSHDetector::trimWhiteSpace(const std::string &str) {
-  size_t start = str.find_first_not_of(" \t\n\r\f\v");
-  if (start == std::string::npos)
-    return "";
+    : rules(RuleSet::load(dllMapConfigPath, sshMapConfigPath)) {}
 
-  size_t end = str.find_last_not_of(" \t\n\r\f\v");
-  return str.substr(start, end - start + 1);
+PESSHDetector::PESSHDetector(RuleStore &store) : ruleStore(&store) {
+  // generation first: a reload in between is caught by the next refresh
+  rulesVersion = store.version();
+  rules = store.snapshot();
 }
 
+const RuleSet &PESSHDetector::getRules() const { return *rules; }
 
-// reads map from file and loads it into sshLibrariesMap
-void PESSHDetector::loadDLLMapFromConfig() {
-  loadMapFromConfig(dllMapFilePath, sshLibrariesMap,
-                    [&]() { setDefaultDLLMap(); });
-}
-
-// loads the map from a file and puts it into sshStringsMap
-void PESSHDetector::loadSSHMapFromConfig() {
-  loadMapFromConfig(sshMapFilePath, sshStringsMap,
-                    [&]() { setDefaultSSHMap(); });
-}
-
-/**
- * Loads a map from a file and puts it into map.
- * If the file does not exist, it sets the default map using the setDeaultMap
- * function If there is an error while reading the file, it sets the default
- * map and writes an error message to cerr.
- *
- * @param filename the name of the file to read from
- * @param map the map to put the data into
- * @param setDefaultMap a function to call if the file does not exist or there
- * is an error while reading the file
- */
-void PESSHDetector::loadMapFromConfig(const std::string &filename,
-                       std::map<std::string, size_t> &map,
-                       std::function<void()> setDefaultMap) {
-
-  if (!fileExists(filename)) {
-    setDefaultMap();
-    return;
-  }
-
-  std::ifstream ifs(filename);
-  if (ifs.bad()) {
-    std::cout << "File : " << filename
-              << " could not be opened\nUsing default Mappings";
+void PESSHDetector::refreshRules() {
+  // one atomic load per file; the snapshot itself is only copied, and its
+  // reference count touched, when a reload was published
+  uint64_t version = ruleStore->version();
+  if (version == rulesVersion)
     return;
-  }
-
-  std::string line{100};
-
-  while (std::getline(ifs, line)) {
-    try {
-
-      size_t eq_pos = line.find('=');
-      if (eq_pos == std::string::npos)
-        throw;
-        
-      map.emplace(std::make_pair(trimWhiteSpace(line.substr(0, eq_pos)),
-                                 std::stoi(trimWhiteSpace(line.substr(eq_pos + 1)))));
-
-    } catch (...) {
-      std::cerr << "Error occured with config file, Using default Mappings\n";
-      setDefaultMap();
-      return;
-    }
-  }
+  rulesVersion = version;
+  rules = ruleStore->snapshot();
 }
 
 /**
@@ -117,224 +36,1184 @@ bool PESSHDetector::loadPEFile(const std::string &filename) {
     std::cerr << "Error: " << filename << " Does not exist" << '\n';
     return false;
   }
-  std::ifstream file(filename, std::ios::binary);
-  if (!file) {
+  if (!mappedFile.open(filename)) {
     std::cerr << "Error: Cannot open file " << filename << '\n';
     return false;
   }
 
-  // Read entire file
-  file.seekg(0, std::ios::end);
-  size_t fileSize = file.tellg();
-  file.seekg(0, std::ios::beg);
+  return loadPEBuffer(ByteView(mappedFile.data(), mappedFile.size()));
+}
+
+bool PESSHDetector::loadPEFile(int fd) {
+  if (!mappedFile.open(fd)) {
+    std::cerr << "Error: Cannot map file descriptor " << fd << '\n';
+    return false;
+  }
+
+  return loadPEBuffer(ByteView(mappedFile.data(), mappedFile.size()));
+}
 
-  fileData.resize(fileSize);
-  file.read(reinterpret_cast<char *>(fileData.data()), fileSize);
-  file.close();
+bool PESSHDetector::loadPEBuffer(ByteView bytes, bool imageLayout) {
+  // findings of the previous file may point into the old rules, they are
+  // dropped below
+  if (ruleStore != nullptr)
+    refreshRules();
 
+  fileData = bytes;
+  mappedImage = imageLayout;
+  pe = std::monostate{};
+  sections = SectionIndex();
+  hasImphash = false;
+  hasContentDigest = false;
+  fuzzyDigest = FuzzyDigest();
+  hasFuzzyDigest = false;
+  stringHits.assign(rules->strings().size(), StringHit());
+  unscoredStringWeight = rules->stringWeight();
+  stringMatches = 0;
+  patternHits.assign(rules->patternStrings().size(), PatternHit());
+  placedHits.assign(rules->placementCount(), 0);
+  dataSections.clear();
+  lastStage = AnalysisStage::Headers;
+  stoppedEarly = false;
   confidence = 0;
   findings.clear();
+  sectionRanges.clear();
+  sectionNames.clear();
+  namedSections.clear();
+  sectionFlags.clear();
+  sectionEntropies.clear();
+  compressedSections.clear();
+  entrySection = -1;
+  packed = false;
+  stringIndex.clear();
+  metrics = AnalysisMetrics();
 
   return true;
 }
 
+int PESSHDetector::getConfidence() const { return confidence; }
+
+bool PESSHDetector::isPacked() const { return packed; }
+
+AnalysisStage PESSHDetector::getLastStage() const { return lastStage; }
+
 bool PESSHDetector::isPEFormat() {
-  if (fileData.size() < sizeof(DOS_HEADER)) {
+  pe = parsePeView(fileData);
+  if (std::holds_alternative<std::monostate>(pe)) {
     return false;
   }
 
-  // Check DOS header
-  std::memcpy(&dosHeader, fileData.data(), sizeof(DOS_HEADER));
-  if (dosHeader.e_magic != 0x5A4D) { // "MZ"
-    return false;
+  findings.push_back({.rule = RuleId::PEFormat,
+                      .weight = 10,
+                      .subject = isPE32Plus() ? "PE32+" : "PE32"});
+  confidence += 10;
+  return true;
+}
+
+void PESSHDetector::readSectionHeaders() {
+  std::visit(
+      [&](const auto &view) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(view)>,
+                                     std::monostate>) {
+          sections = SectionIndex();
+        } else {
+          sections.build(
+              [&](size_t i, SECTION_HEADER &section) {
+                return view.section(i, section);
+              },
+              view.numberOfSections(), view.sizeOfHeaders(), fileData.size(),
+              mappedImage);
+
+          const uint32_t SCN_CNT_INITIALIZED_DATA = 0x00000040;
+          const uint32_t SCN_MEM_EXECUTE = 0x20000000;
+          const uint32_t entryPoint = view.addressOfEntryPoint();
+          SECTION_HEADER section;
+          for (uint16_t i = 0; i < view.numberOfSections(); i++) {
+            if (!view.section(i, section))
+              break;
+
+            size_t begin =
+                mappedImage ? section.VirtualAddress : section.PointerToRawData;
+            size_t end = std::min<size_t>(
+                fileData.size(),
+                begin + (mappedImage ? section.VirtualSize
+                                     : section.SizeOfRawData));
+            sectionRanges.emplace_back(std::min(begin, end), end);
+            sectionNames.emplace_back(section.Name,
+                                      strnlen(section.Name, sizeof(section.Name)));
+            sectionFlags.push_back(section.Characteristics);
+            uint64_t virtualSize = std::max(section.VirtualSize,
+                                            section.SizeOfRawData);
+            if (entrySection < 0 && entryPoint >= section.VirtualAddress &&
+                entryPoint - uint64_t(section.VirtualAddress) < virtualSize)
+              entrySection = static_cast<int16_t>(i);
+            metrics.sectionsParsed++;
+
+            if (!(section.Characteristics & SCN_CNT_INITIALIZED_DATA) ||
+                (section.Characteristics & SCN_MEM_EXECUTE))
+              continue;
+            if (begin < end)
+              dataSections.emplace_back(begin, end);
+          }
+        }
+      },
+      pe);
+
+  // sorted and merged, so no byte is scanned twice
+  mergeRanges(dataSections);
+
+  // once sectionNames is complete, the views into it stay valid
+  for (size_t i = 0; i < sectionNames.size(); i++)
+    namedSections.push_back(
+        {sectionNames[i], sectionRanges[i].first, sectionRanges[i].second});
+}
+
+void PESSHDetector::detectPacker() {
+  const uint32_t SCN_MEM_EXECUTE = 0x20000000;
+  const uint32_t SCN_MEM_WRITE = 0x80000000;
+
+  for (size_t i = 0; i < sectionNames.size(); i++) {
+    std::string_view packer = packerOfSection(sectionNames[i]);
+    if (packer.empty())
+      continue;
+    findings.push_back({.rule = RuleId::Packed,
+                        .section = static_cast<int16_t>(i),
+                        .offset = sectionRanges[i].first,
+                        .subject = packer,
+                        .context = sectionNames[i]});
+    packed = true;
+    return;
   }
 
-  if (dosHeader.e_lfanew >= fileData.size() ||
-      dosHeader.e_lfanew + sizeof(NT_HEADERS) >
-          fileData.size()) {
-    return false;
+  // unpacking stubs write the code they then run
+  if (entrySection >= 0 &&
+      (sectionFlags[entrySection] & (SCN_MEM_EXECUTE | SCN_MEM_WRITE)) ==
+          (SCN_MEM_EXECUTE | SCN_MEM_WRITE)) {
+    findings.push_back({.rule = RuleId::Packed,
+                        .section = entrySection,
+                        .offset = sectionRanges[entrySection].first,
+                        .subject = "unknown",
+                        .context = "writable entry point section"});
+    packed = true;
   }
+}
 
-  // Check NT header
-  std::memcpy(&ntHeaders, fileData.data() + dosHeader.e_lfanew,
-              sizeof(NT_HEADERS));
-  if (ntHeaders.Signature != 0x00004550) { // "PE\0\0"
-    return false;
+void PESSHDetector::analyzeVersionInfo() {
+  const int RESOURCE_TABLE_INDEX = 2;
+  // wLength of the VS_VERSIONINFO block is 16-bit
+  const uint32_t MAX_VERSION_INFO_SIZE = 0xffff;
+
+  IMAGE_DATA_DIRECTORY resourceDir{0, 0};
+  if (const auto *view = std::get_if<PeView32>(&pe))
+    resourceDir = view->dataDirectory(RESOURCE_TABLE_INDEX);
+  else if (const auto *view = std::get_if<PeView64>(&pe))
+    resourceDir = view->dataDirectory(RESOURCE_TABLE_INDEX);
+
+  uint32_t resourceOffset =
+      resourceDir.VirtualAddress == 0
+          ? 0
+          : rvaToFileOffset(resourceDir.VirtualAddress,
+                            sizeof(IMAGE_RESOURCE_DIRECTORY));
+  uint32_t versionRva, versionSize;
+  if (resourceOffset == 0 ||
+      !findVersionResource(fileData.subview(resourceOffset, fileData.size()),
+                           versionRva, versionSize))
+    return;
+
+  versionSize = std::min(versionSize, MAX_VERSION_INFO_SIZE);
+  uint32_t versionOffset = rvaToFileOffset(versionRva, versionSize);
+  if (versionOffset == 0)
+    return;
+
+  forEachVersionString(
+      fileData.subview(versionOffset, versionSize),
+      [&](const VersionString &string) {
+        std::string_view key = identityKey(string.key);
+        std::string_view client =
+            key.empty() ? std::string_view() : sshClientOfProduct(string.value);
+        if (client.empty())
+          return true;
+
+        size_t offset = versionOffset + string.offset;
+        findings.push_back({.rule = RuleId::VersionInfo,
+                            .encoding = PatternScanner::UTF16LE,
+                            .section = sectionOfOffset(offset),
+                            .weight = VERSION_INFO_WEIGHT,
+                            .offset = offset,
+                            .subject = client,
+                            .context = key});
+        confidence += VERSION_INFO_WEIGHT;
+        return false; // one is all it takes
+      });
+}
+
+void PESSHDetector::measureEntropy() {
+  if (sectionEntropies.size() == sectionRanges.size())
+    return;
+
+  sectionEntropies.clear();
+  for (size_t i = 0; i < sectionRanges.size(); i++) {
+    const auto &[begin, end] = sectionRanges[i];
+    double entropy = sectionEntropy(fileData.data() + begin, end - begin);
+    sectionEntropies.push_back(entropy);
+    if (end - begin < MIN_ENTROPY_SIZE || entropy < COMPRESSED_ENTROPY)
+      continue;
+
+    int64_t millibits = static_cast<int64_t>(entropy * 1000);
+    findings.push_back({.rule = RuleId::CompressedSection,
+                        .section = static_cast<int16_t>(i),
+                        .value = millibits,
+                        .offset = begin,
+                        .subject = sectionNames[i]});
+    if (end - begin <= ENTROPY_SAMPLE_SIZE) {
+      compressedSections.emplace_back(begin, end);
+    } else {
+      // the samples flag the section, but only bytes measured as compressed
+      // are left out: plain text between the samples is still scanned
+      for (const auto &[from, to] :
+           compressedBlocks(fileData.data() + begin, end - begin))
+        compressedSections.emplace_back(begin + from, begin + to);
+    }
+
+    if (!packed && static_cast<int16_t>(i) == entrySection) {
+      findings.push_back({.rule = RuleId::Packed,
+                          .section = entrySection,
+                          .value = millibits,
+                          .offset = begin,
+                          .subject = "unknown",
+                          .context = "compressed entry point section"});
+      packed = true;
+    }
   }
 
-  findings.push_back("Valid Windows PE executable");
-  confidence += 10;
-  return true;
+  // strings in compressed bytes are coincidences, leave them out
+  mergeRanges(compressedSections);
+  dataSections = subtractRanges(dataSections, compressedSections);
 }
 
-void PESSHDetector::readSectionHeaders() {
-  size_t sectionOffset = dosHeader.e_lfanew + sizeof(NT_HEADERS);
-  sectionHeaders.resize(ntHeaders.FileHeader.NumberOfSections);
-
-  for (int i = 0; i < ntHeaders.FileHeader.NumberOfSections; i++) {
-    if (sectionOffset + sizeof(SECTION_HEADER) <= fileData.size()) {
-      std::memcpy(&sectionHeaders[i], fileData.data() + sectionOffset,
-                  sizeof(SECTION_HEADER));
-      sectionOffset += sizeof(SECTION_HEADER);
+void mergeRanges(std::vector<FileRange> &ranges) {
+  std::sort(ranges.begin(), ranges.end());
+  std::vector<FileRange> merged;
+  for (const auto &range : ranges) {
+    if (!merged.empty() && range.first <= merged.back().second)
+      merged.back().second = std::max(merged.back().second, range.second);
+    else
+      merged.push_back(range);
+  }
+  ranges = std::move(merged);
+}
+
+std::vector<FileRange> subtractRanges(const std::vector<FileRange> &ranges,
+                                      const std::vector<FileRange> &removed) {
+  std::vector<FileRange> result;
+  for (auto [begin, end] : ranges) {
+    for (const auto &[from, to] : removed) {
+      if (to <= begin || from >= end)
+        continue;
+      if (from > begin)
+        result.emplace_back(begin, from);
+      begin = std::max(begin, to);
     }
+    if (begin < end)
+      result.emplace_back(begin, end);
   }
+  return result;
 }
 
-void PESSHDetector::analyzeStrings() {
-  std::string fileContent(fileData.begin(), fileData.end());
-  std::transform(fileContent.begin(), fileContent.end(), fileContent.begin(),
-                 ::tolower);
+int16_t PESSHDetector::sectionOfOffset(size_t offset) const {
+  for (size_t i = 0; i < sectionRanges.size(); i++) {
+    if (offset >= sectionRanges[i].first && offset < sectionRanges[i].second)
+      return static_cast<int16_t>(i);
+  }
+  return -1;
+}
 
-  int stringMatches = 0;
-  for (const auto &sshString : sshStringsMap) {
-    std::string lowerStr = sshString.first;
-    std::transform(lowerStr.begin(), lowerStr.end(), lowerStr.begin(),
-                   ::tolower);
+std::vector<FileRange> PESSHDetector::rangesOutsideDataSections() const {
+  std::vector<FileRange> covered(dataSections);
+  covered.insert(covered.end(), compressedSections.begin(),
+                 compressedSections.end());
+  mergeRanges(covered);
 
-    if (fileContent.find(lowerStr) != std::string::npos) {
-      findings.push_back("Found SSH-related string: " + sshString.first);
-      stringMatches++;
-      confidence += sshString.second;
+  // matches running on into a data section are still found whole, see
+  // analyzeStrings
+  std::vector<FileRange> ranges;
+  size_t position = 0;
+  for (const auto &section : covered) {
+    if (section.first > position)
+      ranges.emplace_back(position, section.first);
+    position = std::max(position, section.second);
+  }
+  if (position < fileData.size())
+    ranges.emplace_back(position, fileData.size());
+  return ranges;
+}
+
+// What the scan of one chunk found, merged in chunk order
+struct ChunkHits {
+  std::vector<StringHit> strings;
+  std::vector<PatternHit> patterns;
+  std::vector<uint8_t> placed;
+  uint64_t matches{0};
+};
+
+void PESSHDetector::scanChunk(const ScanChunk &chunk, ChunkHits &out) const {
+  const PatternScanner &scanner = rules->scanner();
+  const size_t stringCount = rules->strings().size();
+  out.strings.assign(stringCount, StringHit());
+  out.patterns.assign(rules->patternStrings().size(), PatternHit());
+  out.placed.assign(rules->placementCount(), 0);
+
+  scanner.scan(fileData.data() + chunk.begin, chunk.scanEnd - chunk.begin,
+               [&](const PatternScanner::Match &match) {
+                 size_t offset = chunk.begin + match.offset;
+                 // matches starting in the overlap belong to the next chunk
+                 if (offset >= chunk.end)
+                   return;
+                 out.matches++;
+                 if (match.pattern >= stringCount) {
+                   recordPatternHit(match.pattern - stringCount, offset, out);
+                   return;
+                 }
+                 StringHit &hit = out.strings[match.pattern];
+                 if (hit.encodings == 0 || offset < hit.offset)
+                   hit.offset = offset;
+                 hit.encodings |= match.encoding;
+               });
+}
+
+void PESSHDetector::recordPatternHit(size_t index, size_t offset,
+                                     ChunkHits &out) const {
+  const PatternRuleString &ref = rules->patternStrings()[index];
+  const std::vector<Condition> &placements =
+      rules->patterns()[ref.rule].placements;
+  uint8_t *placed = out.placed.data() + rules->firstPlacement(ref.rule);
+  PatternHit &hit = out.patterns[index];
+
+  // nothing left to learn from more hits of this string
+  bool settled = hit.found;
+  for (uint32_t p : ref.placements)
+    settled = settled && placed[p];
+  if (settled || !verifyPatternHit(index, offset))
+    return;
+
+  if (!hit.found || offset < hit.offset)
+    hit.offset = offset;
+  hit.found = true;
+  for (uint32_t p : ref.placements) {
+    if (!placed[p] && isPlaced(placements[p], offset, namedSections))
+      placed[p] = 1;
+  }
+}
+
+void PESSHDetector::analyzeStrings(const std::vector<FileRange> &ranges) {
+  const std::vector<StringRule> &stringRules = rules->strings();
+  // a match may start up to this many bytes before the end of a chunk
+  const size_t overlap =
+      std::max<size_t>(rules->scanner().maxMatchLength(), 1) - 1;
+
+  // fixed chunk boundaries, so the hits do not depend on the thread count.
+  // A chunk owns the matches starting in it and scans on past its end, and
+  // past the end of its range, to find them whole. The ranges of both scan
+  // stages are disjoint, so no match is found twice and the hit cap below
+  // counts distinct hits only.
+  std::vector<ScanChunk> chunks;
+  for (const auto &[begin, end] : ranges) {
+    for (size_t chunk = begin; chunk < end; chunk += SCAN_CHUNK_SIZE) {
+      size_t chunkEnd = std::min(end, chunk + SCAN_CHUNK_SIZE);
+      chunks.push_back(
+          {chunk, chunkEnd, std::min(fileData.size(), chunkEnd + overlap)});
     }
+    metrics.bytesScanned += end - begin;
   }
 
-  if (stringMatches > 0) {
-    findings.push_back("Total SSH-related strings found: " +
-                       std::to_string(stringMatches));
+  std::vector<ChunkHits> results(chunks.size());
+  unsigned threads =
+      scanThreads != 0 ? scanThreads
+                       : std::max(1u, std::thread::hardware_concurrency());
+  threads = static_cast<unsigned>(std::min<size_t>(threads, chunks.size()));
+  std::atomic<size_t> nextChunk{0};
+  std::function<void()> work = [&]() {
+    for (size_t i; (i = nextChunk.fetch_add(1)) < chunks.size();)
+      scanChunk(chunks[i], results[i]);
+  };
+  if (threads > 1) {
+    // kept between files, threads are not created per scan
+    if (scanPool == nullptr || scanPool->size() < threads - 1)
+      scanPool = std::make_unique<WorkerPool>(threads - 1);
+    scanPool->run(threads - 1, work);
+  } else {
+    work();
+  }
+
+  for (const auto &result : results) {
+    metrics.patternsHit += static_cast<uint32_t>(result.matches);
+    for (size_t i = 0; i < result.strings.size(); i++) {
+      const StringHit &found = result.strings[i];
+      StringHit &hit = stringHits[i];
+      if (found.encodings == 0)
+        continue;
+      if (hit.encodings == 0 || found.offset < hit.offset)
+        hit.offset = found.offset;
+      hit.encodings |= found.encodings;
+    }
+    for (size_t i = 0; i < result.patterns.size(); i++) {
+      const PatternHit &found = result.patterns[i];
+      PatternHit &hit = patternHits[i];
+      if (!found.found)
+        continue;
+      if (!hit.found || found.offset < hit.offset)
+        hit.offset = found.offset;
+      hit.found = true;
+    }
+    for (size_t i = 0; i < result.placed.size(); i++)
+      placedHits[i] |= result.placed[i];
+  }
+
+  for (size_t i = 0; i < stringRules.size(); i++) {
+    const StringRule &rule = stringRules[i];
+    StringHit &hit = stringHits[i];
+    if (hit.encodings == 0 || hit.scored)
+      continue;
+
+    hit.scored = true;
+    unscoredStringWeight -= rule.weight;
+    confidence += rule.weight;
+
+    RuleId id = RuleId::SSHString;
+    if (rule.kind == StringRule::ConfigPath)
+      id = RuleId::ConfigPath;
+    else if (rule.kind == StringRule::ProtocolString)
+      id = RuleId::ProtocolString;
+    else
+      stringMatches++;
+
+    findings.push_back({.rule = id,
+                        .encoding = hit.encodings,
+                        .section = sectionOfOffset(hit.offset),
+                        .weight = static_cast<int32_t>(rule.weight),
+                        .offset = hit.offset,
+                        .subject = rule.text});
   }
 }
 
-void PESSHDetector::analyzeImports() {
-    // Find import table
-    const int IMPORT_TABLE_INDEX = 1;
-    if (ntHeaders.OptionalHeader.NumberOfRvaAndSizes <= IMPORT_TABLE_INDEX) {
-        return;
+bool PESSHDetector::verifyPatternHit(size_t index, size_t &offset) const {
+  const PatternRuleString &ref = rules->patternStrings()[index];
+  const RuleString &string = rules->patterns()[ref.rule].strings[ref.string];
+  if (!string.isHex())
+    return true;
+
+  // the scanner folds case, the verification is exact
+  if (offset < string.atomOffset)
+    return false;
+  offset -= string.atomOffset;
+  return string.matchesAt(fileData.data() + offset, fileData.size() - offset);
+}
+
+void PESSHDetector::evaluatePatternRules() {
+  const auto &patterns = rules->patterns();
+  if (patterns.empty())
+    return;
+
+  RuleHits hits;
+  size_t index = 0;
+  for (size_t r = 0; r < patterns.size(); r++) {
+    const PatternRule &rule = patterns[r];
+    size_t first = SIZE_MAX;
+    hits.found.assign(rule.strings.size(), false);
+    for (size_t i = 0; i < rule.strings.size(); i++, index++) {
+      hits.found[i] = patternHits[index].found;
+      if (patternHits[index].found)
+        first = std::min(first, patternHits[index].offset);
     }
+    auto placed = placedHits.begin() + rules->firstPlacement(r);
+    hits.placed.assign(placed, placed + rule.placements.size());
+    if (!evaluate(rule, hits))
+      continue;
+
+    findings.push_back({.rule = RuleId::PatternRule,
+                        .section = first == SIZE_MAX ? int16_t(-1)
+                                                     : sectionOfOffset(first),
+                        .weight = static_cast<int32_t>(rule.weight),
+                        .offset = first == SIZE_MAX ? 0 : first,
+                        .subject = rule.name});
+    confidence += rule.weight;
+  }
+}
+
+void PESSHDetector::analyzeImports() {
+  seenApis.fill(false);
+  seenLibraries.clear();
+  importedFunctions = 0;
+  imphashInput.clear();
+
+  if (const auto *view = std::get_if<PeView32>(&pe))
+    analyzeImportsOf(*view);
+  else if (const auto *view = std::get_if<PeView64>(&pe))
+    analyzeImportsOf(*view);
+
+  metrics.importsWalked = static_cast<uint32_t>(importedFunctions);
+  if (importedFunctions > 0) {
+    findings.push_back({.rule = RuleId::ImportCount,
+                        .value = static_cast<int64_t>(importedFunctions)});
+  }
+  computeImphash();
+}
+
+template <typename Traits>
+void PESSHDetector::analyzeImportsOf(const PeView<Traits> &view) {
+  const int IMPORT_TABLE_INDEX = 1;
+  const int DELAY_IMPORT_TABLE_INDEX = 13;
+
+  IMAGE_DATA_DIRECTORY importDir = view.dataDirectory(IMPORT_TABLE_INDEX);
+  uint32_t importOffset = importDir.VirtualAddress == 0
+                              ? 0
+                              : rvaToFileOffset(importDir.VirtualAddress);
+
+  size_t currentOffset = importOffset;
+  IMAGE_IMPORT_DESCRIPTOR importDesc;
+  while (importOffset != 0 && fileData.read(currentOffset, importDesc)) {
+    if (importDesc.Name == 0)
+      break; // End of imports
+
+    std::string_view dllName = matchImportedDll(importDesc.Name, false);
+    // Bound or old-style binaries only carry the IAT
+    walkImportNameTable(view,
+                        importDesc.OriginalFirstThunk != 0
+                            ? importDesc.OriginalFirstThunk
+                            : importDesc.FirstThunk,
+                        dllName, false);
+
+    currentOffset += sizeof(IMAGE_IMPORT_DESCRIPTOR);
+  }
+
+  IMAGE_DATA_DIRECTORY delayDir = view.dataDirectory(DELAY_IMPORT_TABLE_INDEX);
+  uint32_t delayOffset = delayDir.VirtualAddress == 0
+                             ? 0
+                             : rvaToFileOffset(delayDir.VirtualAddress);
+
+  currentOffset = delayOffset;
+  IMAGE_DELAY_LOAD_DESCRIPTOR delayDesc;
+  while (delayOffset != 0 && fileData.read(currentOffset, delayDesc)) {
+    if (delayDesc.DllNameRVA == 0)
+      break;
+
+    // Pre-VC7 descriptors hold virtual addresses instead of RVAs, and so do
+    // the name table entries they point to
+    uint64_t base = (delayDesc.Attributes & 1) ? 0 : view.imageBase();
+
+    std::string_view dllName = matchImportedDll(
+        static_cast<uint32_t>(delayDesc.DllNameRVA - base), true);
+    if (delayDesc.ImportNameTableRVA != 0)
+      walkImportNameTable(
+          view, static_cast<uint32_t>(delayDesc.ImportNameTableRVA - base),
+          dllName, true, base);
+
+    currentOffset += sizeof(IMAGE_DELAY_LOAD_DESCRIPTOR);
+  }
+}
+
+std::string_view PESSHDetector::matchImportedDll(uint32_t nameRva,
+                                                 bool delayLoaded) {
+  uint32_t nameOffset = rvaToFileOffset(nameRva);
+  if (nameOffset == 0)
+    return {};
+
+  std::string_view name = stringAt(nameOffset);
 
-    // Get import directory directly from OptionalHeader
-    IMAGE_DATA_DIRECTORY importDir = ntHeaders.OptionalHeader.DataDirectory[IMPORT_TABLE_INDEX];
-    
-    if (importDir.VirtualAddress == 0 || importDir.Size == 0) {
-        return;
+  // each library scores once, however many descriptors name it
+  const auto *library = rules->findLibrary(name);
+  if (library != nullptr && seenLibraries.insert(library->first).second) {
+    findings.push_back(
+        {.rule = delayLoaded ? RuleId::DelayLibrary : RuleId::Library,
+         .weight = static_cast<int32_t>(library->second),
+         .subject = library->first});
+    confidence += library->second;
+  }
+  return name;
+}
+
+template <typename Traits>
+void PESSHDetector::walkImportNameTable(const PeView<Traits> &view,
+                                        uint32_t thunkRva,
+                                        std::string_view dllName,
+                                        bool delayLoaded, uint64_t base) {
+  using Thunk = typename PeView<Traits>::Thunk;
+  // upper bound on thunks per DLL so a corrupt table cannot run away
+  const size_t MAX_THUNKS = 0x10000;
+
+  uint32_t thunkOffset = thunkRva == 0 ? 0 : rvaToFileOffset(thunkRva);
+  if (thunkOffset == 0)
+    return;
+
+  // the whole name, as the loader resolves it (".dll" is implied when there
+  // is no extension): ordinals of any other DLL mean other functions
+  bool winsock = false;
+  for (std::string_view name : {"ws2_32.dll", "wsock32.dll"})
+    winsock = winsock || apihash::equalsFolded(dllName, name) ||
+              apihash::equalsFolded(dllName, name.substr(0, name.size() - 4));
+
+  Thunk thunk;
+  for (size_t i = 0; i < MAX_THUNKS; i++) {
+    if (!view.thunk(thunkOffset + i * sizeof(Thunk), thunk) || thunk == 0)
+      break; // End of this DLL's imports
+
+    importedFunctions++;
+
+    if (PeView<Traits>::isOrdinal(thunk)) {
+      uint16_t ordinal = static_cast<uint16_t>(thunk & 0xFFFF);
+      std::string_view resolved =
+          winsock ? apihash::winsockOrdinalName(ordinal) : std::string_view();
+      matchImportedApi(resolved, dllName);
+      if (!delayLoaded)
+        appendImphashEntry(dllName, resolved, ordinal);
+      continue;
     }
 
-    // Convert RVA to file offset
-    uint32_t importOffset = rvaToFileOffset(importDir.VirtualAddress);
-    if (importOffset == 0)
-        return;
-
-    // Parse import descriptors
-    size_t currentOffset = importOffset;
-    while (currentOffset + sizeof(IMAGE_IMPORT_DESCRIPTOR) <= fileData.size()) {
-        IMAGE_IMPORT_DESCRIPTOR importDesc;
-        std::memcpy(&importDesc, fileData.data() + currentOffset,
-                    sizeof(IMAGE_IMPORT_DESCRIPTOR));
-
-        if (importDesc.Name == 0)
-            break; // End of imports
-
-        uint32_t nameOffset = rvaToFileOffset(importDesc.Name);
-        if (nameOffset > 0 && nameOffset < fileData.size()) {
-            // Safer string construction with bounds checking
-            const char* namePtr = (const char*)(fileData.data() + nameOffset);
-            size_t maxLen = fileData.size() - nameOffset;
-            size_t nameLen = strnlen(namePtr, maxLen);
-            
-            std::string dllName(namePtr, nameLen);
-            std::transform(dllName.begin(), dllName.end(), dllName.begin(), ::tolower);
-
-            auto it = sshLibrariesMap.find(dllName);
-            if (it != sshLibrariesMap.end()) {
-                findings.push_back("Found SSH-related import: " + dllName);
-                confidence += it->second;
-            }
-        }
+    // IMAGE_IMPORT_BY_NAME: 2 byte hint followed by the name
+    uint32_t hintNameOffset =
+        rvaToFileOffset(static_cast<uint32_t>((thunk - base) & 0x7FFFFFFF));
+    if (hintNameOffset == 0)
+      continue;
+    std::string_view apiName = stringAt(hintNameOffset + sizeof(uint16_t));
+    matchImportedApi(apiName, dllName);
+    if (!delayLoaded)
+      appendImphashEntry(dllName, apiName, 0);
+  }
+}
+
+void PESSHDetector::matchImportedApi(std::string_view apiName,
+                                     std::string_view dllName) {
+  if (apiName.empty())
+    return;
+
+  int index = apihash::lookup(apiName);
+  if (index < 0 || seenApis[index])
+    return;
+
+  seenApis[index] = true;
+  const WeightedApi &api = sshApiTable[index];
+  findings.push_back({.rule = RuleId::Api,
+                      .weight = static_cast<int32_t>(api.weight),
+                      .subject = api.name,
+                      .context = dllName});
+  confidence += api.weight;
+}
+
+void PESSHDetector::appendImphashEntry(std::string_view dllName,
+                                       std::string_view apiName,
+                                       uint16_t ordinal) {
+  size_t dot = dllName.rfind('.');
+  if (dot != std::string_view::npos) {
+    std::string_view ext = dllName.substr(dot + 1);
+    if (ext.size() == 3 && (strncasecmp(ext.data(), "dll", 3) == 0 ||
+                            strncasecmp(ext.data(), "ocx", 3) == 0 ||
+                            strncasecmp(ext.data(), "sys", 3) == 0))
+      dllName = dllName.substr(0, dot);
+  }
+
+  if (!imphashInput.empty())
+    imphashInput += ',';
+  for (char c : dllName)
+    imphashInput += static_cast<char>(::tolower(static_cast<unsigned char>(c)));
+  imphashInput += '.';
+  if (apiName.empty()) {
+    imphashInput += "ord";
+    imphashInput += std::to_string(ordinal);
+    return;
+  }
+  for (char c : apiName)
+    imphashInput += static_cast<char>(::tolower(static_cast<unsigned char>(c)));
+}
+
+void PESSHDetector::computeImphash() {
+  hasImphash = !imphashInput.empty();
+  if (!hasImphash)
+    return;
+
+  unsigned int length = 0;
+  hasImphash = EVP_Digest(imphashInput.data(), imphashInput.size(),
+                          imphash.data(), &length, EVP_md5(), nullptr) == 1 &&
+               length == imphash.size();
+}
+
+std::string PESSHDetector::imphashHex() const {
+  if (!hasImphash)
+    return "";
+  static const char digits[] = "0123456789abcdef";
+  std::string hex;
+  for (uint8_t byte : imphash) {
+    hex += digits[byte >> 4];
+    hex += digits[byte & 0xF];
+  }
+  return hex;
+}
 
-        currentOffset += sizeof(IMAGE_IMPORT_DESCRIPTOR);
+void PESSHDetector::setKnownClients(const SimilarityIndex *index) {
+  knownClients = index;
+}
+
+void PESSHDetector::analyzeSimilarity() {
+  // fuzzy match thresholds, see FuzzyDigest::distance
+  const int CLOSE_DISTANCE = 30;
+  const int MAX_DISTANCE = 70;
+
+  if (knownClients == nullptr || !knownClients->isOpen())
+    return;
+
+  if (!hasFuzzyDigest) {
+    fuzzyDigest = fuzzyHash(fileData.data(), fileData.size());
+    hasFuzzyDigest = true;
+  }
+  auto match = knownClients->lookup(fuzzyDigest,
+                                    hasImphash ? &imphash : nullptr,
+                                    MAX_DISTANCE);
+  if (!match)
+    return;
+
+  int weight = match->imphashMatch ? 25 : 0;
+  if (match->distance >= 0 && match->distance <= CLOSE_DISTANCE)
+    weight += 50;
+  else if (match->distance >= 0 && match->distance <= MAX_DISTANCE)
+    weight += 30;
+
+  findings.push_back(
+      {.rule = RuleId::KnownClient,
+       .flags = match->imphashMatch ? Finding::FLAG_IMPHASH_MATCH : uint8_t(0),
+       .weight = weight,
+       .value = match->distance,
+       .subject = match->label});
+  confidence += weight;
+}
+
+void PESSHDetector::setVerdictCache(VerdictCache *cache) {
+  verdictCache = cache;
+}
+
+void PESSHDetector::hashContents() {
+  // small enough to stay in L2 between the two hashers
+  const size_t BLOCK_SIZE = 64 * 1024;
+
+  bool withFuzzy = knownClients != nullptr && knownClients->isOpen();
+  ContentHasher content;
+  FuzzyHasher fuzzy;
+  for (size_t offset = 0; offset < fileData.size(); offset += BLOCK_SIZE) {
+    size_t size = std::min(BLOCK_SIZE, fileData.size() - offset);
+    content.update(fileData.data() + offset, size);
+    if (withFuzzy)
+      fuzzy.update(fileData.data() + offset, size);
+  }
+
+  contentDigest = content.finish();
+  hasContentDigest = true;
+  if (withFuzzy) {
+    fuzzyDigest = fuzzy.finish();
+    hasFuzzyDigest = true;
+  }
+}
+
+bool PESSHDetector::checkVerdictCache() {
+  // the first pass over the mapping, it also pages the file in for analysis
+  hashContents();
+
+  switch (verdictCache->listed(contentDigest)) {
+  case ListVerdict::Allowed:
+    findings.push_back({.rule = RuleId::Allowlisted});
+    confidence = 0;
+    return true;
+  case ListVerdict::Denied:
+    findings.push_back({.rule = RuleId::Denylisted, .weight = 100});
+    confidence = 100;
+    return true;
+  case ListVerdict::None:
+    break;
+  }
+
+  auto cached = verdictCache->find(contentDigest, rulesFingerprint());
+  if (!cached)
+    return false;
+
+  findings.push_back(
+      {.rule = RuleId::CachedVerdict, .weight = cached->confidence});
+  confidence = cached->confidence;
+  packed = cached->flags & CachedVerdict::FLAG_PACKED;
+  hasImphash = cached->flags & CachedVerdict::FLAG_HAS_IMPHASH;
+  imphash = cached->imphash;
+  return true;
+}
+
+uint64_t PESSHDetector::rulesFingerprint() const {
+  uint64_t hash = rules->rulesFingerprint();
+  auto mix = [&](std::string_view bytes) {
+    for (char c : bytes) {
+      hash ^= static_cast<uint8_t>(c);
+      hash *= 1099511628211ull;
     }
+  };
+
+  if (knownClients != nullptr && knownClients->isOpen())
+    mix("index:" + std::to_string(knownClients->identity()));
+  // an early-exit score is only a lower bound, full runs keep their own
+  if (fullAnalysis)
+    mix("full");
+  return hash;
+}
+
+KnownSample PESSHDetector::fingerprint(const std::string &label) {
+  KnownSample sample;
+  sample.label = label;
+  if (!isPEFormat())
+    return sample;
+
+  readSectionHeaders();
+  analyzeImports();
+  sample.imphash = imphash;
+  sample.hasImphash = hasImphash;
+  sample.fuzzy = fuzzyHash(fileData.data(), fileData.size());
+  return sample;
+}
+
+std::string_view PESSHDetector::stringAt(size_t offset) const {
+  return fileData.cstring(offset);
+}
+
+bool PESSHDetector::isPE32Plus() const {
+  return std::holds_alternative<PeView64>(pe);
 }
+
 /**
  * Convert a Relative Virtual Address (RVA) to a file offset.
  * @param rva Relative Virtual Address to convert.
+ * @param length bytes from rva that must be present in the file.
  * @return File offset of the given RVA, or 0 if the RVA is not valid.
  */
-uint32_t PESSHDetector::rvaToFileOffset(uint32_t rva) {
-  for (const auto &section : sectionHeaders) {
-    if (rva >= section.VirtualAddress &&
-        rva < section.VirtualAddress + section.VirtualSize) {
-      return rva - section.VirtualAddress + section.PointerToRawData;
-    }
-  }
-  return 0;
+uint32_t PESSHDetector::rvaToFileOffset(uint32_t rva, uint32_t length) {
+  return sections.translate(rva, length);
 }
 
 void PESSHDetector::additionalHeuristics() {
-  // Check for common SSH client characteristics
-  std::string fileContent(fileData.begin(), fileData.end());
-  std::transform(fileContent.begin(), fileContent.end(), fileContent.begin(),
-                 ::tolower);
-
-  // Look for SSH config paths
-  std::vector<std::string> configPaths = {
-      "/.ssh/config",    "\\.ssh\\config", "ssh_config", "known_hosts",
-      "authorized_keys", "id_rsa",         "id_dsa"};
-
-  for (const auto &path : configPaths) {
-    if (fileContent.find(path) != std::string::npos) {
-      findings.push_back("Found SSH config reference: " + path);
-      confidence += 15;
-    }
+  // Check file size (SSH clients are typically substantial)
+  if (fileData.size() > 100000) { // > 100KB
+    findings.push_back({.rule = RuleId::FileSize,
+                        .weight = 5,
+                        .value = static_cast<int64_t>(fileData.size())});
+    confidence += 5;
   }
+}
 
-  // Look for SSH protocol strings
-  std::vector<std::string> protocolStrings = {
-      "ssh-2.0", "ssh-1.", "protocol version", "diffie-hellman",
-      "aes",     "3des",   "blowfish"};
+void PESSHDetector::setFullAnalysis(bool full) { fullAnalysis = full; }
 
-  for (const auto &proto : protocolStrings) {
-    if (fileContent.find(proto) != std::string::npos) {
-      findings.push_back("Found SSH protocol reference: " + proto);
-      confidence += 10;
-    }
-  }
+void PESSHDetector::setStageStats(StageStats *stats) { stageStats = stats; }
 
-  // Check file size (SSH clients are typically substantial)
-  if (fileData.size() > 100000) { // > 100KB
-    confidence += 5;
+void PESSHDetector::setScanThreads(unsigned threads) { scanThreads = threads; }
+
+void PESSHDetector::setStringIndexing(bool enabled) { indexStrings = enabled; }
+
+const StringIndex &PESSHDetector::getStringIndex() const { return stringIndex; }
+
+void PESSHDetector::buildStringIndex() {
+  measureEntropy();
+  std::vector<FileRange> ranges = subtractRanges(
+      {FileRange(0, fileData.size())}, compressedSections);
+  for (const auto &[begin, end] : ranges)
+    extractStrings(fileData, begin, end, MIN_STRING_LENGTH,
+                   [&](const ExtractedString &string) {
+                     stringIndex.add(string);
+                   });
+  stringIndex.sortByOffset();
+}
+
+void PESSHDetector::runStage(AnalysisStage stage) {
+  switch (stage) {
+  case AnalysisStage::Headers:
+    readSectionHeaders();
+    detectPacker();
+    analyzeVersionInfo();
+    additionalHeuristics();
+    break;
+  case AnalysisStage::Imports:
+    analyzeImports();
+    break;
+  case AnalysisStage::DataSections:
+    measureEntropy();
+    analyzeStrings(dataSections);
+    break;
+  case AnalysisStage::FullScan:
+    measureEntropy();
+    analyzeStrings(rangesOutsideDataSections());
+    evaluatePatternRules();
+    break;
+  case AnalysisStage::Similarity:
+    analyzeSimilarity();
+    break;
+  default:
+    break;
   }
 }
 
+size_t PESSHDetector::maxScoreAfter(AnalysisStage stage) const {
+  // see analyzeSimilarity
+  const size_t MAX_SIMILARITY_SCORE = 25 + 50;
+
+  size_t score = 0;
+  if (stage < AnalysisStage::Imports)
+    score += rules->importScoreLimit();
+  if (stage < AnalysisStage::FullScan)
+    score += unscoredStringWeight + rules->patternWeight();
+  if (stage < AnalysisStage::Similarity && knownClients != nullptr &&
+      knownClients->isOpen())
+    score += MAX_SIMILARITY_SCORE;
+  return score;
+}
+
 bool PESSHDetector::isSSHClient() {
+  const int THRESHOLD = SSH_THRESHOLD;
+
+  if (verdictCache != nullptr && checkVerdictCache()) {
+    // headers only, so the report names the same PE format as a fresh one
+    pe = parsePeView(fileData);
+    // corpus queries need the strings of every file, cached or not; the
+    // sections are only read to leave compressed ones out
+    if (indexStrings) {
+      readSectionHeaders();
+      buildStringIndex();
+    }
+    return confidence >= THRESHOLD;
+  }
+
   if (!isPEFormat()) {
     return false;
   }
 
-  readSectionHeaders();
-  analyzeStrings();
-  analyzeImports();
-  additionalHeuristics();
+  bool settled = false;
+  for (size_t i = 0; i < STAGE_COUNT; i++) {
+    AnalysisStage stage = static_cast<AnalysisStage>(i);
+    int before = confidence;
+    auto start = std::chrono::steady_clock::now();
+    runStage(stage);
+    uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    metrics.stageNanoseconds[i] = elapsed;
+    lastStage = stage;
 
-  return confidence >= 50; // Threshold for SSH client detection
+    // scores only grow, so the verdict is fixed once it is reached or out
+    // of reach
+    bool settledHere =
+        !settled &&
+        (confidence >= THRESHOLD ||
+         confidence + static_cast<int>(maxScoreAfter(stage)) < THRESHOLD);
+    settled = settled || settledHere;
+    if (stageStats != nullptr)
+      stageStats->record(stage, confidence > before, settledHere, elapsed);
+
+    if (settled && !fullAnalysis) {
+      stoppedEarly = maxScoreAfter(stage) > 0;
+      break;
+    }
+  }
+
+  if (stringMatches > 0) {
+    findings.push_back({.rule = RuleId::StringCount, .value = stringMatches});
+  }
+
+  if (indexStrings)
+    buildStringIndex();
+
+  if (verdictCache != nullptr && hasContentDigest)
+    verdictCache->store(
+        contentDigest,
+        {.confidence = confidence,
+         .rulesFingerprint = rulesFingerprint(),
+         .flags = (packed ? CachedVerdict::FLAG_PACKED : 0u) |
+                  (hasImphash ? CachedVerdict::FLAG_HAS_IMPHASH : 0u),
+         .imphash = imphash});
+
+  return confidence >= THRESHOLD;
+}
+
+const std::vector<Finding> &PESSHDetector::getFindings() const {
+  return findings;
 }
 
-void PESSHDetector::printAnalysis() {
-  std::cout << "\n=== PE SSH Client Analysis ===" << std::endl;
-  std::cout << "File size: " << fileData.size() << " bytes" << std::endl;
-  std::cout << "Confidence score: " << confidence << "/100" << std::endl;
+const AnalysisMetrics &PESSHDetector::getMetrics() const { return metrics; }
+
+void PESSHDetector::printAnalysis(std::ostream &out) const {
+  out << "\n=== PE SSH Client Analysis ===\n";
+  out << "File size: " << fileData.size() << " bytes\n";
+  out << "Confidence score: " << confidence << "/100\n";
+  if (stoppedEarly)
+    out << "Stopped after the " << stageName(lastStage)
+        << " stage, the verdict could no longer change (--full for every "
+           "finding)\n";
+  if (hasContentDigest)
+    out << "SHA-256: " << digestToHex(contentDigest) << '\n';
+  if (hasImphash)
+    out << "Imphash: " << imphashHex() << '\n';
+  if (fuzzyDigest.valid)
+    out << "Fuzzy hash: " << fuzzyDigest.toHex() << '\n';
 
-  std::cout << "\nFindings:" << std::endl;
+  out << "\nFindings:\n";
   for (const auto &finding : findings) {
-    std::cout << "  • " << finding << std::endl;
+    out << "  • ";
+    describe(out, finding);
+    out << '\n';
   }
 
-  std::cout << "\nConclusion: ";
+  if (indexStrings) {
+    out << "\nStrings (" << stringIndex.size() << " distinct):\n";
+    for (const auto &entry : stringIndex.getEntries()) {
+      char position[32];
+      std::snprintf(position, sizeof(position), "  0x%08" PRIx64 "  ",
+                    entry.offset);
+      out << position << stringIndex.text(entry);
+      if (entry.encodings != PatternScanner::ASCII)
+        out << " (" << encodingName(entry.encodings) << ")";
+      if (entry.count > 1)
+        out << " x" << entry.count;
+      out << '\n';
+    }
+  }
+
+  out << "\nConclusion: ";
   if (confidence >= 80) {
-    std::cout << "Very likely an SSH client" << std::endl;
+    out << "Very likely an SSH client\n";
   } else if (confidence >= 50) {
-    std::cout << "Possibly an SSH client" << std::endl;
+    out << "Possibly an SSH client\n";
   } else if (confidence >= 20) {
-    std::cout << "Unlikely to be an SSH client" << std::endl;
+    out << "Unlikely to be an SSH client\n";
   } else {
-    std::cout << "Not an SSH client" << std::endl;
+    out << "Not an SSH client\n";
+  }
+  out.flush();
+}
+
+void PESSHDetector::printJson(std::ostream &out, std::string_view path) const {
+  out << "{\"path\":";
+  writeJsonString(out, path);
+  out << ",\"size\":" << fileData.size()
+      << ",\"ssh_client\":" << (confidence >= SSH_THRESHOLD ? "true" : "false")
+      << ",\"confidence\":" << confidence
+      << ",\"pe32_plus\":" << (isPE32Plus() ? "true" : "false")
+      << ",\"packed\":" << (packed ? "true" : "false")
+      << ",\"stopped_early\":" << (stoppedEarly ? "true" : "false")
+      << ",\"last_stage\":\"" << stageName(lastStage) << '"';
+  if (hasContentDigest)
+    out << ",\"sha256\":\"" << digestToHex(contentDigest) << '"';
+  if (hasImphash)
+    out << ",\"imphash\":\"" << imphashHex() << '"';
+  if (fuzzyDigest.valid)
+    out << ",\"fuzzy_hash\":\"" << fuzzyDigest.toHex() << '"';
+
+  out << ",\"metrics\":{\"stage_ns\":{";
+  for (size_t i = 0; i < STAGE_COUNT; i++)
+    out << (i ? "," : "") << '"' << stageName(static_cast<AnalysisStage>(i))
+        << "\":" << metrics.stageNanoseconds[i];
+  out << "},\"bytes_scanned\":" << metrics.bytesScanned
+      << ",\"patterns_hit\":" << metrics.patternsHit
+      << ",\"sections_parsed\":" << metrics.sectionsParsed
+      << ",\"imports_walked\":" << metrics.importsWalked << '}';
+
+  out << ",\"findings\":[";
+  for (size_t i = 0; i < findings.size(); i++) {
+    const Finding &finding = findings[i];
+    out << (i ? "," : "") << "{\"rule\":\"" << ruleName(finding.rule)
+        << "\",\"id\":" << static_cast<int>(finding.rule)
+        << ",\"weight\":" << finding.weight;
+    if (!finding.subject.empty()) {
+      out << ",\"subject\":";
+      writeJsonString(out, finding.subject);
+    }
+    if (!finding.context.empty()) {
+      out << ",\"context\":";
+      writeJsonString(out, finding.context);
+    }
+    if (finding.value != 0)
+      out << ",\"value\":" << finding.value;
+    if (finding.encoding != 0)
+      out << ",\"encoding\":\"" << encodingName(finding.encoding) << '"';
+    if (finding.encoding != 0 || finding.section >= 0)
+      out << ",\"offset\":" << finding.offset;
+    if (finding.section >= 0)
+      out << ",\"section\":" << finding.section;
+    if (finding.flags & Finding::FLAG_IMPHASH_MATCH)
+      out << ",\"imphash_match\":true";
+    out << '}';
+  }
+  out << ']';
+
+  if (indexStrings) {
+    out << ",\"strings\":[";
+    const auto &entries = stringIndex.getEntries();
+    for (size_t i = 0; i < entries.size(); i++) {
+      out << (i ? "," : "") << "{\"text\":";
+      writeJsonString(out, stringIndex.text(entries[i]));
+      out << ",\"encoding\":\"" << encodingName(entries[i].encodings)
+          << "\",\"offset\":" << entries[i].offset
+          << ",\"count\":" << entries[i].count << '}';
+    }
+    out << ']';
+  }
+  out << "}\n";
+}
+
+void PESSHDetector::writeRecord(std::ostream &out,
+                                std::string_view path) const {
+  auto clip = [](std::string_view text) {
+    return text.substr(0, UINT16_MAX);
+  };
+
+  ReportRecord record{};
+  std::copy_n(ReportRecord::MAGIC, sizeof(record.magic), record.magic);
+  record.version = ReportRecord::VERSION;
+  record.sshClient = confidence >= SSH_THRESHOLD;
+  record.flags = (isPE32Plus() ? ReportRecord::FLAG_PE32_PLUS : 0) |
+                 (stoppedEarly ? ReportRecord::FLAG_STOPPED_EARLY : 0) |
+                 (mappedImage ? ReportRecord::FLAG_IMAGE_LAYOUT : 0) |
+                 (hasContentDigest ? ReportRecord::FLAG_HAS_SHA256 : 0) |
+                 (hasImphash ? ReportRecord::FLAG_HAS_IMPHASH : 0) |
+                 (packed ? ReportRecord::FLAG_PACKED : 0);
+  record.lastStage = static_cast<uint8_t>(lastStage);
+  record.confidence = confidence;
+  record.fileSize = fileData.size();
+  if (hasContentDigest)
+    std::copy(contentDigest.begin(), contentDigest.end(), record.sha256);
+  if (hasImphash)
+    std::copy(imphash.begin(), imphash.end(), record.imphash);
+  std::memcpy(record.stageNanoseconds, metrics.stageNanoseconds.data(),
+              sizeof(record.stageNanoseconds));
+  record.bytesScanned = metrics.bytesScanned;
+  record.patternsHit = metrics.patternsHit;
+  record.sectionsParsed = metrics.sectionsParsed;
+  record.importsWalked = metrics.importsWalked;
+  record.findingCount =
+      static_cast<uint16_t>(std::min<size_t>(findings.size(), UINT16_MAX));
+  record.pathLength = static_cast<uint16_t>(clip(path).size());
+
+  size_t size = sizeof(record) + record.pathLength;
+  for (size_t i = 0; i < record.findingCount; i++)
+    size += sizeof(FindingRecord) + clip(findings[i].subject).size() +
+            clip(findings[i].context).size();
+  record.size = static_cast<uint32_t>(size);
+
+  out.write(reinterpret_cast<const char *>(&record), sizeof(record));
+  out.write(path.data(), record.pathLength);
+  for (size_t i = 0; i < record.findingCount; i++) {
+    const Finding &finding = findings[i];
+    std::string_view subject = clip(finding.subject);
+    std::string_view context = clip(finding.context);
+
+    FindingRecord entry{};
+    entry.rule = static_cast<uint16_t>(finding.rule);
+    entry.encoding = finding.encoding;
+    entry.flags = finding.flags;
+    entry.section = finding.section;
+    entry.subjectLength = static_cast<uint16_t>(subject.size());
+    entry.contextLength = static_cast<uint16_t>(context.size());
+    entry.weight = finding.weight;
+    entry.value = finding.value;
+    entry.offset = finding.offset;
+    out.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+    out.write(subject.data(), subject.size());
+    out.write(context.data(), context.size());
   }
 }
@@ -1,8 +1,25 @@
 #ifndef DETECT_PE_SSH__
 #define DETECT_PE_SSH__
 
+#include "analysis_stages.hpp"
+#include "api_hash.hpp"
+#include "findings.hpp"
+#include "packer_detection.hpp"
+#include "mapped_file.hpp"
 #include "pe_headers.hpp"
+#include "pattern_scanner.hpp"
+#include "pe_view.hpp"
+#include "rule_set.hpp"
+#include "section_index.hpp"
+#include "similarity_index.hpp"
+#include "string_index.hpp"
+#include "verdict_cache.hpp"
+#include "version_info.hpp"
+#include "worker_pool.hpp"
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cinttypes>
 #include <cstring>
 #include <filesystem>
@@ -10,72 +27,392 @@
 #include <functional>
 #include <iostream>
 #include <map>
+#include <openssl/evp.h>
 #include <set>
 #include <string>
+#include <string_view>
+#include <strings.h>
+#include <thread>
+#include <type_traits>
 #include <utility>
+#include <variant>
 #include <vector>
 
+// Encodings a string rule was seen in, and where it was first seen
+struct StringHit {
+  uint8_t encodings{0};
+  size_t offset{0};
+  bool scored{false};
+};
+
+// Whether a pattern rule string was seen, and where first
+struct PatternHit {
+  bool found{false};
+  size_t offset{0};
+};
+
+// [begin, end) file offsets
+using FileRange = std::pair<size_t, size_t>;
+
+// Sorts ranges and merges the overlapping ones
+void mergeRanges(std::vector<FileRange> &ranges);
+
+/**
+ * @param ranges sorted, not overlapping
+ * @param removed sorted, not overlapping
+ * @return the parts of ranges outside removed
+ */
+std::vector<FileRange> subtractRanges(const std::vector<FileRange> &ranges,
+                                      const std::vector<FileRange> &removed);
+
+// A piece of a scanned range: matches starting in [begin, end) are its own,
+// the scan runs on to scanEnd so that they are found whole
+struct ScanChunk {
+  size_t begin;
+  size_t end;
+  size_t scanEnd;
+};
+
+struct ChunkHits;
+
 class PESSHDetector {
 private:
-  std::vector<uint8_t> fileData;
-  std::string dllMapFilePath{"config/dllMap.conf"};
-  std::string sshMapFilePath{"config/sshMap.conf"};
-  DOS_HEADER dosHeader;
-  NT_HEADERS ntHeaders;
-  std::vector<SECTION_HEADER> sectionHeaders;
-  int confidence;
-  std::vector<std::string> findings;
-  std::map<std::string, size_t> sshStringsMap;
-  std::map<std::string, size_t> sshLibrariesMap;
+  MappedFile mappedFile;
+  ByteView fileData;
+  AnyPeView pe;
+  SectionIndex sections;
+  std::shared_ptr<const RuleSet> rules;
+  RuleStore *ruleStore{nullptr};
+  uint64_t rulesVersion{0};
+  int confidence{0};
+  std::vector<Finding> findings;
+  AnalysisMetrics metrics;
+  std::array<bool, sshApiTable.size()> seenApis{};
+  std::set<std::string_view> seenLibraries;
+  size_t importedFunctions{0};
+  std::string imphashInput;
+  Imphash imphash{};
+  bool hasImphash{false};
+  FuzzyDigest fuzzyDigest;
+  bool hasFuzzyDigest{false}; // computed, fuzzyDigest may still be invalid
+  const SimilarityIndex *knownClients{nullptr};
+  VerdictCache *verdictCache{nullptr};
+  ContentDigest contentDigest{};
+  bool hasContentDigest{false};
+  bool mappedImage{false};
+  std::vector<StringHit> stringHits;
+  size_t unscoredStringWeight{0};
+  int stringMatches{0};
+  std::vector<FileRange> sectionRanges; // by section table index
+  std::vector<std::string> sectionNames;
+  std::vector<NamedRange> namedSections; // for pattern rule placements
+  std::vector<uint32_t> sectionFlags;     // Characteristics
+  std::vector<double> sectionEntropies;   // bits per byte, see measureEntropy
+  int16_t entrySection{-1};
+  bool packed{false};
+  // merged, left out of every string scan
+  std::vector<FileRange> compressedSections;
+  // by pattern rule string, see RuleSet::patternStrings()
+  std::vector<PatternHit> patternHits;
+  // by placement, see RuleSet::firstPlacement(): whether a hit satisfied it
+  std::vector<uint8_t> placedHits;
+  std::vector<FileRange> dataSections;
+  bool fullAnalysis{false};
+  unsigned scanThreads{0};
+  std::unique_ptr<WorkerPool> scanPool; // created by the first parallel scan
+  bool indexStrings{false};
+  StringIndex stringIndex;
+  StageStats *stageStats{nullptr};
+  AnalysisStage lastStage{AnalysisStage::Headers};
+  bool stoppedEarly{false};
 
 public:
-
-  /**
-   * Loads a map from a file and puts it into map.
-   * If the file does not exist, it sets the default map using the setDeaultMap
-   * function If there is an error while reading the file, it sets the default
-   * map and writes an error message to cerr.
-   *
-   * @param filename the name of the file to read from
-   * @param map the map to put the data into
-   * @param setDefaultMap a function to call if the file does not exist or there
-   * is an error while reading the file
-   */
-  void loadMapFromConfig(const std::string &filename,
-                         std::map<std::string, size_t> &map,
-                         std::function<void()> setDefaultMap);
-  std::string trimWhiteSpace(const std::string &str);
-  bool fileExists(const std::string &path);
-  void setDefaultDLLMap();
-  void setDefaultSSHMap();
+  static constexpr int SSH_THRESHOLD = 50;
+  // a version resource naming an SSH client; with the PE format alone it
+  // reaches the threshold
+  static constexpr int VERSION_INFO_WEIGHT = 40;
+  // shortest run of printable characters indexed, as strings(1)
+  static constexpr size_t MIN_STRING_LENGTH = 4;
+  // ranges are scanned in chunks of this size, in parallel if there are more
+  static constexpr size_t SCAN_CHUNK_SIZE = 4 << 20;
 
   PESSHDetector();
   PESSHDetector(std::string dllMapConfigPath, std::string sshMapConfigPath);
+
+  /**
+   * Uses the rules published by store, which may be shared with other
+   * detectors and must outlive this one. A new snapshot is picked up when
+   * the next file is loaded, never in the middle of an analysis.
+   */
+  explicit PESSHDetector(RuleStore &store);
+
+  // The rules the current analysis runs with
+  const RuleSet &getRules() const;
+
+  /**
+   * Runs the analysis stages cheapest first and stops as soon as the
+   * verdict cannot change: once the score reaches the threshold, or once
+   * even the most the remaining stages could add would not reach it.
+   * In full analysis mode every stage runs, for a complete list of findings.
+   *
+   * @return true if the file is likely an SSH client
+   */
   bool isSSHClient();
+  void setFullAnalysis(bool full);
+
+  // Records per-stage counters into stats, which must outlive the detector
+  void setStageStats(StageStats *stats);
+
+  /**
+   * Threads that scan the chunks of a large file, 0 (the default) for one
+   * per hardware thread. Use 1 when many detectors already run in parallel.
+   */
+  void setScanThreads(unsigned threads);
+
+  /**
+   * Extracts the printable strings of every analysed PE into an index,
+   * after the verdict. Off by default: the verdict does not need it.
+   */
+  void setStringIndexing(bool enabled);
 
+  // The strings of the last file, empty unless string indexing is on
+  const StringIndex &getStringIndex() const;
+
+  /**
+   * One pass over the file, compressed sections left out, extracting every
+   * ASCII and UTF-16LE string of at least MIN_STRING_LENGTH characters.
+   */
+  void buildStringIndex();
+
+  void runStage(AnalysisStage stage);
+
+  // Most points the stages after stage could still add
+  size_t maxScoreAfter(AnalysisStage stage) const;
+
+  /**
+   * Walks the import and delay-load import directories. Every imported DLL
+   * is matched against the library rules and every imported function, by name
+   * or by Winsock ordinal, against the sshApiTable perfect hash.
+   */
   void analyzeImports();
-  void loadDLLMapFromConfig();
-  void loadSSHMapFromConfig();
 
   /**
-   * Reads a PE file and stores its contents in the PESSHDetector class.
+   * Matches a DLL name from an import descriptor against the library rules.
+   *
+   * @param nameRva RVA of the NUL terminated DLL name
+   * @param delayLoaded whether the DLL came from the delay-load directory
+   * @return the DLL name as stored in the file, empty if unreadable
+   */
+  std::string_view matchImportedDll(uint32_t nameRva, bool delayLoaded);
+
+  // analyzeImports for one concrete layout, PE32 or PE32+
+  template <typename Traits> void analyzeImportsOf(const PeView<Traits> &view);
+
+  /**
+   * Walks an import name table (OriginalFirstThunk) until the terminating
+   * zero thunk. Thunks are 32-bit for PE32 and 64-bit for PE32+.
+   *
+   * @param view the PE layout the thunks belong to
+   * @param thunkRva RVA of the first thunk
+   * @param dllName name of the DLL the thunks belong to
+   * @param delayLoaded delay-load imports are left out of the imphash
+   * @param base subtracted from the name entries, the image base for
+   * old-style delay-load tables that hold virtual addresses
+   */
+  template <typename Traits>
+  void walkImportNameTable(const PeView<Traits> &view, uint32_t thunkRva,
+                           std::string_view dllName, bool delayLoaded,
+                           uint64_t base = 0);
+
+  /**
+   * Appends "dll.function" to the imphash input, in the format used by
+   * pefile: lower case, .dll/.ocx/.sys stripped, unknown ordinals as ordN.
+   */
+  void appendImphashEntry(std::string_view dllName, std::string_view apiName,
+                          uint16_t ordinal);
+  // MD5 of the imphash input collected by analyzeImports
+  void computeImphash();
+  std::string imphashHex() const;
+
+  /**
+   * Reads the file once, feeding the content hash and, when a known client
+   * index is set, the fuzzy digest, block by block while it is in cache.
+   */
+  void hashContents();
+
+  /**
+   * Computes the fuzzy digest of the file, unless hashContents() already
+   * did, and looks it up, together with
+   * the imphash, in the known client index set by setKnownClients().
+   * A close match is strong evidence and scores accordingly.
+   */
+  void analyzeSimilarity();
+  void setKnownClients(const SimilarityIndex *index);
+
+  /**
+   * Uses a verdict cache for isSSHClient(). The cache may be shared with
+   * other detectors and must outlive this one.
+   */
+  void setVerdictCache(VerdictCache *cache);
+
+  /**
+   * Hashes the file and answers from the allow/deny lists or the verdict
+   * cache.
+   * @return true if the verdict was found and no analysis is needed
+   */
+  bool checkVerdictCache();
+
+  // Identifies the rules and the analysis mode in effect, so cached
+  // verdicts made with other rules, or early-exit scores under --full, are
+  // not reused
+  uint64_t rulesFingerprint() const;
+
+  /**
+   * Hashes a loaded file for inclusion in a SimilarityIndex.
+   * @param label name the sample is reported under when matched
+   * @return the sample, without hashes if the file is not a PE
+   */
+  KnownSample fingerprint(const std::string &label);
+
+  /**
+   * Scores one imported function if it is a weighted API. Each API is
+   * counted once, however many DLLs or directories import it.
+   */
+  void matchImportedApi(std::string_view apiName, std::string_view dllName);
+
+  // NUL terminated string at a file offset, bounded by the end of the file
+  std::string_view stringAt(size_t offset) const;
+  bool isPE32Plus() const;
+
+  // Takes the store's current snapshot if it changed since the last file
+  void refreshRules();
+
+  /**
+   * Maps a PE file read-only into the PESSHDetector class.
    *
    * @param filename the path to the PE file to read
    * @return true if the file was read successfully, false otherwise
    */
   bool loadPEFile(const std::string &filename);
+
+  // loadPEFile for an open file descriptor, which stays owned by the caller
+  bool loadPEFile(int fd);
+
+  /**
+   * Analyses a PE that lives inside a larger buffer, such as one found by
+   * the carver. The bytes are not copied and must outlive the analysis.
+   *
+   * @param bytes the PE image, starting at its DOS header
+   * @param imageLayout true if the image is laid out as mapped by the loader
+   * (memory dumps), so RVAs are offsets
+   */
+  bool loadPEBuffer(ByteView bytes, bool imageLayout = false);
+  int getConfidence() const;
+  // The stage the last analysis ended with
+  AnalysisStage getLastStage() const;
+
+  /**
+   * Validates the DOS and NT headers in place and selects the PE32 or PE32+
+   * view of the file. Nothing is copied out of the mapping.
+   */
   bool isPEFormat();
+
+  /**
+   * Builds the RVA interval index from the section headers inside the file,
+   * and collects the file ranges of the non-executable initialized data
+   * sections, where strings usually live.
+   */
   void readSectionHeaders();
-  void analyzeStrings();
+
+  /**
+   * Runs the string scanner over file ranges and scores every rule seen for
+   * the first time. Each rule scores once, whichever range it is found in.
+   * Every hit of a pattern rule string is checked against the offset and
+   * section constraints on it there, so no hit needs to be kept.
+   * Ranges are split into SCAN_CHUNK_SIZE chunks, overlapping by the longest
+   * match, which are scanned on up to setScanThreads() threads and merged
+   * in file order, so the result is the same for any thread count.
+   */
+  void analyzeStrings(const std::vector<FileRange> &ranges);
+
+  // Scans one chunk, only reading shared state
+  void scanChunk(const ScanChunk &chunk, ChunkHits &out) const;
+
+  // Verifies a hit of pattern rule string index and checks it against the
+  // placements of its rule that constrain that string
+  void recordPatternHit(size_t index, size_t offset, ChunkHits &out) const;
+
+  /**
+   * Checks a scanner match of a pattern rule string. Hex strings are found
+   * by their atom and only count if the whole string matches around it.
+   *
+   * @param index the string, in rules->patternStrings()
+   * @param offset file offset of the scanner match, moved to the start of
+   * the whole string
+   */
+  bool verifyPatternHit(size_t index, size_t &offset) const;
+
+  /**
+   * Flags packed files from the section table: section names of known
+   * packers, or an entry point in a writable and executable section.
+   * Cheap enough for the headers stage.
+   */
+  void detectPacker();
+
+  /**
+   * Computes the entropy of every section, once per file, before the first
+   * string scan. Compressed sections are reported, left out of the scans,
+   * and flag the file as packed if they hold the entry point. Of a sampled
+   * section, only the blocks that are compressed on their own are left out.
+   */
+  void measureEntropy();
+
+  /**
+   * Follows the resource directory to the version resource, if any, and
+   * scores the first product name, file name or description naming a known
+   * SSH client. The UTF-16LE values are compared where they are, nothing is
+   * copied. Cheap enough for the headers stage.
+   */
+  void analyzeVersionInfo();
+
+  // Whether the last file was recognised as packed
+  bool isPacked() const;
+
+  // Evaluates the pattern rule conditions once the whole file was scanned
+  void evaluatePatternRules();
+
+  // The ranges not covered by the data sections or compressed sections
+  std::vector<FileRange> rangesOutsideDataSections() const;
 
   /**
    * Convert a Relative Virtual Address (RVA) to a file offset.
+   * Binary search over the section index, with the last hit cached.
    * @param rva Relative Virtual Address to convert.
+   * @param length bytes from rva that must be present in the file.
    * @return File offset of the given RVA, or 0 if the RVA is not valid.
    */
-  uint32_t rvaToFileOffset(uint32_t rva);
+  uint32_t rvaToFileOffset(uint32_t rva, uint32_t length = 1);
+
+  // Index of the section holding a file offset, -1 if none does
+  int16_t sectionOfOffset(size_t offset) const;
 
   void additionalHeuristics();
-  void printAnalysis();
+
+  // Findings of the last analysis, valid until the next file is loaded
+  const std::vector<Finding> &getFindings() const;
+  const AnalysisMetrics &getMetrics() const;
+
+  void printAnalysis(std::ostream &out = std::cout) const;
+
+  /**
+   * Writes the result of the last analysis as one line of JSON: verdict,
+   * hashes, per-stage timings and counters, and every finding.
+   *
+   * @param path the file name to report
+   */
+  void printJson(std::ostream &out, std::string_view path) const;
+
+  // Writes the result of the last analysis as one ReportRecord
+  void writeRecord(std::ostream &out, std::string_view path) const;
 };
 #endif
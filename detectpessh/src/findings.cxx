@@ -0,0 +1,169 @@
+#include "findings.hpp"
+#include "pattern_scanner.hpp"
+#include <cstdio>
+
+const char *ruleName(RuleId rule) {
+  switch (rule) {
+  case RuleId::PEFormat:
+    return "pe_format";
+  case RuleId::Library:
+    return "library";
+  case RuleId::DelayLibrary:
+    return "delay_library";
+  case RuleId::Api:
+    return "api";
+  case RuleId::ImportCount:
+    return "import_count";
+  case RuleId::SSHString:
+    return "ssh_string";
+  case RuleId::ConfigPath:
+    return "config_path";
+  case RuleId::ProtocolString:
+    return "protocol_string";
+  case RuleId::StringCount:
+    return "string_count";
+  case RuleId::FileSize:
+    return "file_size";
+  case RuleId::KnownClient:
+    return "known_client";
+  case RuleId::Allowlisted:
+    return "allowlisted";
+  case RuleId::Denylisted:
+    return "denylisted";
+  case RuleId::CachedVerdict:
+    return "cached_verdict";
+  case RuleId::PatternRule:
+    return "pattern_rule";
+  case RuleId::Packed:
+    return "packed";
+  case RuleId::CompressedSection:
+    return "compressed_section";
+  case RuleId::VersionInfo:
+    return "version_info";
+  }
+  return "unknown";
+}
+
+// " (UTF-16LE)" for hits that were not only narrow, so wide strings stand out
+static void describeEncoding(std::ostream &out, uint8_t encoding) {
+  if (encoding != 0 && encoding != PatternScanner::ASCII)
+    out << " (" << encodingName(encoding) << ")";
+}
+
+// " (entropy 7.95)" from millibits per byte
+static void describeEntropy(std::ostream &out, int64_t millibits) {
+  char text[32];
+  std::snprintf(text, sizeof(text), " (entropy %.2f)",
+                static_cast<double>(millibits) / 1000);
+  out << text;
+}
+
+void describe(std::ostream &out, const Finding &finding) {
+  switch (finding.rule) {
+  case RuleId::PEFormat:
+    out << (finding.subject == "PE32+" ? "Valid Windows PE32+ executable"
+                                       : "Valid Windows PE executable");
+    break;
+  case RuleId::Library:
+    out << "Found SSH-related import: " << finding.subject;
+    break;
+  case RuleId::DelayLibrary:
+    out << "Found SSH-related delay-load import: " << finding.subject;
+    break;
+  case RuleId::Api:
+    out << "Found SSH-related API import: " << finding.subject << " ("
+        << finding.context << ")";
+    break;
+  case RuleId::ImportCount:
+    out << "Total imported functions walked: " << finding.value;
+    break;
+  case RuleId::SSHString:
+    out << "Found SSH-related string: " << finding.subject;
+    describeEncoding(out, finding.encoding);
+    break;
+  case RuleId::ConfigPath:
+    out << "Found SSH config reference: " << finding.subject;
+    describeEncoding(out, finding.encoding);
+    break;
+  case RuleId::ProtocolString:
+    out << "Found SSH protocol reference: " << finding.subject;
+    describeEncoding(out, finding.encoding);
+    break;
+  case RuleId::StringCount:
+    out << "Total SSH-related strings found: " << finding.value;
+    break;
+  case RuleId::FileSize:
+    out << "Large file: " << finding.value << " bytes";
+    break;
+  case RuleId::KnownClient: {
+    bool imphash = finding.flags & Finding::FLAG_IMPHASH_MATCH;
+    out << "Matches known SSH client: " << finding.subject << " ("
+        << (imphash ? "imphash" : "");
+    if (finding.value >= 0)
+      out << (imphash ? ", " : "") << "fuzzy distance " << finding.value;
+    out << ")";
+    break;
+  }
+  case RuleId::Allowlisted:
+    out << "Content hash is allowlisted";
+    break;
+  case RuleId::Denylisted:
+    out << "Content hash is denylisted";
+    break;
+  case RuleId::CachedVerdict:
+    out << "Cached verdict for identical content";
+    break;
+  case RuleId::PatternRule:
+    out << "Matched rule: " << finding.subject;
+    break;
+  case RuleId::Packed:
+    if (finding.subject == "unknown")
+      out << "Packed by an unknown packer";
+    else
+      out << "Packed with " << finding.subject;
+    out << " (" << finding.context << ")";
+    break;
+  case RuleId::CompressedSection:
+    out << "Compressed section, not scanned: " << finding.subject;
+    describeEntropy(out, finding.value);
+    break;
+  case RuleId::VersionInfo:
+    out << "Version resource names an SSH client: " << finding.subject
+        << " (" << finding.context << ")";
+    break;
+  }
+}
+
+void writeJsonString(std::ostream &out, std::string_view text) {
+  out << '"';
+  for (char c : text) {
+    switch (c) {
+    case '"':
+      out << "\\\"";
+      break;
+    case '\\':
+      out << "\\\\";
+      break;
+    case '\n':
+      out << "\\n";
+      break;
+    case '\r':
+      out << "\\r";
+      break;
+    case '\t':
+      out << "\\t";
+      break;
+    default:
+      if (static_cast<uint8_t>(c) < 0x20 || static_cast<uint8_t>(c) >= 0x7f) {
+        // names come from arbitrary files: keep the output valid UTF-8
+        char escaped[8];
+        std::snprintf(escaped, sizeof(escaped), "\\u%04x",
+                      static_cast<uint8_t>(c));
+        out << escaped;
+      } else {
+        out << c;
+      }
+    }
+  }
+  out << '"';
+}
@@ -0,0 +1,121 @@
+#ifndef FINDINGS_H__
+#define FINDINGS_H__
+
+#include "analysis_stages.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+// What a finding is about. The values are part of the JSON and binary
+// report formats, so existing ones must not change.
+enum class RuleId : uint16_t {
+  PEFormat = 1,       // subject: "PE32" or "PE32+"
+  Library = 2,        // subject: library rule
+  DelayLibrary = 3,   // subject: library rule
+  Api = 4,            // subject: API name, context: DLL as named in the file
+  ImportCount = 5,    // value: imported functions walked
+  SSHString = 6,      // subject: rule text, with encoding, offset, section
+  ConfigPath = 7,     // as SSHString
+  ProtocolString = 8, // as SSHString
+  StringCount = 9,    // value: SSH strings found
+  FileSize = 10,      // value: file size
+  KnownClient = 11,   // subject: label, value: fuzzy distance or -1
+  Allowlisted = 12,
+  Denylisted = 13,
+  CachedVerdict = 14,
+  PatternRule = 15,   // subject: rule name, offset: first hit of its strings
+  Packed = 16,        // subject: packer or "unknown", context: evidence,
+                      // section, value: its entropy in millibits per byte
+  CompressedSection = 17, // subject: section name, section, value: entropy
+                          // in millibits per byte; the section is not scanned
+  VersionInfo = 18,   // subject: SSH client, context: version resource key,
+                      // offset: the UTF-16LE value
+};
+
+const char *ruleName(RuleId rule);
+
+/**
+ * One piece of evidence. Findings hold no strings of their own: subject
+ * and context point into the rule tables, the configuration maps, the
+ * mapped file or the known client index, and stay valid until the
+ * detector loads another file.
+ */
+struct Finding {
+  static constexpr uint8_t FLAG_IMPHASH_MATCH = 1; // KnownClient
+
+  RuleId rule;
+  uint8_t encoding{0}; // PatternScanner::Encoding bits, string hits only
+  uint8_t flags{0};
+  int16_t section{-1}; // index in the section table, -1 for none
+  int32_t weight{0};   // points added to the confidence score
+  int64_t value{0};
+  uint64_t offset{0};  // file offset, string hits only
+  std::string_view subject;
+  std::string_view context;
+};
+
+// Writes the human readable line of a finding, without a newline
+void describe(std::ostream &out, const Finding &finding);
+
+// Writes text as a JSON string literal, quotes included
+void writeJsonString(std::ostream &out, std::string_view text);
+
+// Counters of one analysis, reset for every file
+struct AnalysisMetrics {
+  std::array<uint64_t, STAGE_COUNT> stageNanoseconds{};
+  uint64_t bytesScanned{0};   // by the string scanner
+  uint32_t patternsHit{0};    // string matches, every occurrence counted
+  uint32_t sectionsParsed{0};
+  uint32_t importsWalked{0};  // imported functions
+};
+
+/**
+ * Binary report stream: one record per analysed file, little-endian, with
+ * no padding. A ReportRecord is followed by the file path, then by
+ * findingCount FindingRecords, each followed by its subject and context.
+ * size covers the whole record, so readers can skip unknown versions.
+ */
+struct ReportRecord {
+  static constexpr char MAGIC[4] = {'P', 'S', 'R', 'R'};
+  static constexpr uint8_t VERSION = 1;
+  static constexpr uint8_t FLAG_PE32_PLUS = 1;
+  static constexpr uint8_t FLAG_STOPPED_EARLY = 2;
+  static constexpr uint8_t FLAG_IMAGE_LAYOUT = 4;
+  static constexpr uint8_t FLAG_HAS_SHA256 = 8;
+  static constexpr uint8_t FLAG_HAS_IMPHASH = 16;
+  static constexpr uint8_t FLAG_PACKED = 32;
+
+  char magic[4];
+  uint32_t size;
+  uint8_t version;
+  uint8_t sshClient;
+  uint8_t flags;
+  uint8_t lastStage;
+  int32_t confidence;
+  uint64_t fileSize;
+  uint8_t sha256[32];
+  uint8_t imphash[16];
+  uint64_t stageNanoseconds[STAGE_COUNT];
+  uint64_t bytesScanned;
+  uint32_t patternsHit;
+  uint32_t sectionsParsed;
+  uint32_t importsWalked;
+  uint16_t findingCount;
+  uint16_t pathLength;
+} __attribute__((packed));
+
+struct FindingRecord {
+  uint16_t rule;
+  uint8_t encoding;
+  uint8_t flags;
+  int16_t section;
+  uint16_t subjectLength;
+  uint16_t contextLength;
+  uint16_t reserved;
+  int32_t weight;
+  int64_t value;
+  uint64_t offset;
+} __attribute__((packed));
+#endif
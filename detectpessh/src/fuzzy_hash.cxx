@@ -0,0 +1,177 @@
+#include "fuzzy_hash.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+// Fixed permutation of 0..255 (Fisher-Yates driven by xorshift32)
+constexpr std::array<uint8_t, 256> makePearsonTable() {
+  std::array<uint8_t, 256> table{};
+  for (size_t i = 0; i < table.size(); i++)
+    table[i] = static_cast<uint8_t>(i);
+
+  uint32_t state = 0x9E3779B9u;
+  for (size_t i = table.size() - 1; i > 0; i--) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    size_t j = state % (i + 1);
+    uint8_t tmp = table[i];
+    table[i] = table[j];
+    table[j] = tmp;
+  }
+  return table;
+}
+
+constexpr std::array<uint8_t, 256> pearson = makePearsonTable();
+
+inline uint8_t bucketMapping(uint8_t salt, uint8_t i, uint8_t j, uint8_t k) {
+  uint8_t h = pearson[salt];
+  h = pearson[h ^ i];
+  h = pearson[h ^ j];
+  return pearson[h ^ k];
+}
+
+// log-scale length bucket, fine grained for small files
+uint8_t lengthCapture(uint64_t length) {
+  double value;
+  if (length <= 656)
+    value = std::floor(std::log(double(length)) / std::log(1.5));
+  else if (length <= 3199)
+    value = std::floor(std::log(double(length)) / std::log(1.3) - 8.72777);
+  else
+    value = std::floor(std::log(double(length)) / std::log(1.1) - 62.5472);
+  return static_cast<uint8_t>(static_cast<uint64_t>(value) & 0xFF);
+}
+
+int modDiff(int x, int y, int range) {
+  int diff = std::abs(x - y);
+  return std::min(diff, range - diff);
+}
+
+} // namespace
+
+void FuzzyHasher::update(const uint8_t *data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    // window[0] is the newest byte
+    window[4] = window[3];
+    window[3] = window[2];
+    window[2] = window[1];
+    window[1] = window[0];
+    window[0] = data[i];
+    length++;
+
+    if (length < window.size())
+      continue;
+
+    const uint8_t c0 = window[0], c1 = window[1], c2 = window[2],
+                  c3 = window[3], c4 = window[4];
+    checksum = bucketMapping(0, c0, c1, checksum);
+    buckets[bucketMapping(2, c0, c1, c2)]++;
+    buckets[bucketMapping(3, c0, c1, c3)]++;
+    buckets[bucketMapping(5, c0, c2, c3)]++;
+    buckets[bucketMapping(7, c0, c2, c4)]++;
+    buckets[bucketMapping(11, c0, c1, c4)]++;
+    buckets[bucketMapping(13, c0, c3, c4)]++;
+  }
+}
+
+FuzzyDigest FuzzyHasher::finish() const {
+  FuzzyDigest digest;
+  if (length < MIN_LENGTH)
+    return digest;
+
+  std::array<uint32_t, EFFECTIVE_BUCKETS> sorted;
+  std::copy_n(buckets.begin(), EFFECTIVE_BUCKETS, sorted.begin());
+  size_t nonZero = std::count_if(sorted.begin(), sorted.end(),
+                                 [](uint32_t count) { return count != 0; });
+  // too uniform (e.g. all zero bytes) to say anything about similarity
+  if (nonZero <= EFFECTIVE_BUCKETS / 2)
+    return digest;
+
+  std::sort(sorted.begin(), sorted.end());
+  uint32_t q1 = sorted[EFFECTIVE_BUCKETS / 4 - 1];
+  uint32_t q2 = sorted[EFFECTIVE_BUCKETS / 2 - 1];
+  uint32_t q3 = sorted[EFFECTIVE_BUCKETS * 3 / 4 - 1];
+  if (q3 == 0)
+    return digest;
+
+  for (size_t i = 0; i < EFFECTIVE_BUCKETS; i++) {
+    uint32_t count = buckets[i];
+    uint8_t code = count <= q1 ? 0 : count <= q2 ? 1 : count <= q3 ? 2 : 3;
+    digest.body[i / 4] |= code << ((i % 4) * 2);
+  }
+
+  uint8_t q1Ratio = static_cast<uint8_t>((uint64_t(q1) * 100 / q3) % 16);
+  uint8_t q2Ratio = static_cast<uint8_t>((uint64_t(q2) * 100 / q3) % 16);
+  digest.checksum = checksum;
+  digest.lvalue = lengthCapture(length);
+  digest.qRatios = static_cast<uint8_t>(q1Ratio << 4 | q2Ratio);
+  digest.valid = true;
+  return digest;
+}
+
+FuzzyDigest fuzzyHash(const uint8_t *data, size_t size) {
+  FuzzyHasher hasher;
+  hasher.update(data, size);
+  return hasher.finish();
+}
+
+void FuzzyDigest::encode(uint8_t *out) const {
+  out[0] = checksum;
+  out[1] = lvalue;
+  out[2] = qRatios;
+  std::copy(body.begin(), body.end(), out + 3);
+}
+
+FuzzyDigest FuzzyDigest::decode(const uint8_t *in) {
+  FuzzyDigest digest;
+  digest.checksum = in[0];
+  digest.lvalue = in[1];
+  digest.qRatios = in[2];
+  std::copy_n(in + 3, BODY_SIZE, digest.body.begin());
+  digest.valid = true;
+  return digest;
+}
+
+std::string FuzzyDigest::toHex() const {
+  if (!valid)
+    return "";
+
+  static const char digits[] = "0123456789ABCDEF";
+  uint8_t encoded[ENCODED_SIZE];
+  encode(encoded);
+
+  std::string hex;
+  hex.reserve(ENCODED_SIZE * 2);
+  for (uint8_t byte : encoded) {
+    hex += digits[byte >> 4];
+    hex += digits[byte & 0xF];
+  }
+  return hex;
+}
+
+int FuzzyDigest::distance(const FuzzyDigest &a, const FuzzyDigest &b) {
+  int diff = 0;
+
+  int lengthDiff = modDiff(a.lvalue, b.lvalue, 256);
+  diff += lengthDiff <= 1 ? lengthDiff : lengthDiff * 12;
+
+  int q1Diff = modDiff(a.qRatios >> 4, b.qRatios >> 4, 16);
+  diff += q1Diff <= 1 ? q1Diff : (q1Diff - 1) * 12;
+  int q2Diff = modDiff(a.qRatios & 0xF, b.qRatios & 0xF, 16);
+  diff += q2Diff <= 1 ? q2Diff : (q2Diff - 1) * 12;
+
+  if (a.checksum != b.checksum)
+    diff += 1;
+
+  for (size_t i = 0; i < BODY_SIZE; i++) {
+    uint8_t x = a.body[i], y = b.body[i];
+    for (int shift = 0; shift < 8; shift += 2) {
+      int codeDiff = std::abs(((x >> shift) & 3) - ((y >> shift) & 3));
+      diff += codeDiff == 3 ? 6 : codeDiff;
+    }
+  }
+  return diff;
+}
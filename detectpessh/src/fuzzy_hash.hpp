@@ -0,0 +1,64 @@
+#ifndef FUZZY_HASH_H__
+#define FUZZY_HASH_H__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Locality-sensitive digest of a byte stream, built like TLSH: a 5 byte
+ * sliding window feeds byte triplets into 128 buckets, and the digest keeps
+ * each bucket's quartile (2 bits) plus a small header describing the length
+ * and the bucket distribution. Similar inputs give digests with a small
+ * distance().
+ *
+ * The Pearson table is generated here, so digests are only comparable with
+ * other FuzzyDigests, not with the reference TLSH library.
+ */
+struct FuzzyDigest {
+  static constexpr size_t BODY_SIZE = 32;
+  static constexpr size_t ENCODED_SIZE = 3 + BODY_SIZE;
+
+  uint8_t checksum{0};
+  uint8_t lvalue{0};
+  uint8_t qRatios{0}; // q1 ratio in the high nibble, q2 ratio in the low
+  std::array<uint8_t, BODY_SIZE> body{};
+  bool valid{false};
+
+  std::string toHex() const;
+  void encode(uint8_t *out) const;
+  static FuzzyDigest decode(const uint8_t *in);
+
+  /**
+   * Distance between two digests. 0 for identical inputs, typically below
+   * 50 for builds of the same program, several hundred for unrelated files.
+   */
+  static int distance(const FuzzyDigest &a, const FuzzyDigest &b);
+};
+
+// Streaming builder for FuzzyDigest, so the digest can be computed in the
+// same pass that reads the file.
+class FuzzyHasher {
+private:
+  static constexpr size_t BUCKETS = 256;
+  static constexpr size_t EFFECTIVE_BUCKETS = 128;
+  static constexpr size_t MIN_LENGTH = 50;
+
+  std::array<uint32_t, BUCKETS> buckets{};
+  std::array<uint8_t, 5> window{};
+  uint64_t length{0};
+  uint8_t checksum{0};
+
+public:
+  void update(const uint8_t *data, size_t size);
+
+  /**
+   * Builds the digest from everything passed to update().
+   * @return the digest, invalid if the input was too short or too uniform
+   */
+  FuzzyDigest finish() const;
+};
+
+FuzzyDigest fuzzyHash(const uint8_t *data, size_t size);
+#endif
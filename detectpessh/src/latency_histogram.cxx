@@ -0,0 +1,57 @@
+#include "latency_histogram.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+size_t LatencyHistogram::bucketOf(uint64_t micros) {
+  if (micros < SUB_BUCKETS)
+    return static_cast<size_t>(micros);
+
+  // the top SUB_BUCKET_BITS + 1 bits select the bucket
+  unsigned shift = std::bit_width(micros) - SUB_BUCKET_BITS - 1;
+  return (shift + 1) * SUB_BUCKETS +
+         static_cast<size_t>((micros >> shift) - SUB_BUCKETS);
+}
+
+uint64_t LatencyHistogram::bucketLimit(size_t bucket) {
+  if (bucket < SUB_BUCKETS)
+    return bucket;
+
+  unsigned shift = static_cast<unsigned>(bucket / SUB_BUCKETS) - 1;
+  uint64_t first = (SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+  return first + ((uint64_t{1} << shift) - 1);
+}
+
+void LatencyHistogram::record(uint64_t micros) {
+  buckets[bucketOf(micros)].fetch_add(1, std::memory_order_relaxed);
+  total.fetch_add(1, std::memory_order_relaxed);
+
+  uint64_t seen = maximum.load(std::memory_order_relaxed);
+  while (micros > seen &&
+         !maximum.compare_exchange_weak(seen, micros, std::memory_order_relaxed))
+    ;
+}
+
+uint64_t LatencyHistogram::count() const {
+  return total.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::max() const {
+  return maximum.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(double quantile) const {
+  uint64_t samples = count();
+  if (samples == 0)
+    return 0;
+
+  uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(quantile * static_cast<double>(samples))));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < BUCKET_COUNT; i++) {
+    seen += buckets[i].load(std::memory_order_relaxed);
+    if (seen >= rank)
+      return std::min(bucketLimit(i), max());
+  }
+  return max();
+}
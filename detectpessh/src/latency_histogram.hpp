@@ -0,0 +1,41 @@
+#ifndef LATENCY_HISTOGRAM_H__
+#define LATENCY_HISTOGRAM_H__
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Lock-free latency histogram with log-linear buckets: 16 sub-buckets per
+ * power of two of microseconds, so any percentile is within about 6% of
+ * the true value, from 1 us up to hours, in a fixed 8 KB.
+ */
+class LatencyHistogram {
+private:
+  static constexpr unsigned SUB_BUCKET_BITS = 4;
+  static constexpr unsigned SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+  static constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets{};
+  std::atomic<uint64_t> total{0};
+  std::atomic<uint64_t> maximum{0};
+
+  static size_t bucketOf(uint64_t micros);
+  // Largest value that falls into a bucket
+  static uint64_t bucketLimit(size_t bucket);
+
+public:
+  void record(uint64_t micros);
+
+  uint64_t count() const;
+  uint64_t max() const;
+
+  /**
+   * @param quantile between 0 and 1, such as 0.99
+   * @return the latency in microseconds that quantile of the samples did
+   * not exceed, 0 if nothing was recorded
+   */
+  uint64_t percentile(double quantile) const;
+};
+#endif
@@ -1,19 +1,369 @@
 #include "detectpessh.hpp"
+#include "pe_carver.hpp"
+#include "scan_service.hpp"
+#include "zip_scanner.hpp"
+#include <csignal>
+#include <cstdio>
 
-int main(int argc, char *argv[]) {
-  if (argc != 2) {
-    std::cout << "Usage: " << argv[0] << " <PE_file>" << std::endl;
+static void printUsage(const char *program) {
+  std::cout << "Usage: " << program
+            << " [--index <index_file>] [--cache <cache_file>]\n"
+            << "         [--allowlist <file>] [--denylist <file>] [--full]\n"
+            << "         [--stage-stats] [--format text|json|binary] "
+               "[--rules <file>]\n"
+            << "         [--scan-threads <n>] [--strings] <PE_file>\n"
+            << "       " << program
+            << " [options] --carve <disk_image|memory_dump|blob>\n"
+            << "       " << program
+            << " [options] --zip <archive.zip> [--workers <n>]\n"
+            << "       " << program
+            << " [options] --serve <socket> [--workers <n>] [--queue <n>]\n"
+            << "       " << program
+            << " --build-index <index_file> <sample_list>\n"
+            << "\nsample_list holds one 'label = path' per line, allow and "
+               "deny lists one SHA-256 per line.\n"
+            << "Analysis stops once the verdict is certain, --full runs "
+               "every stage."
+            << std::endl;
+}
+
+/**
+ * Builds a known client index from a list of reference binaries.
+ *
+ * @param indexPath the index file to write
+ * @param listPath file with one "label = path" line per sample
+ * @return process exit code
+ */
+static int buildIndex(const std::string &indexPath,
+                      const std::string &listPath) {
+  std::ifstream list(listPath);
+  if (!list) {
+    std::cerr << "Error: Cannot open file " << listPath << '\n';
     return 1;
   }
 
   PESSHDetector detector;
+  std::vector<KnownSample> samples;
+  std::string line;
+  while (std::getline(list, line)) {
+    size_t eq_pos = line.find('=');
+    if (eq_pos == std::string::npos)
+      continue;
+
+    std::string label = RuleSet::trimWhiteSpace(line.substr(0, eq_pos));
+    std::string path = RuleSet::trimWhiteSpace(line.substr(eq_pos + 1));
+    if (!detector.loadPEFile(path))
+      continue;
+
+    KnownSample sample = detector.fingerprint(label);
+    if (!sample.hasImphash && !sample.fuzzy.valid) {
+      std::cerr << "Skipping " << path << ": nothing to index\n";
+      continue;
+    }
+    samples.push_back(std::move(sample));
+  }
+
+  if (!SimilarityIndex::write(indexPath, samples)) {
+    std::cerr << "Error: Cannot write index " << indexPath << '\n';
+    return 1;
+  }
+  std::cout << "Indexed " << samples.size() << " samples into " << indexPath
+            << std::endl;
+  return 0;
+}
+
+static ScanService *runningService = nullptr;
+
+static void stopService(int) {
+  if (runningService != nullptr)
+    runningService->stop();
+}
+
+/**
+ * Serves scan requests on a Unix socket until SIGINT or SIGTERM. The rules
+ * are reloaded whenever the config files change.
+ *
+ * @param socketPath the socket to create
+ * @param rules shared by every worker detector
+ * @param strings collects the strings of every file for FIND, or nullptr
+ * @param configure applied to every worker detector
+ * @return process exit code
+ */
+static int serve(const std::string &socketPath, RuleStore &rules,
+                 unsigned workers, size_t queueDepth, CorpusStrings *strings,
+                 const std::function<void(PESSHDetector &)> &configure) {
+  ScanService service(
+      [&]() {
+        auto detector = std::make_unique<PESSHDetector>(rules);
+        configure(*detector);
+        return detector;
+      },
+      workers, queueDepth);
+  service.setCorpusStrings(strings);
+  if (!service.listen(socketPath))
+    return 1;
+
+  runningService = &service;
+  std::signal(SIGINT, stopService);
+  std::signal(SIGTERM, stopService);
+  rules.watch(std::chrono::seconds(1));
+
+  std::cerr << "Serving on " << socketPath << std::endl;
+  service.run();
+  runningService = nullptr;
+  service.printStats(std::cerr);
+  return 0;
+}
+
+/**
+ * Carves every embedded PE out of a blob and reports each one.
+ *
+ * @param blobPath disk image, memory dump or firmware blob
+ * @param rules shared by every worker detector
+ * @param configure applied to every worker detector
+ * @return 0 if any embedded PE is an SSH client, 1 otherwise
+ */
+static int carveBlob(const std::string &blobPath, RuleStore &rules,
+                     const std::function<void(PESSHDetector &)> &configure) {
+  MappedFile blob;
+  if (!blob.open(blobPath)) {
+    std::cerr << "Error: Cannot open file " << blobPath << '\n';
+    return 1;
+  }
+
+  PECarver carver([&]() {
+    auto detector = std::make_unique<PESSHDetector>(rules);
+    configure(*detector);
+    return detector;
+  });
+  std::vector<CarvedImage> images =
+      carver.carve(ByteView(blob.data(), blob.size()));
+
+  size_t sshClients = 0;
+  std::cout << "\n=== Embedded PE Carving ===\n";
+  for (const auto &image : images) {
+    char line[160];
+    std::snprintf(line, sizeof(line),
+                  "0x%012zx  %10zu bytes  %-5s %-6s  score %4d  %s\n",
+                  image.offset, image.extent, image.pe32Plus ? "PE32+" : "PE32",
+                  image.imageLayout ? "memory" : "file", image.confidence,
+                  image.sshClient ? "SSH client" : "-");
+    std::cout << line;
+    sshClients += image.sshClient;
+  }
+  std::cout << "\n" << images.size() << " embedded PE images, " << sshClients
+            << " SSH clients" << std::endl;
+  return sshClients > 0 ? 0 : 1;
+}
+
+/**
+ * Analyses every PE member of a ZIP archive, without extracting it.
+ *
+ * @param archivePath the archive
+ * @param rules shared by every worker detector
+ * @param configure applied to every worker detector
+ * @param workers worker threads, 0 for one per hardware thread
+ * @return 0 if any member is an SSH client, 1 otherwise
+ */
+static int scanZip(const std::string &archivePath, RuleStore &rules,
+                   const std::function<void(PESSHDetector &)> &configure,
+                   unsigned workers) {
+  MappedFile archive;
+  if (!archive.open(archivePath)) {
+    std::cerr << "Error: Cannot open file " << archivePath << '\n';
+    return 1;
+  }
+
+  ByteView bytes(archive.data(), archive.size());
+  std::vector<ZipMember> members;
+  if (!ZipScanner::listMembers(bytes, members)) {
+    std::cerr << "Error: " << archivePath << " is not a ZIP archive" << '\n';
+    return 1;
+  }
+
+  ZipScanner scanner(
+      [&]() {
+        auto detector = std::make_unique<PESSHDetector>(rules);
+        configure(*detector);
+        return detector;
+      },
+      workers);
+  std::vector<ScannedMember> results = scanner.scan(bytes, members);
+
+  size_t analysed = 0;
+  size_t sshClients = 0;
+  std::cout << "\n=== ZIP Archive Scan ===\n";
+  for (const auto &result : results) {
+    char line[128];
+    if (result.skipped != nullptr)
+      std::snprintf(line, sizeof(line), "%12llu bytes  %-8s  %-22s  ",
+                    static_cast<unsigned long long>(result.member.size),
+                    result.member.method == 0 ? "stored" : "deflated",
+                    result.skipped);
+    else
+      std::snprintf(line, sizeof(line), "%12llu bytes  %-8s  score %4d  %-10s  ",
+                    static_cast<unsigned long long>(result.member.size),
+                    result.member.method == 0 ? "stored" : "deflated",
+                    result.confidence,
+                    result.sshClient ? "SSH client" : "-");
+    std::cout << line << result.member.name << '\n';
+    analysed += result.skipped == nullptr;
+    sshClients += result.sshClient;
+  }
+  std::cout << "\n" << results.size() << " members, " << analysed
+            << " PE files analysed, " << sshClients << " SSH clients"
+            << std::endl;
+  return sshClients > 0 ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+  std::string indexPath;
+  std::string cachePath;
+  std::string allowlistPath;
+  std::string denylistPath;
+  std::string peFile;
+  std::string rulesPath = RuleSet::DEFAULT_RULES;
+  std::string socketPath;
+  unsigned workers = 0;
+  size_t queueDepth = 0;
+  int scanThreads = -1;
+  bool carve = false;
+  bool zip = false;
+  bool fullAnalysis = false;
+  bool printStageStats = false;
+  bool indexStrings = false;
+  std::string format = "text";
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--build-index" && i + 2 < argc) {
+      return buildIndex(argv[i + 1], argv[i + 2]);
+    } else if (arg == "--index" && i + 1 < argc) {
+      indexPath = argv[++i];
+    } else if (arg == "--cache" && i + 1 < argc) {
+      cachePath = argv[++i];
+    } else if (arg == "--allowlist" && i + 1 < argc) {
+      allowlistPath = argv[++i];
+    } else if (arg == "--denylist" && i + 1 < argc) {
+      denylistPath = argv[++i];
+    } else if (arg == "--rules" && i + 1 < argc) {
+      rulesPath = argv[++i];
+    } else if (arg == "--serve" && i + 1 < argc) {
+      socketPath = argv[++i];
+    } else if (arg == "--workers" && i + 1 < argc) {
+      workers = static_cast<unsigned>(std::atoi(argv[++i]));
+    } else if (arg == "--queue" && i + 1 < argc) {
+      queueDepth = static_cast<size_t>(std::atoll(argv[++i]));
+    } else if (arg == "--scan-threads" && i + 1 < argc) {
+      scanThreads = std::max(0, std::atoi(argv[++i]));
+    } else if (arg == "--carve") {
+      carve = true;
+    } else if (arg == "--zip") {
+      zip = true;
+    } else if (arg == "--full") {
+      fullAnalysis = true;
+    } else if (arg == "--strings") {
+      indexStrings = true;
+    } else if (arg == "--stage-stats") {
+      printStageStats = true;
+    } else if (arg == "--format" && i + 1 < argc) {
+      format = argv[++i];
+      if (format != "text" && format != "json" && format != "binary") {
+        printUsage(argv[0]);
+        return 1;
+      }
+    } else if (peFile.empty() && arg.rfind("--", 0) != 0) {
+      peFile = arg;
+    } else {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (peFile.empty() == socketPath.empty()) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  SimilarityIndex knownClients;
+  if (!indexPath.empty() && !knownClients.open(indexPath)) {
+    std::cerr << "Error: " << indexPath << " is not a valid index" << '\n';
+    return 1;
+  }
+
+  VerdictCache verdictCache;
+  bool useVerdictCache =
+      !cachePath.empty() || !allowlistPath.empty() || !denylistPath.empty();
+  if (!cachePath.empty() && !verdictCache.open(cachePath)) {
+    std::cerr << "Error: Cannot open cache " << cachePath << '\n';
+    return 1;
+  }
+  if (!allowlistPath.empty() && !verdictCache.loadAllowlist(allowlistPath)) {
+    std::cerr << "Error: Cannot open file " << allowlistPath << '\n';
+    return 1;
+  }
+  if (!denylistPath.empty() && !verdictCache.loadDenylist(denylistPath)) {
+    std::cerr << "Error: Cannot open file " << denylistPath << '\n';
+    return 1;
+  }
+
+  RuleStore rules(RuleSet::DEFAULT_DLL_MAP, RuleSet::DEFAULT_SSH_MAP,
+                  rulesPath);
+  // carving, archives and serving already run one detector per core
+  if (scanThreads < 0)
+    scanThreads = carve || zip || !socketPath.empty() ? 1 : 0;
+  StageStats stageStats;
+  auto configure = [&](PESSHDetector &detector) {
+    detector.setFullAnalysis(fullAnalysis);
+    detector.setScanThreads(static_cast<unsigned>(scanThreads));
+    detector.setStringIndexing(indexStrings);
+    if (printStageStats)
+      detector.setStageStats(&stageStats);
+    if (knownClients.isOpen())
+      detector.setKnownClients(&knownClients);
+    if (useVerdictCache)
+      detector.setVerdictCache(&verdictCache);
+  };
+
+  if (!socketPath.empty()) {
+    CorpusStrings corpusStrings;
+    int status = serve(socketPath, rules, workers, queueDepth,
+                       indexStrings ? &corpusStrings : nullptr, configure);
+    if (printStageStats)
+      stageStats.print(std::cerr);
+    return status;
+  }
+
+  if (carve) {
+    int status = carveBlob(peFile, rules, configure);
+    if (printStageStats)
+      stageStats.print(std::cout);
+    return status;
+  }
+
+  if (zip) {
+    int status = scanZip(peFile, rules, configure, workers);
+    if (printStageStats)
+      stageStats.print(std::cout);
+    return status;
+  }
+
+  PESSHDetector detector(rules);
+  configure(detector);
 
-  if (!detector.loadPEFile(argv[1])) {
+  if (!detector.loadPEFile(peFile)) {
     return 1;
   }
 
   bool isSSH = detector.isSSHClient();
-  detector.printAnalysis();
+  if (format == "json")
+    detector.printJson(std::cout, peFile);
+  else if (format == "binary")
+    detector.writeRecord(std::cout, peFile);
+  else
+    detector.printAnalysis();
+  if (printStageStats)
+    stageStats.print(std::cout);
 
   return isSSH ? 0 : 1;
 }
@@ -0,0 +1,62 @@
+#include "mapped_file.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+MappedFile::~MappedFile() { close(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : mapping(std::exchange(other.mapping, nullptr)),
+      length(std::exchange(other.length, 0)) {}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    close();
+    mapping = std::exchange(other.mapping, nullptr);
+    length = std::exchange(other.length, 0);
+  }
+  return *this;
+}
+
+bool MappedFile::open(const std::string &filename) {
+  close();
+
+  int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  bool mapped = open(fd);
+  ::close(fd);
+  return mapped;
+}
+
+bool MappedFile::open(int fd) {
+  close();
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    return false;
+
+  if (st.st_size == 0)
+    return true;
+
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED)
+    return false;
+
+  // the whole file is read front to back by the string scan
+  madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+  mapping = static_cast<const uint8_t *>(addr);
+  length = static_cast<size_t>(st.st_size);
+  return true;
+}
+
+void MappedFile::close() {
+  if (mapping != nullptr)
+    munmap(const_cast<uint8_t *>(mapping), length);
+  mapping = nullptr;
+  length = 0;
+}
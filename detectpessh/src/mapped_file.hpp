@@ -0,0 +1,42 @@
+#ifndef MAPPED_FILE_H__
+#define MAPPED_FILE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file. Move-only, unmapped on
+// destruction.
+class MappedFile {
+private:
+  const uint8_t *mapping{nullptr};
+  size_t length{0};
+
+public:
+  MappedFile() = default;
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+
+  /**
+   * Maps a file read-only. Any previous mapping is released first.
+   * Empty files are accepted and leave an empty view.
+   *
+   * @param filename the path of the file to map
+   * @return true if the file was mapped, false otherwise
+   */
+  bool open(const std::string &filename);
+
+  /**
+   * Maps an already open file read-only, such as one passed over a socket.
+   * The descriptor stays open and owned by the caller.
+   */
+  bool open(int fd);
+  void close();
+
+  const uint8_t *data() const { return mapping; }
+  size_t size() const { return length; }
+};
+#endif
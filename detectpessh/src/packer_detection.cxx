@@ -0,0 +1,120 @@
+#include "packer_detection.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+void countBytes(const uint8_t *data, size_t size, ByteHistogram &histogram) {
+  // 32-bit counters stay in L1; flushed before they could overflow
+  const size_t BLOCK = size_t(1) << 30;
+  std::array<std::array<uint32_t, 256>, 4> counts;
+
+  while (size > 0) {
+    size_t block = std::min(size, BLOCK);
+    for (auto &table : counts)
+      table.fill(0);
+
+    size_t i = 0;
+    for (; i + 16 <= block; i += 16) {
+      uint64_t low, high;
+      std::memcpy(&low, data + i, sizeof(low));
+      std::memcpy(&high, data + i + 8, sizeof(high));
+      for (int shift = 0; shift < 64; shift += 16) {
+        counts[0][static_cast<uint8_t>(low >> shift)]++;
+        counts[1][static_cast<uint8_t>(low >> (shift + 8))]++;
+        counts[2][static_cast<uint8_t>(high >> shift)]++;
+        counts[3][static_cast<uint8_t>(high >> (shift + 8))]++;
+      }
+    }
+    for (; i < block; i++)
+      counts[0][data[i]]++;
+
+    for (int b = 0; b < 256; b++)
+      histogram[b] += uint64_t(counts[0][b]) + counts[1][b] + counts[2][b] +
+                      counts[3][b];
+    data += block;
+    size -= block;
+  }
+}
+
+double shannonEntropy(const ByteHistogram &histogram) {
+  uint64_t total = 0;
+  for (uint64_t count : histogram)
+    total += count;
+  if (total == 0)
+    return 0;
+
+  double entropy = 0;
+  for (uint64_t count : histogram) {
+    if (count == 0)
+      continue;
+    double p = static_cast<double>(count) / static_cast<double>(total);
+    entropy -= p * std::log2(p);
+  }
+  return entropy;
+}
+
+double sectionEntropy(const uint8_t *data, size_t size) {
+  ByteHistogram histogram{};
+  if (size <= ENTROPY_SAMPLE_SIZE) {
+    countBytes(data, size, histogram);
+    return shannonEntropy(histogram);
+  }
+
+  const size_t block = ENTROPY_BLOCK_SIZE;
+  const size_t stride = (size - block) / (ENTROPY_SAMPLE_BLOCKS - 1);
+  for (size_t i = 0; i < ENTROPY_SAMPLE_BLOCKS; i++)
+    countBytes(data + i * stride, block, histogram);
+  return shannonEntropy(histogram);
+}
+
+std::vector<std::pair<size_t, size_t>> compressedBlocks(const uint8_t *data,
+                                                        size_t size) {
+  std::vector<std::pair<size_t, size_t>> blocks;
+  for (size_t begin = 0; begin < size;) {
+    size_t end = begin + ENTROPY_BLOCK_SIZE;
+    if (end + ENTROPY_BLOCK_SIZE > size)
+      end = size;
+
+    ByteHistogram histogram{};
+    countBytes(data + begin, end - begin, histogram);
+    if (shannonEntropy(histogram) >= COMPRESSED_ENTROPY) {
+      if (!blocks.empty() && blocks.back().second == begin)
+        blocks.back().second = end;
+      else
+        blocks.emplace_back(begin, end);
+    }
+    begin = end;
+  }
+  return blocks;
+}
+
+std::string_view packerOfSection(std::string_view sectionName) {
+  static constexpr struct {
+    std::string_view section;
+    std::string_view packer;
+  } SIGNATURES[] = {
+      {"UPX0", "UPX"},          {"UPX1", "UPX"},
+      {"UPX2", "UPX"},          {"UPX!", "UPX"},
+      {".aspack", "ASPack"},    {".adata", "ASPack"},
+      {".MPRESS1", "MPRESS"},   {".MPRESS2", "MPRESS"},
+      {".petite", "Petite"},    {"PEC2", "PECompact"},
+      {"PEC2TO", "PECompact"},  {"PEC2MO", "PECompact"},
+      {"pec1", "PECompact"},    {"pec2", "PECompact"},
+      {".nsp0", "NsPack"},      {".nsp1", "NsPack"},
+      {".nsp2", "NsPack"},      {"nsp0", "NsPack"},
+      {"nsp1", "NsPack"},       {".themida", "Themida"},
+      {".winlice", "WinLicense"}, {".vmp0", "VMProtect"},
+      {".vmp1", "VMProtect"},   {".vmp2", "VMProtect"},
+      {".enigma1", "Enigma"},   {".enigma2", "Enigma"},
+      {"MEW", "MEW"},           {"FSG!", "FSG"},
+      {".RLPack", "RLPack"},    {".packed", "RLPack"},
+      {".perplex", "Perplex"},  {".yP", "Y0da Protector"},
+      {".y0da", "Y0da Protector"}, {"kkrunchy", "kkrunchy"},
+      {".MaskPE", "MaskPE"},
+  };
+  for (const auto &signature : SIGNATURES) {
+    if (signature.section == sectionName)
+      return signature.packer;
+  }
+  return {};
+}
@@ -0,0 +1,60 @@
+#ifndef PACKER_DETECTION_H__
+#define PACKER_DETECTION_H__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * Packed and encrypted sections look like random bytes: their Shannon
+ * entropy is close to the 8 bits per byte maximum, where code sits around
+ * 6 and text or tables well below. Strings found in them are coincidences,
+ * so they are not worth scanning.
+ */
+
+// Sections at least this dense are compressed or encrypted
+constexpr double COMPRESSED_ENTROPY = 7.2;
+// Smaller sections are too short for a meaningful entropy
+constexpr size_t MIN_ENTROPY_SIZE = 4096;
+
+using ByteHistogram = std::array<uint64_t, 256>;
+
+/**
+ * Adds the bytes of data to histogram. Four sub-histograms are counted
+ * side by side, eight bytes per load, so runs of equal bytes do not wait
+ * on one counter.
+ */
+void countBytes(const uint8_t *data, size_t size, ByteHistogram &histogram);
+
+// Shannon entropy in bits per byte, 0 for an empty histogram
+double shannonEntropy(const ByteHistogram &histogram);
+
+/**
+ * Entropy of a section. Sections up to ENTROPY_SAMPLE_SIZE are counted
+ * whole; larger ones from ENTROPY_SAMPLE_BLOCKS blocks spread evenly over
+ * them, so the cost is bounded however large the file is.
+ */
+double sectionEntropy(const uint8_t *data, size_t size);
+
+constexpr size_t ENTROPY_SAMPLE_SIZE = 64 << 10;
+constexpr size_t ENTROPY_SAMPLE_BLOCKS = 16;
+constexpr size_t ENTROPY_BLOCK_SIZE = ENTROPY_SAMPLE_SIZE / ENTROPY_SAMPLE_BLOCKS;
+
+/**
+ * The blocks of ENTROPY_BLOCK_SIZE bytes of data that are compressed on
+ * their own, for a section whose sampled entropy cannot vouch for the bytes
+ * between the samples. A shorter tail is counted with the block before it.
+ * @return [begin, end) offsets into data, merged
+ */
+std::vector<std::pair<size_t, size_t>> compressedBlocks(const uint8_t *data,
+                                                        size_t size);
+
+/**
+ * Names the packer that uses a section name, such as "UPX" for UPX0.
+ * @return the packer, empty if no known packer uses the name
+ */
+std::string_view packerOfSection(std::string_view sectionName);
+#endif
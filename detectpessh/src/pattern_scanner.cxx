@@ -0,0 +1,157 @@
+#include "pattern_scanner.hpp"
+#include <cctype>
+#include <queue>
+
+namespace {
+inline uint8_t fold(uint8_t c) {
+  return static_cast<uint8_t>(std::tolower(c));
+}
+} // namespace
+
+uint32_t PatternScanner::add(std::string_view pattern, bool wide) {
+  bool ascii = true;
+  for (char c : pattern)
+    ascii = ascii && static_cast<uint8_t>(c) < 0x80;
+
+  patterns.emplace_back(pattern);
+  widePatterns.push_back(wide && ascii);
+  return static_cast<uint32_t>(patterns.size() - 1);
+}
+
+void PatternScanner::clear() {
+  patterns.clear();
+  widePatterns.clear();
+  atoms.clear();
+  transitions.clear();
+  startsMatch.fill(false);
+  outputBegin.clear();
+  outputs.clear();
+  classCount = 0;
+  longestAtom = 0;
+}
+
+void PatternScanner::compile() {
+  // every form of every pattern, as folded bytes
+  std::vector<std::string> forms;
+  atoms.clear();
+  longestAtom = 0;
+  for (uint32_t id = 0; id < patterns.size(); id++) {
+    if (patterns[id].empty())
+      continue;
+
+    std::string ascii;
+    for (char c : patterns[id])
+      ascii += static_cast<char>(fold(static_cast<uint8_t>(c)));
+    forms.push_back(ascii);
+    atoms.push_back({id, ASCII, static_cast<uint32_t>(ascii.size())});
+
+    if (widePatterns[id]) {
+      std::string utf16;
+      for (char c : ascii) {
+        utf16 += c;
+        utf16 += '\0';
+      }
+      forms.push_back(utf16);
+      atoms.push_back({id, UTF16LE, static_cast<uint32_t>(utf16.size())});
+    }
+  }
+  for (const auto &atom : atoms)
+    longestAtom = std::max<size_t>(longestAtom, atom.length);
+
+  // byte classes: class 0 for bytes no pattern uses
+  byteClass.fill(0);
+  classCount = 1;
+  std::array<int, 256> classOfFolded;
+  classOfFolded.fill(-1);
+  for (const auto &form : forms) {
+    for (char c : form) {
+      uint8_t b = static_cast<uint8_t>(c);
+      if (classOfFolded[b] < 0)
+        classOfFolded[b] = static_cast<int>(classCount++);
+    }
+  }
+  for (int b = 0; b < 256; b++) {
+    int cls = classOfFolded[fold(static_cast<uint8_t>(b))];
+    byteClass[b] = static_cast<uint8_t>(cls < 0 ? 0 : cls);
+  }
+
+  // trie, -1 for missing edges
+  std::vector<std::vector<int32_t>> trie(1, std::vector<int32_t>(classCount, -1));
+  std::vector<std::vector<uint32_t>> stateOutputs(1);
+  for (uint32_t atom = 0; atom < forms.size(); atom++) {
+    uint32_t state = 0;
+    for (char c : forms[atom]) {
+      uint8_t cls = byteClass[static_cast<uint8_t>(c)];
+      if (trie[state][cls] < 0) {
+        trie[state][cls] = static_cast<int32_t>(trie.size());
+        trie.emplace_back(classCount, -1);
+        stateOutputs.emplace_back();
+      }
+      state = static_cast<uint32_t>(trie[state][cls]);
+    }
+    stateOutputs[state].push_back(atom);
+  }
+
+  // breadth first: fill failure transitions and inherit suffix outputs
+  const size_t states = trie.size();
+  std::vector<uint32_t> failure(states, 0);
+  transitions.assign(states * classCount, 0);
+  std::queue<uint32_t> pending;
+  for (uint32_t cls = 0; cls < classCount; cls++) {
+    int32_t next = trie[0][cls];
+    if (next > 0) {
+      transitions[cls] = static_cast<uint32_t>(next);
+      failure[next] = 0;
+      pending.push(static_cast<uint32_t>(next));
+    }
+  }
+  while (!pending.empty()) {
+    uint32_t state = pending.front();
+    pending.pop();
+    const auto &inherited = stateOutputs[failure[state]];
+    stateOutputs[state].insert(stateOutputs[state].end(), inherited.begin(),
+                               inherited.end());
+
+    for (uint32_t cls = 0; cls < classCount; cls++) {
+      int32_t next = trie[state][cls];
+      uint32_t fallback = transitions[failure[state] * classCount + cls];
+      if (next > 0) {
+        failure[next] = fallback;
+        transitions[state * classCount + cls] = static_cast<uint32_t>(next);
+        pending.push(static_cast<uint32_t>(next));
+      } else {
+        transitions[state * classCount + cls] = fallback;
+      }
+    }
+  }
+
+  // premultiplied: entries hold the next state's row offset, with
+  // OUTPUT_FLAG set if that state reports matches
+  for (auto &entry : transitions) {
+    uint32_t next = entry;
+    entry = next * classCount;
+    if (!stateOutputs[next].empty())
+      entry |= OUTPUT_FLAG;
+  }
+
+  for (int b = 0; b < 256; b++)
+    startsMatch[b] = transitions[byteClass[b]] != 0;
+
+  outputBegin.assign(states + 1, 0);
+  outputs.clear();
+  for (size_t state = 0; state < states; state++) {
+    outputBegin[state] = static_cast<uint32_t>(outputs.size());
+    outputs.insert(outputs.end(), stateOutputs[state].begin(),
+                   stateOutputs[state].end());
+  }
+  outputBegin[states] = static_cast<uint32_t>(outputs.size());
+}
+
+std::string encodingName(uint8_t encodings) {
+  std::string name;
+  if (encodings & PatternScanner::ASCII)
+    name = "ASCII";
+  if (encodings & PatternScanner::UTF16LE)
+    name += name.empty() ? "UTF-16LE" : "+UTF-16LE";
+  return name;
+}
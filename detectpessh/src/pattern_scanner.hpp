@@ -0,0 +1,108 @@
+#ifndef PATTERN_SCANNER_H__
+#define PATTERN_SCANNER_H__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Multi-pattern matcher: every pattern, in its ASCII and UTF-16LE forms,
+ * is compiled into one Aho-Corasick DFA so a single pass over the bytes
+ * finds all of them. Matching is ASCII case-insensitive.
+ *
+ * Bytes are first mapped to equivalence classes (one per distinct folded
+ * pattern byte, plus one for everything else), which keeps the transition
+ * table small enough to stay in cache.
+ */
+class PatternScanner {
+public:
+  enum Encoding : uint8_t { ASCII = 1, UTF16LE = 2 };
+
+  struct Match {
+    uint32_t pattern;
+    Encoding encoding;
+    size_t offset; // of the first byte of the match
+  };
+
+private:
+  struct Atom {
+    uint32_t pattern;
+    Encoding encoding;
+    uint32_t length; // in bytes
+  };
+
+  std::vector<std::string> patterns;
+  std::vector<bool> widePatterns;
+  std::vector<Atom> atoms;
+
+  static constexpr uint32_t OUTPUT_FLAG = 0x80000000u;
+
+  std::array<uint8_t, 256> byteClass{};
+  uint32_t classCount{0};
+  // [state * classCount + class]: next state * classCount, | OUTPUT_FLAG
+  // if it reports matches, so the scan loop needs no multiply and no
+  // second load per byte
+  std::vector<uint32_t> transitions;
+  // bytes that leave the start state; all others are skipped there
+  std::array<bool, 256> startsMatch{};
+  std::vector<uint32_t> outputBegin; // atoms ending in state s are
+  std::vector<uint32_t> outputs;     // outputs[outputBegin[s]..[s + 1])
+  size_t longestAtom{0};
+
+public:
+  /**
+   * Adds a pattern. Call compile() before scanning.
+   *
+   * @param pattern the bytes to look for
+   * @param wide also match the UTF-16LE form (ASCII patterns only)
+   * @return the pattern id reported in matches
+   */
+  uint32_t add(std::string_view pattern, bool wide = true);
+  void compile();
+  void clear();
+
+  size_t patternCount() const { return patterns.size(); }
+  const std::string &pattern(uint32_t id) const { return patterns[id]; }
+  // longest match in bytes, UTF-16LE forms included
+  size_t maxMatchLength() const { return longestAtom; }
+  size_t stateCount() const { return outputBegin.empty() ? 0 : outputBegin.size() - 1; }
+
+  /**
+   * Scans a byte range once, calling onMatch(const Match &) for every
+   * occurrence of every pattern form, in order of their end offset.
+   */
+  template <typename OnMatch>
+  void scan(const uint8_t *data, size_t size, OnMatch &&onMatch) const {
+    if (transitions.empty())
+      return;
+
+    const uint32_t *table = transitions.data();
+    uint32_t row = 0;
+    for (size_t i = 0; i < size; i++) {
+      if (row == 0) {
+        // most bytes cannot begin a match: find the next one that can
+        // without going through the transition table
+        while (i < size && !startsMatch[data[i]])
+          i++;
+        if (i == size)
+          break;
+      }
+      uint32_t next = table[row + byteClass[data[i]]];
+      row = next & ~OUTPUT_FLAG;
+      if (next & OUTPUT_FLAG) [[unlikely]] {
+        uint32_t state = row / classCount;
+        for (uint32_t k = outputBegin[state]; k < outputBegin[state + 1]; k++) {
+          const Atom &atom = atoms[outputs[k]];
+          onMatch(Match{atom.pattern, atom.encoding, i + 1 - atom.length});
+        }
+      }
+    }
+  }
+};
+
+// Encoding names for findings, e.g. "ASCII+UTF-16LE"
+std::string encodingName(uint8_t encodings);
+#endif
@@ -0,0 +1,197 @@
+#include "pe_carver.hpp"
+#include <algorithm>
+#include <optional>
+#include <thread>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+void findSignaturesScalar(const uint8_t *data, size_t size, size_t begin,
+                          size_t end, std::vector<size_t> &out) {
+  for (size_t i = begin; i < end && i + 1 < size; i++) {
+    if (data[i] == 'M' && data[i + 1] == 'Z')
+      out.push_back(i);
+  }
+}
+
+#if defined(__x86_64__)
+// SSE2 is part of the x86_64 baseline
+size_t findSignaturesSSE2(const uint8_t *data, size_t size, size_t begin,
+                          size_t end, std::vector<size_t> &out) {
+  const __m128i m = _mm_set1_epi8('M');
+  const __m128i z = _mm_set1_epi8('Z');
+  size_t i = begin;
+  for (; i + 16 <= end && i + 17 <= size; i += 16) {
+    __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    __m128i second =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 1));
+    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(
+        _mm_cmpeq_epi8(first, m), _mm_cmpeq_epi8(second, z))));
+    while (mask != 0) {
+      out.push_back(i + __builtin_ctz(mask));
+      mask &= mask - 1;
+    }
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) size_t
+findSignaturesAVX2(const uint8_t *data, size_t size, size_t begin, size_t end,
+                   std::vector<size_t> &out) {
+  const __m256i m = _mm256_set1_epi8('M');
+  const __m256i z = _mm256_set1_epi8('Z');
+  size_t i = begin;
+  for (; i + 32 <= end && i + 33 <= size; i += 32) {
+    __m256i first =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    __m256i second =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 1));
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(
+        _mm256_cmpeq_epi8(first, m), _mm256_cmpeq_epi8(second, z))));
+    while (mask != 0) {
+      out.push_back(i + __builtin_ctz(mask));
+      mask &= mask - 1;
+    }
+  }
+  return i;
+}
+#endif
+
+bool anyNonZero(ByteView bytes, size_t offset, size_t count) {
+  ByteView window = bytes.subview(offset, count);
+  return std::any_of(window.begin(), window.end(),
+                     [](uint8_t byte) { return byte != 0; });
+}
+
+} // namespace
+
+PECarver::PECarver(DetectorFactory factory, unsigned threadCount)
+    : makeDetector(std::move(factory)),
+      threads(threadCount != 0
+                  ? threadCount
+                  : std::max(1u, std::thread::hardware_concurrency())) {}
+
+void PECarver::findSignatures(const uint8_t *data, size_t size, size_t begin,
+                              size_t end, std::vector<size_t> &out) {
+  end = std::min(end, size);
+#if defined(__x86_64__)
+  static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+  begin = hasAVX2 ? findSignaturesAVX2(data, size, begin, end, out)
+                  : findSignaturesSSE2(data, size, begin, end, out);
+#endif
+  findSignaturesScalar(data, size, begin, end, out);
+}
+
+bool PECarver::validate(ByteView blob, size_t offset, CarvedImage &image) {
+  const uint32_t MAX_LFANEW = 0x10000;
+  const uint16_t MAX_SECTIONS = 96; // the Windows loader limit
+
+  ByteView rest = blob.subview(offset, blob.size() - offset);
+  uint32_t lfanew = rest.get<uint32_t>(offsetof(DOS_HEADER, e_lfanew));
+  if (lfanew == 0 || lfanew > MAX_LFANEW || lfanew % 4 != 0)
+    return false;
+
+  return std::visit(
+      [&](const auto &view) -> bool {
+        using View = std::decay_t<decltype(view)>;
+        if constexpr (std::is_same_v<View, std::monostate>) {
+          return false;
+        } else {
+          using OptionalHeader = typename View::OptionalHeader;
+          uint16_t count = view.numberOfSections();
+          if (count == 0 || count > MAX_SECTIONS ||
+              view.sizeOfOptionalHeader() <
+                  offsetof(OptionalHeader, DataDirectory) ||
+              !rest.contains(view.sectionTableOffset(),
+                             count * sizeof(SECTION_HEADER)))
+            return false;
+
+          uint64_t rawExtent = view.sizeOfHeaders();
+          uint64_t imageExtent = view.sizeOfImage();
+          if (rawExtent == 0 || imageExtent < rawExtent)
+            return false;
+
+          SECTION_HEADER section;
+          std::optional<SECTION_HEADER> first;
+          for (uint16_t i = 0; i < count; i++) {
+            view.section(i, section);
+            if (section.SizeOfRawData == 0)
+              continue;
+            rawExtent = std::max<uint64_t>(
+                rawExtent, uint64_t(section.PointerToRawData) +
+                               section.SizeOfRawData);
+            if (!first)
+              first = section;
+          }
+
+          // A dumped image has its sections at their RVAs: the file
+          // position of the first section is empty while its RVA is not,
+          // or the on-disk layout would not even fit in the blob.
+          bool imageLayout = false;
+          if (first && first->PointerToRawData != first->VirtualAddress)
+            imageLayout = !anyNonZero(rest, first->PointerToRawData, 64) &&
+                          anyNonZero(rest, first->VirtualAddress, 64);
+          if (rawExtent > rest.size() && imageExtent <= rest.size())
+            imageLayout = true;
+
+          image.offset = offset;
+          image.extent = std::min<uint64_t>(
+              imageLayout ? imageExtent : rawExtent, rest.size());
+          image.pe32Plus = std::is_same_v<View, PeView64>;
+          image.imageLayout = imageLayout;
+          return true;
+        }
+      },
+      parsePeView(rest));
+}
+
+void PECarver::carveChunk(ByteView blob, size_t begin, size_t end,
+                          std::vector<CarvedImage> &out) const {
+  std::vector<size_t> candidates;
+  findSignatures(blob.data(), blob.size(), begin, end, candidates);
+  if (candidates.empty())
+    return;
+
+  std::unique_ptr<PESSHDetector> detector = makeDetector();
+  for (size_t offset : candidates) {
+    CarvedImage image{};
+    if (!validate(blob, offset, image))
+      continue;
+
+    detector->loadPEBuffer(blob.subview(image.offset, image.extent),
+                           image.imageLayout);
+    image.sshClient = detector->isSSHClient();
+    image.confidence = detector->getConfidence();
+    out.push_back(image);
+  }
+}
+
+std::vector<CarvedImage> PECarver::carve(ByteView blob) const {
+  // below this a chunk is not worth a thread
+  const size_t MIN_CHUNK = 1 << 20;
+
+  size_t workers = std::max<size_t>(
+      1, std::min<size_t>(threads, blob.size() / MIN_CHUNK));
+  size_t chunk = (blob.size() + workers - 1) / workers;
+
+  std::vector<std::vector<CarvedImage>> results(workers);
+  std::vector<std::thread> pool;
+  for (size_t i = 1; i < workers; i++) {
+    pool.emplace_back([&, i]() {
+      carveChunk(blob, i * chunk, std::min(blob.size(), (i + 1) * chunk),
+                 results[i]);
+    });
+  }
+  carveChunk(blob, 0, std::min(blob.size(), chunk), results[0]);
+  for (auto &thread : pool)
+    thread.join();
+
+  // chunks are in order and so are the offsets inside each of them
+  std::vector<CarvedImage> images;
+  for (auto &result : results)
+    images.insert(images.end(), result.begin(), result.end());
+  return images;
+}
@@ -0,0 +1,65 @@
+#ifndef PE_CARVER_H__
+#define PE_CARVER_H__
+
+#include "detectpessh.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// A PE image found inside a larger blob
+struct CarvedImage {
+  size_t offset;      // of the DOS header in the blob
+  size_t extent;      // bytes the image occupies from offset
+  bool pe32Plus;
+  bool imageLayout;   // laid out as loaded in memory, not as on disk
+  int confidence;
+  bool sshClient;
+};
+
+/**
+ * Finds and analyses PE images embedded at arbitrary offsets in disk
+ * images, memory dumps and firmware blobs, without extracting them.
+ *
+ * The blob is split into one chunk per thread. Each thread scans its chunk
+ * for "MZ" with 32 byte (AVX2) or 16 byte (SSE2) compares, validates the
+ * DOS/NT headers of every candidate in place, works out the image's extent
+ * and runs the SSH analysis on the bytes where they lie.
+ */
+class PECarver {
+public:
+  // creates the detector a worker thread analyses with
+  using DetectorFactory = std::function<std::unique_ptr<PESSHDetector>()>;
+
+private:
+  DetectorFactory makeDetector;
+  unsigned threads;
+
+  /**
+   * Validates a candidate and fills in its extent and layout.
+   * @return true if a plausible PE image starts at offset
+   */
+  static bool validate(ByteView blob, size_t offset, CarvedImage &image);
+
+  void carveChunk(ByteView blob, size_t begin, size_t end,
+                  std::vector<CarvedImage> &out) const;
+
+public:
+  /**
+   * @param factory creates one detector per worker thread
+   * @param threadCount worker threads, 0 for one per hardware thread
+   */
+  explicit PECarver(DetectorFactory factory, unsigned threadCount = 0);
+
+  /**
+   * Offsets of every "MZ" in [begin, end) of data.
+   * A match may use the byte at end, so size bounds the read.
+   */
+  static void findSignatures(const uint8_t *data, size_t size, size_t begin,
+                             size_t end, std::vector<size_t> &out);
+
+  // Carves and analyses every embedded PE, ordered by offset
+  std::vector<CarvedImage> carve(ByteView blob) const;
+};
+#endif
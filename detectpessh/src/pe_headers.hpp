@@ -29,51 +29,85 @@ struct DOS_HEADER {
   uint32_t e_lfanew;   // File address of new exe header
 } __attribute__((packed));
 
-struct NT_HEADERS {
-  uint32_t Signature;
-  struct {
-    uint16_t Machine;
-    uint16_t NumberOfSections;
-    uint32_t TimeDateStamp;
-    uint32_t PointerToSymbolTable;
-    uint32_t NumberOfSymbols;
-    uint16_t SizeOfOptionalHeader;
-    uint16_t Characteristics;
-  } __attribute__((packed)) FileHeader;
-  struct {
-    uint16_t Magic;
-    uint8_t MajorLinkerVersion;
-    uint8_t MinorLinkerVersion;
-    uint32_t SizeOfCode;
-    uint32_t SizeOfInitializedData;
-    uint32_t SizeOfUninitializedData;
-    uint32_t AddressOfEntryPoint;
-    uint32_t BaseOfCode;
-    uint32_t BaseOfData; // Only in PE32
-    uint32_t ImageBase;
-    uint32_t SectionAlignment;
-    uint32_t FileAlignment;
-    uint16_t MajorOperatingSystemVersion;
-    uint16_t MinorOperatingSystemVersion;
-    uint16_t MajorImageVersion;
-    uint16_t MinorImageVersion;
-    uint16_t MajorSubsystemVersion;
-    uint16_t MinorSubsystemVersion;
-    uint32_t Win32VersionValue;
-    uint32_t SizeOfImage;
-    uint32_t SizeOfHeaders;
-    uint32_t CheckSum;
-    uint16_t Subsystem;
-    uint16_t DllCharacteristics;
-    uint32_t SizeOfStackReserve;
-    uint32_t SizeOfStackCommit;
-    uint32_t SizeOfHeapReserve;
-    uint32_t SizeOfHeapCommit;
-    uint32_t LoaderFlags;
-    uint32_t NumberOfRvaAndSizes; IMAGE_DATA_DIRECTORY DataDirectory[16];
+struct FILE_HEADER {
+  uint16_t Machine;
+  uint16_t NumberOfSections;
+  uint32_t TimeDateStamp;
+  uint32_t PointerToSymbolTable;
+  uint32_t NumberOfSymbols;
+  uint16_t SizeOfOptionalHeader;
+  uint16_t Characteristics;
+} __attribute__((packed));
 
-  } __attribute__((packed)) OptionalHeader;
-};
+// PE32 optional header (Magic 0x10b)
+struct OPTIONAL_HEADER32 {
+  uint16_t Magic;
+  uint8_t MajorLinkerVersion;
+  uint8_t MinorLinkerVersion;
+  uint32_t SizeOfCode;
+  uint32_t SizeOfInitializedData;
+  uint32_t SizeOfUninitializedData;
+  uint32_t AddressOfEntryPoint;
+  uint32_t BaseOfCode;
+  uint32_t BaseOfData; // Only in PE32
+  uint32_t ImageBase;
+  uint32_t SectionAlignment;
+  uint32_t FileAlignment;
+  uint16_t MajorOperatingSystemVersion;
+  uint16_t MinorOperatingSystemVersion;
+  uint16_t MajorImageVersion;
+  uint16_t MinorImageVersion;
+  uint16_t MajorSubsystemVersion;
+  uint16_t MinorSubsystemVersion;
+  uint32_t Win32VersionValue;
+  uint32_t SizeOfImage;
+  uint32_t SizeOfHeaders;
+  uint32_t CheckSum;
+  uint16_t Subsystem;
+  uint16_t DllCharacteristics;
+  uint32_t SizeOfStackReserve;
+  uint32_t SizeOfStackCommit;
+  uint32_t SizeOfHeapReserve;
+  uint32_t SizeOfHeapCommit;
+  uint32_t LoaderFlags;
+  uint32_t NumberOfRvaAndSizes;
+  IMAGE_DATA_DIRECTORY DataDirectory[16];
+} __attribute__((packed));
+
+// PE32+ optional header (Magic 0x20b): no BaseOfData, 64-bit ImageBase and
+// stack/heap sizes
+struct OPTIONAL_HEADER64 {
+  uint16_t Magic;
+  uint8_t MajorLinkerVersion;
+  uint8_t MinorLinkerVersion;
+  uint32_t SizeOfCode;
+  uint32_t SizeOfInitializedData;
+  uint32_t SizeOfUninitializedData;
+  uint32_t AddressOfEntryPoint;
+  uint32_t BaseOfCode;
+  uint64_t ImageBase;
+  uint32_t SectionAlignment;
+  uint32_t FileAlignment;
+  uint16_t MajorOperatingSystemVersion;
+  uint16_t MinorOperatingSystemVersion;
+  uint16_t MajorImageVersion;
+  uint16_t MinorImageVersion;
+  uint16_t MajorSubsystemVersion;
+  uint16_t MinorSubsystemVersion;
+  uint32_t Win32VersionValue;
+  uint32_t SizeOfImage;
+  uint32_t SizeOfHeaders;
+  uint32_t CheckSum;
+  uint16_t Subsystem;
+  uint16_t DllCharacteristics;
+  uint64_t SizeOfStackReserve;
+  uint64_t SizeOfStackCommit;
+  uint64_t SizeOfHeapReserve;
+  uint64_t SizeOfHeapCommit;
+  uint32_t LoaderFlags;
+  uint32_t NumberOfRvaAndSizes;
+  IMAGE_DATA_DIRECTORY DataDirectory[16];
+} __attribute__((packed));
 
 struct SECTION_HEADER {
   char Name[8];
@@ -96,4 +130,37 @@ struct IMAGE_IMPORT_DESCRIPTOR {
   uint32_t Name;
   uint32_t FirstThunk;
 } __attribute__((packed));
+
+struct IMAGE_DELAY_LOAD_DESCRIPTOR {
+  uint32_t Attributes; // bit 0 set: fields are RVAs, otherwise VAs
+  uint32_t DllNameRVA;
+  uint32_t ModuleHandleRVA;
+  uint32_t ImportAddressTableRVA;
+  uint32_t ImportNameTableRVA;
+  uint32_t BoundImportAddressTableRVA;
+  uint32_t UnloadInformationTableRVA;
+  uint32_t TimeDateStamp;
+} __attribute__((packed));
+
+// Followed by NumberOfNamedEntries named entries, then the ID entries
+struct IMAGE_RESOURCE_DIRECTORY {
+  uint32_t Characteristics;
+  uint32_t TimeDateStamp;
+  uint16_t MajorVersion;
+  uint16_t MinorVersion;
+  uint16_t NumberOfNamedEntries;
+  uint16_t NumberOfIdEntries;
+} __attribute__((packed));
+
+struct IMAGE_RESOURCE_DIRECTORY_ENTRY {
+  uint32_t Name;         // an ID, or with the high bit a name offset
+  uint32_t OffsetToData; // with the high bit a subdirectory; from the root
+} __attribute__((packed));
+
+struct IMAGE_RESOURCE_DATA_ENTRY {
+  uint32_t OffsetToData; // an RVA, unlike the offsets of the tree
+  uint32_t Size;
+  uint32_t CodePage;
+  uint32_t Reserved;
+} __attribute__((packed));
 #endif
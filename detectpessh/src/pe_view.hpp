@@ -0,0 +1,209 @@
+// Zero-copy, bounds-checked views over the bytes of a PE image
+#include "pe_headers.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <variant>
+#ifndef PE_VIEW_H__
+#define PE_VIEW_H__
+
+static_assert(sizeof(DOS_HEADER) == 64);
+static_assert(sizeof(FILE_HEADER) == 20);
+static_assert(sizeof(OPTIONAL_HEADER32) == 224);
+static_assert(sizeof(OPTIONAL_HEADER64) == 240);
+static_assert(sizeof(SECTION_HEADER) == 40);
+
+// Read-only view over a byte range. Every read is bounds checked, reads that
+// fall outside the range return the fallback value instead.
+class ByteView {
+private:
+  const uint8_t *bytes{nullptr};
+  size_t length{0};
+
+public:
+  ByteView() = default;
+  ByteView(const uint8_t *data, size_t size) : bytes(data), length(size) {}
+
+  const uint8_t *data() const { return bytes; }
+  size_t size() const { return length; }
+  bool empty() const { return length == 0; }
+  const uint8_t *begin() const { return bytes; }
+  const uint8_t *end() const { return bytes + length; }
+  uint8_t operator[](size_t offset) const { return bytes[offset]; }
+
+  bool contains(size_t offset, size_t count) const {
+    return offset <= length && count <= length - offset;
+  }
+
+  template <typename T> bool read(size_t offset, T &out) const {
+    if (!contains(offset, sizeof(T)))
+      return false;
+    std::memcpy(&out, bytes + offset, sizeof(T));
+    return true;
+  }
+
+  template <typename T> T get(size_t offset, T fallback = T{}) const {
+    read(offset, fallback);
+    return fallback;
+  }
+
+  // NUL terminated string at offset, cut at the end of the view
+  std::string_view cstring(size_t offset) const {
+    if (offset >= length)
+      return {};
+    const char *str = reinterpret_cast<const char *>(bytes + offset);
+    return std::string_view(str, strnlen(str, length - offset));
+  }
+
+  ByteView subview(size_t offset, size_t count) const {
+    if (offset > length)
+      return {};
+    return ByteView(bytes + offset, std::min(count, length - offset));
+  }
+};
+
+struct PE32Traits {
+  using OptionalHeader = OPTIONAL_HEADER32;
+  using Thunk = uint32_t;
+  static constexpr uint16_t Magic = 0x10b;
+  static constexpr Thunk OrdinalFlag = 0x80000000u;
+};
+
+struct PE64Traits {
+  using OptionalHeader = OPTIONAL_HEADER64;
+  using Thunk = uint64_t;
+  static constexpr uint16_t Magic = 0x20b;
+  static constexpr Thunk OrdinalFlag = 0x8000000000000000ull;
+};
+
+/**
+ * View of a PE image laid out as described by Traits (PE32 or PE32+).
+ * Holds no copies of the headers: every accessor reads its field from the
+ * underlying bytes on demand.
+ */
+template <typename Traits> class PeView {
+public:
+  using OptionalHeader = typename Traits::OptionalHeader;
+  using Thunk = typename Traits::Thunk;
+
+private:
+  ByteView image;
+  size_t ntOffset{0};
+
+  size_t fileHeaderOffset() const { return ntOffset + sizeof(uint32_t); }
+  size_t optionalHeaderOffset() const {
+    return fileHeaderOffset() + sizeof(FILE_HEADER);
+  }
+
+  template <typename F> F fileField(size_t fieldOffset) const {
+    return image.get<F>(fileHeaderOffset() + fieldOffset);
+  }
+  template <typename F> F optionalField(size_t fieldOffset) const {
+    return image.get<F>(optionalHeaderOffset() + fieldOffset);
+  }
+
+public:
+  PeView(ByteView bytes, size_t ntHeadersOffset)
+      : image(bytes), ntOffset(ntHeadersOffset) {}
+
+  const ByteView &bytes() const { return image; }
+  size_t ntHeadersOffset() const { return ntOffset; }
+
+  uint16_t machine() const {
+    return fileField<uint16_t>(offsetof(FILE_HEADER, Machine));
+  }
+  uint16_t numberOfSections() const {
+    return fileField<uint16_t>(offsetof(FILE_HEADER, NumberOfSections));
+  }
+  uint16_t sizeOfOptionalHeader() const {
+    return fileField<uint16_t>(offsetof(FILE_HEADER, SizeOfOptionalHeader));
+  }
+  uint16_t characteristics() const {
+    return fileField<uint16_t>(offsetof(FILE_HEADER, Characteristics));
+  }
+
+  uint64_t imageBase() const {
+    return optionalField<decltype(OptionalHeader::ImageBase)>(
+        offsetof(OptionalHeader, ImageBase));
+  }
+  uint32_t addressOfEntryPoint() const {
+    return optionalField<uint32_t>(
+        offsetof(OptionalHeader, AddressOfEntryPoint));
+  }
+  uint32_t sizeOfImage() const {
+    return optionalField<uint32_t>(offsetof(OptionalHeader, SizeOfImage));
+  }
+  uint32_t sizeOfHeaders() const {
+    return optionalField<uint32_t>(offsetof(OptionalHeader, SizeOfHeaders));
+  }
+  uint32_t numberOfRvaAndSizes() const {
+    return optionalField<uint32_t>(
+        offsetof(OptionalHeader, NumberOfRvaAndSizes));
+  }
+
+  /**
+   * Reads a data directory entry.
+   * @return the entry, or an empty entry if the index is beyond
+   * NumberOfRvaAndSizes or outside the optional header
+   */
+  IMAGE_DATA_DIRECTORY dataDirectory(size_t index) const {
+    size_t fieldOffset = offsetof(OptionalHeader, DataDirectory) +
+                         index * sizeof(IMAGE_DATA_DIRECTORY);
+    if (index >= numberOfRvaAndSizes() || index >= 16 ||
+        fieldOffset + sizeof(IMAGE_DATA_DIRECTORY) > sizeOfOptionalHeader())
+      return {0, 0};
+    return optionalField<IMAGE_DATA_DIRECTORY>(fieldOffset);
+  }
+
+  // The section table follows the optional header as sized by the file
+  // header, not by sizeof(OptionalHeader).
+  size_t sectionTableOffset() const {
+    return optionalHeaderOffset() + sizeOfOptionalHeader();
+  }
+
+  bool section(size_t index, SECTION_HEADER &out) const {
+    return image.read(sectionTableOffset() + index * sizeof(SECTION_HEADER),
+                      out);
+  }
+
+  // Reads one import thunk, 4 bytes for PE32 and 8 bytes for PE32+
+  bool thunk(size_t offset, Thunk &out) const { return image.read(offset, out); }
+  static bool isOrdinal(Thunk thunk) { return thunk & Traits::OrdinalFlag; }
+};
+
+using PeView32 = PeView<PE32Traits>;
+using PeView64 = PeView<PE64Traits>;
+using AnyPeView = std::variant<std::monostate, PeView32, PeView64>;
+
+/**
+ * Validates the DOS and NT signatures in place and picks the layout from
+ * the optional header magic.
+ *
+ * @param bytes the image bytes
+ * @return a PE32 or PE32+ view, or std::monostate if bytes is not a PE image
+ */
+inline AnyPeView parsePeView(ByteView bytes) {
+  if (bytes.get<uint16_t>(offsetof(DOS_HEADER, e_magic)) != 0x5A4D) // "MZ"
+    return std::monostate{};
+
+  uint32_t ntOffset = bytes.get<uint32_t>(offsetof(DOS_HEADER, e_lfanew));
+  if (!bytes.contains(ntOffset, sizeof(uint32_t) + sizeof(FILE_HEADER) +
+                                    sizeof(uint16_t)))
+    return std::monostate{};
+
+  if (bytes.get<uint32_t>(ntOffset) != 0x00004550) // "PE\0\0"
+    return std::monostate{};
+
+  size_t optionalOffset = ntOffset + sizeof(uint32_t) + sizeof(FILE_HEADER);
+  switch (bytes.get<uint16_t>(optionalOffset)) {
+  case PE32Traits::Magic:
+    return PeView32(bytes, ntOffset);
+  case PE64Traits::Magic:
+    return PeView64(bytes, ntOffset);
+  default:
+    return std::monostate{};
+  }
+}
+#endif
@@ -0,0 +1,535 @@
+#include "rule_language.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+std::string RuleString::atom() const {
+  if (!isHex())
+    return text;
+  std::string bytes;
+  for (size_t i = atomOffset; i < atomOffset + atomLength; i++)
+    bytes += static_cast<char>(hex[i]);
+  return bytes;
+}
+
+bool RuleString::matchesAt(const uint8_t *data, size_t size) const {
+  if (size < hex.size())
+    return false;
+  for (size_t i = 0; i < hex.size(); i++) {
+    if (hex[i] != ANY_BYTE && data[i] != hex[i])
+      return false;
+  }
+  return true;
+}
+
+namespace {
+
+struct Token {
+  enum Kind : uint8_t {
+    End,
+    Identifier, // keywords included
+    StringRef,  // $name
+    Text,       // "..."
+    Hex,        // { .. }, raw contents
+    Number,
+    Symbol      // one of = : ( ) { } , or ".."
+  };
+
+  Kind kind{End};
+  std::string text;
+  uint64_t number{0};
+  size_t line{1};
+};
+
+class Lexer {
+private:
+  std::string_view source;
+  size_t position{0};
+  size_t line{1};
+
+  [[noreturn]] void fail(const std::string &message) const {
+    throw RuleSyntaxError(line, message);
+  }
+
+  void skipSpaceAndComments() {
+    while (position < source.size()) {
+      char c = source[position];
+      if (c == '\n') {
+        line++;
+        position++;
+      } else if (std::isspace(static_cast<unsigned char>(c))) {
+        position++;
+      } else if (c == '#' || source.substr(position, 2) == "//") {
+        while (position < source.size() && source[position] != '\n')
+          position++;
+      } else {
+        return;
+      }
+    }
+  }
+
+  std::string readText() {
+    std::string text;
+    position++; // opening quote
+    while (position < source.size() && source[position] != '"') {
+      char c = source[position++];
+      if (c == '\n')
+        fail("unterminated string");
+      if (c != '\\') {
+        text += c;
+        continue;
+      }
+      if (position >= source.size())
+        fail("unterminated string");
+      char escaped = source[position++];
+      switch (escaped) {
+      case 'n':
+        text += '\n';
+        break;
+      case 't':
+        text += '\t';
+        break;
+      case 'r':
+        text += '\r';
+        break;
+      case '0':
+        text += '\0';
+        break;
+      case 'x': {
+        if (position + 2 > source.size() ||
+            !std::isxdigit(static_cast<unsigned char>(source[position])) ||
+            !std::isxdigit(static_cast<unsigned char>(source[position + 1])))
+          fail("bad \\x escape");
+        text += static_cast<char>(
+            std::stoi(std::string(source.substr(position, 2)), nullptr, 16));
+        position += 2;
+        break;
+      }
+      default:
+        text += escaped; // \" and \\ among others
+      }
+    }
+    if (position >= source.size())
+      fail("unterminated string");
+    position++; // closing quote
+    return text;
+  }
+
+public:
+  explicit Lexer(std::string_view text) : source(text) {}
+
+  // Hex blocks are only read where a string value is expected, since a
+  // rule body is a { } block as well
+  std::string readHexBlock() {
+    skipSpaceAndComments();
+    if (position >= source.size() || source[position] != '{')
+      fail("expected {");
+    size_t close = source.find('}', position);
+    if (close == std::string_view::npos)
+      fail("unterminated hex string");
+    std::string contents(source.substr(position + 1, close - position - 1));
+    line += std::count(contents.begin(), contents.end(), '\n');
+    position = close + 1;
+    return contents;
+  }
+
+  bool atHexBlock() {
+    skipSpaceAndComments();
+    return position < source.size() && source[position] == '{';
+  }
+
+  Token next() {
+    skipSpaceAndComments();
+    Token token;
+    token.line = line;
+    if (position >= source.size())
+      return token;
+
+    char c = source[position];
+    if (c == '"') {
+      token.kind = Token::Text;
+      token.text = readText();
+    } else if (c == '$' || std::isalpha(static_cast<unsigned char>(c)) ||
+               c == '_') {
+      size_t begin = position++;
+      while (position < source.size() &&
+             (std::isalnum(static_cast<unsigned char>(source[position])) ||
+              source[position] == '_'))
+        position++;
+      token.kind = c == '$' ? Token::StringRef : Token::Identifier;
+      token.text = source.substr(begin + (c == '$'), position - begin - (c == '$'));
+      if (token.kind == Token::StringRef && token.text.empty())
+        fail("$ without a name");
+    } else if (std::isdigit(static_cast<unsigned char>(c))) {
+      size_t begin = position;
+      int base = 10;
+      if (source.substr(position, 2) == "0x" ||
+          source.substr(position, 2) == "0X") {
+        base = 16;
+        position += 2;
+      }
+      while (position < source.size() &&
+             std::isxdigit(static_cast<unsigned char>(source[position])) &&
+             (base == 16 ||
+              std::isdigit(static_cast<unsigned char>(source[position]))))
+        position++;
+      token.kind = Token::Number;
+      token.text = source.substr(begin, position - begin);
+      try {
+        token.number = std::stoull(token.text, nullptr, base);
+      } catch (...) {
+        fail("bad number " + token.text);
+      }
+    } else if (source.substr(position, 2) == "..") {
+      token.kind = Token::Symbol;
+      token.text = "..";
+      position += 2;
+    } else if (std::strchr("=:(){},", c) != nullptr) {
+      token.kind = Token::Symbol;
+      token.text = std::string(1, c);
+      position++;
+    } else {
+      fail(std::string("unexpected character '") + c + "'");
+    }
+    return token;
+  }
+};
+
+bool keywordIs(const Token &token, std::string_view keyword) {
+  if (token.kind != Token::Identifier || token.text.size() != keyword.size())
+    return false;
+  for (size_t i = 0; i < keyword.size(); i++) {
+    if (std::tolower(static_cast<unsigned char>(token.text[i])) != keyword[i])
+      return false;
+  }
+  return true;
+}
+
+// Numbers the constrained matches of a condition and copies them into
+// rule.placements
+void collectPlacements(Condition &condition, PatternRule &rule) {
+  for (auto &operand : condition.operands)
+    collectPlacements(operand, rule);
+  if (condition.kind != Condition::Match ||
+      condition.where == Condition::Anywhere)
+    return;
+  condition.placement = static_cast<uint32_t>(rule.placements.size());
+  rule.placements.push_back(condition);
+}
+
+class Parser {
+private:
+  Lexer lexer;
+  Token current;
+
+  [[noreturn]] void fail(const std::string &message) const {
+    throw RuleSyntaxError(current.line, message);
+  }
+
+  void advance() { current = lexer.next(); }
+
+  bool isSymbol(std::string_view symbol) const {
+    return current.kind == Token::Symbol && current.text == symbol;
+  }
+
+  void expectSymbol(std::string_view symbol) {
+    if (!isSymbol(symbol))
+      fail("expected '" + std::string(symbol) + "'");
+    advance();
+  }
+
+  void expectKeyword(std::string_view keyword) {
+    if (!keywordIs(current, keyword))
+      fail("expected '" + std::string(keyword) + "'");
+    advance();
+  }
+
+  static std::vector<int16_t> parseHex(const std::string &contents,
+                                       size_t line) {
+    std::vector<int16_t> bytes;
+    std::string digits;
+    for (char c : contents) {
+      if (std::isspace(static_cast<unsigned char>(c)))
+        continue;
+      if (c != '?' && !std::isxdigit(static_cast<unsigned char>(c)))
+        throw RuleSyntaxError(line, std::string("bad hex digit '") + c + "'");
+      digits += c;
+      if (digits.size() < 2)
+        continue;
+      if (digits == "??")
+        bytes.push_back(RuleString::ANY_BYTE);
+      else if (digits.find('?') != std::string::npos)
+        throw RuleSyntaxError(line, "only whole bytes can be ??");
+      else
+        bytes.push_back(static_cast<int16_t>(std::stoi(digits, nullptr, 16)));
+      digits.clear();
+    }
+    if (!digits.empty())
+      throw RuleSyntaxError(line, "odd number of hex digits");
+    return bytes;
+  }
+
+  RuleString parseString() {
+    RuleString string;
+    string.name = current.text;
+    advance();
+    if (!isSymbol("="))
+      fail("expected '='");
+
+    if (lexer.atHexBlock()) {
+      size_t line = current.line;
+      string.hex = parseHex(lexer.readHexBlock(), line);
+
+      // the longest run of fixed bytes is what the scanner looks for
+      size_t runStart = 0;
+      for (size_t i = 0; i <= string.hex.size(); i++) {
+        if (i < string.hex.size() && string.hex[i] != RuleString::ANY_BYTE)
+          continue;
+        if (i - runStart > string.atomLength) {
+          string.atomOffset = runStart;
+          string.atomLength = i - runStart;
+        }
+        runStart = i + 1;
+      }
+      if (string.atomLength < 2)
+        throw RuleSyntaxError(line, "$" + string.name +
+                                        " needs two fixed bytes in a row");
+      advance();
+    } else {
+      advance();
+      if (current.kind != Token::Text)
+        fail("expected a string or a hex block");
+      if (current.text.empty())
+        fail("empty string");
+      string.text = current.text;
+      advance();
+      if (keywordIs(current, "ascii")) {
+        string.wide = false;
+        advance();
+      }
+    }
+    return string;
+  }
+
+  uint32_t stringIndex(const PatternRule &rule, const std::string &name) {
+    for (size_t i = 0; i < rule.strings.size(); i++) {
+      if (rule.strings[i].name == name)
+        return static_cast<uint32_t>(i);
+    }
+    fail("undefined string $" + name);
+  }
+
+  Condition parseOr(const PatternRule &rule) {
+    Condition left = parseAnd(rule);
+    while (keywordIs(current, "or")) {
+      advance();
+      Condition node{.kind = Condition::Or};
+      node.operands.push_back(std::move(left));
+      node.operands.push_back(parseAnd(rule));
+      left = std::move(node);
+    }
+    return left;
+  }
+
+  Condition parseAnd(const PatternRule &rule) {
+    Condition left = parseUnary(rule);
+    while (keywordIs(current, "and")) {
+      advance();
+      Condition node{.kind = Condition::And};
+      node.operands.push_back(std::move(left));
+      node.operands.push_back(parseUnary(rule));
+      left = std::move(node);
+    }
+    return left;
+  }
+
+  Condition parseUnary(const PatternRule &rule) {
+    if (keywordIs(current, "not")) {
+      advance();
+      Condition node{.kind = Condition::Not};
+      node.operands.push_back(parseUnary(rule));
+      return node;
+    }
+    if (isSymbol("(")) {
+      advance();
+      Condition inner = parseOr(rule);
+      expectSymbol(")");
+      return inner;
+    }
+    if (keywordIs(current, "any") || keywordIs(current, "all") ||
+        current.kind == Token::Number) {
+      Condition node{.kind = Condition::CountOf};
+      node.count = keywordIs(current, "any")   ? 1
+                   : keywordIs(current, "all") ? SIZE_MAX
+                                               : current.number;
+      advance();
+      expectKeyword("of");
+      expectKeyword("them");
+      return node;
+    }
+    if (current.kind != Token::StringRef)
+      fail("expected a condition");
+
+    Condition node{.kind = Condition::Match};
+    node.string = stringIndex(rule, current.text);
+    advance();
+    if (keywordIs(current, "at")) {
+      advance();
+      if (current.kind != Token::Number)
+        fail("expected an offset after 'at'");
+      node.where = Condition::At;
+      node.from = current.number;
+      advance();
+    } else if (keywordIs(current, "in")) {
+      advance();
+      if (current.kind == Token::Text) {
+        node.where = Condition::InSection;
+        node.section = current.text;
+        advance();
+      } else {
+        expectSymbol("(");
+        if (current.kind != Token::Number)
+          fail("expected an offset range");
+        node.where = Condition::InRange;
+        node.from = current.number;
+        advance();
+        expectSymbol("..");
+        if (current.kind != Token::Number)
+          fail("expected an offset range");
+        node.to = current.number;
+        advance();
+        expectSymbol(")");
+      }
+    }
+    return node;
+  }
+
+  PatternRule parseRule() {
+    PatternRule rule;
+    expectKeyword("rule");
+    if (current.kind != Token::Identifier)
+      fail("expected a rule name");
+    rule.name = current.text;
+    size_t ruleLine = current.line;
+    advance();
+    expectSymbol("{");
+
+    bool hasWeight = false;
+    bool hasCondition = false;
+    while (!isSymbol("}")) {
+      if (keywordIs(current, "meta")) {
+        advance();
+        expectSymbol(":");
+        while (current.kind == Token::Identifier && !keywordIs(current, "strings") &&
+               !keywordIs(current, "condition")) {
+          std::string key = current.text;
+          advance();
+          expectSymbol("=");
+          if (key == "weight") {
+            if (current.kind != Token::Number)
+              fail("weight must be a number");
+            rule.weight = current.number;
+            hasWeight = true;
+          }
+          advance(); // other meta values are allowed and ignored
+        }
+      } else if (keywordIs(current, "strings")) {
+        advance();
+        expectSymbol(":");
+        while (current.kind == Token::StringRef) {
+          for (const auto &string : rule.strings) {
+            if (string.name == current.text)
+              fail("duplicate string $" + current.text);
+          }
+          rule.strings.push_back(parseString());
+        }
+      } else if (keywordIs(current, "condition")) {
+        advance();
+        expectSymbol(":");
+        rule.condition = parseOr(rule);
+        collectPlacements(rule.condition, rule);
+        hasCondition = true;
+      } else {
+        fail("expected meta:, strings:, condition: or '}'");
+      }
+    }
+    advance();
+
+    if (!hasWeight)
+      throw RuleSyntaxError(ruleLine, "rule " + rule.name + " has no weight");
+    if (!hasCondition)
+      throw RuleSyntaxError(ruleLine,
+                            "rule " + rule.name + " has no condition");
+    return rule;
+  }
+
+public:
+  explicit Parser(std::string_view source) : lexer(source) { advance(); }
+
+  std::vector<PatternRule> parse() {
+    std::vector<PatternRule> rules;
+    while (current.kind != Token::End) {
+      PatternRule rule = parseRule();
+      for (const auto &other : rules) {
+        if (other.name == rule.name)
+          fail("duplicate rule " + rule.name);
+      }
+      rules.push_back(std::move(rule));
+    }
+    return rules;
+  }
+};
+
+bool evaluateCondition(const Condition &condition, const RuleHits &hits) {
+  switch (condition.kind) {
+  case Condition::And:
+    return evaluateCondition(condition.operands[0], hits) &&
+           evaluateCondition(condition.operands[1], hits);
+  case Condition::Or:
+    return evaluateCondition(condition.operands[0], hits) ||
+           evaluateCondition(condition.operands[1], hits);
+  case Condition::Not:
+    return !evaluateCondition(condition.operands[0], hits);
+  case Condition::CountOf: {
+    size_t hit = std::count(hits.found.begin(), hits.found.end(), true);
+    return condition.count == SIZE_MAX ? hit == hits.found.size()
+                                       : hit >= condition.count;
+  }
+  case Condition::Match:
+    break;
+  }
+
+  if (condition.where == Condition::Anywhere)
+    return hits.found[condition.string];
+  return hits.placed[condition.placement];
+}
+
+} // namespace
+
+std::vector<PatternRule> parseRules(std::string_view source) {
+  return Parser(source).parse();
+}
+
+bool isPlaced(const Condition &placement, size_t offset,
+              const std::vector<NamedRange> &sections) {
+  switch (placement.where) {
+  case Condition::Anywhere:
+    return true;
+  case Condition::At:
+    return offset == placement.from;
+  case Condition::InRange:
+    return offset >= placement.from && offset <= placement.to;
+  case Condition::InSection:
+    for (const auto &section : sections) {
+      if (section.name == placement.section && offset >= section.begin &&
+          offset < section.end)
+        return true;
+    }
+    return false;
+  }
+  return false;
+}
+
+bool evaluate(const PatternRule &rule, const RuleHits &hits) {
+  return evaluateCondition(rule.condition, hits);
+}
@@ -0,0 +1,121 @@
+#ifndef RULE_LANGUAGE_H__
+#define RULE_LANGUAGE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * A small YARA-style rule language for analysts:
+ *
+ *   rule putty_host_keys {
+ *     meta:
+ *       weight = 30
+ *     strings:
+ *       $hosts = "known_hosts"          // ASCII and UTF-16LE, any case
+ *       $banner = "SSH-2.0-" ascii      // ASCII only
+ *       $kex = { 00 00 00 ?? 14 }       // exact bytes, ?? is any byte
+ *     condition:
+ *       $hosts and ($banner in ".rdata" or $kex in (0..0x1000))
+ *   }
+ *
+ * Conditions combine string hits with and, or, not and parentheses.
+ * A string can be required in a section ($a in ".rdata"), at a file offset
+ * ($a at 0x400) or in an offset range ($a in (0..4096)); "any of them",
+ * "all of them" and "<n> of them" count the strings of the rule.
+ *
+ * Every string becomes one atom of the detector's multi-pattern scanner, so
+ * rules add no passes over the file. Offset and section constraints are
+ * checked against every hit as the scan finds it, so no hit has to be kept;
+ * conditions are evaluated once, after the scan.
+ */
+
+// A string of a pattern rule: text, or hex bytes with wildcards
+struct RuleString {
+  static constexpr int16_t ANY_BYTE = -1;
+
+  std::string name;          // without the $
+  std::string text;          // text strings
+  std::vector<int16_t> hex;  // hex strings: byte values or ANY_BYTE
+  bool wide{true};           // text strings: also match UTF-16LE
+
+  // hex strings are scanned for their longest run of fixed bytes and
+  // verified in full where it is found
+  size_t atomOffset{0};
+  size_t atomLength{0};
+
+  bool isHex() const { return !hex.empty(); }
+  // The bytes handed to the scanner
+  std::string atom() const;
+  // Whether the whole hex string matches at data, which holds size bytes
+  bool matchesAt(const uint8_t *data, size_t size) const;
+};
+
+struct Condition {
+  enum Kind : uint8_t { And, Or, Not, Match, CountOf };
+  enum Where : uint8_t { Anywhere, InSection, At, InRange };
+
+  Kind kind{Match};
+  // Match
+  uint32_t string{0}; // index in PatternRule::strings
+  Where where{Anywhere};
+  std::string section;        // InSection
+  uint64_t from{0}, to{0};    // At: from, InRange: [from, to]
+  uint32_t placement{0};      // not Anywhere: index in PatternRule::placements
+  // CountOf: strings of the rule that must have hits, SIZE_MAX for all
+  size_t count{0};
+  std::vector<Condition> operands; // And, Or, Not
+};
+
+struct PatternRule {
+  std::string name;
+  size_t weight{0};
+  std::vector<RuleString> strings;
+  Condition condition;
+  // copies of the Match conditions with a constraint on where the string is
+  std::vector<Condition> placements;
+};
+
+class RuleSyntaxError : public std::runtime_error {
+public:
+  size_t line;
+  RuleSyntaxError(size_t line, const std::string &message)
+      : std::runtime_error("line " + std::to_string(line) + ": " + message),
+        line(line) {}
+};
+
+/**
+ * Parses a rule file.
+ * @throws RuleSyntaxError on the first error
+ */
+std::vector<PatternRule> parseRules(std::string_view source);
+
+// A section as conditions see it
+struct NamedRange {
+  std::string_view name;
+  size_t begin;
+  size_t end;
+};
+
+/**
+ * Whether a hit of its string satisfies a placement of a rule.
+ *
+ * @param placement one of PatternRule::placements
+ * @param offset file offset of the hit
+ * @param sections the section table of the file
+ */
+bool isPlaced(const Condition &placement, size_t offset,
+              const std::vector<NamedRange> &sections);
+
+// What a scan found of the strings of one rule
+struct RuleHits {
+  std::vector<bool> found;  // by string, hit anywhere
+  std::vector<bool> placed; // by placement, satisfied by a hit
+};
+
+// Evaluates the condition of a rule
+bool evaluate(const PatternRule &rule, const RuleHits &hits);
+#endif
@@ -0,0 +1,269 @@
+#include "rule_set.hpp"
+#include "api_hash.hpp"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+std::shared_ptr<const RuleSet>
+RuleSet::load(const std::string &dllMapConfigPath,
+              const std::string &sshMapConfigPath,
+              const std::string &rulesPath) {
+  // not make_shared: the constructor is private
+  std::shared_ptr<RuleSet> rules(new RuleSet());
+  rules->dllMapFilePath = dllMapConfigPath;
+  rules->sshMapFilePath = sshMapConfigPath;
+  rules->rulesFilePath = rulesPath;
+  rules->loadMapFromConfig(dllMapConfigPath, rules->sshLibrariesMap,
+                           [&]() { rules->setDefaultDLLMap(); });
+  rules->loadMapFromConfig(sshMapConfigPath, rules->sshStringsMap,
+                           [&]() { rules->setDefaultSSHMap(); });
+  std::string patternSource = rules->loadPatternRules(rulesPath);
+  rules->compileStringRules();
+
+  for (const auto &library : rules->sshLibrariesMap) {
+    rules->maxImportScore += library.second;
+    rules->librariesByHash.emplace(apihash::fnv1aFolded(library.first),
+                                   &library);
+  }
+  for (const auto &api : sshApiTable)
+    rules->maxImportScore += api.weight;
+  for (const auto &rule : rules->stringRules)
+    rules->totalStringWeight += rule.weight;
+  for (const auto &rule : rules->patternRules)
+    rules->totalPatternRuleWeight += rule.weight;
+
+  uint64_t hash = 14695981039346656037ull;
+  auto mix = [&](std::string_view bytes) {
+    for (char c : bytes) {
+      hash ^= static_cast<uint8_t>(c);
+      hash *= 1099511628211ull;
+    }
+  };
+  for (const auto *map : {&rules->sshStringsMap, &rules->sshLibrariesMap}) {
+    for (const auto &[pattern, weight] : *map) {
+      mix(pattern);
+      mix(std::to_string(weight));
+    }
+    mix("|");
+  }
+  mix(patternSource);
+  rules->fingerprint = hash;
+  return rules;
+}
+
+const std::pair<const std::string, size_t> *
+RuleSet::findLibrary(std::string_view dllName) const {
+  auto [first, last] =
+      librariesByHash.equal_range(apihash::fnv1aFolded(dllName));
+  for (auto it = first; it != last; ++it) {
+    if (apihash::equalsFolded(it->second->first, dllName))
+      return it->second;
+  }
+  return nullptr;
+}
+
+void RuleSet::setDefaultDLLMap() {
+  sshLibrariesMap = {
+      {"ws2_32.dll", 12},   {"wsock32.dll", 12},  {"wininet.dll", 12},
+      {"crypt32.dll", 12},  {"advapi32.dll", 12}, {"bcrypt.dll", 12},
+      {"libssl", 12},       {"libcrypto", 12},    {"openssl", 12},
+      {"libeay32.dll", 12}, {"ssleay32.dll", 12}, {"ncrypt.dll", 12},
+      {"cryptsp.dll", 12}};
+}
+void RuleSet::setDefaultSSHMap() {
+  sshStringsMap = {
+      {"ssh", 25},         {"openssh", 25},     {"putty", 25},
+      {"PUTTY", 25},       {"ssh-rsa", 25},     {"ssh-dss", 25},
+      {"ssh-ed25519", 15}, {"ecdsa-sha2", 25},  {"id_rsa", 12},
+      {"id_dsa", 19},      {"known_hosts", 25}, {"authorized_keys", 12},
+      {".ssh", 20},        {"~/.ssh", 20},      {"%USERPROFILE%\\.ssh", 25},
+      {"ssh-keygen", 20},  {"ssh-add", 19},     {"ssh-agent", 20},
+      {"SecureShell", 20}, {"terminal", 12},    {"sftp", 18},
+      {"scp", 20}};
+}
+
+// Trim whitespace from both ends of a string
+std::string RuleSet::trimWhiteSpace(const std::string &str) {
+  size_t start = str.find_first_not_of(" \t\n\r\f\v");
+  if (start == std::string::npos)
+    return "";
+
+  size_t end = str.find_last_not_of(" \t\n\r\f\v");
+  return str.substr(start, end - start + 1);
+}
+
+void RuleSet::loadMapFromConfig(const std::string &filename,
+                                std::map<std::string, size_t> &map,
+                                std::function<void()> setDefaultMap) {
+
+  if (!std::filesystem::exists(filename)) {
+    setDefaultMap();
+    return;
+  }
+
+  std::ifstream ifs(filename);
+  if (!ifs) {
+    std::cerr << "File : " << filename
+              << " could not be opened\nUsing default Mappings\n";
+    setDefaultMap();
+    return;
+  }
+
+  std::string line{100};
+
+  while (std::getline(ifs, line)) {
+    try {
+
+      size_t eq_pos = line.find('=');
+      if (eq_pos == std::string::npos)
+        throw std::invalid_argument("missing '='");
+
+      map.emplace(std::make_pair(trimWhiteSpace(line.substr(0, eq_pos)),
+                                 std::stoi(trimWhiteSpace(line.substr(eq_pos + 1)))));
+
+    } catch (...) {
+      std::cerr << "Error occured with config file, Using default Mappings\n";
+      setDefaultMap();
+      return;
+    }
+  }
+}
+
+std::string RuleSet::loadPatternRules(const std::string &filename) {
+  if (filename.empty() || !std::filesystem::exists(filename))
+    return "";
+
+  std::ifstream ifs(filename);
+  std::stringstream source;
+  source << ifs.rdbuf();
+  if (!ifs) {
+    std::cerr << "File : " << filename << " could not be read\n";
+    return "";
+  }
+
+  try {
+    patternRules = parseRules(source.str());
+  } catch (const RuleSyntaxError &error) {
+    std::cerr << "Error in " << filename << ", " << error.what()
+              << "\nPattern rules disabled\n";
+    patternRules.clear();
+    return "";
+  }
+  return source.str();
+}
+
+void RuleSet::compileStringRules() {
+  const char *const configPaths[] = {
+      "/.ssh/config",    "\\.ssh\\config", "ssh_config", "known_hosts",
+      "authorized_keys", "id_rsa",         "id_dsa"};
+  const char *const protocolStrings[] = {
+      "ssh-2.0", "ssh-1.", "protocol version", "diffie-hellman",
+      "aes",     "3des",   "blowfish"};
+
+  stringRules.clear();
+  for (const auto &sshString : sshStringsMap)
+    stringRules.push_back(
+        {sshString.first, sshString.second, StringRule::SSHString});
+  for (const char *path : configPaths)
+    stringRules.push_back({path, 15, StringRule::ConfigPath});
+  for (const char *proto : protocolStrings)
+    stringRules.push_back({proto, 10, StringRule::ProtocolString});
+
+  stringScanner.clear();
+  for (const auto &rule : stringRules)
+    stringScanner.add(rule.text);
+  patternRuleStrings.clear();
+  firstPlacements.clear();
+  size_t placements = 0;
+  for (uint32_t r = 0; r < patternRules.size(); r++) {
+    const PatternRule &rule = patternRules[r];
+    for (uint32_t i = 0; i < rule.strings.size(); i++) {
+      const RuleString &string = rule.strings[i];
+      stringScanner.add(string.atom(), !string.isHex() && string.wide);
+      PatternRuleString &ref = patternRuleStrings.emplace_back();
+      ref.rule = r;
+      ref.string = i;
+      for (uint32_t p = 0; p < rule.placements.size(); p++) {
+        if (rule.placements[p].string == i)
+          ref.placements.push_back(p);
+      }
+    }
+    firstPlacements.push_back(placements);
+    placements += rule.placements.size();
+  }
+  stringScanner.compile();
+}
+
+RuleStore::RuleStore(const std::string &dllMapConfigPath,
+                     const std::string &sshMapConfigPath,
+                     const std::string &rulesPath)
+    : current(RuleSet::load(dllMapConfigPath, sshMapConfigPath, rulesPath)),
+      dllMapTime(modificationTime(dllMapConfigPath)),
+      sshMapTime(modificationTime(sshMapConfigPath)),
+      rulesTime(modificationTime(rulesPath)) {}
+
+RuleStore::~RuleStore() {
+  {
+    std::lock_guard<std::mutex> lock(watcherLock);
+    stopping = true;
+  }
+  watcherWake.notify_all();
+  if (watcher.joinable())
+    watcher.join();
+}
+
+std::filesystem::file_time_type
+RuleStore::modificationTime(const std::string &path) {
+  std::error_code error;
+  auto time = std::filesystem::last_write_time(path, error);
+  return error ? std::filesystem::file_time_type{} : time;
+}
+
+std::shared_ptr<const RuleSet> RuleStore::snapshot() const {
+  std::lock_guard<std::mutex> lock(currentLock);
+  return current;
+}
+
+void RuleStore::publish(std::shared_ptr<const RuleSet> rules) {
+  {
+    std::lock_guard<std::mutex> lock(currentLock);
+    current.swap(rules);
+  }
+  // snapshot before generation: a detector that sees the new generation
+  // is guaranteed to load the new snapshot. The old rules are released
+  // here, or by the last detector still scanning with them.
+  generation.fetch_add(1, std::memory_order_release);
+}
+
+bool RuleStore::reloadIfChanged() {
+  std::lock_guard<std::mutex> lock(reloadLock);
+  auto rules = snapshot();
+  auto dllTime = modificationTime(rules->dllMapPath());
+  auto sshTime = modificationTime(rules->sshMapPath());
+  auto patternTime = modificationTime(rules->rulesPath());
+  if (dllTime == dllMapTime && sshTime == sshMapTime && patternTime == rulesTime)
+    return false;
+
+  dllMapTime = dllTime;
+  sshMapTime = sshTime;
+  rulesTime = patternTime;
+  publish(RuleSet::load(rules->dllMapPath(), rules->sshMapPath(),
+                        rules->rulesPath()));
+  return true;
+}
+
+void RuleStore::watch(std::chrono::milliseconds interval) {
+  if (watcher.joinable())
+    return;
+
+  watcher = std::thread([this, interval]() {
+    std::unique_lock<std::mutex> lock(watcherLock);
+    while (!watcherWake.wait_for(lock, interval, [&] { return stopping; })) {
+      lock.unlock();
+      if (reloadIfChanged())
+        std::cerr << "Reloaded rules, generation " << version() << '\n';
+      lock.lock();
+    }
+  });
+}
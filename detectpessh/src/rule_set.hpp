@@ -0,0 +1,209 @@
+#ifndef RULE_SET_H__
+#define RULE_SET_H__
+
+#include "pattern_scanner.hpp"
+#include "rule_language.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// A string rule compiled into the scanner, from whichever list it came from
+struct StringRule {
+  enum Kind : uint8_t { SSHString, ConfigPath, ProtocolString };
+  std::string text;
+  size_t weight;
+  Kind kind;
+};
+
+// Which pattern rule string a scanner pattern after the string rules is
+struct PatternRuleString {
+  uint32_t rule;   // index in RuleSet::patterns()
+  uint32_t string; // index in PatternRule::strings
+  // the PatternRule::placements of the rule that constrain this string
+  std::vector<uint32_t> placements;
+};
+
+/**
+ * The detection rules, loaded from the config files and compiled once.
+ * A RuleSet never changes after load(), so any number of detectors on any
+ * number of threads can share one through a shared_ptr without locking.
+ */
+class RuleSet {
+private:
+  std::string dllMapFilePath;
+  std::string sshMapFilePath;
+  std::string rulesFilePath;
+  std::map<std::string, size_t> sshStringsMap;
+  std::map<std::string, size_t> sshLibrariesMap;
+  // sshLibrariesMap entries by apihash::fnv1aFolded of their name
+  std::unordered_multimap<uint32_t, const std::pair<const std::string, size_t> *>
+      librariesByHash;
+  std::vector<StringRule> stringRules;
+  std::vector<PatternRule> patternRules;
+  std::vector<PatternRuleString> patternRuleStrings;
+  // where the placements of each pattern rule start in placementCount()
+  std::vector<size_t> firstPlacements;
+  PatternScanner stringScanner;
+  size_t maxImportScore{0};
+  size_t totalStringWeight{0};
+  size_t totalPatternRuleWeight{0};
+  uint64_t fingerprint{0};
+
+  RuleSet() = default;
+
+  /**
+   * Loads a map from a file and puts it into map.
+   * If the file does not exist, it sets the default map using the setDeaultMap
+   * function If there is an error while reading the file, it sets the default
+   * map and writes an error message to cerr.
+   *
+   * @param filename the name of the file to read from
+   * @param map the map to put the data into
+   * @param setDefaultMap a function to call if the file does not exist or there
+   * is an error while reading the file
+   */
+  void loadMapFromConfig(const std::string &filename,
+                         std::map<std::string, size_t> &map,
+                         std::function<void()> setDefaultMap);
+  void setDefaultDLLMap();
+  void setDefaultSSHMap();
+
+  /**
+   * Parses the pattern rule file, if there is one. A file with errors is
+   * reported on cerr and ignored as a whole.
+   * @return the contents of the file, for the fingerprint
+   */
+  std::string loadPatternRules(const std::string &filename);
+
+  /**
+   * Compiles the SSH strings, config paths, protocol strings and the
+   * strings of the pattern rules into one case-insensitive scanner matching
+   * both their ASCII and UTF-16LE forms.
+   */
+  void compileStringRules();
+
+public:
+  static constexpr const char *DEFAULT_DLL_MAP = "config/dllMap.conf";
+  static constexpr const char *DEFAULT_SSH_MAP = "config/sshMap.conf";
+  static constexpr const char *DEFAULT_RULES = "config/rules.conf";
+
+  /**
+   * Loads and compiles the rules. Missing or broken config files fall back
+   * to the built-in rules.
+   *
+   * @param dllMapConfigPath library rules, "name = weight" per line
+   * @param sshMapConfigPath string rules, "string = weight" per line
+   * @param rulesPath pattern rules, see rule_language.hpp; optional
+   */
+  static std::shared_ptr<const RuleSet>
+  load(const std::string &dllMapConfigPath, const std::string &sshMapConfigPath,
+       const std::string &rulesPath = DEFAULT_RULES);
+
+  static std::string trimWhiteSpace(const std::string &str);
+
+  const std::string &dllMapPath() const { return dllMapFilePath; }
+  const std::string &sshMapPath() const { return sshMapFilePath; }
+  const std::string &rulesPath() const { return rulesFilePath; }
+  const std::map<std::string, size_t> &sshStrings() const {
+    return sshStringsMap;
+  }
+  const std::map<std::string, size_t> &sshLibraries() const {
+    return sshLibrariesMap;
+  }
+  /**
+   * Looks up a library rule by DLL name, ignoring ASCII case, without
+   * allocating.
+   * @return the rule, nullptr if the library has none
+   */
+  const std::pair<const std::string, size_t> *
+  findLibrary(std::string_view dllName) const;
+  const std::vector<StringRule> &strings() const { return stringRules; }
+  const std::vector<PatternRule> &patterns() const { return patternRules; }
+  // Scanner pattern stringRules.size() + i is patternStrings()[i]
+  const std::vector<PatternRuleString> &patternStrings() const {
+    return patternRuleStrings;
+  }
+  // The placements of every pattern rule, numbered one after the other
+  size_t firstPlacement(size_t rule) const { return firstPlacements[rule]; }
+  size_t placementCount() const {
+    return patternRules.empty() ? 0
+                                : firstPlacements.back() +
+                                      patternRules.back().placements.size();
+  }
+  const PatternScanner &scanner() const { return stringScanner; }
+
+  // Most points the import stage can add: every library and API rule
+  size_t importScoreLimit() const { return maxImportScore; }
+  size_t stringWeight() const { return totalStringWeight; }
+  size_t patternWeight() const { return totalPatternRuleWeight; }
+
+  // Identifies the rules, so cached verdicts made with others are not reused
+  uint64_t rulesFingerprint() const { return fingerprint; }
+};
+
+/**
+ * Publishes the current RuleSet to every detector that uses the store.
+ *
+ * Updates are read-copy-update: a new RuleSet is loaded and compiled off
+ * to the side, then swapped in and the generation counter bumped.
+ * Detectors check the generation, a single atomic load, when they load a
+ * file and only take the new snapshot after it changed, so the lock guarding
+ * the pointer swap is never on the scan path. A scan that is already running
+ * keeps the snapshot it started with, which is freed when its last user
+ * lets go.
+ */
+class RuleStore {
+private:
+  std::shared_ptr<const RuleSet> current;
+  mutable std::mutex currentLock;
+  std::atomic<uint64_t> generation{1};
+
+  std::filesystem::file_time_type dllMapTime{};
+  std::filesystem::file_time_type sshMapTime{};
+  std::filesystem::file_time_type rulesTime{};
+  std::mutex reloadLock; // serialises reloads, never taken by scans
+
+  std::thread watcher;
+  std::mutex watcherLock;
+  std::condition_variable watcherWake;
+  bool stopping{false};
+
+  static std::filesystem::file_time_type modificationTime(
+      const std::string &path);
+
+public:
+  RuleStore(const std::string &dllMapConfigPath,
+            const std::string &sshMapConfigPath,
+            const std::string &rulesPath = RuleSet::DEFAULT_RULES);
+  ~RuleStore();
+  RuleStore(const RuleStore &) = delete;
+  RuleStore &operator=(const RuleStore &) = delete;
+
+  std::shared_ptr<const RuleSet> snapshot() const;
+  uint64_t version() const { return generation.load(std::memory_order_acquire); }
+
+  // Makes rules the current snapshot
+  void publish(std::shared_ptr<const RuleSet> rules);
+
+  /**
+   * Reloads the config files if either changed since the last load.
+   * @return true if a new snapshot was published
+   */
+  bool reloadIfChanged();
+
+  // Polls the config files from a background thread until destruction
+  void watch(std::chrono::milliseconds interval);
+};
+#endif
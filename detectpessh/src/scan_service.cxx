@@ -0,0 +1,477 @@
+#include "scan_service.hpp"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <sstream>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// requests longer than this are refused rather than buffered
+static const size_t MAX_LINE = 4096;
+// descriptors accepted with one read
+static const size_t MAX_PASSED_FDS = 32;
+// responses buffered for a client that does not read them, before it is
+// disconnected
+static const size_t MAX_OUTPUT = 4 << 20;
+// how long responses still buffered at shutdown may take to be sent
+static const std::chrono::seconds FLUSH_TIMEOUT(5);
+
+struct ScanService::Connection {
+  int fd;
+  std::string input;       // received bytes not yet turned into jobs
+  std::deque<int> passed;  // descriptors received, for SCANFD in order
+  bool open{true};         // false once broken, dropped by the event loop
+  bool finished{false};    // the client sent everything it will send
+  std::atomic<size_t> pending{0}; // jobs queued or being scanned
+  std::mutex outputLock;
+  std::string output;      // responses the socket did not take yet
+  bool broken{false};      // a send failed or output overflowed
+
+  // Sends what the socket takes without blocking; outputLock must be held
+  void flush() {
+    size_t sent = 0;
+    while (sent < output.size()) {
+      ssize_t n = ::send(fd, output.data() + sent, output.size() - sent,
+                         MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        break;
+      if (n <= 0) {
+        broken = true; // the client went away
+        output.clear();
+        return;
+      }
+      sent += static_cast<size_t>(n);
+    }
+    output.erase(0, sent);
+  }
+
+  bool isBroken() {
+    std::lock_guard<std::mutex> lock(outputLock);
+    return broken;
+  }
+
+  bool hasOutput() {
+    std::lock_guard<std::mutex> lock(outputLock);
+    return !output.empty();
+  }
+
+  explicit Connection(int socket) : fd(socket) {}
+  ~Connection() {
+    for (int passedFd : passed)
+      ::close(passedFd);
+    ::close(fd);
+  }
+};
+
+ScanService::ScanService(DetectorFactory factory, unsigned threadCount,
+                         size_t maxQueued)
+    : makeDetector(std::move(factory)),
+      workerCount(threadCount != 0
+                      ? threadCount
+                      : std::max(1u, std::thread::hardware_concurrency())),
+      queueDepth(maxQueued != 0 ? maxQueued : 4 * workerCount) {
+  wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+}
+
+ScanService::~ScanService() {
+  stop();
+  {
+    std::lock_guard<std::mutex> lock(queueLock);
+    draining = true;
+  }
+  queueReady.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+
+  if (listenFd >= 0) {
+    ::close(listenFd);
+    ::unlink(socketPath.c_str());
+  }
+  if (wakeFd >= 0)
+    ::close(wakeFd);
+}
+
+bool ScanService::listen(const std::string &path) {
+  sockaddr_un address{};
+  if (path.size() >= sizeof(address.sun_path)) {
+    std::cerr << "Error: Socket path too long: " << path << '\n';
+    return false;
+  }
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+  listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (listenFd < 0) {
+    std::cerr << "Error: socket: " << std::strerror(errno) << '\n';
+    return false;
+  }
+
+  ::unlink(path.c_str());
+  if (::bind(listenFd, reinterpret_cast<sockaddr *>(&address),
+             sizeof(address)) != 0 ||
+      ::listen(listenFd, SOMAXCONN) != 0) {
+    std::cerr << "Error: Cannot listen on " << path << ": "
+              << std::strerror(errno) << '\n';
+    ::close(listenFd);
+    listenFd = -1;
+    return false;
+  }
+  socketPath = path;
+  return true;
+}
+
+void ScanService::stop() {
+  stopping.store(true);
+  wake();
+}
+
+void ScanService::wake() {
+  uint64_t one = 1;
+  [[maybe_unused]] ssize_t written = ::write(wakeFd, &one, sizeof(one));
+}
+
+bool ScanService::queueFull() {
+  std::lock_guard<std::mutex> lock(queueLock);
+  return queue.size() >= queueDepth;
+}
+
+void ScanService::run() {
+  for (unsigned i = 0; i < workerCount; i++)
+    workers.emplace_back([this]() { workerLoop(); });
+
+  std::vector<std::shared_ptr<Connection>> connections;
+  std::vector<pollfd> pollFds;
+  while (!stopping.load()) {
+    // lines left over from a full queue go first, in connection order
+    for (const auto &connection : connections) {
+      if (!dispatch(connection))
+        connection->open = false;
+    }
+    // a connection stays until its jobs are answered and the answers sent;
+    // one that overflowed its output is cut off with its jobs dropped
+    std::erase_if(connections, [](const auto &c) {
+      if (!c->open || c->isBroken()) {
+        ::shutdown(c->fd, SHUT_RDWR);
+        return true;
+      }
+      return c->finished && c->input.find('\n') == std::string::npos &&
+             c->pending.load() == 0 && !c->hasOutput();
+    });
+
+    // with the queue full, nothing is read: clients block on their sends
+    bool reading = !queueFull();
+    pollFds.assign({{wakeFd, POLLIN, 0}, {listenFd, POLLIN, 0}});
+    for (const auto &connection : connections) {
+      short events = reading && !connection->finished ? POLLIN : 0;
+      if (connection->hasOutput())
+        events |= POLLOUT;
+      pollFds.push_back({events != 0 ? connection->fd : -1, events, 0});
+    }
+
+    if (::poll(pollFds.data(), pollFds.size(), -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      std::cerr << "Error: poll: " << std::strerror(errno) << '\n';
+      break;
+    }
+
+    if (pollFds[0].revents & POLLIN) {
+      uint64_t wakeups;
+      [[maybe_unused]] ssize_t read = ::read(wakeFd, &wakeups, sizeof(wakeups));
+    }
+    if (pollFds[1].revents & POLLIN) {
+      int client;
+      // non-blocking, so a client that stops reading its responses holds
+      // neither a worker nor the event loop
+      while ((client = ::accept4(listenFd, nullptr, nullptr,
+                                 SOCK_CLOEXEC | SOCK_NONBLOCK)) >= 0)
+        connections.push_back(std::make_shared<Connection>(client));
+    }
+    for (size_t i = 2; i < pollFds.size(); i++) {
+      Connection &connection = *connections[i - 2];
+      if (pollFds[i].revents & (POLLOUT | POLLERR | POLLHUP)) {
+        std::lock_guard<std::mutex> lock(connection.outputLock);
+        connection.flush();
+      }
+      if ((pollFds[i].events & POLLIN) &&
+          (pollFds[i].revents & (POLLIN | POLLERR | POLLHUP)) &&
+          !receive(connections[i - 2]))
+        connection.open = false;
+    }
+  }
+
+  // finish what was accepted; connections close once their jobs are done
+  {
+    std::lock_guard<std::mutex> lock(queueLock);
+    draining = true;
+  }
+  queueReady.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+  workers.clear();
+
+  // the last responses may still sit in the output buffers
+  auto deadline = std::chrono::steady_clock::now() + FLUSH_TIMEOUT;
+  while (true) {
+    std::erase_if(connections, [](const auto &c) {
+      return !c->open || c->isBroken() || !c->hasOutput();
+    });
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (connections.empty() || left.count() <= 0)
+      break;
+
+    pollFds.clear();
+    for (const auto &connection : connections)
+      pollFds.push_back({connection->fd, POLLOUT, 0});
+    if (::poll(pollFds.data(), pollFds.size(), static_cast<int>(left.count())) <
+            0 &&
+        errno != EINTR)
+      break;
+    for (size_t i = 0; i < pollFds.size(); i++) {
+      if (pollFds[i].revents != 0) {
+        std::lock_guard<std::mutex> lock(connections[i]->outputLock);
+        connections[i]->flush();
+      }
+    }
+  }
+}
+
+bool ScanService::receive(const std::shared_ptr<Connection> &connection) {
+  char buffer[65536];
+  alignas(cmsghdr) char control[CMSG_SPACE(MAX_PASSED_FDS * sizeof(int))];
+  iovec io{buffer, sizeof(buffer)};
+  msghdr message{};
+  message.msg_iov = &io;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  ssize_t received = ::recvmsg(connection->fd, &message,
+                               MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+  if (received < 0)
+    return errno == EAGAIN || errno == EINTR;
+
+  for (cmsghdr *header = CMSG_FIRSTHDR(&message); header != nullptr;
+       header = CMSG_NXTHDR(&message, header)) {
+    if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+      continue;
+    size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (size_t i = 0; i < count; i++) {
+      int passedFd;
+      std::memcpy(&passedFd, CMSG_DATA(header) + i * sizeof(int),
+                  sizeof(int));
+      connection->passed.push_back(passedFd);
+    }
+  }
+  // a client shutting down its sending side still gets its responses
+  if (received == 0) {
+    connection->finished = true;
+    return true;
+  }
+
+  connection->input.append(buffer, static_cast<size_t>(received));
+  return dispatch(connection);
+}
+
+bool ScanService::dispatch(const std::shared_ptr<Connection> &connection) {
+  std::string &input = connection->input;
+  size_t begin = 0;
+  size_t end;
+  while ((end = input.find('\n', begin)) != std::string::npos) {
+    std::string_view line(input.data() + begin, end - begin);
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+
+    size_t space = line.find(' ');
+    std::string_view command = line.substr(0, space);
+    if (command == "STATS") {
+      reply(*connection, statsLine());
+      begin = end + 1;
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(queueLock);
+    if (queue.size() >= queueDepth)
+      break;
+
+    Job job;
+    job.connection = connection;
+    job.received = std::chrono::steady_clock::now();
+    std::string_view arguments =
+        space == std::string_view::npos ? "" : line.substr(space + 1);
+    size_t idEnd = arguments.find(' ');
+    job.id = arguments.substr(0, idEnd);
+
+    if (command == "SCAN" && idEnd != std::string_view::npos) {
+      job.path = arguments.substr(idEnd + 1);
+    } else if (command == "FIND" && corpusStrings != nullptr &&
+               idEnd != std::string_view::npos) {
+      job.query = arguments.substr(idEnd + 1);
+    } else if (command == "SCANFD" && !job.id.empty() &&
+               idEnd == std::string_view::npos &&
+               !connection->passed.empty()) {
+      job.fd = connection->passed.front();
+      connection->passed.pop_front();
+    } else {
+      lock.unlock();
+      std::ostringstream error;
+      error << "{\"id\":";
+      writeJsonString(error, job.id);
+      error << ",\"error\":\"bad request\"}";
+      reply(*connection, error.str());
+      failed++;
+      begin = end + 1;
+      continue;
+    }
+    connection->pending++;
+    queue.push_back(std::move(job));
+    lock.unlock();
+    queueReady.notify_one();
+    begin = end + 1;
+  }
+  input.erase(0, begin);
+  return input.size() <= MAX_LINE || input.find('\n') != std::string::npos;
+}
+
+void ScanService::workerLoop() {
+  std::unique_ptr<PESSHDetector> detector = makeDetector();
+  for (;;) {
+    Job job;
+    bool wasFull;
+    {
+      std::unique_lock<std::mutex> lock(queueLock);
+      queueReady.wait(lock, [&] { return !queue.empty() || draining; });
+      if (queue.empty())
+        return;
+      wasFull = queue.size() >= queueDepth;
+      job = std::move(queue.front());
+      queue.pop_front();
+    }
+    // the event loop stopped reading when the queue filled up
+    if (wasFull)
+      wake();
+
+    Connection &connection = *job.connection;
+    // its answers would be thrown away
+    if (connection.isBroken()) {
+      if (job.fd >= 0)
+        ::close(job.fd);
+      connection.pending--;
+      continue;
+    }
+
+    if (!job.query.empty()) {
+      reply(connection, findLine(job));
+      // the event loop closes a finished connection once nothing is left
+      if (--connection.pending == 0)
+        wake();
+      continue;
+    }
+
+    bool loaded = job.fd >= 0 ? detector->loadPEFile(job.fd)
+                              : detector->loadPEFile(job.path);
+    if (job.fd >= 0)
+      ::close(job.fd);
+
+    std::ostringstream response;
+    response << "{\"id\":";
+    writeJsonString(response, job.id);
+    if (loaded) {
+      bool sshClient = detector->isSSHClient();
+      uint64_t micros =
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - job.received)
+              .count();
+      response << ",\"ssh_client\":" << (sshClient ? "true" : "false")
+               << ",\"confidence\":" << detector->getConfidence()
+               << ",\"stage\":\"" << stageName(detector->getLastStage())
+               << "\",\"us\":" << micros << '}';
+      latency.record(micros);
+      completed++;
+      if (corpusStrings != nullptr)
+        corpusStrings->add(job.fd >= 0 ? "fd:" + job.id : job.path,
+                           detector->getStringIndex());
+    } else {
+      response << ",\"error\":\"cannot load file\"}";
+      failed++;
+    }
+    reply(connection, response.str());
+    if (--connection.pending == 0)
+      wake();
+  }
+}
+
+void ScanService::reply(Connection &connection, const std::string &line) {
+  bool waiting;
+  {
+    std::lock_guard<std::mutex> lock(connection.outputLock);
+    if (connection.broken)
+      return;
+    // behind buffered responses, a direct send would overtake them
+    bool queued = !connection.output.empty();
+    connection.output += line;
+    connection.output += '\n';
+    if (!queued)
+      connection.flush();
+    if (connection.output.size() > MAX_OUTPUT) {
+      connection.broken = true; // not reading, the event loop drops it
+      connection.output.clear();
+    }
+    waiting = queued || !connection.output.empty() || connection.broken;
+  }
+  // the event loop polls for POLLOUT, or disconnects the client
+  if (waiting)
+    wake();
+}
+
+void ScanService::setCorpusStrings(CorpusStrings *strings) {
+  corpusStrings = strings;
+}
+
+std::string ScanService::findLine(const Job &job) {
+  std::vector<std::string> files = corpusStrings->find(job.query);
+  std::ostringstream line;
+  line << "{\"id\":";
+  writeJsonString(line, job.id);
+  line << ",\"files\":[";
+  for (size_t i = 0; i < files.size(); i++) {
+    line << (i ? "," : "");
+    writeJsonString(line, files[i]);
+  }
+  line << "]}";
+  return line.str();
+}
+
+std::string ScanService::statsLine() {
+  size_t queued;
+  {
+    std::lock_guard<std::mutex> lock(queueLock);
+    queued = queue.size();
+  }
+  std::ostringstream line;
+  line << "{\"completed\":" << completed.load()
+       << ",\"failed\":" << failed.load() << ",\"queued\":" << queued
+       << ",\"p50_us\":" << latency.percentile(0.5)
+       << ",\"p99_us\":" << latency.percentile(0.99)
+       << ",\"p999_us\":" << latency.percentile(0.999)
+       << ",\"max_us\":" << latency.max() << '}';
+  return line.str();
+}
+
+void ScanService::printStats(std::ostream &out) const {
+  out << "\n=== Scan service ===\n"
+      << "Requests: " << completed.load() << " completed, " << failed.load()
+      << " failed\n"
+      << "Latency: p50 " << latency.percentile(0.5) << " us, p99 "
+      << latency.percentile(0.99) << " us, p999 " << latency.percentile(0.999)
+      << " us, max " << latency.max() << " us" << std::endl;
+  if (corpusStrings != nullptr)
+    out << "Strings: " << corpusStrings->stringCount() << " distinct in "
+        << corpusStrings->sampleCount() << " files" << std::endl;
+}
@@ -0,0 +1,143 @@
+#ifndef SCAN_SERVICE_H__
+#define SCAN_SERVICE_H__
+
+#include "detectpessh.hpp"
+#include "latency_histogram.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Long-lived scanner serving requests over a Unix domain socket, so that
+ * rules are compiled and detectors warmed up once rather than per file.
+ *
+ * Requests and responses are lines. A client may send any number of
+ * requests without waiting; responses carry the request id and come back
+ * in completion order:
+ *
+ *   SCAN <id> <path>   analyse a file by path
+ *   SCANFD <id>        analyse the file descriptor passed with SCM_RIGHTS
+ *                      in the same sendmsg() as this line
+ *   STATS              request counters and latency percentiles
+ *   FIND <id> <text>   files scanned so far holding a string that contains
+ *                      text, when the service collects strings
+ *
+ *   {"id":"7","ssh_client":true,"confidence":65,"stage":"imports","us":412}
+ *   {"id":"8","error":"cannot load file"}
+ *   {"id":"9","files":["/srv/in/putty.exe"]}
+ *
+ * One event loop thread reads requests into a bounded queue drained by a
+ * pool of worker threads, each with its own detector. While the queue is
+ * full the loop stops reading, so clients block in the kernel socket
+ * buffers instead of the service buffering without bound.
+ *
+ * Client sockets are non-blocking. Responses the socket does not take at
+ * once wait in a bounded buffer per connection, which the event loop
+ * flushes when the socket becomes writable; a client that lets it overflow
+ * by not reading is disconnected, so it never holds a worker or the loop.
+ */
+class ScanService {
+public:
+  // creates the detector a worker thread analyses with
+  using DetectorFactory = std::function<std::unique_ptr<PESSHDetector>()>;
+
+private:
+  struct Connection;
+
+  struct Job {
+    std::shared_ptr<Connection> connection;
+    std::string id;
+    std::string path;
+    int fd{-1}; // passed descriptor, closed after the scan
+    std::string query; // FIND
+    std::chrono::steady_clock::time_point received;
+  };
+
+  DetectorFactory makeDetector;
+  CorpusStrings *corpusStrings{nullptr};
+  unsigned workerCount;
+  size_t queueDepth;
+
+  int listenFd{-1};
+  int wakeFd{-1}; // eventfd: stop() and queue space wake the event loop
+  std::string socketPath;
+  std::atomic<bool> stopping{false};
+
+  std::deque<Job> queue;
+  std::mutex queueLock;
+  std::condition_variable queueReady;
+  bool draining{false}; // no more jobs will be queued
+  std::vector<std::thread> workers;
+
+  LatencyHistogram latency;
+  std::atomic<uint64_t> completed{0};
+  std::atomic<uint64_t> failed{0};
+
+  void workerLoop();
+  void wake();
+
+  /**
+   * Reads what a connection sent and queues its complete requests.
+   * @return false once the connection is finished with
+   */
+  bool receive(const std::shared_ptr<Connection> &connection);
+
+  /**
+   * Turns the buffered lines of a connection into jobs while the queue has
+   * room; what is left waits for the next round.
+   * @return false if the connection sent something invalid
+   */
+  bool dispatch(const std::shared_ptr<Connection> &connection);
+
+  bool queueFull();
+  std::string findLine(const Job &job);
+  // Sends a response line, or buffers it until the socket takes it
+  void reply(Connection &connection, const std::string &line);
+  std::string statsLine();
+
+public:
+  /**
+   * @param factory creates one detector per worker thread
+   * @param threadCount worker threads, 0 for one per hardware thread
+   * @param maxQueued requests queued before the service stops reading,
+   * 0 for four per worker
+   */
+  explicit ScanService(DetectorFactory factory, unsigned threadCount = 0,
+                       size_t maxQueued = 0);
+  ~ScanService();
+  ScanService(const ScanService &) = delete;
+  ScanService &operator=(const ScanService &) = delete;
+
+  /**
+   * Collects the strings of every scanned file into strings, which must
+   * outlive the service, and answers FIND from them. The detectors need
+   * string indexing turned on.
+   */
+  void setCorpusStrings(CorpusStrings *strings);
+
+  /**
+   * Creates the socket, replacing a stale one left by a previous run.
+   * @return false if the socket cannot be created, with the reason on cerr
+   */
+  bool listen(const std::string &path);
+
+  // Serves until stop(), then finishes the queued requests and returns
+  void run();
+
+  // Makes run() return. Async-signal-safe.
+  void stop();
+
+  // Requests served, failures and latency percentiles
+  void printStats(std::ostream &out) const;
+};
+#endif
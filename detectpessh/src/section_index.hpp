@@ -0,0 +1,166 @@
+// Sorted interval index for RVA to file offset translation
+#include "pe_headers.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <vector>
+#ifndef SECTION_INDEX_H__
+#define SECTION_INDEX_H__
+
+class SectionIndex {
+private:
+  struct Interval {
+    uint32_t virtualStart;
+    uint32_t virtualEnd; // exclusive, start + VirtualSize
+    uint32_t rawOffset;
+    uint32_t rawSize; // bytes of the section actually backed by the file
+  };
+
+  std::vector<Interval> intervals; // disjoint, by virtualStart
+  uint32_t headersSize{0};
+  // most translations in a row hit the same section (thunks, names)
+  mutable size_t lastHit{0};
+
+  // Adds [start, end) of section, which no earlier section covers. Its raw
+  // size still counts to the end of the section's file data, so a range
+  // may run on into the part an earlier section owns, as it could before.
+  void addPart(const Interval &section, uint32_t start, uint32_t end) {
+    uint32_t skipped = start - section.virtualStart;
+    uint32_t rawSize =
+        section.rawSize > skipped ? section.rawSize - skipped : 0;
+    uint32_t rawOffset = rawSize != 0 ? section.rawOffset + skipped : 0;
+    intervals.push_back({start, end, rawOffset, rawSize});
+  }
+
+public:
+  /**
+   * Rebuilds the index from a section table.
+   *
+   * A section occupies [VirtualAddress, VirtualAddress + VirtualSize) in
+   * memory (SizeOfRawData when VirtualSize is 0), but only the first
+   * min(VirtualSize, SizeOfRawData) bytes of it come from the file, the rest
+   * is zero fill. Raw data running past the end of the file is clipped.
+   *
+   * @param readSection callback reading section i into a SECTION_HEADER
+   * @param count number of sections in the table
+   * @param sizeOfHeaders SizeOfHeaders, RVAs below it map 1:1 to the file
+   * @param size size of the file in bytes
+   * @param imageLayout the bytes are a loaded image (memory dump), sections
+   * sit at their VirtualAddress instead of PointerToRawData
+   */
+  template <typename ReadSection>
+  void build(ReadSection readSection, size_t count, uint32_t sizeOfHeaders,
+             size_t size, bool imageLayout = false) {
+    intervals.clear();
+    lastHit = 0;
+    headersSize = static_cast<uint32_t>(std::min<size_t>(sizeOfHeaders, size));
+
+    std::vector<Interval> sections; // in table order
+    SECTION_HEADER section;
+    for (size_t i = 0; i < count; i++) {
+      if (!readSection(i, section))
+        break;
+
+      uint64_t virtualSize =
+          section.VirtualSize != 0 ? section.VirtualSize : section.SizeOfRawData;
+      uint32_t rawOffset =
+          imageLayout ? section.VirtualAddress : section.PointerToRawData;
+      uint64_t rawSize =
+          imageLayout ? virtualSize
+                      : std::min<uint64_t>(virtualSize, section.SizeOfRawData);
+      if (rawOffset >= size)
+        rawSize = 0;
+      else
+        rawSize = std::min<uint64_t>(rawSize, size - rawOffset);
+
+      uint64_t virtualEnd =
+          std::min<uint64_t>(uint64_t(section.VirtualAddress) + virtualSize,
+                             UINT32_MAX);
+      if (virtualEnd <= section.VirtualAddress)
+        continue;
+
+      sections.push_back({section.VirtualAddress,
+                          static_cast<uint32_t>(virtualEnd), rawOffset,
+                          static_cast<uint32_t>(rawSize)});
+    }
+
+    // Sections may overlap, and an RVA belongs to the first section in the
+    // table that contains it. Each section gets the parts of its range that
+    // no earlier section covers, so the intervals are disjoint and one
+    // binary search finds the owner.
+    std::map<uint32_t, uint32_t> covered; // start -> end, earlier sections
+    for (const Interval &section : sections) {
+      auto it = covered.upper_bound(section.virtualStart);
+      if (it != covered.begin() &&
+          std::prev(it)->second >= section.virtualStart)
+        --it;
+
+      uint32_t cursor = section.virtualStart;
+      uint32_t mergedStart = section.virtualStart;
+      uint32_t mergedEnd = section.virtualEnd;
+      while (it != covered.end() && it->first <= section.virtualEnd) {
+        if (cursor < it->first)
+          addPart(section, cursor, it->first);
+        cursor = std::max(cursor, it->second);
+        mergedStart = std::min(mergedStart, it->first);
+        mergedEnd = std::max(mergedEnd, it->second);
+        it = covered.erase(it);
+      }
+      if (cursor < section.virtualEnd)
+        addPart(section, cursor, section.virtualEnd);
+      covered[mergedStart] = mergedEnd;
+    }
+
+    std::sort(intervals.begin(), intervals.end(),
+              [](const Interval &a, const Interval &b) {
+                return a.virtualStart < b.virtualStart;
+              });
+  }
+
+  size_t size() const { return intervals.size(); }
+
+  /**
+   * Translates an RVA range to a file offset.
+   *
+   * @param rva Relative Virtual Address to translate
+   * @param length number of bytes that must be file backed from rva
+   * @return file offset of rva, or 0 if any of the range is not in the file
+   */
+  uint32_t translate(uint32_t rva, uint32_t length = 1) const {
+    if (intervals.empty() || rva < intervals.front().virtualStart) {
+      if (uint64_t(rva) + length <= headersSize)
+        return rva;
+      if (intervals.empty())
+        return 0;
+    }
+
+    const Interval *hit = nullptr;
+    const Interval &cached = intervals[lastHit < intervals.size() ? lastHit : 0];
+    if (rva >= cached.virtualStart && rva < cached.virtualEnd) {
+      hit = &cached;
+    } else {
+      auto it = std::upper_bound(intervals.begin(), intervals.end(), rva,
+                                 [](uint32_t value, const Interval &interval) {
+                                   return value < interval.virtualStart;
+                                 });
+      // the intervals are disjoint: only the last one starting at or before
+      // rva can hold it
+      if (it != intervals.begin() && rva < std::prev(it)->virtualEnd) {
+        --it;
+        hit = &*it;
+        lastHit = static_cast<size_t>(it - intervals.begin());
+      }
+    }
+
+    if (hit == nullptr)
+      return 0;
+
+    uint64_t delta = rva - hit->virtualStart;
+    if (delta + length > hit->rawSize)
+      return 0; // zero fill or beyond the end of the file
+    return static_cast<uint32_t>(hit->rawOffset + delta);
+  }
+};
+#endif
@@ -0,0 +1,244 @@
+#include "similarity_index.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+
+namespace {
+constexpr char INDEX_MAGIC[8] = {'P', 'E', 'S', 'S', 'H', 'I', 'D', 'X'};
+constexpr uint32_t INDEX_VERSION = 2;
+} // namespace
+
+uint32_t SimilarityIndex::bandKey(const FuzzyDigest &digest, size_t band) {
+  constexpr size_t bandBytes = FuzzyDigest::BODY_SIZE / BANDS;
+  uint32_t key = 0;
+  std::memcpy(&key, digest.body.data() + band * bandBytes, bandBytes);
+  return key;
+}
+
+bool SimilarityIndex::write(const std::string &path,
+                            const std::vector<KnownSample> &samples) {
+  const uint32_t count = static_cast<uint32_t>(samples.size());
+
+  std::vector<Entry> entries(count);
+  std::vector<ImphashKey> imphashes;
+  std::string labels;
+  std::vector<Posting> postings[BANDS];
+
+  for (uint32_t i = 0; i < count; i++) {
+    const KnownSample &sample = samples[i];
+    Entry &entry = entries[i];
+    std::memset(&entry, 0, sizeof(Entry));
+
+    if (sample.fuzzy.valid) {
+      sample.fuzzy.encode(entry.fuzzy);
+      entry.flags |= 1;
+      for (size_t band = 0; band < BANDS; band++)
+        postings[band].push_back({bandKey(sample.fuzzy, band), i});
+    }
+    if (sample.hasImphash) {
+      std::memcpy(entry.imphash, sample.imphash.data(), 16);
+      entry.flags |= 2;
+      ImphashKey key;
+      std::memcpy(key.imphash, sample.imphash.data(), 16);
+      key.entry = i;
+      imphashes.push_back(key);
+    }
+
+    entry.labelOffset = static_cast<uint32_t>(labels.size());
+    labels += sample.label;
+    labels += '\0';
+  }
+
+  for (auto &band : postings) {
+    std::sort(band.begin(), band.end(), [](const Posting &a, const Posting &b) {
+      return a.key != b.key ? a.key < b.key : a.entry < b.entry;
+    });
+    // bands are fixed size so they can be addressed without a table
+    band.resize(count, Posting{UINT32_MAX, UINT32_MAX});
+  }
+  std::sort(imphashes.begin(), imphashes.end(),
+            [](const ImphashKey &a, const ImphashKey &b) {
+              return std::memcmp(a.imphash, b.imphash, 16) < 0;
+            });
+  imphashes.resize(count, ImphashKey{{0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                      0xFF, 0xFF, 0xFF, 0xFF},
+                                     UINT32_MAX});
+
+  Header header{};
+  std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  header.version = INDEX_VERSION;
+  header.count = count;
+  header.entriesOffset = sizeof(Header);
+  header.postingsOffset = header.entriesOffset + uint64_t(count) * sizeof(Entry);
+  header.imphashOffset =
+      header.postingsOffset + uint64_t(BANDS) * count * sizeof(Posting);
+  header.labelsOffset =
+      header.imphashOffset + uint64_t(count) * sizeof(ImphashKey);
+  header.labelsSize = labels.size();
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out)
+    return false;
+
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(entries.data()),
+            entries.size() * sizeof(Entry));
+  for (const auto &band : postings)
+    out.write(reinterpret_cast<const char *>(band.data()),
+              band.size() * sizeof(Posting));
+  out.write(reinterpret_cast<const char *>(imphashes.data()),
+            imphashes.size() * sizeof(ImphashKey));
+  out.write(labels.data(), labels.size());
+  return static_cast<bool>(out);
+}
+
+bool SimilarityIndex::open(const std::string &path) {
+  bytes = ByteView();
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 || !mappedFile.open(path))
+    return false;
+
+  ByteView view(mappedFile.data(), mappedFile.size());
+  Header candidate;
+  if (!view.read(0, candidate) ||
+      std::memcmp(candidate.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+      candidate.version != INDEX_VERSION)
+    return false;
+
+  const uint64_t count = candidate.count;
+  if (candidate.entriesOffset != sizeof(Header) ||
+      candidate.postingsOffset !=
+          candidate.entriesOffset + count * sizeof(Entry) ||
+      candidate.imphashOffset !=
+          candidate.postingsOffset + BANDS * count * sizeof(Posting) ||
+      candidate.labelsOffset !=
+          candidate.imphashOffset + count * sizeof(ImphashKey) ||
+      !view.contains(candidate.labelsOffset, candidate.labelsSize))
+    return false;
+
+  header = candidate;
+  bytes = view;
+  fileIdentity = 14695981039346656037ull;
+  for (uint64_t value :
+       {uint64_t(st.st_dev), uint64_t(st.st_ino), uint64_t(st.st_size),
+        uint64_t(st.st_mtim.tv_sec), uint64_t(st.st_mtim.tv_nsec)}) {
+    fileIdentity ^= value;
+    fileIdentity *= 1099511628211ull;
+  }
+  return true;
+}
+
+bool SimilarityIndex::readEntry(uint32_t index, Entry &entry) const {
+  return index < header.count &&
+         bytes.read(header.entriesOffset + uint64_t(index) * sizeof(Entry),
+                    entry);
+}
+
+std::string_view SimilarityIndex::label(const Entry &entry) const {
+  if (entry.labelOffset >= header.labelsSize)
+    return {};
+  std::string_view str = bytes.cstring(header.labelsOffset + entry.labelOffset);
+  return str.substr(0, header.labelsSize - entry.labelOffset);
+}
+
+std::optional<SimilarityMatch>
+SimilarityIndex::lookup(const FuzzyDigest &fuzzy, const Imphash *imphash,
+                        int maxDistance) const {
+  if (!isOpen() || header.count == 0)
+    return std::nullopt;
+
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> imphashHits;
+
+  if (fuzzy.valid && header.count <= LINEAR_SCAN_LIMIT) {
+    for (uint32_t i = 0; i < header.count; i++)
+      candidates.push_back(i);
+  } else if (fuzzy.valid) {
+    for (size_t band = 0; band < BANDS; band++) {
+      const uint32_t key = bandKey(fuzzy, band);
+      const uint64_t base =
+          header.postingsOffset + uint64_t(band) * header.count * sizeof(Posting);
+      auto keyAt = [&](uint32_t i) {
+        return bytes.get<Posting>(base + uint64_t(i) * sizeof(Posting)).key;
+      };
+
+      // lower bound of key in the band's sorted posting list
+      uint32_t lo = 0, hi = header.count;
+      while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (keyAt(mid) < key)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+      for (size_t taken = 0;
+           lo < header.count && taken < MAX_CANDIDATES_PER_BAND; lo++, taken++) {
+        Posting posting =
+            bytes.get<Posting>(base + uint64_t(lo) * sizeof(Posting));
+        if (posting.key != key)
+          break;
+        candidates.push_back(posting.entry);
+      }
+    }
+  }
+
+  if (imphash != nullptr) {
+    auto compareAt = [&](uint32_t i) {
+      ImphashKey entry = bytes.get<ImphashKey>(header.imphashOffset +
+                                               uint64_t(i) * sizeof(ImphashKey));
+      return std::memcmp(entry.imphash, imphash->data(), 16);
+    };
+    uint32_t lo = 0, hi = header.count;
+    while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      if (compareAt(mid) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    for (size_t taken = 0;
+         lo < header.count && taken < MAX_CANDIDATES_PER_BAND &&
+         compareAt(lo) == 0;
+         lo++, taken++) {
+      imphashHits.push_back(bytes
+                                .get<ImphashKey>(header.imphashOffset +
+                                                 uint64_t(lo) *
+                                                     sizeof(ImphashKey))
+                                .entry);
+    }
+    candidates.insert(candidates.end(), imphashHits.begin(), imphashHits.end());
+    std::sort(imphashHits.begin(), imphashHits.end());
+  }
+
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                   candidates.end());
+
+  std::optional<SimilarityMatch> best;
+  Entry entry;
+  for (uint32_t index : candidates) {
+    if (!readEntry(index, entry))
+      continue;
+
+    bool imphashMatch =
+        std::binary_search(imphashHits.begin(), imphashHits.end(), index);
+    // -1 when there is no digest on one of the two sides
+    int distance = (fuzzy.valid && (entry.flags & 1))
+                       ? FuzzyDigest::distance(
+                             fuzzy, FuzzyDigest::decode(entry.fuzzy))
+                       : -1;
+    if (!imphashMatch && (distance < 0 || distance > maxDistance))
+      continue;
+
+    auto rank = [](const SimilarityMatch &match) {
+      return std::make_pair(!match.imphashMatch,
+                            match.distance < 0 ? INT32_MAX : match.distance);
+    };
+    SimilarityMatch match{label(entry), distance, imphashMatch};
+    if (!best || rank(match) < rank(*best))
+      best = match;
+  }
+  return best;
+}
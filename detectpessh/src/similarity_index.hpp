@@ -0,0 +1,124 @@
+#ifndef SIMILARITY_INDEX_H__
+#define SIMILARITY_INDEX_H__
+
+#include "fuzzy_hash.hpp"
+#include "mapped_file.hpp"
+#include "pe_view.hpp"
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using Imphash = std::array<uint8_t, 16>;
+
+// A reference binary, e.g. "PuTTY 0.81 x64"
+struct KnownSample {
+  std::string label;
+  Imphash imphash{};
+  bool hasImphash{false};
+  FuzzyDigest fuzzy;
+};
+
+struct SimilarityMatch {
+  std::string_view label;
+  int distance;
+  bool imphashMatch;
+};
+
+/**
+ * On-disk index of known SSH client builds, memory mapped for lookups.
+ *
+ * Entries are found by exact imphash (binary search over a sorted table) and
+ * by fuzzy digest similarity. For the latter the 32 byte digest body is cut
+ * into BANDS bands; each band has a posting list sorted by band value, and
+ * only entries sharing at least one band value with the query are compared
+ * with the full distance. Lookups cost a handful of binary searches no
+ * matter how many samples the index holds. Banding can miss a digest that
+ * differs a little in every band, so indexes of up to LINEAR_SCAN_LIMIT
+ * samples, where comparing every entry is cheap, are searched exhaustively.
+ *
+ * Layout (little endian): Header, Entry[count], Posting[BANDS][count],
+ * ImphashKey[count], label strings.
+ */
+class SimilarityIndex {
+public:
+  // 2 byte bands: 8 bucket codes each
+  static constexpr size_t BANDS = 16;
+  static constexpr size_t LINEAR_SCAN_LIMIT = 4096;
+  // upper bound on fuzzy candidates taken from a single band
+  static constexpr size_t MAX_CANDIDATES_PER_BAND = 256;
+
+private:
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t entriesOffset;
+    uint64_t postingsOffset;
+    uint64_t imphashOffset;
+    uint64_t labelsOffset;
+    uint64_t labelsSize;
+  } __attribute__((packed));
+
+  struct Entry {
+    uint8_t fuzzy[FuzzyDigest::ENCODED_SIZE];
+    uint8_t flags; // bit 0: fuzzy valid, bit 1: imphash valid
+    uint8_t imphash[16];
+    uint32_t labelOffset;
+  } __attribute__((packed));
+
+  struct Posting {
+    uint32_t key;
+    uint32_t entry;
+  } __attribute__((packed));
+
+  struct ImphashKey {
+    uint8_t imphash[16];
+    uint32_t entry;
+  } __attribute__((packed));
+
+  MappedFile mappedFile;
+  ByteView bytes;
+  Header header{};
+  uint64_t fileIdentity{0};
+
+  static uint32_t bandKey(const FuzzyDigest &digest, size_t band);
+  bool readEntry(uint32_t index, Entry &entry) const;
+  std::string_view label(const Entry &entry) const;
+
+public:
+  /**
+   * Writes an index file for the given samples.
+   *
+   * @param path the index file to create
+   * @param samples the reference binaries
+   * @return true if the file was written, false otherwise
+   */
+  static bool write(const std::string &path,
+                    const std::vector<KnownSample> &samples);
+
+  /**
+   * Maps an index file written by write().
+   * @return true if the file is a valid index, false otherwise
+   */
+  bool open(const std::string &path);
+  bool isOpen() const { return !bytes.empty(); }
+  size_t size() const { return header.count; }
+  // Changes whenever the index file is rebuilt: device, inode, size and
+  // modification time of the file that was opened
+  uint64_t identity() const { return fileIdentity; }
+
+  /**
+   * Finds the closest known sample.
+   *
+   * @param fuzzy digest of the binary being analysed
+   * @param imphash imphash of the binary, or nullptr if it has none
+   * @param maxDistance fuzzy matches further away than this are ignored
+   * @return the best match, imphash matches first, or std::nullopt
+   */
+  std::optional<SimilarityMatch> lookup(const FuzzyDigest &fuzzy,
+                                        const Imphash *imphash,
+                                        int maxDistance) const;
+};
+#endif
@@ -0,0 +1,235 @@
+#include "string_extractor.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const size_t BLOCK = 64;
+// blocks classified per call, 4 KB
+const size_t BATCH = 64;
+
+// Bit i is set if byte i of the block is printable, or zero
+struct BlockMasks {
+  uint64_t printable;
+  uint64_t zero;
+};
+
+inline bool isPrintable(uint8_t c) {
+  return (c >= 0x20 && c < 0x7f) || c == '\t';
+}
+
+void classifyScalar(const uint8_t *data, size_t size, BlockMasks &out) {
+  out = {0, 0};
+  for (size_t i = 0; i < size; i++) {
+    out.printable |= uint64_t(isPrintable(data[i])) << i;
+    out.zero |= uint64_t(data[i] == 0) << i;
+  }
+}
+
+#if defined(__x86_64__)
+// SSE2 is part of the x86_64 baseline. Bytes from 0x80 are negative as
+// signed bytes, so two signed compares bound the printable range.
+void classifySSE2(const uint8_t *data, size_t blocks, BlockMasks *out) {
+  const __m128i low = _mm_set1_epi8(0x1f);
+  const __m128i high = _mm_set1_epi8(0x7f);
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i zero = _mm_setzero_si128();
+  for (size_t b = 0; b < blocks; b++) {
+    uint64_t printable = 0;
+    uint64_t zeros = 0;
+    for (int part = 0; part < 4; part++) {
+      __m128i v = _mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(data + b * BLOCK + part * 16));
+      __m128i p = _mm_or_si128(
+          _mm_and_si128(_mm_cmpgt_epi8(v, low), _mm_cmplt_epi8(v, high)),
+          _mm_cmpeq_epi8(v, tab));
+      printable |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(p)))
+                   << (part * 16);
+      zeros |= uint64_t(static_cast<uint16_t>(
+                   _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero))))
+               << (part * 16);
+    }
+    out[b] = {printable, zeros};
+  }
+}
+
+__attribute__((target("avx2"))) void
+classifyAVX2(const uint8_t *data, size_t blocks, BlockMasks *out) {
+  const __m256i low = _mm256_set1_epi8(0x1f);
+  const __m256i high = _mm256_set1_epi8(0x7f);
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i zero = _mm256_setzero_si256();
+  for (size_t b = 0; b < blocks; b++) {
+    uint64_t printable = 0;
+    uint64_t zeros = 0;
+    for (int part = 0; part < 2; part++) {
+      __m256i v = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i *>(data + b * BLOCK + part * 32));
+      __m256i p = _mm256_or_si256(
+          _mm256_and_si256(_mm256_cmpgt_epi8(v, low),
+                           _mm256_cmpgt_epi8(high, v)),
+          _mm256_cmpeq_epi8(v, tab));
+      printable |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(p)))
+                   << (part * 32);
+      zeros |= uint64_t(static_cast<uint32_t>(
+                   _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero))))
+               << (part * 32);
+    }
+    out[b] = {printable, zeros};
+  }
+}
+
+__attribute__((target("avx512bw"))) void
+classifyAVX512(const uint8_t *data, size_t blocks, BlockMasks *out) {
+  const __m512i low = _mm512_set1_epi8(0x1f);
+  const __m512i high = _mm512_set1_epi8(0x7f);
+  const __m512i tab = _mm512_set1_epi8('\t');
+  for (size_t b = 0; b < blocks; b++) {
+    __m512i v = _mm512_loadu_si512(data + b * BLOCK);
+    uint64_t printable = (_mm512_cmpgt_epi8_mask(v, low) &
+                          _mm512_cmplt_epi8_mask(v, high)) |
+                         _mm512_cmpeq_epi8_mask(v, tab);
+    out[b] = {printable, _mm512_testn_epi8_mask(v, v)};
+  }
+}
+#endif
+
+void classifyBlocks(const uint8_t *data, size_t blocks, BlockMasks *out) {
+#if defined(__x86_64__)
+  static const bool hasAVX512 = __builtin_cpu_supports("avx512bw");
+  static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+  if (hasAVX512)
+    classifyAVX512(data, blocks, out);
+  else if (hasAVX2)
+    classifyAVX2(data, blocks, out);
+  else
+    classifySSE2(data, blocks, out);
+#else
+  for (size_t b = 0; b < blocks; b++)
+    classifyScalar(data + b * BLOCK, BLOCK, out[b]);
+#endif
+}
+
+// Packs the even bits of x: bit 2k moves to bit k
+inline uint64_t evenBits(uint64_t x) {
+  x &= 0x5555555555555555ull;
+  x = (x | (x >> 1)) & 0x3333333333333333ull;
+  x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0full;
+  x = (x | (x >> 4)) & 0x00ff00ff00ff00ffull;
+  x = (x | (x >> 8)) & 0x0000ffff0000ffffull;
+  x = (x | (x >> 16)) & 0x00000000ffffffffull;
+  return x;
+}
+
+// Follows the runs of one encoding and alignment across blocks
+class RunTracker {
+private:
+  static constexpr size_t NONE = SIZE_MAX;
+
+  ByteView bytes;
+  size_t stride;
+  PatternScanner::Encoding encoding;
+  size_t minLength;
+  const std::function<void(const ExtractedString &)> &onString;
+  size_t start{NONE};
+
+  void emit(size_t end) {
+    size_t length = (end - start) / stride;
+    if (length >= minLength)
+      onString({bytes.data() + start, start, length, encoding});
+    start = NONE;
+  }
+
+public:
+  RunTracker(ByteView bytes, size_t stride, PatternScanner::Encoding encoding,
+             size_t minLength,
+             const std::function<void(const ExtractedString &)> &onString)
+      : bytes(bytes), stride(stride), encoding(encoding),
+        minLength(minLength), onString(onString) {}
+
+  /**
+   * @param mask bit k set if the character at base + k * stride is printable
+   * @param count positions in mask, at most 64
+   */
+  void feed(uint64_t mask, unsigned count, size_t base) {
+    const uint64_t valid = count == 64 ? ~0ull : (1ull << count) - 1;
+    unsigned k = 0;
+    while (k < count) {
+      if (start == NONE) {
+        uint64_t rest = (mask & valid) >> k;
+        if (rest == 0)
+          return;
+        k += __builtin_ctzll(rest);
+        start = base + k * stride;
+      }
+      uint64_t gaps = (~mask & valid) >> k;
+      if (gaps == 0)
+        return;
+      k += __builtin_ctzll(gaps);
+      emit(base + k * stride);
+    }
+  }
+
+  bool idle() const { return start == NONE; }
+
+  // Ends an open run at end, the end of the scanned range
+  void finish(size_t end) {
+    if (start != NONE)
+      emit(std::max(end, start));
+  }
+};
+
+} // namespace
+
+void extractStrings(
+    ByteView bytes, size_t begin, size_t end, size_t minLength,
+    const std::function<void(const ExtractedString &)> &onString) {
+  end = std::min(end, bytes.size());
+  if (begin >= end)
+    return;
+  minLength = std::max<size_t>(minLength, 1);
+
+  RunTracker ascii(bytes, 1, PatternScanner::ASCII, minLength, onString);
+  RunTracker evenWide(bytes, 2, PatternScanner::UTF16LE, minLength, onString);
+  RunTracker oddWide(bytes, 2, PatternScanner::UTF16LE, minLength, onString);
+
+  BlockMasks masks[BATCH];
+  size_t position = begin;
+  while (position < end) {
+    size_t blocks = std::min(BATCH, (end - position) / BLOCK);
+    size_t size = blocks * BLOCK;
+    if (blocks > 0) {
+      classifyBlocks(bytes.data() + position, blocks, masks);
+    } else {
+      // the tail: bits past the end stay clear and close open runs
+      size = end - position;
+      classifyScalar(bytes.data() + position, size, masks[0]);
+      blocks = 1;
+    }
+
+    for (size_t b = 0; b < blocks; b++) {
+      size_t base = position + b * BLOCK;
+      const BlockMasks &block = masks[b];
+      // code and padding: nothing starts, nothing is open
+      if (block.printable == 0 && ascii.idle() && evenWide.idle() &&
+          oddWide.idle())
+        continue;
+      // the zero after the last byte of the block, if it is in range
+      size_t next = base + BLOCK;
+      uint64_t nextZero =
+          next < end && bytes.data()[next] == 0 ? 1ull << 63 : 0;
+      uint64_t wide = block.printable & ((block.zero >> 1) | nextZero);
+
+      ascii.feed(block.printable, 64, base);
+      evenWide.feed(evenBits(wide), 32, base);
+      oddWide.feed(evenBits(wide >> 1), 32, base + 1);
+    }
+    position += size;
+  }
+
+  ascii.finish(end);
+  evenWide.finish(end);
+  oddWide.finish(end);
+}
@@ -0,0 +1,43 @@
+#ifndef STRING_EXTRACTOR_H__
+#define STRING_EXTRACTOR_H__
+
+#include "pattern_scanner.hpp"
+#include "pe_view.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+/**
+ * Finds runs of printable characters, like strings(1), in ASCII and in
+ * UTF-16LE at either byte alignment.
+ *
+ * Bytes are classified 64 at a time into a printable mask and a zero mask,
+ * with AVX-512BW, AVX2 or SSE2 compares. UTF-16LE characters are printable
+ * bytes followed by a zero byte, split into even and odd lanes.
+ * Runs are then found from the masks with bit scans, so the cost per block
+ * does not depend on how many characters it holds and long stretches of
+ * code or padding are skipped whole.
+ */
+
+struct ExtractedString {
+  const uint8_t *data;  // first byte, in the scanned buffer
+  size_t offset;        // of data, from the start of the buffer
+  size_t length;        // in characters
+  PatternScanner::Encoding encoding;
+
+  // The character at index, for either encoding
+  char at(size_t index) const {
+    return static_cast<char>(
+        data[encoding == PatternScanner::UTF16LE ? index * 2 : index]);
+  }
+};
+
+/**
+ * Calls onString for every run of at least minLength printable characters
+ * (0x20-0x7e and tab) in [begin, end) of bytes. Runs of each encoding and
+ * alignment come in file order.
+ */
+void extractStrings(ByteView bytes, size_t begin, size_t end,
+                    size_t minLength,
+                    const std::function<void(const ExtractedString &)> &onString);
+#endif
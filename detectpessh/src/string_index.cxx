@@ -0,0 +1,179 @@
+#include "string_index.hpp"
+#include <algorithm>
+#include <mutex>
+
+void StringIndex::clear() {
+  arena.clear();
+  entries.clear();
+  std::fill(slots.begin(), slots.end(), 0);
+  dropped = 0;
+}
+
+void StringIndex::rehash(size_t size) {
+  slots.assign(size, 0);
+  const size_t mask = slots.size() - 1;
+  for (uint32_t i = 0; i < entries.size(); i++) {
+    size_t slot = std::hash<std::string_view>()(text(entries[i])) & mask;
+    while (slots[slot] != 0)
+      slot = (slot + 1) & mask;
+    slots[slot] = i + 1;
+  }
+}
+
+void StringIndex::add(std::string_view text, uint8_t encoding,
+                      uint64_t offset) {
+  text = text.substr(0, MAX_LENGTH);
+  // at most half full, so probes stay short
+  if ((entries.size() + 1) * 2 > slots.size())
+    rehash(std::max<size_t>(slots.size() * 2, 1024));
+
+  const size_t mask = slots.size() - 1;
+  size_t slot = std::hash<std::string_view>()(text) & mask;
+  while (slots[slot] != 0) {
+    Entry &entry = entries[slots[slot] - 1];
+    if (this->text(entry) == text) {
+      entry.count++;
+      entry.encodings |= encoding;
+      entry.offset = std::min(entry.offset, offset);
+      return;
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  if (arena.size() + text.size() > MAX_TEXT) {
+    dropped++;
+    return;
+  }
+  slots[slot] = static_cast<uint32_t>(entries.size() + 1);
+  entries.push_back({.offset = offset,
+                     .textOffset = static_cast<uint32_t>(arena.size()),
+                     .length = static_cast<uint32_t>(text.size()),
+                     .count = 1,
+                     .encodings = encoding});
+  arena.append(text);
+}
+
+void StringIndex::add(const ExtractedString &string) {
+  if (string.encoding == PatternScanner::ASCII) {
+    add(std::string_view(reinterpret_cast<const char *>(string.data),
+                         string.length),
+        string.encoding, string.offset);
+    return;
+  }
+
+  size_t length = std::min(string.length, MAX_LENGTH);
+  scratch.resize(length);
+  for (size_t i = 0; i < length; i++)
+    scratch[i] = string.at(i);
+  add(scratch, string.encoding, string.offset);
+}
+
+void StringIndex::sortByOffset() {
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) { return a.offset < b.offset; });
+  rehash(slots.size());
+}
+
+const StringIndex::Entry *StringIndex::find(std::string_view text) const {
+  if (slots.empty())
+    return nullptr;
+  const size_t mask = slots.size() - 1;
+  size_t slot = std::hash<std::string_view>()(text) & mask;
+  while (slots[slot] != 0) {
+    const Entry &entry = entries[slots[slot] - 1];
+    if (this->text(entry) == text)
+      return &entry;
+    slot = (slot + 1) & mask;
+  }
+  return nullptr;
+}
+
+namespace {
+
+char lower(char c) {
+  return c >= 'A' && c <= 'Z' ? static_cast<char>(c + 32) : c;
+}
+
+uint32_t trigramAt(std::string_view text, size_t i) {
+  return uint32_t(uint8_t(lower(text[i]))) << 16 |
+         uint32_t(uint8_t(lower(text[i + 1]))) << 8 |
+         uint8_t(lower(text[i + 2]));
+}
+
+} // namespace
+
+void CorpusStrings::indexTrigrams(std::string_view text, uint32_t id) {
+  for (size_t i = 0; i + 3 <= text.size(); i++) {
+    std::vector<uint32_t> &ids = trigrams[trigramAt(text, i)];
+    // a trigram repeated in the string is listed once
+    if (ids.empty() || ids.back() != id)
+      ids.push_back(id);
+  }
+}
+
+void CorpusStrings::add(const std::string &label, const StringIndex &index) {
+  std::unique_lock<std::shared_mutex> guard(lock);
+  uint32_t sample = static_cast<uint32_t>(samples.size());
+  samples.push_back(label);
+  for (const auto &entry : index.getEntries()) {
+    std::string_view text = index.text(entry);
+    auto it = postings.find(text);
+    if (it == postings.end()) {
+      it = postings.emplace(std::string(text), std::vector<uint32_t>()).first;
+      indexTrigrams(text, static_cast<uint32_t>(strings.size()));
+      strings.push_back(&*it); // map nodes do not move
+    }
+    it->second.push_back(sample);
+  }
+}
+
+std::vector<std::string> CorpusStrings::find(std::string_view text) const {
+  auto same = [](char a, char b) { return lower(a) == lower(b); };
+  auto contains = [&](const std::string &string) {
+    return std::search(string.begin(), string.end(), text.begin(), text.end(),
+                       same) != string.end();
+  };
+
+  std::shared_lock<std::shared_mutex> guard(lock);
+  std::vector<uint32_t> matches;
+  if (text.size() < 3) {
+    // too short for a trigram, every string is a candidate
+    for (const auto &[string, holders] : postings) {
+      if (contains(string))
+        matches.insert(matches.end(), holders.begin(), holders.end());
+    }
+  } else {
+    // every match holds each trigram of text, so the rarest one's strings
+    // are the only candidates
+    const std::vector<uint32_t> *candidates = nullptr;
+    for (size_t i = 0; i + 3 <= text.size(); i++) {
+      auto it = trigrams.find(trigramAt(text, i));
+      if (it == trigrams.end())
+        return {};
+      if (candidates == nullptr || it->second.size() < candidates->size())
+        candidates = &it->second;
+    }
+    for (uint32_t id : *candidates) {
+      const auto &[string, holders] = *strings[id];
+      if (contains(string))
+        matches.insert(matches.end(), holders.begin(), holders.end());
+    }
+  }
+  std::sort(matches.begin(), matches.end());
+  matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+
+  std::vector<std::string> labels;
+  for (uint32_t sample : matches)
+    labels.push_back(samples[sample]);
+  return labels;
+}
+
+size_t CorpusStrings::sampleCount() const {
+  std::shared_lock<std::shared_mutex> guard(lock);
+  return samples.size();
+}
+
+size_t CorpusStrings::stringCount() const {
+  std::shared_lock<std::shared_mutex> guard(lock);
+  return postings.size();
+}
@@ -0,0 +1,116 @@
+#ifndef STRING_INDEX_H__
+#define STRING_INDEX_H__
+
+#include "string_extractor.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * The distinct strings of one binary. Each string is stored once, in one
+ * text arena, with the encodings it was seen in, where it was first seen
+ * and how often. Lookups go through an open addressing hash table.
+ *
+ * clear() keeps the memory, so a detector reusing its index allocates
+ * nothing once it has seen its largest binary.
+ */
+class StringIndex {
+public:
+  struct Entry {
+    uint64_t offset;     // of the first occurrence in the file
+    uint32_t textOffset; // in the arena
+    uint32_t length;
+    uint32_t count;      // occurrences
+    uint8_t encodings;   // PatternScanner::Encoding bits
+  };
+
+  // longer strings are cut, the rest is rarely worth reading
+  static constexpr size_t MAX_LENGTH = 1024;
+  // bytes of text per binary; strings beyond it are counted, not kept
+  static constexpr size_t MAX_TEXT = 32 << 20;
+
+private:
+  std::string arena;
+  std::vector<Entry> entries;
+  std::vector<uint32_t> slots; // entry index + 1, 0 for empty
+  std::string scratch;         // decoded UTF-16LE
+  size_t dropped{0};
+
+  // Rebuilds the hash table with size slots
+  void rehash(size_t size);
+
+public:
+  void clear();
+
+  // Interns text, or counts one more occurrence of it
+  void add(std::string_view text, uint8_t encoding, uint64_t offset);
+
+  // Interns an extracted run, decoding UTF-16LE to ASCII
+  void add(const ExtractedString &string);
+
+  // Orders the entries by file offset, once the extraction is done
+  void sortByOffset();
+
+  // The entry of text, nullptr if the binary does not contain it
+  const Entry *find(std::string_view text) const;
+
+  // Entries in the order they were added, unless sorted
+  const std::vector<Entry> &getEntries() const { return entries; }
+  std::string_view text(const Entry &entry) const {
+    return std::string_view(arena).substr(entry.textOffset, entry.length);
+  }
+  size_t size() const { return entries.size(); }
+  // Distinct strings not kept because the arena was full
+  size_t droppedStrings() const { return dropped; }
+};
+
+/**
+ * The strings of every binary of a corpus scan, for queries such as "which
+ * files contain 'PuTTY'". Each distinct string is stored once with the
+ * list of samples containing it. Samples are added from many threads.
+ *
+ * Every three bytes of every string, with ASCII case folded, list the
+ * strings they occur in, so a query only reads the strings holding its
+ * rarest trigram instead of every string of the corpus.
+ */
+class CorpusStrings {
+private:
+  struct Hash {
+    using is_transparent = void;
+    size_t operator()(std::string_view text) const {
+      return std::hash<std::string_view>()(text);
+    }
+  };
+
+  using Postings = std::unordered_map<std::string, std::vector<uint32_t>,
+                                      Hash, std::equal_to<>>;
+
+  mutable std::shared_mutex lock;
+  std::vector<std::string> samples;
+  Postings postings;
+  // by string id, in the order the strings were first added
+  std::vector<const Postings::value_type *> strings;
+  // folded trigram to the ids of the strings holding it, ascending
+  std::unordered_map<uint32_t, std::vector<uint32_t>> trigrams;
+
+  // Adds string id to the posting list of every trigram of text
+  void indexTrigrams(std::string_view text, uint32_t id);
+
+public:
+  // Adds the strings of one binary, labelled by path or request
+  void add(const std::string &label, const StringIndex &index);
+
+  /**
+   * Samples holding a string that contains text, ignoring ASCII case.
+   * @return the labels, in the order the samples were added
+   */
+  std::vector<std::string> find(std::string_view text) const;
+
+  size_t sampleCount() const;
+  size_t stringCount() const;
+};
+#endif
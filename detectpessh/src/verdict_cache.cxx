@@ -0,0 +1,235 @@
+#include "verdict_cache.hpp"
+#include <cstdio>
+#include <cstring>
+#include <openssl/evp.h>
+
+ContentDigest contentHash(const uint8_t *data, size_t size) {
+  ContentDigest digest{};
+  unsigned int length = 0;
+  EVP_Digest(data, size, digest.data(), &length, EVP_sha256(), nullptr);
+  return digest;
+}
+
+ContentHasher::ContentHasher() : context(EVP_MD_CTX_new()) {
+  EVP_DigestInit_ex(context, EVP_sha256(), nullptr);
+}
+
+ContentHasher::~ContentHasher() { EVP_MD_CTX_free(context); }
+
+void ContentHasher::update(const uint8_t *data, size_t size) {
+  EVP_DigestUpdate(context, data, size);
+}
+
+ContentDigest ContentHasher::finish() {
+  ContentDigest digest{};
+  unsigned int length = 0;
+  EVP_DigestFinal_ex(context, digest.data(), &length);
+  return digest;
+}
+
+std::string digestToHex(const ContentDigest &digest) {
+  static const char digits[] = "0123456789abcdef";
+  std::string hex;
+  hex.reserve(digest.size() * 2);
+  for (uint8_t byte : digest) {
+    hex += digits[byte >> 4];
+    hex += digits[byte & 0xF];
+  }
+  return hex;
+}
+
+std::optional<ContentDigest> digestFromHex(const std::string &hex) {
+  auto nibble = [](char c) -> int {
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+    return -1;
+  };
+
+  ContentDigest digest;
+  if (hex.size() != digest.size() * 2)
+    return std::nullopt;
+  for (size_t i = 0; i < digest.size(); i++) {
+    int high = nibble(hex[i * 2]), low = nibble(hex[i * 2 + 1]);
+    if (high < 0 || low < 0)
+      return std::nullopt;
+    digest[i] = static_cast<uint8_t>(high << 4 | low);
+  }
+  return digest;
+}
+
+VerdictCache::~VerdictCache() {
+  {
+    std::lock_guard<std::mutex> guard(pendingLock);
+    stopping = true;
+  }
+  pendingReady.notify_one();
+  if (writer.joinable())
+    writer.join();
+}
+
+VerdictCache::Record VerdictCache::toRecord(const ContentDigest &digest,
+                                            const CachedVerdict &verdict) {
+  Record record{};
+  std::memcpy(record.digest, digest.data(), digest.size());
+  record.confidence = verdict.confidence;
+  record.flags = verdict.flags;
+  record.rulesFingerprint = verdict.rulesFingerprint;
+  std::memcpy(record.imphash, verdict.imphash.data(), verdict.imphash.size());
+  return record;
+}
+
+bool VerdictCache::open(const std::string &path) {
+  size_t records = 0;
+  bool current = false;
+  {
+    std::ifstream in(path, std::ios::binary);
+    FileHeader header;
+    current = in.read(reinterpret_cast<char *>(&header), sizeof(header)) &&
+              std::equal(MAGIC, MAGIC + sizeof(MAGIC), header.magic) &&
+              header.version == VERSION;
+    Record record;
+    while (current &&
+           in.read(reinterpret_cast<char *>(&record), sizeof(record))) {
+      ContentDigest digest;
+      std::memcpy(digest.data(), record.digest, digest.size());
+      CachedVerdict verdict{record.confidence, record.rulesFingerprint,
+                            record.flags};
+      std::memcpy(verdict.imphash.data(), record.imphash,
+                  verdict.imphash.size());
+      Shard &shard = shardFor(digest);
+      std::lock_guard<std::mutex> guard(shard.lock);
+      // later records win, the log is replayed in order
+      shard.map[digest] = verdict;
+      records++;
+    }
+  }
+
+  // a new file, or one of another version, gets its header here
+  if ((!current || (records >= 2 * size() && records > 0)) && !compact(path))
+    return false;
+
+  cacheFile.open(path, std::ios::binary | std::ios::app);
+  if (!cacheFile)
+    return false;
+  writer = std::thread(&VerdictCache::writeRecords, this);
+  return true;
+}
+
+bool VerdictCache::compact(const std::string &path) {
+  // written aside and renamed over, so a crash leaves the old log intact
+  std::string compacted = path + ".compact";
+  {
+    std::ofstream out(compacted, std::ios::binary | std::ios::trunc);
+    FileHeader header{};
+    std::copy_n(MAGIC, sizeof(MAGIC), header.magic);
+    header.version = VERSION;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (auto &shard : shards) {
+      std::lock_guard<std::mutex> guard(shard.lock);
+      for (const auto &[digest, verdict] : shard.map) {
+        Record record = toRecord(digest, verdict);
+        out.write(reinterpret_cast<const char *>(&record), sizeof(record));
+      }
+    }
+    if (!out.flush())
+      return false;
+  }
+  return std::rename(compacted.c_str(), path.c_str()) == 0;
+}
+
+void VerdictCache::writeRecords() {
+  std::vector<Record> batch;
+  std::unique_lock<std::mutex> lock(pendingLock);
+  while (true) {
+    pendingReady.wait(lock, [&]() { return stopping || !pending.empty(); });
+    if (pending.empty())
+      return; // stopping, everything written
+    batch.swap(pending);
+
+    // stores go on queueing while the batch is written
+    lock.unlock();
+    cacheFile.write(reinterpret_cast<const char *>(batch.data()),
+                    batch.size() * sizeof(Record));
+    cacheFile.flush();
+    batch.clear();
+    lock.lock();
+  }
+}
+
+bool VerdictCache::loadList(
+    const std::string &path,
+    std::unordered_set<ContentDigest, ContentDigestHash> &list) {
+  std::ifstream in(path);
+  if (!in)
+    return false;
+
+  std::string line;
+  while (std::getline(in, line)) {
+    // "<sha256> [comment]"
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line[start] == '#')
+      continue;
+    size_t end = line.find_first_of(" \t\r#", start);
+    auto digest = digestFromHex(line.substr(start, end - start));
+    if (digest)
+      list.insert(*digest);
+  }
+  return true;
+}
+
+bool VerdictCache::loadAllowlist(const std::string &path) {
+  return loadList(path, allowlist);
+}
+
+bool VerdictCache::loadDenylist(const std::string &path) {
+  return loadList(path, denylist);
+}
+
+ListVerdict VerdictCache::listed(const ContentDigest &digest) const {
+  if (denylist.count(digest))
+    return ListVerdict::Denied;
+  if (allowlist.count(digest))
+    return ListVerdict::Allowed;
+  return ListVerdict::None;
+}
+
+std::optional<CachedVerdict>
+VerdictCache::find(const ContentDigest &digest, uint64_t rulesFingerprint) {
+  Shard &shard = shardFor(digest);
+  std::lock_guard<std::mutex> guard(shard.lock);
+  auto it = shard.map.find(digest);
+  if (it == shard.map.end() || it->second.rulesFingerprint != rulesFingerprint)
+    return std::nullopt;
+  return it->second;
+}
+
+void VerdictCache::store(const ContentDigest &digest,
+                         const CachedVerdict &verdict) {
+  {
+    Shard &shard = shardFor(digest);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    shard.map[digest] = verdict;
+  }
+
+  if (!writer.joinable())
+    return;
+  Record record = toRecord(digest, verdict);
+  {
+    std::lock_guard<std::mutex> guard(pendingLock);
+    pending.push_back(record);
+  }
+  pendingReady.notify_one();
+}
+
+size_t VerdictCache::size() {
+  size_t total = 0;
+  for (auto &shard : shards) {
+    std::lock_guard<std::mutex> guard(shard.lock);
+    total += shard.map.size();
+  }
+  return total;
+}
@@ -0,0 +1,162 @@
+#ifndef VERDICT_CACHE_H__
+#define VERDICT_CACHE_H__
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// SHA-256 of a file's contents
+using ContentDigest = std::array<uint8_t, 32>;
+
+/**
+ * Hashes a byte range with SHA-256 (libcrypto, SHA-NI where available).
+ * A cryptographic hash, so an allowlisted digest cannot be forged by a
+ * crafted binary, and the digests match what threat intel feeds publish.
+ */
+ContentDigest contentHash(const uint8_t *data, size_t size);
+
+// Streaming contentHash, so other digests can be fed from the same pass
+class ContentHasher {
+private:
+  struct evp_md_ctx_st *context;
+
+public:
+  ContentHasher();
+  ~ContentHasher();
+  ContentHasher(const ContentHasher &) = delete;
+  ContentHasher &operator=(const ContentHasher &) = delete;
+
+  void update(const uint8_t *data, size_t size);
+  ContentDigest finish();
+};
+std::string digestToHex(const ContentDigest &digest);
+std::optional<ContentDigest> digestFromHex(const std::string &hex);
+
+struct ContentDigestHash {
+  size_t operator()(const ContentDigest &digest) const {
+    size_t value;
+    static_assert(sizeof(value) <= sizeof(ContentDigest));
+    std::copy_n(digest.data(), sizeof(value),
+                reinterpret_cast<uint8_t *>(&value));
+    return value;
+  }
+};
+
+struct CachedVerdict {
+  int confidence;
+  uint64_t rulesFingerprint; // verdicts made under other rules are ignored
+  // what the analysis learnt about the file besides its score, so that a
+  // report from the cache reads the same as the first one
+  uint32_t flags{0};
+  std::array<uint8_t, 16> imphash{};
+
+  static constexpr uint32_t FLAG_PACKED = 1;
+  static constexpr uint32_t FLAG_HAS_IMPHASH = 2;
+};
+
+enum class ListVerdict { None, Allowed, Denied };
+
+/**
+ * Verdicts keyed by content hash, shared by any number of detectors.
+ *
+ * The in-memory map is split into shards with one mutex each, so threads
+ * analysing different files rarely contend. When a cache file is opened,
+ * its records are loaded and every new verdict is appended to it, so the
+ * cache survives restarts. Appends are queued and written in batches by a
+ * writer thread, off the scan path. The file is a log, so a digest
+ * re-analysed under new rules leaves its old record behind; it is
+ * rewritten with the live records only when it is opened with at least as
+ * many stale records as live ones, or when it was written by another
+ * version.
+ *
+ * Allowlisted and denylisted digests, one hex SHA-256 per line, bypass
+ * analysis entirely.
+ */
+class VerdictCache {
+private:
+  static constexpr size_t SHARDS = 16;
+
+  // the file starts with one, a file without it is started afresh
+  struct FileHeader {
+    char magic[4];
+    uint32_t version;
+  } __attribute__((packed));
+  static constexpr char MAGIC[4] = {'P', 'S', 'V', 'C'};
+  static constexpr uint32_t VERSION = 2;
+
+  struct Record {
+    uint8_t digest[32];
+    int32_t confidence;
+    uint32_t flags;
+    uint64_t rulesFingerprint;
+    uint8_t imphash[16];
+  } __attribute__((packed));
+
+  static Record toRecord(const ContentDigest &digest,
+                         const CachedVerdict &verdict);
+
+  struct Shard {
+    std::mutex lock;
+    std::unordered_map<ContentDigest, CachedVerdict, ContentDigestHash> map;
+  };
+
+  std::array<Shard, SHARDS> shards;
+  std::unordered_set<ContentDigest, ContentDigestHash> allowlist;
+  std::unordered_set<ContentDigest, ContentDigestHash> denylist;
+  std::ofstream cacheFile;
+  std::mutex pendingLock;
+  std::condition_variable pendingReady;
+  std::vector<Record> pending; // stored, not yet written
+  bool stopping{false};
+  std::thread writer;
+
+  // Writes the pending records until the cache is destroyed
+  void writeRecords();
+  // Rewrites path with one record per digest
+  bool compact(const std::string &path);
+
+  Shard &shardFor(const ContentDigest &digest) {
+    return shards[digest[sizeof(size_t)] % SHARDS];
+  }
+  static bool loadList(const std::string &path,
+                       std::unordered_set<ContentDigest, ContentDigestHash> &list);
+
+public:
+  VerdictCache() = default;
+  // Writes the records still pending
+  ~VerdictCache();
+  VerdictCache(const VerdictCache &) = delete;
+  VerdictCache &operator=(const VerdictCache &) = delete;
+
+  /**
+   * Loads the records of a cache file and keeps it open for appending.
+   * A missing file is created.
+   *
+   * @param path the cache file
+   * @return true if the file could be opened, false otherwise
+   */
+  bool open(const std::string &path);
+  bool loadAllowlist(const std::string &path);
+  bool loadDenylist(const std::string &path);
+
+  ListVerdict listed(const ContentDigest &digest) const;
+
+  /**
+   * @return the cached verdict, if one was made with the same rules
+   */
+  std::optional<CachedVerdict> find(const ContentDigest &digest,
+                                    uint64_t rulesFingerprint);
+  void store(const ContentDigest &digest, const CachedVerdict &verdict);
+  size_t size();
+};
+#endif
@@ -0,0 +1,210 @@
+#include "version_info.hpp"
+#include "pe_headers.hpp"
+
+namespace {
+
+const uint32_t RT_VERSION = 16;
+const uint32_t RESOURCE_SUBDIRECTORY = 0x80000000u;
+
+uint16_t lowerAscii(uint16_t c) { return c >= 'A' && c <= 'Z' ? c + 32 : c; }
+
+/**
+ * Reads an entry of a resource directory.
+ * @param directory offset of the directory from the root
+ * @param id the ID entry to find, or 0 for the first entry of any kind
+ */
+bool directoryEntry(ByteView resources, uint32_t directory, uint32_t id,
+                    IMAGE_RESOURCE_DIRECTORY_ENTRY &entry) {
+  IMAGE_RESOURCE_DIRECTORY header;
+  if (!resources.read(directory, header))
+    return false;
+
+  size_t first = size_t(directory) + sizeof(header);
+  if (id == 0)
+    return header.NumberOfNamedEntries + header.NumberOfIdEntries > 0 &&
+           resources.read(first, entry);
+
+  // named entries come first
+  size_t count = size_t(header.NumberOfNamedEntries) + header.NumberOfIdEntries;
+  for (size_t i = header.NumberOfNamedEntries; i < count; i++) {
+    if (!resources.read(first + i * sizeof(entry), entry))
+      return false;
+    if (entry.Name == id)
+      return true;
+  }
+  return false;
+}
+
+size_t align4(size_t offset) { return (offset + 3) & ~size_t(3); }
+
+/**
+ * A block of the version resource: wLength, wValueLength, wType, a NUL
+ * terminated UTF-16LE key, then its value and its children, each 32-bit
+ * aligned.
+ */
+struct VersionBlock {
+  size_t end;
+  WideText key;
+  size_t value;
+  size_t children;
+};
+
+// Reads the block at offset, cut at limit
+bool readBlock(ByteView info, size_t offset, size_t limit,
+               VersionBlock &block) {
+  uint16_t length = info.get<uint16_t>(offset);
+  if (length < 3 * sizeof(uint16_t))
+    return false;
+  block.end = std::min(limit, offset + length);
+
+  uint16_t valueLength = info.get<uint16_t>(offset + 2);
+  bool text = info.get<uint16_t>(offset + 4) == 1; // length in characters
+
+  size_t key = offset + 3 * sizeof(uint16_t);
+  size_t keyEnd = key;
+  while (keyEnd + 2 <= block.end && info.get<uint16_t>(keyEnd) != 0)
+    keyEnd += 2;
+  block.key = WideText(info.subview(key, keyEnd - key));
+  block.value = align4(keyEnd + 2);
+  block.children = align4(block.value + (text ? valueLength * 2 : valueLength));
+  return true;
+}
+
+// Calls onChild for the children of parent until it returns false
+template <typename OnChild>
+bool forEachChild(ByteView info, const VersionBlock &parent, OnChild onChild) {
+  VersionBlock child;
+  for (size_t offset = parent.children; offset < parent.end;
+       offset = align4(child.end)) {
+    if (!readBlock(info, offset, parent.end, child))
+      break;
+    if (!onChild(child))
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+bool WideText::equals(std::string_view ascii) const {
+  if (length() != ascii.size())
+    return false;
+  for (size_t i = 0; i < ascii.size(); i++) {
+    if (at(i) != static_cast<uint8_t>(ascii[i]))
+      return false;
+  }
+  return true;
+}
+
+bool WideText::contains(std::string_view ascii) const {
+  if (ascii.size() > length())
+    return false;
+  for (size_t start = 0; start + ascii.size() <= length(); start++) {
+    size_t i = 0;
+    while (i < ascii.size() &&
+           lowerAscii(at(start + i)) ==
+               lowerAscii(static_cast<uint8_t>(ascii[i])))
+      i++;
+    if (i == ascii.size())
+      return true;
+  }
+  return false;
+}
+
+bool findVersionResource(ByteView resources, uint32_t &rva, uint32_t &size) {
+  // type, name and language: two subdirectories, then the leaf
+  IMAGE_RESOURCE_DIRECTORY_ENTRY type, name, language;
+  if (!directoryEntry(resources, 0, RT_VERSION, type) ||
+      !(type.OffsetToData & RESOURCE_SUBDIRECTORY))
+    return false;
+  if (!directoryEntry(resources, type.OffsetToData & ~RESOURCE_SUBDIRECTORY, 0,
+                      name) ||
+      !(name.OffsetToData & RESOURCE_SUBDIRECTORY))
+    return false;
+  if (!directoryEntry(resources, name.OffsetToData & ~RESOURCE_SUBDIRECTORY, 0,
+                      language) ||
+      (language.OffsetToData & RESOURCE_SUBDIRECTORY))
+    return false;
+
+  IMAGE_RESOURCE_DATA_ENTRY data;
+  if (!resources.read(language.OffsetToData, data) || data.Size == 0)
+    return false;
+  rva = data.OffsetToData;
+  size = data.Size;
+  return true;
+}
+
+void forEachVersionString(
+    ByteView versionInfo,
+    const std::function<bool(const VersionString &)> &onString) {
+  VersionBlock root;
+  if (!readBlock(versionInfo, 0, versionInfo.size(), root) ||
+      !root.key.equals("VS_VERSION_INFO"))
+    return;
+
+  // StringFileInfo > StringTable per language > String; VarFileInfo holds
+  // only the translation list
+  forEachChild(versionInfo, root, [&](const VersionBlock &fileInfo) {
+    if (!fileInfo.key.equals("StringFileInfo"))
+      return true;
+    return forEachChild(
+        versionInfo, fileInfo, [&](const VersionBlock &table) {
+          return forEachChild(
+              versionInfo, table, [&](const VersionBlock &string) {
+                // wValueLength is in bytes for some linkers: the NUL is
+                // what ends the value
+                size_t end = string.value;
+                while (end + 2 <= string.end &&
+                       versionInfo.get<uint16_t>(end) != 0)
+                  end += 2;
+                WideText value(versionInfo.subview(
+                    string.value, end > string.value ? end - string.value : 0));
+                return onString({string.key, value, string.value});
+              });
+        });
+  });
+}
+
+std::string_view identityKey(const WideText &key) {
+  static constexpr std::string_view KEYS[] = {
+      "ProductName", "OriginalFilename", "InternalName", "FileDescription"};
+  for (std::string_view name : KEYS) {
+    if (key.equals(name))
+      return name;
+  }
+  return {};
+}
+
+std::string_view sshClientOfProduct(const WideText &value) {
+  // the first match wins, so "pscp" comes before "scp.exe"
+  static constexpr struct {
+    std::string_view text;
+    std::string_view client;
+  } PRODUCTS[] = {
+      {"PuTTY", "PuTTY"},
+      {"plink", "PuTTY"},
+      {"pscp", "PuTTY"},
+      {"psftp", "PuTTY"},
+      {"KiTTY", "KiTTY"},
+      {"OpenSSH", "OpenSSH"},
+      {"ssh.exe", "OpenSSH"},
+      {"scp.exe", "OpenSSH"},
+      {"sftp.exe", "OpenSSH"},
+      {"Bitvise SSH", "Bitvise SSH Client"},
+      {"SecureCRT", "SecureCRT"},
+      {"Tectia", "Tectia SSH"},
+      {"Dropbear", "Dropbear"},
+      {"dbclient", "Dropbear"},
+      {"MobaXterm", "MobaXterm"},
+      {"Tera Term", "Tera Term"},
+      {"ttermpro", "Tera Term"},
+      {"WinSCP", "WinSCP"},
+      {"SmarTTY", "SmarTTY"},
+      {"Xshell", "Xshell"},
+  };
+  for (const auto &product : PRODUCTS) {
+    if (value.contains(product.text))
+      return product.client;
+  }
+  return {};
+}
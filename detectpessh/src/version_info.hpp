@@ -0,0 +1,78 @@
+#ifndef VERSION_INFO_H__
+#define VERSION_INFO_H__
+
+#include "pe_view.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+/**
+ * The version resource (VS_VERSIONINFO) of a PE names the product and the
+ * file it was built as, in UTF-16LE key/value pairs such as
+ * ProductName = "PuTTY suite". Builds rarely change them, so they identify
+ * a client more reliably than strings found anywhere in the file, and
+ * reading them costs a few dozen bounds checked reads.
+ */
+
+// UTF-16LE text inside the file, read in place
+class WideText {
+private:
+  ByteView units; // two bytes per character
+
+public:
+  WideText() = default;
+  explicit WideText(ByteView bytes)
+      : units(bytes.subview(0, bytes.size() & ~size_t(1))) {}
+
+  size_t length() const { return units.size() / 2; }
+  uint16_t at(size_t index) const { return units.get<uint16_t>(index * 2); }
+
+  // Whether the text is ascii, exactly
+  bool equals(std::string_view ascii) const;
+  // Whether ascii occurs in the text, ignoring ASCII case
+  bool contains(std::string_view ascii) const;
+};
+
+// One String of a StringFileInfo table
+struct VersionString {
+  WideText key;
+  WideText value;  // up to its terminating NUL
+  size_t offset;   // of the value, from the start of the VS_VERSIONINFO
+};
+
+/**
+ * Walks a resource tree straight to the first RT_VERSION leaf: the type
+ * directory, then the first name and the first language under it. Only
+ * the directories on the way are read.
+ *
+ * @param resources the bytes from the root directory on
+ * @param rva set to the RVA of the VS_VERSIONINFO block
+ * @param size set to its size in bytes
+ * @return false if there is no version resource
+ */
+bool findVersionResource(ByteView resources, uint32_t &rva, uint32_t &size);
+
+/**
+ * Calls onString for every String of every StringTable in a VS_VERSIONINFO
+ * block, in file order, until it returns false. Blocks claiming more bytes
+ * than their parent are cut at the end of the parent.
+ */
+void forEachVersionString(
+    ByteView versionInfo,
+    const std::function<bool(const VersionString &)> &onString);
+
+/**
+ * Names the keys that identify the product or the file: ProductName,
+ * OriginalFilename, InternalName and FileDescription.
+ * @return the key, empty for any other key
+ */
+std::string_view identityKey(const WideText &key);
+
+/**
+ * Names the SSH client a version string value belongs to, such as "PuTTY"
+ * for "PuTTY suite" or "PLINK.EXE".
+ * @return the client, empty if the value names no known SSH client
+ */
+std::string_view sshClientOfProduct(const WideText &value);
+#endif
@@ -0,0 +1,57 @@
+#include "worker_pool.hpp"
+#include <algorithm>
+
+WorkerPool::WorkerPool(unsigned helpers) {
+  for (unsigned i = 0; i < helpers; i++)
+    threads.emplace_back(&WorkerPool::threadLoop, this);
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &thread : threads)
+    thread.join();
+}
+
+void WorkerPool::threadLoop() {
+  uint64_t seen = 0;
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    wake.wait(guard, [&]() {
+      return stopping || (generation != seen && wanted > 0);
+    });
+    if (stopping)
+      return;
+
+    seen = generation;
+    wanted--;
+    running++;
+    const std::function<void()> *work = task;
+    guard.unlock();
+    (*work)();
+    guard.lock();
+    if (--running == 0)
+      done.notify_all();
+  }
+}
+
+void WorkerPool::run(unsigned helpers, const std::function<void()> &work) {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    task = &work;
+    wanted = std::min(helpers, size());
+    generation++;
+  }
+  if (helpers > 0)
+    wake.notify_all();
+  work();
+
+  // threads that have not started by now are not needed: the work is done
+  std::unique_lock<std::mutex> guard(lock);
+  wanted = 0;
+  done.wait(guard, [&]() { return running == 0; });
+  task = nullptr;
+}
@@ -0,0 +1,48 @@
+#ifndef WORKER_POOL_H__
+#define WORKER_POOL_H__
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Threads kept waiting between parallel loops, so a loop run per file does
+ * not pay for creating and joining threads every time.
+ *
+ * run() hands one function to the calling thread and to idle pool threads;
+ * the function pulls its work items itself (an atomic counter), so it does
+ * not matter how many threads end up taking part.
+ */
+class WorkerPool {
+private:
+  std::vector<std::thread> threads;
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable done;
+  const std::function<void()> *task{nullptr};
+  uint64_t generation{0}; // counts run() calls
+  unsigned wanted{0};     // pool threads still to join the current run
+  unsigned running{0};    // pool threads in the current run
+  bool stopping{false};
+
+  void threadLoop();
+
+public:
+  // @param helpers pool threads, the caller of run() makes one more
+  explicit WorkerPool(unsigned helpers);
+  ~WorkerPool();
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  unsigned size() const { return static_cast<unsigned>(threads.size()); }
+
+  /**
+   * Runs work on this thread and on up to helpers pool threads at once.
+   * Returns when every thread that took part has returned from work.
+   */
+  void run(unsigned helpers, const std::function<void()> &work);
+};
+#endif
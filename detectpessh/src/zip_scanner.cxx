@@ -0,0 +1,311 @@
+#include "zip_scanner.hpp"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <mutex>
+#include <thread>
+#include <zlib.h>
+
+namespace {
+
+const uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;   // "PK\3\4"
+const uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014b50; // "PK\1\2"
+const uint32_t END_SIGNATURE = 0x06054b50;            // "PK\5\6"
+const uint32_t ZIP64_END_SIGNATURE = 0x06064b50;      // "PK\6\6"
+const uint32_t ZIP64_LOCATOR_SIGNATURE = 0x07064b50;  // "PK\6\7"
+const size_t LOCAL_HEADER_SIZE = 30;
+const size_t CENTRAL_HEADER_SIZE = 46;
+const size_t END_SIZE = 22;
+const size_t ZIP64_LOCATOR_SIZE = 20;
+const uint16_t ZIP64_EXTRA_ID = 0x0001;
+const uint16_t FLAG_ENCRYPTED = 1;
+const uint16_t METHOD_STORED = 0;
+const uint16_t METHOD_DEFLATED = 8;
+
+/**
+ * Finds the end of central directory record, searching back over the
+ * archive comment, which is at most 64 KB.
+ * @return its offset, SIZE_MAX if there is none
+ */
+size_t findEndRecord(ByteView archive) {
+  if (archive.size() < END_SIZE)
+    return SIZE_MAX;
+  size_t last = archive.size() - END_SIZE;
+  size_t first = last > 0xffff ? last - 0xffff : 0;
+  for (size_t offset = last + 1; offset-- > first;) {
+    if (archive.get<uint32_t>(offset) == END_SIGNATURE)
+      return offset;
+  }
+  return SIZE_MAX;
+}
+
+/**
+ * Sizes and offsets that do not fit 32 bits are 0xffffffff in the central
+ * directory, the real values follow in the ZIP64 extra field, in this
+ * order and only for the fields that overflowed.
+ */
+void readZip64Extra(ByteView extra, ZipMember &member) {
+  for (size_t offset = 0; offset + 4 <= extra.size();) {
+    uint16_t id = extra.get<uint16_t>(offset);
+    uint16_t length = extra.get<uint16_t>(offset + 2);
+    if (id == ZIP64_EXTRA_ID) {
+      ByteView field = extra.subview(offset + 4, length);
+      size_t next = 0;
+      for (uint64_t *value :
+           {&member.size, &member.compressedSize, &member.headerOffset}) {
+        if (*value != UINT32_MAX)
+          continue;
+        *value = field.get<uint64_t>(next, *value);
+        next += sizeof(uint64_t);
+      }
+      return;
+    }
+    offset += 4 + length;
+  }
+}
+
+// Raw deflate of one member at a time, the stream state reused
+class Inflater {
+private:
+  z_stream stream{};
+  bool ready{false};
+  ByteView input;
+  size_t consumed{0};
+
+public:
+  Inflater() { ready = inflateInit2(&stream, -MAX_WBITS) == Z_OK; }
+  ~Inflater() {
+    if (ready)
+      inflateEnd(&stream);
+  }
+  Inflater(const Inflater &) = delete;
+  Inflater &operator=(const Inflater &) = delete;
+
+  bool start(ByteView data) {
+    input = data;
+    consumed = 0;
+    stream.avail_in = 0;
+    return ready && inflateReset(&stream) == Z_OK;
+  }
+
+  /**
+   * Inflates up to count bytes into out.
+   * @param corrupt set if the data is not valid deflate or is cut short
+   * @return the bytes written, fewer than count at the end of the stream
+   */
+  size_t read(uint8_t *out, size_t count, bool &corrupt) {
+    size_t written = 0;
+    while (written < count) {
+      // avail_in and avail_out are 32-bit
+      if (stream.avail_in == 0 && consumed < input.size()) {
+        size_t chunk = std::min<size_t>(input.size() - consumed, UINT_MAX);
+        stream.next_in = const_cast<Bytef *>(input.data() + consumed);
+        stream.avail_in = static_cast<uInt>(chunk);
+        consumed += chunk;
+      }
+      size_t chunk = std::min<size_t>(count - written, UINT_MAX);
+      stream.next_out = out + written;
+      stream.avail_out = static_cast<uInt>(chunk);
+      int status = inflate(&stream, Z_NO_FLUSH);
+      written += chunk - stream.avail_out;
+      if (status == Z_STREAM_END)
+        break;
+      if (status != Z_OK) {
+        corrupt = true;
+        break;
+      }
+    }
+    return written;
+  }
+};
+
+// What a worker thread keeps between members
+struct MemberWorker {
+  std::unique_ptr<PESSHDetector> detector;
+  Inflater inflater;
+  std::unique_ptr<uint8_t[]> buffer;
+  size_t capacity{0};
+};
+
+} // namespace
+
+ZipScanner::ZipScanner(DetectorFactory factory, unsigned threadCount)
+    : makeDetector(std::move(factory)),
+      threads(threadCount != 0
+                  ? threadCount
+                  : std::max(1u, std::thread::hardware_concurrency())) {}
+
+bool ZipScanner::listMembers(ByteView archive,
+                             std::vector<ZipMember> &members) {
+  members.clear();
+  size_t end = findEndRecord(archive);
+  if (end == SIZE_MAX)
+    return false;
+
+  uint64_t count = archive.get<uint16_t>(end + 10);
+  uint64_t directorySize = archive.get<uint32_t>(end + 12);
+  uint64_t directoryOffset = archive.get<uint32_t>(end + 16);
+  // bytes in front of the archive, such as a self-extractor stub, shift
+  // every offset it records
+  uint64_t shift = 0;
+
+  size_t locator = end >= ZIP64_LOCATOR_SIZE ? end - ZIP64_LOCATOR_SIZE : 0;
+  uint64_t zip64End = archive.get<uint64_t>(locator + 8);
+  if (end >= ZIP64_LOCATOR_SIZE &&
+      archive.get<uint32_t>(locator) == ZIP64_LOCATOR_SIGNATURE &&
+      archive.get<uint32_t>(zip64End) == ZIP64_END_SIGNATURE) {
+    count = archive.get<uint64_t>(zip64End + 32);
+    directorySize = archive.get<uint64_t>(zip64End + 40);
+    directoryOffset = archive.get<uint64_t>(zip64End + 48);
+  } else if (directoryOffset + directorySize < end) {
+    shift = end - (directoryOffset + directorySize);
+  }
+
+  size_t offset = directoryOffset + shift;
+  members.reserve(std::min<uint64_t>(
+      count, std::min<uint64_t>(directorySize, archive.size()) /
+                 CENTRAL_HEADER_SIZE));
+  for (uint64_t i = 0; i < count; i++) {
+    if (!archive.contains(offset, CENTRAL_HEADER_SIZE) ||
+        archive.get<uint32_t>(offset) != CENTRAL_HEADER_SIGNATURE)
+      break;
+
+    ZipMember member{};
+    member.flags = archive.get<uint16_t>(offset + 8);
+    member.method = archive.get<uint16_t>(offset + 10);
+    member.compressedSize = archive.get<uint32_t>(offset + 20);
+    member.size = archive.get<uint32_t>(offset + 24);
+    uint16_t nameLength = archive.get<uint16_t>(offset + 28);
+    uint16_t extraLength = archive.get<uint16_t>(offset + 30);
+    uint16_t commentLength = archive.get<uint16_t>(offset + 32);
+    member.headerOffset = archive.get<uint32_t>(offset + 42);
+
+    ByteView name = archive.subview(offset + CENTRAL_HEADER_SIZE, nameLength);
+    member.name = std::string_view(reinterpret_cast<const char *>(name.data()),
+                                   name.size());
+    readZip64Extra(
+        archive.subview(offset + CENTRAL_HEADER_SIZE + nameLength, extraLength),
+        member);
+    member.headerOffset += shift;
+    offset += CENTRAL_HEADER_SIZE + nameLength + extraLength + commentLength;
+
+    if (!member.name.empty() && member.name.back() == '/')
+      continue; // a directory
+    members.push_back(member);
+  }
+  return true;
+}
+
+ByteView ZipScanner::memberData(ByteView archive, const ZipMember &member) {
+  size_t header = member.headerOffset;
+  if (!archive.contains(header, LOCAL_HEADER_SIZE) ||
+      archive.get<uint32_t>(header) != LOCAL_HEADER_SIGNATURE)
+    return {};
+
+  // the local name and extra field may differ from the central ones
+  size_t data = header + LOCAL_HEADER_SIZE +
+                archive.get<uint16_t>(header + 26) +
+                archive.get<uint16_t>(header + 28);
+  if (!archive.contains(data, member.compressedSize))
+    return {};
+  return archive.subview(data, member.compressedSize);
+}
+
+std::vector<ScannedMember>
+ZipScanner::scan(ByteView archive,
+                 const std::vector<ZipMember> &members) const {
+  std::vector<ScannedMember> results(members.size());
+  unsigned workers =
+      static_cast<unsigned>(std::min<size_t>(threads, members.size()));
+  // a worker's own buffer stays within its share
+  const size_t share =
+      (MAX_INFLATE_MEMORY - MAX_MEMBER_SIZE) / std::max(1u, workers);
+  std::mutex sharedLock;
+  std::unique_ptr<uint8_t[]> sharedBuffer;
+  size_t sharedCapacity = 0;
+
+  auto scanMember = [&](MemberWorker &worker, const ZipMember &member,
+                        ScannedMember &result) {
+    result = {member, nullptr, 0, false};
+    if (member.flags & FLAG_ENCRYPTED) {
+      result.skipped = "encrypted";
+      return;
+    }
+    if (member.method != METHOD_STORED && member.method != METHOD_DEFLATED) {
+      result.skipped = "unsupported method";
+      return;
+    }
+    if (member.method == METHOD_DEFLATED && member.size > MAX_MEMBER_SIZE) {
+      result.skipped = "too large";
+      return;
+    }
+    ByteView data = memberData(archive, member);
+    if (data.empty() && member.compressedSize != 0) {
+      result.skipped = "corrupt";
+      return;
+    }
+
+    ByteView image;
+    // held while the member is analysed from the shared buffer
+    std::unique_lock<std::mutex> shared;
+    if (member.method == METHOD_STORED) {
+      image = data.subview(0, member.size);
+      if (image.get<uint16_t>(0) != 0x5A4D) { // "MZ"
+        result.skipped = "not a PE";
+        return;
+      }
+    } else {
+      bool corrupt = false;
+      uint8_t magic[2];
+      if (member.size < sizeof(magic) || !worker.inflater.start(data) ||
+          worker.inflater.read(magic, sizeof(magic), corrupt) !=
+              sizeof(magic) ||
+          magic[0] != 'M' || magic[1] != 'Z') {
+        result.skipped = "not a PE";
+        return;
+      }
+
+      std::unique_ptr<uint8_t[]> *buffer = &worker.buffer;
+      size_t *capacity = &worker.capacity;
+      if (member.size > share) {
+        shared = std::unique_lock(sharedLock);
+        buffer = &sharedBuffer;
+        capacity = &sharedCapacity;
+      }
+      if (*capacity < member.size) {
+        buffer->reset(); // before the larger one is allocated
+        *buffer = std::make_unique_for_overwrite<uint8_t[]>(member.size);
+        *capacity = member.size;
+      }
+      std::copy(magic, magic + sizeof(magic), buffer->get());
+      size_t rest = member.size - sizeof(magic);
+      if (worker.inflater.read(buffer->get() + sizeof(magic), rest, corrupt) !=
+              rest ||
+          corrupt) {
+        result.skipped = "corrupt";
+        return;
+      }
+      image = ByteView(buffer->get(), member.size);
+    }
+
+    worker.detector->loadPEBuffer(image);
+    result.sshClient = worker.detector->isSSHClient();
+    result.confidence = worker.detector->getConfidence();
+  };
+
+  std::atomic<size_t> nextMember{0};
+  auto work = [&]() {
+    MemberWorker worker;
+    worker.detector = makeDetector();
+    for (size_t i; (i = nextMember.fetch_add(1)) < members.size();)
+      scanMember(worker, members[i], results[i]);
+  };
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < workers; i++)
+    pool.emplace_back(work);
+  if (workers > 0)
+    work();
+  for (auto &thread : pool)
+    thread.join();
+  return results;
+}
@@ -0,0 +1,90 @@
+#ifndef ZIP_SCANNER_H__
+#define ZIP_SCANNER_H__
+
+#include "detectpessh.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// A member of a ZIP archive, as listed by the central directory
+struct ZipMember {
+  std::string_view name; // in the archive mapping
+  uint64_t headerOffset; // of the local file header
+  uint64_t compressedSize;
+  uint64_t size;
+  uint16_t method;       // 0 stored, 8 deflated
+  uint16_t flags;        // general purpose bit flags
+};
+
+// What became of one member
+struct ScannedMember {
+  ZipMember member;
+  // why the member was not analysed, nullptr if it was
+  const char *skipped;
+  int confidence;
+  bool sshClient;
+};
+
+/**
+ * Analyses the PE files inside a ZIP archive without extracting them to
+ * disk.
+ *
+ * The central directory at the end of the archive, ZIP64 included, lists
+ * the members. Stored members are analysed where they lie in the mapped
+ * archive. Deflated members are inflated with zlib into a buffer owned by
+ * the worker thread, which grows to its largest member up to the worker's
+ * share of MAX_INFLATE_MEMORY and is then reused. Larger members up to
+ * MAX_MEMBER_SIZE take turns with one buffer shared by the workers, so the
+ * inflated bytes never take more than MAX_INFLATE_MEMORY however many
+ * workers there are. Only the first two bytes are inflated before "MZ" is
+ * checked, so members that are not PE files cost next to nothing. Members are handed to the worker threads one at a time, so a
+ * large member does not hold up the others.
+ */
+class ZipScanner {
+public:
+  // creates the detector a worker thread analyses with
+  using DetectorFactory = std::function<std::unique_ptr<PESSHDetector>()>;
+
+  // every inflate buffer together
+  static constexpr uint64_t MAX_INFLATE_MEMORY = 256ull << 20;
+  // larger deflated members are skipped; the shared buffer takes this much
+  // of MAX_INFLATE_MEMORY, the workers' own buffers the rest
+  static constexpr uint64_t MAX_MEMBER_SIZE = MAX_INFLATE_MEMORY / 2;
+
+private:
+  DetectorFactory makeDetector;
+  unsigned threads;
+
+  /**
+   * The bytes of a member's data, after its local file header.
+   * @return an empty view if the header is missing or the data is cut off
+   */
+  static ByteView memberData(ByteView archive, const ZipMember &member);
+
+public:
+  /**
+   * @param factory creates one detector per worker thread
+   * @param threadCount worker threads, 0 for one per hardware thread
+   */
+  explicit ZipScanner(DetectorFactory factory, unsigned threadCount = 0);
+
+  /**
+   * Reads the central directory. Every offset and size is checked against
+   * the archive.
+   *
+   * @param members set to the members, directories left out
+   * @return false if archive is not a ZIP archive
+   */
+  static bool listMembers(ByteView archive, std::vector<ZipMember> &members);
+
+  /**
+   * Analyses every member, in parallel.
+   * @return one result per member, in central directory order
+   */
+  std::vector<ScannedMember> scan(ByteView archive,
+                                  const std::vector<ZipMember> &members) const;
+};
+#endif
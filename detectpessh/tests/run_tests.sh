@@ -1,68 +1,366 @@
-#!/bin/bash 
+#!/bin/bash
+# Runs detectpessh on a generated corpus and checks every verdict.
+# File names start with the expected verdict: ssh_* or benign_*.
+CORPUS_DIR="corpus"
 SAMPLE_FILES_DIR="sample_files"
-CURL_TEST_FILE_1="putty.exe"
-CURL_TEST_FILE_2="pscp.exe"
-CURL_TEST_FILE_3="puttytel.exe"
+DETECTOR="../build/detectpessh"
+GENERATOR="../build/gen_corpus"
+CLIENT="../build/scan_client"
+SOCKET="${TMPDIR:-/tmp}/detectpessh_test_$$.sock"
+CACHE="${TMPDIR:-/tmp}/detectpessh_test_$$.cache"
 
-if [[ -z "$(which curl)" ]];then
-  echo "Error: 'curl' is required to download dependencies."
-  echo "Please install curl and try again."
+if [[ ! -x "${DETECTOR}" ]] || [[ ! -x "${GENERATOR}" ]] ||
+  [[ ! -x "${CLIENT}" ]]; then
+  echo "Error: build with 'make all gen_corpus scan_client' first."
   exit 1
-    exit 1
 fi
 
+echo "Generating test corpus..."
+if ! "${GENERATOR}" --max-size 1M "${CORPUS_DIR}" > /dev/null; then
+  echo "Error: Could not generate the test corpus."
+  exit 1
+fi
+
+failures=0
+run_check() {
+  local file="$1"
+  local expected="$2"
+  shift 2
+
+  "${DETECTOR}" "$@" "$file" > /dev/null
+  local status=$?
+  local verdict="benign"
+  [[ $status -eq 0 ]] && verdict="ssh"
+
+  if [[ "$verdict" == "$expected" ]]; then
+    echo "Pass: $file $* ($verdict)"
+  else
+    echo "FAIL: $file $* (expected $expected, got $verdict)"
+    failures=$((failures + 1))
+  fi
+}
+
+echo -e "\nRunning tests on generated files..."
+for file in "${CORPUS_DIR}"/*.exe; do
+  expected="benign"
+  [[ "$(basename "$file")" == ssh_* ]] && expected="ssh"
+  run_check "$file" "$expected"
+  run_check "$file" "$expected" --full
+done
 
-# Function to check if all required sample files exist.
-check_files_exist() {
-  if [[ ! -f "${SAMPLE_FILES_DIR}/${CURL_TEST_FILE_1}" ]] || \
-     [[ ! -f "${SAMPLE_FILES_DIR}/${CURL_TEST_FILE_2}" ]] || \
-     [[ ! -f "${SAMPLE_FILES_DIR}/${CURL_TEST_FILE_3}" ]]; then
-    return 1 # Return 1 if any file is missing
+# Pattern rules: matched on the SSH clients with a banner only
+echo -e "\nRunning pattern rule tests..."
+for file in "${CORPUS_DIR}"/*.exe; do
+  expected="no match"
+  [[ "$(basename "$file")" == ssh_imports_* ]] && expected="match"
+  result="no match"
+  "${DETECTOR}" --full --rules test_rules.conf --format json "$file" |
+    grep -q '"subject":"synthetic_banner"' && result="match"
+
+  if [[ "$result" == "$expected" ]]; then
+    echo "Pass: $file --rules ($result)"
+  else
+    echo "FAIL: $file --rules (expected $expected, got $result)"
+    failures=$((failures + 1))
   fi
-  return 0 # Return 0 if all files are found
+done
+
+# Offset conditions hold for every hit, not just the first few: a marker
+# repeated 1100 times past the end of a PE is matched at both ends
+echo -e "\nRunning repeated string tests..."
+repeated="${CORPUS_DIR}/repeated.bin"
+rules="${CORPUS_DIR}/repeated.conf"
+for file in "${CORPUS_DIR}"/benign_pe*.exe; do
+  size=$(stat -c %s "$file")
+  last=$((size + 1099 * 8))
+  cp "$file" "${repeated}"
+  for ((i = 0; i < 1100; i++)); do printf 'EVILMARK'; done >> "${repeated}"
+  cat > "${rules}" << RULES
+rule first_mark {
+  meta:
+    weight = 10
+  strings:
+    \$a = "EVILMARK"
+  condition:
+    \$a at ${size}
 }
+rule last_mark {
+  meta:
+    weight = 10
+  strings:
+    \$a = "EVILMARK"
+  condition:
+    \$a at ${last} and \$a in ($((last - 80))..$((last - 8)))
+}
+RULES
+  json=$("${DETECTOR}" --full --rules "${rules}" --format json "${repeated}")
+  for rule in first_mark last_mark; do
+    if [[ "$json" == *"\"subject\":\"${rule}\""* ]]; then
+      echo "Pass: $file repeated ${rule}"
+    else
+      echo "FAIL: $file repeated ${rule} (no match)"
+      failures=$((failures + 1))
+    fi
+  done
+done
+rm -f "${repeated}" "${rules}"
+
+# A sample over the 4 MB scan chunk size is scanned in parallel chunks; the
+# report must be the one the serial scan gives, timings aside
+echo -e "\nRunning parallel scan tests..."
+large="${CORPUS_DIR}/ssh_large.bin"
+"${GENERATOR}" --out "${large}" --size 9M --sections 6 \
+  --import ws2_32.dll:connect,send,recv --ascii "SSH-2.0-Synthetic_1.0" \
+  --ascii known_hosts --ascii ssh-ed25519 --wide id_rsa > /dev/null
+for ((i = 0; i < 1100; i++)); do printf 'known_hosts'; done >> "${large}"
+strip_metrics() { sed 's/"metrics":{"stage_ns":{[^}]*}[^}]*},//'; }
+serial=$("${DETECTOR}" --full --rules test_rules.conf --format json \
+  --scan-threads 1 "${large}" | strip_metrics)
+for threads in 2 4; do
+  parallel=$("${DETECTOR}" --full --rules test_rules.conf --format json \
+    --scan-threads "${threads}" "${large}" | strip_metrics)
+  if [[ "$serial" == *'"ssh_client":true'* ]] &&
+    [[ "$parallel" == "$serial" ]]; then
+    echo "Pass: ${large} --scan-threads ${threads}"
+  else
+    echo "FAIL: ${large} --scan-threads ${threads} differs from the serial scan"
+    diff <(echo "$serial") <(echo "$parallel")
+    failures=$((failures + 1))
+  fi
+done
+rm -f "${large}"
+
+# Packer detection: flagged on the packed samples only
+echo -e "\nRunning packer detection tests..."
+for file in "${CORPUS_DIR}"/*.exe; do
+  expected='"packed":false'
+  [[ "$(basename "$file")" == *_packed_* ]] && expected='"packed":true'
+  result=$("${DETECTOR}" --full --format json "$file" | grep -o '"packed":[a-z]*')
+
+  if [[ "$result" == "$expected" ]]; then
+    echo "Pass: $file packer ($result)"
+  else
+    echo "FAIL: $file packer (expected $expected, got $result)"
+    failures=$((failures + 1))
+  fi
+done
+
+# Plain text between the entropy samples of a packed section is still
+# scanned, while the sampled blocks keep the section flagged
+hidden="${CORPUS_DIR}/hidden_text.bin"
+for file in "${CORPUS_DIR}"/benign_packed_*_1M.exe; do
+  offset=$("${DETECTOR}" --format json "$file" |
+    grep -o '"rule":"compressed_section"[^}]*' | grep -o '"offset":[0-9]*')
+  cp "$file" "${hidden}"
+  yes "known_hosts" | head -c 4096 |
+    dd of="${hidden}" bs=1 seek=$((${offset#*:} + 32768)) conv=notrunc \
+      status=none
+  json=$("${DETECTOR}" --full --format json "${hidden}")
+  if [[ "$json" == *'"packed":true'* ]] &&
+    [[ "$json" == *'"subject":"known_hosts"'* ]]; then
+    echo "Pass: $file text between samples"
+  else
+    echo "FAIL: $file text between samples (not found)"
+    failures=$((failures + 1))
+  fi
+done
+rm -f "${hidden}"
 
-if check_files_exist; then
-  echo "Sample files already exist, skipping download."
-else
-  echo "Sample files not found. Checking internet connection..."
-  ping -c 1 -W 2 1.1.1.1 > /dev/null 2>&1
-  if [ $? -ne 0 ]; then
-    echo "No internet connection detected. Cannot download files."
-    exit 1
+# Version resources: the client is named before the imports are read
+echo -e "\nRunning version resource tests..."
+for file in "${CORPUS_DIR}"/*.exe; do
+  expected="no match"
+  [[ "$(basename "$file")" == ssh_version_* ]] && expected="headers"
+  result="no match"
+  json=$("${DETECTOR}" --format json "$file")
+  if [[ "$json" == *'"rule":"version_info"'* ]]; then
+    result="match"
+    [[ "$json" == *'"last_stage":"headers"'* ]] && result="headers"
   fi
 
-  echo "Internet connection is available. Downloading files..."
-  mkdir -p "${SAMPLE_FILES_DIR}"
-  
-
-  echo "Downloading ${CURL_TEST_FILE_1}..."
-  curl -L -s https://the.earth.li/~sgtatham/putty/latest/w64/putty.exe -o "${SAMPLE_FILES_DIR}/${CURL_TEST_FILE_1}"
-  
-  echo "Downloading ${CURL_TEST_FILE_2}..."
-  curl -L -s https://the.earth.li/~sgtatham/putty/latest/w64/pscp.exe -o "${SAMPLE_FILES_DIR}/${CURL_TEST_FILE_2}"
-  
-  echo "Downloading ${CURL_TEST_FILE_3}..."
-  curl -L -s https://the.earth.li/~sgtatham/putty/latest/w64/puttytel.exe -o "${SAMPLE_FILES_DIR}/${CURL_TEST_FILE_3}"
-
-  if ! check_files_exist; then
-    echo "Error: One or more files failed to download."
-    exit 1
-  else 
-   echo  "Pass: All files downloaded"
+  if [[ "$result" == "$expected" ]]; then
+    echo "Pass: $file version ($result)"
+  else
+    echo "FAIL: $file version (expected $expected, got $result)"
+    failures=$((failures + 1))
   fi
+done
+
+# The corpus zipped, deflated and stored, scanned without extraction
+if command -v zip > /dev/null; then
+  echo -e "\nRunning ZIP archive tests..."
+  for level in "-6" "-0"; do
+    archive="${CORPUS_DIR}/corpus${level}.zip"
+    rm -f "${archive}"
+    zip -q -j "${level}" "${archive}" "${CORPUS_DIR}"/*.exe
+    report=$("${DETECTOR}" --zip "${archive}")
+    for file in "${CORPUS_DIR}"/*.exe; do
+      name=$(basename "$file")
+      expected="benign"
+      [[ "$name" == ssh_* ]] && expected="ssh"
+      verdict="missing"
+      line=$(grep " ${name}\$" <<< "$report")
+      [[ "$line" == *"score"* ]] && verdict="benign"
+      [[ "$line" == *"SSH client"* ]] && verdict="ssh"
+
+      if [[ "$verdict" == "$expected" ]]; then
+        echo "Pass: $file --zip ${level} ($verdict)"
+      else
+        echo "FAIL: $file --zip ${level} (expected $expected, got $verdict)"
+        failures=$((failures + 1))
+      fi
+    done
+    rm -f "${archive}"
+  done
+
+  # Members too large for a worker's share of the inflate memory take turns
+  # with the shared buffer; past it, deflated members are skipped
+  archive="${CORPUS_DIR}/large.zip"
+  large="${CORPUS_DIR}/ssh_large.exe"
+  huge="${CORPUS_DIR}/huge.exe"
+  rm -f "${archive}"
+  "${GENERATOR}" --out "${large}" --size 9M \
+    --import ws2_32.dll:connect,send,recv --ascii known_hosts > /dev/null
+  { printf 'MZ'; head -c 129M /dev/zero; } > "${huge}"
+  zip -q -j "${archive}" "${CORPUS_DIR}"/*.exe
+  report=$("${DETECTOR}" --zip "${archive}" --workers 32)
+  for name in ssh_large.exe huge.exe; do
+    expected="SSH client"
+    [[ "$name" == huge.exe ]] && expected="too large"
+    line=$(grep " ${name}\$" <<< "$report")
+    if [[ "$line" == *"${expected}"* ]]; then
+      echo "Pass: ${name} --zip --workers 32 (${expected})"
+    else
+      echo "FAIL: ${name} --zip --workers 32 (expected ${expected}, got ${line})"
+      failures=$((failures + 1))
+    fi
+  done
+  rm -f "${archive}" "${large}" "${huge}"
+fi
+
+# Three samples embedded in random bytes, each carved where it lies
+echo -e "\nRunning carving tests..."
+BLOB="${TMPDIR:-/tmp}/detectpessh_test_$$.blob"
+embedded=("${CORPUS_DIR}/ssh_imports_pe64_10K.exe"
+  "${CORPUS_DIR}/benign_pe32_10K.exe" "${CORPUS_DIR}/ssh_wide_pe32_1M.exe")
+offsets=()
+rm -f "${BLOB}"
+for file in "${embedded[@]}"; do
+  head -c $((4096 + ${#offsets[@]} * 1234)) /dev/urandom >> "${BLOB}"
+  offsets+=("$(stat -c %s "${BLOB}")")
+  cat "$file" >> "${BLOB}"
+done
+head -c 777 /dev/urandom >> "${BLOB}"
+report=$("${DETECTOR}" --carve "${BLOB}")
+for i in "${!embedded[@]}"; do
+  file="${embedded[$i]}"
+  format="PE32"
+  [[ "$file" == *_pe64_* ]] && format="PE32+"
+  verdict="-"
+  [[ "$(basename "$file")" == ssh_* ]] && verdict="SSH client"
+  expected=$(printf "0x%012x  %10d bytes  %-5s %-6s" "${offsets[$i]}" \
+    "$(stat -c %s "$file")" "${format}" "file")
+  line=$(grep "^0x" <<< "$report" | sed -n "$((i + 1))p")
+
+  if [[ "$line" == "${expected}"*"  ${verdict}" ]]; then
+    echo "Pass: $file --carve (${verdict})"
+  else
+    echo "FAIL: $file --carve (expected ${expected} ... ${verdict}, got ${line})"
+    failures=$((failures + 1))
+  fi
+done
+if [[ "$(grep -c "^0x" <<< "$report")" -ne ${#embedded[@]} ]]; then
+  echo "FAIL: --carve found other images than the ${#embedded[@]} embedded"
+  failures=$((failures + 1))
 fi
+rm -f "${BLOB}"
+
+# A verdict from the cache is reported like the analysis that made it
+echo -e "\nRunning verdict cache tests..."
+rm -f "${CACHE}"
+facts='"pe32_plus":[a-z]*|"packed":[a-z]*|"imphash":"[0-9a-f]*"'
+for file in "${CORPUS_DIR}"/*.exe; do
+  fresh=$("${DETECTOR}" --cache "${CACHE}" --format json "$file" |
+    grep -oE "${facts}")
+  json=$("${DETECTOR}" --cache "${CACHE}" --format json "$file")
+  cached=$(grep -oE "${facts}" <<< "$json")
+
+  if [[ "$json" == *'"rule":"cached_verdict"'* ]] &&
+    [[ "$cached" == "$fresh" ]]; then
+    echo "Pass: $file --cache (same report)"
+  else
+    echo "FAIL: $file --cache (expected ${fresh//$'\n'/ }, got ${cached//$'\n'/ })"
+    failures=$((failures + 1))
+  fi
+done
+
+# The same corpus through the scan service, by path and by descriptor,
+# with a queue small enough for backpressure to kick in. The verdict cache
+# warmed above is used, so the string index of cached files is checked too.
+echo -e "\nRunning tests through the scan service..."
+"${DETECTOR}" --serve "${SOCKET}" --workers 2 --queue 2 --strings \
+  --cache "${CACHE}" 2> /dev/null &
+service=$!
+for _ in $(seq 50); do
+  [[ -S "${SOCKET}" ]] && break
+  sleep 0.1
+done
+
+files=("${CORPUS_DIR}"/*.exe)
+for mode in "" "--fd"; do
+  responses=$("${CLIENT}" ${mode} --window 8 "${SOCKET}" "${files[@]}")
+  for i in "${!files[@]}"; do
+    file="${files[$i]}"
+    expected="benign"
+    [[ "$(basename "$file")" == ssh_* ]] && expected="ssh"
+    verdict="missing"
+    line=$(grep "^{\"id\":\"$i\"," <<< "$responses")
+    [[ "$line" == *'"ssh_client":true'* ]] && verdict="ssh"
+    [[ "$line" == *'"ssh_client":false'* ]] && verdict="benign"
+
+    if [[ "$verdict" == "$expected" ]]; then
+      echo "Pass: $file --serve ${mode} ($verdict)"
+    else
+      echo "FAIL: $file --serve ${mode} (expected $expected, got $verdict)"
+      failures=$((failures + 1))
+    fi
+  done
+done
 
+# The strings of every file scanned so far, queried across the corpus:
+# only the plain benign samples hold "Hello, World"
+answer=$("${CLIENT}" --quiet --find "hello, world" "${SOCKET}" "${files[0]}" |
+  grep '^{"id":"q0",')
+for file in "${files[@]}"; do
+  expected="absent"
+  [[ "$(basename "$file")" == benign_pe* ]] && expected="found"
+  result="absent"
+  [[ "$answer" == *"\"$file\""* ]] && result="found"
 
+  if [[ "$result" == "$expected" ]]; then
+    echo "Pass: $file FIND ($result)"
+  else
+    echo "FAIL: $file FIND (expected $expected, got $result)"
+    failures=$((failures + 1))
+  fi
+done
+kill -TERM "${service}"
+wait "${service}"
+rm -f "${CACHE}"
 
-sleep 1
-echo -e "\nRunning tests on sample files..."
-sleep 0.5
+# Real clients, if any were put there by hand
 for file in "${SAMPLE_FILES_DIR}"/*; do
   if [[ -f "$file" ]]; then
     echo "=========================================================================="
     echo "Testing: $file"
-    ../build/detectpessh "$file"
+    "${DETECTOR}" "$file"
     echo
   fi
 done
+
+echo
+if [[ $failures -gt 0 ]]; then
+  echo "$failures tests failed"
+  exit 1
+fi
+echo "All tests passed"
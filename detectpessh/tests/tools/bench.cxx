@@ -0,0 +1,296 @@
+// Measures detectpessh on a corpus and compares the results with a baseline
+#include "detectpessh.hpp"
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+
+struct BenchResult {
+  std::string name;
+  uint64_t size;
+  double fullMicros;   // best of all iterations, every stage
+  double triageMicros; // best of all iterations, stopping early
+  std::array<double, STAGE_COUNT> stageMicros{};
+  long peakRssKb; // of a process that analysed only this file
+  bool sshClient;
+};
+
+// What the child process measuring one file sends back
+struct Measurement {
+  double fullMicros;
+  double triageMicros;
+  std::array<double, STAGE_COUNT> stageMicros;
+  bool sshClient;
+  bool triageVerdict;
+};
+
+static void printUsage(const char *program) {
+  std::cout << "Usage: " << program
+            << " [--iterations <n>] [--baseline <file>] [--write-baseline "
+               "<file>]\n"
+            << "         [--tolerance <percent>] <corpus_dir>" << std::endl;
+}
+
+/**
+ * Analyses one file repeatedly, each time from loading it to the verdict.
+ * After one warm-up run, iterates at least iterations times and until
+ * MIN_TIME has passed, so that short runs are not just timer noise.
+ *
+ * @param full whether to run every stage
+ * @param stats receives the per-stage times of every timed iteration
+ * @return the fastest iteration in microseconds, -1 if the file failed
+ */
+static double timeAnalysis(PESSHDetector &detector, const std::string &path,
+                           bool full, int iterations, StageStats *stats,
+                           bool &sshClient) {
+  const std::chrono::milliseconds MIN_TIME(200);
+  const int MAX_ITERATIONS = 10000;
+
+  detector.setFullAnalysis(full);
+  detector.setStageStats(nullptr);
+  if (!detector.loadPEFile(path))
+    return -1;
+  detector.isSSHClient(); // page cache, lazy library initialisation
+  detector.setStageStats(stats);
+
+  double best = 0;
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < MAX_ITERATIONS; i++) {
+    auto start = std::chrono::steady_clock::now();
+    if (!detector.loadPEFile(path))
+      return -1;
+    sshClient = detector.isSSHClient();
+    auto end = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double, std::micro> elapsed = end - start;
+    if (i == 0 || elapsed.count() < best)
+      best = elapsed.count();
+    if (i + 1 >= iterations && end - begin >= MIN_TIME)
+      break;
+  }
+  detector.setStageStats(nullptr);
+  return best;
+}
+
+/**
+ * Times one file, full and triage, in a child process of its own, so that
+ * the peak resident memory is what this file took and not the most any
+ * file before it did. The parent keeps no analysis state, so what the child
+ * starts with is small and the same for every file.
+ *
+ * @param peakRssKb set to the child's peak resident memory
+ * @return false if the file could not be analysed
+ */
+static bool measureFile(const std::string &path, int iterations,
+                        Measurement &measurement, long &peakRssKb) {
+  int fds[2];
+  if (pipe(fds) != 0)
+    return false;
+
+  pid_t child = fork();
+  if (child < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  if (child == 0) {
+    close(fds[0]);
+    PESSHDetector detector;
+    Measurement result{};
+    StageStats stats;
+    result.fullMicros = timeAnalysis(detector, path, true, iterations, &stats,
+                                     result.sshClient);
+    result.triageMicros = timeAnalysis(detector, path, false, iterations,
+                                       nullptr, result.triageVerdict);
+    for (size_t s = 0; s < STAGE_COUNT; s++) {
+      AnalysisStage stage = static_cast<AnalysisStage>(s);
+      if (stats.runs(stage) > 0)
+        result.stageMicros[s] = stats.nanoseconds(stage) / 1000.0 /
+                                static_cast<double>(stats.runs(stage));
+    }
+    bool sent = write(fds[1], &result, sizeof(result)) == sizeof(result);
+    _exit(sent ? 0 : 1);
+  }
+
+  close(fds[1]);
+  ssize_t received = 0;
+  while (received < static_cast<ssize_t>(sizeof(measurement))) {
+    ssize_t n = read(fds[0], reinterpret_cast<char *>(&measurement) + received,
+                     sizeof(measurement) - received);
+    if (n <= 0)
+      break;
+    received += n;
+  }
+  close(fds[0]);
+
+  int status = 0;
+  rusage usage{};
+  if (wait4(child, &status, 0, &usage) != child)
+    return false;
+  peakRssKb = usage.ru_maxrss;
+  return received == sizeof(measurement) && WIFEXITED(status) &&
+         WEXITSTATUS(status) == 0 && measurement.fullMicros >= 0 &&
+         measurement.triageMicros >= 0;
+}
+
+// "name full_us triage_us" per line, # starts a comment
+static std::map<std::string, std::pair<double, double>>
+readBaseline(const std::string &path) {
+  std::map<std::string, std::pair<double, double>> baseline;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    char name[256];
+    double full, triage;
+    if (std::sscanf(line.c_str(), "%255s %lf %lf", name, &full, &triage) == 3)
+      baseline[name] = {full, triage};
+  }
+  return baseline;
+}
+
+static bool writeBaseline(const std::string &path,
+                          const std::vector<BenchResult> &results) {
+  std::ofstream out(path, std::ios::trunc);
+  out << "# detectpessh benchmark baseline: file full_us triage_us\n"
+      << "# regenerate with: make bench-baseline\n";
+  for (const auto &result : results) {
+    char line[320];
+    std::snprintf(line, sizeof(line), "%s %.1f %.1f\n", result.name.c_str(),
+                  result.fullMicros, result.triageMicros);
+    out << line;
+  }
+  return static_cast<bool>(out);
+}
+
+int main(int argc, char *argv[]) {
+  std::string corpusDir;
+  std::string baselinePath;
+  std::string newBaselinePath;
+  int iterations = 3;
+  double tolerance = 25; // percent slower before a result is a regression
+  const double NOISE_MICROS = 20; // differences below this are never one
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--iterations" && hasValue) {
+      iterations = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--baseline" && hasValue) {
+      baselinePath = argv[++i];
+    } else if (arg == "--write-baseline" && hasValue) {
+      newBaselinePath = argv[++i];
+    } else if (arg == "--tolerance" && hasValue) {
+      tolerance = std::atof(argv[++i]);
+    } else if (corpusDir.empty() && arg.rfind("--", 0) != 0) {
+      corpusDir = arg;
+    } else {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (corpusDir.empty()) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  std::vector<std::string> files;
+  for (const auto &entry : std::filesystem::directory_iterator(corpusDir)) {
+    if (entry.is_regular_file() && entry.path().extension() == ".exe")
+      files.push_back(entry.path().string());
+  }
+  std::sort(files.begin(), files.end());
+  if (files.empty()) {
+    std::cerr << "Error: no .exe files in " << corpusDir << '\n';
+    return 1;
+  }
+
+  std::vector<BenchResult> results;
+  for (const auto &path : files) {
+    BenchResult result{};
+    result.name = std::filesystem::path(path).filename().string();
+    result.size = std::filesystem::file_size(path);
+
+    Measurement measurement{};
+    if (!measureFile(path, iterations, measurement, result.peakRssKb)) {
+      std::cerr << "Error: Cannot analyse " << path << '\n';
+      return 1;
+    }
+    if (measurement.triageVerdict != measurement.sshClient) {
+      std::cerr << "Error: early exit changed the verdict of " << path << '\n';
+      return 1;
+    }
+
+    result.fullMicros = measurement.fullMicros;
+    result.triageMicros = measurement.triageMicros;
+    result.stageMicros = measurement.stageMicros;
+    result.sshClient = measurement.sshClient;
+    results.push_back(result);
+  }
+
+  std::cout << "\n=== detectpessh benchmark (best of at least " << iterations
+            << ") ===\n";
+  std::printf("%-26s %11s %11s %11s %9s %9s", "file", "bytes", "full us",
+              "triage us", "MB/s", "rss KB");
+  for (size_t s = 0; s < STAGE_COUNT; s++)
+    std::printf(" %13.13s", stageName(static_cast<AnalysisStage>(s)));
+  std::printf("\n");
+  for (const auto &result : results) {
+    double throughput = result.size / result.fullMicros; // bytes/us = MB/s
+    std::printf("%-26s %11llu %11.1f %11.1f %9.1f %9ld",
+                result.name.c_str(),
+                static_cast<unsigned long long>(result.size),
+                result.fullMicros, result.triageMicros, throughput,
+                result.peakRssKb);
+    for (double micros : result.stageMicros)
+      std::printf(" %11.1fus", micros);
+    std::printf("\n");
+  }
+  std::fflush(stdout);
+
+  int status = 0;
+  if (!baselinePath.empty()) {
+    auto baseline = readBaseline(baselinePath);
+    size_t regressions = 0;
+    size_t unmeasured = 0;
+    std::cout << "\n=== Compared with " << baselinePath << " ===\n";
+    for (const auto &result : results) {
+      auto it = baseline.find(result.name);
+      if (it == baseline.end()) {
+        // listed, so a stale baseline does not pass for a checked one
+        std::printf("%-26s no baseline entry\n", result.name.c_str());
+        unmeasured++;
+        continue;
+      }
+
+      double fullChange = 100.0 * (result.fullMicros / it->second.first - 1);
+      double triageChange =
+          100.0 * (result.triageMicros / it->second.second - 1);
+      bool regressed =
+          (fullChange > tolerance &&
+           result.fullMicros - it->second.first > NOISE_MICROS) ||
+          (triageChange > tolerance &&
+           result.triageMicros - it->second.second > NOISE_MICROS);
+      regressions += regressed;
+      std::printf("%-26s full %+7.1f%%  triage %+7.1f%%%s\n",
+                  result.name.c_str(), fullChange, triageChange,
+                  regressed ? "  REGRESSION" : "");
+    }
+    std::cout << regressions << " regressions (tolerance " << tolerance
+              << "%)" << std::endl;
+    if (unmeasured > 0)
+      std::cout << unmeasured
+                << " samples without a baseline, regenerate it with make "
+                   "bench-baseline"
+                << std::endl;
+    status = regressions > 0 ? 1 : 0;
+  }
+
+  if (!newBaselinePath.empty() && !writeBaseline(newBaselinePath, results)) {
+    std::cerr << "Error: Cannot write " << newBaselinePath << '\n';
+    return 1;
+  }
+  return status;
+}
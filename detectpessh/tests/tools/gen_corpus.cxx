@@ -0,0 +1,196 @@
+// Generates synthetic PE32/PE32+ binaries for the tests and the benchmark
+#include "pe_generator.hpp"
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+
+static void printUsage(const char *program) {
+  std::cout << "Usage: " << program << " [--max-size <size>] <corpus_dir>\n"
+            << "       " << program
+            << " --out <file> [--pe32] [--sections <n>] [--size <size>]\n"
+            << "         [--seed <n>] [--import <dll>:<fn>,<fn>,#<ordinal>]\n"
+            << "         [--delay-import <dll>:<fn>,...] [--ascii <string>]\n"
+            << "         [--wide <string>] [--packed] [--version <key>=<value>]\n"
+            << "\nSizes take a K, M or G suffix. The corpus holds every "
+               "standard sample up to max-size (default 1M)."
+            << std::endl;
+}
+
+static ImportSpec parseImport(const std::string &text, bool delayLoaded) {
+  ImportSpec import;
+  import.delayLoaded = delayLoaded;
+  size_t colon = text.find(':');
+  import.dll = text.substr(0, colon);
+  if (colon == std::string::npos)
+    return import;
+
+  std::stringstream functions(text.substr(colon + 1));
+  std::string function;
+  while (std::getline(functions, function, ','))
+    import.functions.push_back(function);
+  return import;
+}
+
+/**
+ * Writes the standard corpus. File names start with the expected verdict,
+ * "ssh_" or "benign_", so tests can check it.
+ *
+ * @return process exit code
+ */
+static int writeCorpus(const std::string &dir, uint64_t maxSize) {
+  struct Kind {
+    const char *name;
+    std::vector<ImportSpec> imports;
+    std::vector<std::string> ascii;
+    std::vector<std::string> wide;
+    bool packed{false};
+    std::vector<std::pair<std::string, std::string>> version;
+  };
+  const std::vector<Kind> kinds = {
+      // recognised from its imports alone
+      {"ssh_imports",
+       {{"WS2_32.dll", {"WSAStartup", "WSAConnect", "getaddrinfo", "#4", "#23"}},
+        {"bcrypt.dll", {"BCryptGenRandom"}},
+        {"ADVAPI32.dll", {"CryptAcquireContextA", "RegOpenKeyExA"}},
+        {"KERNEL32.dll", {"CreateFileW", "ExitProcess"}},
+        {"CRYPT32.dll", {"CertOpenStore"}, true}},
+       {"SSH-2.0-Synthetic_1.0", "known_hosts", "ssh-rsa", "aes256-ctr",
+        "diffie-hellman-group14-sha256"},
+       {"%USERPROFILE%\\.ssh\\known_hosts"}},
+      // recognised only from UTF-16LE strings
+      {"ssh_wide",
+       {{"KERNEL32.dll", {"ExitProcess"}}},
+       {},
+       {"OpenSSH", "known_hosts", "ssh-ed25519", "authorized_keys"}},
+      {"benign",
+       {{"KERNEL32.dll", {"CreateFileW", "ReadFile", "ExitProcess"}},
+        {"USER32.dll", {"MessageBoxW"}}},
+       {"hello world"},
+       {"Hello, World"},
+       false,
+       {{"ProductName", "Hello World"},
+        {"OriginalFilename", "hello.exe"}}},
+      // named by its version resource, no other SSH evidence
+      {"ssh_version",
+       {{"KERNEL32.dll", {"ExitProcess"}}},
+       {},
+       {},
+       false,
+       {{"CompanyName", "Simon Tatham"},
+        {"FileDescription", "SSH, Telnet and Rlogin client"},
+        {"ProductName", "PuTTY suite"},
+        {"OriginalFilename", "PuTTY.exe"}}},
+      // code compressed by a packer, only the stub's imports in the clear
+      {"benign_packed",
+       {{"KERNEL32.dll",
+         {"LoadLibraryA", "GetProcAddress", "VirtualProtect", "ExitProcess"}}},
+       {},
+       {},
+       true},
+  };
+  const struct {
+    const char *label;
+    uint64_t size;
+    uint16_t sections;
+  } sizes[] = {{"10K", 10ull << 10, 3},
+               {"1M", 1ull << 20, 4},
+               {"64M", 64ull << 20, 8},
+               {"1G", 1ull << 30, 16}};
+
+  std::error_code error;
+  std::filesystem::create_directories(dir, error);
+  if (error) {
+    std::cerr << "Error: Cannot create " << dir << '\n';
+    return 1;
+  }
+
+  uint64_t seed = 1;
+  for (const auto &size : sizes) {
+    if (size.size > maxSize)
+      continue;
+    for (const auto &kind : kinds) {
+      for (bool pe32Plus : {false, true}) {
+        PESpec spec;
+        spec.pe32Plus = pe32Plus;
+        spec.sections = size.sections;
+        spec.imports = kind.imports;
+        spec.asciiStrings = kind.ascii;
+        spec.wideStrings = kind.wide;
+        spec.packed = kind.packed;
+        spec.versionInfo = kind.version;
+        spec.size = size.size;
+        spec.seed = seed++;
+
+        std::string path = dir + "/" + kind.name +
+                           (pe32Plus ? "_pe64_" : "_pe32_") + size.label +
+                           ".exe";
+        if (!writePE(spec, path)) {
+          std::cerr << "Error: Cannot write " << path << '\n';
+          return 1;
+        }
+        std::cout << "Generated " << path << std::endl;
+      }
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  PESpec spec;
+  std::string outPath;
+  std::string corpusDir;
+  uint64_t maxSize = 1ull << 20;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--out" && hasValue) {
+      outPath = argv[++i];
+    } else if (arg == "--max-size" && hasValue) {
+      maxSize = parseSize(argv[++i]);
+    } else if (arg == "--pe32") {
+      spec.pe32Plus = false;
+    } else if (arg == "--sections" && hasValue) {
+      spec.sections = static_cast<uint16_t>(std::stoul(argv[++i]));
+    } else if (arg == "--size" && hasValue) {
+      spec.size = parseSize(argv[++i]);
+    } else if (arg == "--seed" && hasValue) {
+      spec.seed = std::stoull(argv[++i]);
+    } else if (arg == "--import" && hasValue) {
+      spec.imports.push_back(parseImport(argv[++i], false));
+    } else if (arg == "--delay-import" && hasValue) {
+      spec.imports.push_back(parseImport(argv[++i], true));
+    } else if (arg == "--ascii" && hasValue) {
+      spec.asciiStrings.push_back(argv[++i]);
+    } else if (arg == "--wide" && hasValue) {
+      spec.wideStrings.push_back(argv[++i]);
+    } else if (arg == "--packed") {
+      spec.packed = true;
+    } else if (arg == "--version" && hasValue) {
+      std::string pair = argv[++i];
+      size_t equals = pair.find('=');
+      spec.versionInfo.emplace_back(pair.substr(0, equals),
+                                    equals == std::string::npos
+                                        ? std::string()
+                                        : pair.substr(equals + 1));
+    } else if (corpusDir.empty() && arg.rfind("--", 0) != 0) {
+      corpusDir = arg;
+    } else {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (!outPath.empty()) {
+    if (!writePE(spec, outPath)) {
+      std::cerr << "Error: Cannot write " << outPath << '\n';
+      return 1;
+    }
+    return 0;
+  }
+  if (corpusDir.empty() || maxSize == 0) {
+    printUsage(argv[0]);
+    return 1;
+  }
+  return writeCorpus(corpusDir, maxSize);
+}
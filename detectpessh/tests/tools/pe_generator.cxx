@@ -0,0 +1,451 @@
+#include "pe_generator.hpp"
+#include "pe_headers.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+const uint32_t FILE_ALIGNMENT = 0x200;
+const uint32_t SECTION_ALIGNMENT = 0x1000;
+const uint32_t LFANEW = 0x80;
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// Contents of .rdata, addressed by RVA
+class RdataBuilder {
+private:
+  std::vector<uint8_t> bytes;
+  uint32_t base;
+
+public:
+  explicit RdataBuilder(uint32_t rva) : base(rva) {}
+
+  uint32_t put(const void *data, size_t size) {
+    uint32_t rva = base + static_cast<uint32_t>(bytes.size());
+    const uint8_t *begin = static_cast<const uint8_t *>(data);
+    bytes.insert(bytes.end(), begin, begin + size);
+    return rva;
+  }
+  uint32_t put(const std::string &text) {
+    return put(text.c_str(), text.size() + 1);
+  }
+  // RVA of the next byte put
+  uint32_t next() const { return base + static_cast<uint32_t>(bytes.size()); }
+  void align(size_t alignment) {
+    bytes.resize(alignUp(bytes.size(), alignment), 0);
+  }
+  const std::vector<uint8_t> &data() const { return bytes; }
+};
+
+struct RdataTables {
+  IMAGE_DATA_DIRECTORY imports{};
+  IMAGE_DATA_DIRECTORY resources{};
+  IMAGE_DATA_DIRECTORY delayImports{};
+};
+
+// Name table and address table of one DLL, both pointing at the same names
+template <typename Thunk>
+std::pair<uint32_t, uint32_t> putThunks(RdataBuilder &rdata,
+                                        const ImportSpec &import,
+                                        Thunk ordinalFlag) {
+  std::vector<Thunk> thunks;
+  for (const auto &function : import.functions) {
+    if (!function.empty() && function[0] == '#') {
+      thunks.push_back(ordinalFlag |
+                       static_cast<Thunk>(std::stoul(function.substr(1))));
+      continue;
+    }
+    rdata.align(2);
+    uint16_t hint = 0;
+    uint32_t rva = rdata.put(&hint, sizeof(hint));
+    rdata.put(function);
+    thunks.push_back(rva);
+  }
+  thunks.push_back(0);
+
+  rdata.align(sizeof(Thunk));
+  uint32_t nameTable = rdata.put(thunks.data(), thunks.size() * sizeof(Thunk));
+  uint32_t addressTable =
+      rdata.put(thunks.data(), thunks.size() * sizeof(Thunk));
+  return {nameTable, addressTable};
+}
+
+// text as UTF-16LE with its terminating NUL
+std::vector<uint8_t> wide(const std::string &text) {
+  std::vector<uint8_t> units;
+  for (char c : text) {
+    units.push_back(static_cast<uint8_t>(c));
+    units.push_back(0);
+  }
+  units.insert(units.end(), {0, 0});
+  return units;
+}
+
+void pad4(std::vector<uint8_t> &bytes) {
+  bytes.resize(alignUp(bytes.size(), 4), 0);
+}
+
+/**
+ * One block of a VS_VERSIONINFO: wLength, wValueLength, wType, the key,
+ * then the value and the children, each 32-bit aligned.
+ */
+std::vector<uint8_t>
+versionBlock(const std::string &key, const std::vector<uint8_t> &value,
+             uint16_t valueLength, bool text,
+             const std::vector<std::vector<uint8_t>> &children) {
+  std::vector<uint8_t> block(6, 0);
+  std::vector<uint8_t> keyUnits = wide(key);
+  block.insert(block.end(), keyUnits.begin(), keyUnits.end());
+  pad4(block);
+  block.insert(block.end(), value.begin(), value.end());
+  for (const auto &child : children) {
+    pad4(block);
+    block.insert(block.end(), child.begin(), child.end());
+  }
+
+  uint16_t header[3] = {static_cast<uint16_t>(block.size()), valueLength,
+                        static_cast<uint16_t>(text)};
+  std::memcpy(block.data(), header, sizeof(header));
+  return block;
+}
+
+/**
+ * A resource tree with a single RT_VERSION leaf, in English, holding the
+ * version strings of spec.
+ * @return the resource directory entry
+ */
+IMAGE_DATA_DIRECTORY putVersionResource(const PESpec &spec,
+                                        RdataBuilder &rdata) {
+  std::vector<std::vector<uint8_t>> strings;
+  for (const auto &[key, value] : spec.versionInfo)
+    strings.push_back(versionBlock(key, wide(value),
+                                   static_cast<uint16_t>(value.size() + 1),
+                                   true, {}));
+  std::vector<uint8_t> table = versionBlock("040904B0", {}, 0, true, strings);
+  std::vector<uint8_t> stringFileInfo =
+      versionBlock("StringFileInfo", {}, 0, true, {table});
+
+  // VS_FIXEDFILEINFO: signature and structure version, versions left 0
+  std::vector<uint8_t> fixed(52, 0);
+  const uint32_t signature[2] = {0xFEEF04BD, 0x00010000};
+  std::memcpy(fixed.data(), signature, sizeof(signature));
+  std::vector<uint8_t> info = versionBlock(
+      "VS_VERSION_INFO", fixed, static_cast<uint16_t>(fixed.size()), false,
+      {stringFileInfo});
+
+  // type, name and language directories of one entry each, then the leaf
+  const uint32_t SUBDIRECTORY = 0x80000000u;
+  const uint32_t LEVEL =
+      sizeof(IMAGE_RESOURCE_DIRECTORY) + sizeof(IMAGE_RESOURCE_DIRECTORY_ENTRY);
+  const IMAGE_RESOURCE_DIRECTORY_ENTRY path[3] = {
+      {16, SUBDIRECTORY | LEVEL},     // RT_VERSION
+      {1, SUBDIRECTORY | 2 * LEVEL},  // VS_VERSION_INFO is resource 1
+      {0x409, 3 * LEVEL}};            // en-US
+  std::vector<uint8_t> tree(3 * LEVEL + sizeof(IMAGE_RESOURCE_DATA_ENTRY), 0);
+  for (size_t i = 0; i < 3; i++) {
+    IMAGE_RESOURCE_DIRECTORY directory{};
+    directory.NumberOfIdEntries = 1;
+    std::memcpy(tree.data() + i * LEVEL, &directory, sizeof(directory));
+    std::memcpy(tree.data() + i * LEVEL + sizeof(directory), &path[i],
+                sizeof(path[i]));
+  }
+
+  rdata.align(4);
+  const uint32_t root = rdata.next();
+  IMAGE_RESOURCE_DATA_ENTRY leaf{};
+  leaf.OffsetToData = root + static_cast<uint32_t>(tree.size());
+  leaf.Size = static_cast<uint32_t>(info.size());
+  std::memcpy(tree.data() + 3 * LEVEL, &leaf, sizeof(leaf));
+  tree.insert(tree.end(), info.begin(), info.end());
+  return {rdata.put(tree.data(), tree.size()),
+          static_cast<uint32_t>(tree.size())};
+}
+
+RdataTables buildRdata(const PESpec &spec, RdataBuilder &rdata) {
+  for (const auto &text : spec.asciiStrings)
+    rdata.put(text);
+
+  for (const auto &text : spec.wideStrings) {
+    rdata.align(2);
+    for (char c : text) {
+      uint8_t unit[2] = {static_cast<uint8_t>(c), 0};
+      rdata.put(unit, sizeof(unit));
+    }
+    uint8_t terminator[2] = {0, 0};
+    rdata.put(terminator, sizeof(terminator));
+  }
+
+  std::vector<IMAGE_IMPORT_DESCRIPTOR> descriptors;
+  std::vector<IMAGE_DELAY_LOAD_DESCRIPTOR> delayDescriptors;
+  for (const auto &import : spec.imports) {
+    uint32_t nameRva = rdata.put(import.dll);
+    auto [nameTable, addressTable] =
+        spec.pe32Plus ? putThunks<uint64_t>(rdata, import, 1ull << 63)
+                      : putThunks<uint32_t>(rdata, import, 0x80000000u);
+
+    if (import.delayLoaded) {
+      IMAGE_DELAY_LOAD_DESCRIPTOR descriptor{};
+      descriptor.Attributes = 1; // RVAs
+      descriptor.DllNameRVA = nameRva;
+      descriptor.ImportAddressTableRVA = addressTable;
+      descriptor.ImportNameTableRVA = nameTable;
+      delayDescriptors.push_back(descriptor);
+    } else {
+      IMAGE_IMPORT_DESCRIPTOR descriptor{};
+      descriptor.OriginalFirstThunk = nameTable;
+      descriptor.Name = nameRva;
+      descriptor.FirstThunk = addressTable;
+      descriptors.push_back(descriptor);
+    }
+  }
+
+  RdataTables tables;
+  if (!descriptors.empty()) {
+    descriptors.emplace_back();
+    rdata.align(4);
+    tables.imports.Size = static_cast<uint32_t>(
+        descriptors.size() * sizeof(IMAGE_IMPORT_DESCRIPTOR));
+    tables.imports.VirtualAddress =
+        rdata.put(descriptors.data(), tables.imports.Size);
+  }
+  if (!delayDescriptors.empty()) {
+    delayDescriptors.emplace_back();
+    rdata.align(4);
+    tables.delayImports.Size = static_cast<uint32_t>(
+        delayDescriptors.size() * sizeof(IMAGE_DELAY_LOAD_DESCRIPTOR));
+    tables.delayImports.VirtualAddress =
+        rdata.put(delayDescriptors.data(), tables.delayImports.Size);
+  }
+  if (!spec.versionInfo.empty())
+    tables.resources = putVersionResource(spec, rdata);
+  return tables;
+}
+
+// Bytes 0x80-0xbf: never an ASCII letter, so never part of a string rule
+class Filler {
+private:
+  uint64_t state;
+
+public:
+  explicit Filler(uint64_t seed) : state(seed * 0x9e3779b97f4a7c15ull + 1) {}
+
+  void fill(uint8_t *out, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      out[i] = static_cast<uint8_t>(0x80 | ((state >> 32) & 0x3f));
+    }
+  }
+
+  // Every byte value, as dense as compressed data
+  void fillCompressed(uint8_t *out, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      out[i] = static_cast<uint8_t>(state >> 32);
+    }
+  }
+};
+
+struct SectionLayout {
+  const char *name;
+  uint32_t rawSize;
+  uint32_t virtualSize;
+  uint32_t characteristics;
+  SECTION_HEADER header{};
+};
+
+template <typename OptionalHeader>
+void fillOptionalHeader(OptionalHeader &optional, const PESpec &spec,
+                        uint32_t sizeOfHeaders, uint32_t sizeOfImage,
+                        const std::vector<SectionLayout> &sections,
+                        const RdataTables &tables) {
+  optional.MajorLinkerVersion = 14;
+  optional.AddressOfEntryPoint = sections[0].header.VirtualAddress;
+  optional.BaseOfCode = sections[0].header.VirtualAddress;
+  optional.SizeOfCode = sections[0].rawSize;
+  for (size_t i = 1; i < sections.size(); i++)
+    optional.SizeOfInitializedData += sections[i].rawSize;
+  optional.SectionAlignment = SECTION_ALIGNMENT;
+  optional.FileAlignment = FILE_ALIGNMENT;
+  optional.MajorOperatingSystemVersion = 6;
+  optional.MajorSubsystemVersion = 6;
+  optional.SizeOfImage = sizeOfImage;
+  optional.SizeOfHeaders = sizeOfHeaders;
+  optional.Subsystem = 3; // console
+  optional.DllCharacteristics = spec.pe32Plus ? 0x8160 : 0x8140;
+  optional.SizeOfStackReserve = 0x100000;
+  optional.SizeOfStackCommit = 0x1000;
+  optional.SizeOfHeapReserve = 0x100000;
+  optional.SizeOfHeapCommit = 0x1000;
+  optional.NumberOfRvaAndSizes = 16;
+  optional.DataDirectory[1] = tables.imports;
+  optional.DataDirectory[2] = tables.resources;
+  optional.DataDirectory[13] = tables.delayImports;
+}
+
+} // namespace
+
+bool writePE(const PESpec &spec, std::ostream &out) {
+  const uint16_t sectionCount = std::max<uint16_t>(spec.sections, 2);
+  const size_t optionalSize =
+      spec.pe32Plus ? sizeof(OPTIONAL_HEADER64) : sizeof(OPTIONAL_HEADER32);
+  const uint32_t sizeOfHeaders = static_cast<uint32_t>(alignUp(
+      LFANEW + 4 + sizeof(FILE_HEADER) + optionalSize +
+          sectionCount * sizeof(SECTION_HEADER),
+      FILE_ALIGNMENT));
+
+  // .rdata is built once to learn its size, then again at its real RVA
+  RdataBuilder sizing(0);
+  buildRdata(spec, sizing);
+  const uint32_t rdataRawSize = static_cast<uint32_t>(
+      alignUp(std::max<size_t>(sizing.data().size(), 1), FILE_ALIGNMENT));
+
+  uint64_t fixed = sizeOfHeaders + rdataRawSize;
+  uint64_t filler = spec.size > fixed ? spec.size - fixed : 0;
+  size_t dataSections = sectionCount - 2;
+  uint64_t textSize = dataSections == 0 ? filler : filler / 2;
+  uint64_t dataSize = dataSections == 0 ? 0 : (filler - textSize) / dataSections;
+
+  std::vector<SectionLayout> sections;
+  sections.push_back({spec.packed ? "UPX1" : ".text",
+                      static_cast<uint32_t>(alignUp(
+                          std::max<uint64_t>(textSize, 1), FILE_ALIGNMENT)),
+                      static_cast<uint32_t>(std::max<uint64_t>(textSize, 1)),
+                      spec.packed ? 0xE0000040u : 0x60000020u});
+  sections.push_back({".rdata", rdataRawSize,
+                      static_cast<uint32_t>(sizing.data().size()),
+                      0x40000040});
+  std::vector<std::string> dataNames;
+  for (size_t i = 0; i < dataSections; i++)
+    dataNames.push_back(i == 0 ? ".data" : ".data" + std::to_string(i));
+  for (size_t i = 0; i < dataSections; i++) {
+    sections.push_back({dataNames[i].c_str(),
+                        static_cast<uint32_t>(alignUp(
+                            std::max<uint64_t>(dataSize, 1), FILE_ALIGNMENT)),
+                        static_cast<uint32_t>(std::max<uint64_t>(dataSize, 1)),
+                        0xC0000040});
+  }
+
+  uint32_t rva = SECTION_ALIGNMENT;
+  uint32_t rawOffset = sizeOfHeaders;
+  for (auto &section : sections) {
+    std::strncpy(section.header.Name, section.name,
+                 sizeof(section.header.Name));
+    section.header.VirtualSize = section.virtualSize;
+    section.header.VirtualAddress = rva;
+    section.header.SizeOfRawData = section.rawSize;
+    section.header.PointerToRawData = rawOffset;
+    section.header.Characteristics = section.characteristics;
+    rva = static_cast<uint32_t>(
+        alignUp(uint64_t(rva) + section.virtualSize, SECTION_ALIGNMENT));
+    rawOffset += section.rawSize;
+  }
+  const uint32_t sizeOfImage = rva;
+
+  RdataBuilder rdata(sections[1].header.VirtualAddress);
+  RdataTables tables = buildRdata(spec, rdata);
+
+  std::vector<uint8_t> headers(sizeOfHeaders, 0);
+  DOS_HEADER dos{};
+  dos.e_magic = 0x5A4D; // "MZ"
+  dos.e_lfanew = LFANEW;
+  std::memcpy(headers.data(), &dos, sizeof(dos));
+
+  size_t offset = LFANEW;
+  std::memcpy(headers.data() + offset, "PE\0\0", 4);
+  offset += 4;
+
+  FILE_HEADER file{};
+  file.Machine = spec.pe32Plus ? 0x8664 : 0x14c;
+  file.NumberOfSections = sectionCount;
+  file.SizeOfOptionalHeader = static_cast<uint16_t>(optionalSize);
+  file.Characteristics = spec.pe32Plus ? 0x22 : 0x102;
+  std::memcpy(headers.data() + offset, &file, sizeof(file));
+  offset += sizeof(file);
+
+  if (spec.pe32Plus) {
+    OPTIONAL_HEADER64 optional{};
+    optional.Magic = 0x20b;
+    optional.ImageBase = 0x140000000ull;
+    fillOptionalHeader(optional, spec, sizeOfHeaders, sizeOfImage, sections,
+                       tables);
+    std::memcpy(headers.data() + offset, &optional, sizeof(optional));
+  } else {
+    OPTIONAL_HEADER32 optional{};
+    optional.Magic = 0x10b;
+    optional.ImageBase = 0x400000;
+    optional.BaseOfData = sections[1].header.VirtualAddress;
+    fillOptionalHeader(optional, spec, sizeOfHeaders, sizeOfImage, sections,
+                       tables);
+    std::memcpy(headers.data() + offset, &optional, sizeof(optional));
+  }
+  offset += optionalSize;
+
+  for (const auto &section : sections) {
+    std::memcpy(headers.data() + offset, &section.header,
+                sizeof(SECTION_HEADER));
+    offset += sizeof(SECTION_HEADER);
+  }
+  out.write(reinterpret_cast<const char *>(headers.data()), headers.size());
+
+  const size_t CHUNK = 1 << 20;
+  std::vector<uint8_t> chunk(CHUNK);
+  Filler random(spec.seed);
+  for (size_t i = 0; i < sections.size(); i++) {
+    const auto &section = sections[i];
+    if (i == 1) {
+      std::vector<uint8_t> raw(rdata.data());
+      raw.resize(section.rawSize, 0);
+      out.write(reinterpret_cast<const char *>(raw.data()), raw.size());
+      continue;
+    }
+
+    uint64_t remaining = section.rawSize;
+    bool first = true;
+    while (remaining > 0) {
+      size_t count = static_cast<size_t>(std::min<uint64_t>(remaining, CHUNK));
+      if (spec.packed && i == 0)
+        random.fillCompressed(chunk.data(), count);
+      else
+        random.fill(chunk.data(), count);
+      if (first && i == 0)
+        chunk[0] = 0xC3; // the entry point returns
+      first = false;
+      out.write(reinterpret_cast<const char *>(chunk.data()), count);
+      remaining -= count;
+    }
+  }
+  return static_cast<bool>(out);
+}
+
+bool writePE(const PESpec &spec, const std::string &path) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  return out && writePE(spec, out) && out.flush();
+}
+
+uint64_t parseSize(const std::string &text) {
+  size_t end = 0;
+  uint64_t value;
+  try {
+    value = std::stoull(text, &end);
+  } catch (...) {
+    return 0;
+  }
+
+  std::string unit = text.substr(end);
+  if (unit.empty() || unit == "B")
+    return value;
+  if (unit == "K" || unit == "KB")
+    return value << 10;
+  if (unit == "M" || unit == "MB")
+    return value << 20;
+  if (unit == "G" || unit == "GB")
+    return value << 30;
+  return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef PE_GENERATOR_H__
+#define PE_GENERATOR_H__
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// One imported DLL. Functions named "#n" are imported by ordinal n.
+struct ImportSpec {
+  std::string dll;
+  std::vector<std::string> functions;
+  bool delayLoaded{false};
+};
+
+/**
+ * What a synthetic PE looks like. Sections are .text, .rdata (strings and
+ * import tables), .data and .dataN for any more; the bytes needed to reach
+ * size are spread over .text and the data sections.
+ */
+struct PESpec {
+  bool pe32Plus{true};
+  uint16_t sections{3}; // at least 2, .text and .rdata
+  std::vector<ImportSpec> imports;
+  std::vector<std::string> asciiStrings;
+  std::vector<std::string> wideStrings; // stored as UTF-16LE
+  uint64_t size{10 * 1024};             // approximate file size in bytes
+  uint64_t seed{1};                     // for the filler bytes
+  // .text becomes UPX1: writable, holding random bytes like compressed code
+  bool packed{false};
+  // key/value pairs of a version resource (VS_VERSIONINFO) in .rdata
+  std::vector<std::pair<std::string, std::string>> versionInfo;
+};
+
+/**
+ * Writes a valid PE32 or PE32+ file. Filler bytes are generated while
+ * writing, so files of a gigabyte need no more memory than small ones.
+ * Filler never contains ASCII letters, so it cannot match a string rule,
+ * except for the random bytes of packed code.
+ *
+ * @return true if every byte was written
+ */
+bool writePE(const PESpec &spec, std::ostream &out);
+bool writePE(const PESpec &spec, const std::string &path);
+
+/**
+ * Parses a size such as "10K", "64M" or "1G" (powers of 1024).
+ * @return the size in bytes, 0 if malformed
+ */
+uint64_t parseSize(const std::string &text);
+#endif
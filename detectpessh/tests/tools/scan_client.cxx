@@ -0,0 +1,174 @@
+// Sends pipelined scan requests to a detectpessh --serve socket
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void printUsage(const char *program) {
+  std::cout << "Usage: " << program
+            << " [--fd] [--window <n>] [--repeat <n>] [--quiet]\n"
+            << "         [--find <text>]... <socket> <file>...\n"
+            << "Prints one response line per file, the answers to --find "
+               "once every file is scanned, then the service stats."
+            << std::endl;
+}
+
+static int connectTo(const std::string &path) {
+  sockaddr_un address{};
+  if (path.size() >= sizeof(address.sun_path))
+    return -1;
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr *>(&address),
+                           sizeof(address)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static bool sendAll(int socket, const std::string &text, int passedFd = -1) {
+  size_t sent = 0;
+  while (sent < text.size()) {
+    iovec io{const_cast<char *>(text.data() + sent), text.size() - sent};
+    msghdr message{};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+
+    // the descriptor travels with the first byte of its request
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    if (passedFd >= 0 && sent == 0) {
+      message.msg_control = control;
+      message.msg_controllen = sizeof(control);
+      cmsghdr *header = CMSG_FIRSTHDR(&message);
+      header->cmsg_level = SOL_SOCKET;
+      header->cmsg_type = SCM_RIGHTS;
+      header->cmsg_len = CMSG_LEN(sizeof(int));
+      std::memcpy(CMSG_DATA(header), &passedFd, sizeof(int));
+    }
+
+    ssize_t n = ::sendmsg(socket, &message, MSG_NOSIGNAL);
+    if (n <= 0)
+      return false;
+    sent += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  bool passFds = false;
+  bool quiet = false;
+  size_t window = 16;
+  size_t repeat = 1;
+  std::string socketPath;
+  std::vector<std::string> files;
+  std::vector<std::string> queries;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--fd") {
+      passFds = true;
+    } else if (arg == "--quiet") {
+      quiet = true;
+    } else if (arg == "--window" && i + 1 < argc) {
+      window = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--find" && i + 1 < argc) {
+      queries.push_back(argv[++i]);
+    } else if (arg == "--repeat" && i + 1 < argc) {
+      repeat = std::max(1, std::atoi(argv[++i]));
+    } else if (socketPath.empty() && arg.rfind("--", 0) != 0) {
+      socketPath = arg;
+    } else if (arg.rfind("--", 0) != 0) {
+      files.push_back(arg);
+    } else {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (socketPath.empty() || files.empty()) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  int socket = connectTo(socketPath);
+  if (socket < 0) {
+    std::cerr << "Error: Cannot connect to " << socketPath << '\n';
+    return 1;
+  }
+
+  size_t total = files.size() * repeat;
+  size_t next = 0;
+  size_t answered = 0;
+  int status = 0;
+  std::string input;
+  while (answered < total) {
+    // keep up to window requests in flight
+    while (next < total && next - answered < window) {
+      const std::string &file = files[next % files.size()];
+      std::string id = std::to_string(next);
+      bool sent;
+      if (passFds) {
+        int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+          std::cerr << "Error: Cannot open file " << file << '\n';
+          return 1;
+        }
+        sent = sendAll(socket, "SCANFD " + id + "\n", fd);
+        ::close(fd);
+      } else {
+        sent = sendAll(socket, "SCAN " + id + " " + file + "\n");
+      }
+      if (!sent) {
+        std::cerr << "Error: Connection lost\n";
+        return 1;
+      }
+      next++;
+    }
+
+    char buffer[4096];
+    ssize_t n = ::recv(socket, buffer, sizeof(buffer), 0);
+    if (n <= 0) {
+      std::cerr << "Error: Connection lost\n";
+      return 1;
+    }
+    input.append(buffer, static_cast<size_t>(n));
+    size_t end;
+    while ((end = input.find('\n')) != std::string::npos) {
+      std::string line = input.substr(0, end);
+      input.erase(0, end + 1);
+      if (line.find("\"error\"") != std::string::npos)
+        status = 1;
+      if (!quiet)
+        std::cout << line << '\n';
+      answered++;
+    }
+  }
+
+  // one line at a time: queries and stats answer in order
+  auto request = [&](const std::string &line) {
+    sendAll(socket, line + "\n");
+    while (input.find('\n') == std::string::npos) {
+      char buffer[4096];
+      ssize_t n = ::recv(socket, buffer, sizeof(buffer), 0);
+      if (n <= 0)
+        break;
+      input.append(buffer, static_cast<size_t>(n));
+    }
+    size_t end = input.find('\n');
+    std::cout << input.substr(0, end) << std::endl;
+    input.erase(0, end == std::string::npos ? end : end + 1);
+  };
+  for (size_t i = 0; i < queries.size(); i++)
+    request("FIND q" + std::to_string(i) + " " + queries[i]);
+  request("STATS");
+  ::close(socket);
+  return status;
+}
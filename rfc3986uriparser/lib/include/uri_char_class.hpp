@@ -0,0 +1,78 @@
+/*
+ * Author : Hyun Wo
+ * Purpose : This software is free for use and modification by any third party.
+ * No warranty is provided and the user is responsible for any consequences of
+ * its use.
+ * Date : 5th September 2025
+ */
+#ifndef URI_CHAR_CLASS_HPP
+#define URI_CHAR_CLASS_HPP
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// RFC 3986 character classes as bits of a 256-entry table built at compile
+// time: a check is one load and an AND, whatever the locale. Bytes outside
+// ASCII belong to no class.
+namespace uri_char_class {
+enum : uint16_t {
+  ALPHA = 1 << 0,      // A-Z a-z
+  DIGIT = 1 << 1,      // 0-9
+  HEX_DIGIT = 1 << 2,  // 0-9 A-F a-f
+  UNRESERVED = 1 << 3, // ALPHA DIGIT - . _ ~
+  GEN_DELIM = 1 << 4,  // : / ? # [ ] @
+  SUB_DELIM = 1 << 5,  // ! $ & ' ( ) * + , ; =
+  SCHEME = 1 << 6,     // ALPHA DIGIT + - .
+  USERINFO = 1 << 7,   // unreserved sub-delims : %
+  HOST = 1 << 8,       // unreserved sub-delims : [ ] %
+  PATH = 1 << 9,       // pchar and /, % starting a pct-encoded octet
+  QUERY = 1 << 10,     // path and ?
+  FRAGMENT = 1 << 11,  // path and ?
+};
+
+using Table = std::array<uint16_t, 256>;
+
+constexpr Table make_table() {
+  Table table{};
+  auto add = [&table](std::string_view chars, uint16_t classes) {
+    for (char c : chars)
+      table[static_cast<unsigned char>(c)] |= classes;
+  };
+
+  for (int c = 0; c < 256; ++c) {
+    bool lower = c >= 'a' && c <= 'z';
+    bool upper = c >= 'A' && c <= 'Z';
+    bool digit = c >= '0' && c <= '9';
+    if (lower || upper)
+      table[c] |= ALPHA;
+    if (digit)
+      table[c] |= DIGIT;
+    if (digit || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'))
+      table[c] |= HEX_DIGIT;
+    if (lower || upper || digit)
+      table[c] |= UNRESERVED | SCHEME;
+  }
+  add("-._~", UNRESERVED);
+  add(":/?#[]@", GEN_DELIM);
+  add("!$&'()*+,;=", SUB_DELIM);
+  add("+-.", SCHEME);
+
+  for (int c = 0; c < 256; ++c) {
+    if (table[c] & (UNRESERVED | SUB_DELIM))
+      table[c] |= USERINFO | HOST | PATH | QUERY | FRAGMENT;
+  }
+  add(":%", USERINFO | HOST | PATH | QUERY | FRAGMENT);
+  add("[]", HOST);
+  add("@/", PATH | QUERY | FRAGMENT);
+  add("?", QUERY | FRAGMENT);
+  return table;
+}
+
+inline constexpr Table TABLE = make_table();
+
+// whether c is in any of classes
+constexpr bool is(char c, uint16_t classes) {
+  return TABLE[static_cast<unsigned char>(c)] & classes;
+}
+} // namespace uri_char_class
+#endif
@@ -9,71 +9,127 @@
 #ifndef URI_PARSER_H
 #define URI_PARSER_H
 
+#include "uri_char_class.hpp"
 #include "uri_utils.hpp"
 #include <algorithm>
 #include <cctype>
 #include <cinttypes>
+#include <expected>
 #include <memory>
+#include <memory_resource>
 #include <optional>
+#include <span>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
+// Why a uri failed to parse
+enum class URIErrorCode : uint8_t {
+  MISSING_SCHEME, // a ':' in the first segment of a relative path
+  INVALID_PATH,
+  INVALID_QUERY,
+  INVALID_FRAGMENT,
+  INVALID_USERINFO,
+  INVALID_HOST,
+  INVALID_PORT,
+  INVALID_IP_LITERAL,
+  INVALID_PERCENT_ENCODING,
+  TOO_LONG, // 4 GB or more
+};
+
+// A parse failure and the byte offset in the input where it was found
+struct URIError {
+  URIErrorCode code;
+  size_t offset;
+
+  // e.g. "Invalid port"
+  const char *message() const;
+  // e.g. "Invalid port at offset 18"
+  std::string to_string() const;
+};
+
 class URIParseException : public std::runtime_error {
 public:
   explicit URIParseException(const std::string &message)
       : std::runtime_error(message) {}
+  explicit URIParseException(const URIError &error)
+      : std::runtime_error("Failed to parse URI: " + error.to_string()),
+        error_(error) {}
+
+  // The parse failure, if the exception comes from parsing
+  const std::optional<URIError> &error() const { return error_; }
+
+private:
+  std::optional<URIError> error_;
 };
 
+// Components are allocated from the uri's memory resource, the default
+// resource unless one is given, so uris can live in an arena. Containers
+// such as std::pmr::vector<URI> pass theirs down.
 class URI {
 public:
+  using allocator_type = std::pmr::polymorphic_allocator<char>;
+
   URI() = default;
+  explicit URI(const allocator_type &alloc);
   ~URI() = default;
+  URI(const URI &) = default;
+  URI(URI &&) noexcept = default;
+  // Copy or move into alloc's memory resource
+  URI(const URI &other, const allocator_type &alloc);
+  URI(URI &&other, const allocator_type &alloc);
+  URI &operator=(const URI &) = default;
+  URI &operator=(URI &&) = default;
+
+  allocator_type get_allocator() const { return scheme_.get_allocator(); }
 
   // Getters
-  const std::string &scheme() const { return scheme_; }
-  const std::string &authority() const { return authority_; }
-  const std::string &userinfo() const { return userinfo_; }
-  const std::string &host() const { return host_; }
+  const std::pmr::string &scheme() const { return scheme_; }
+  const std::pmr::string &authority() const { return authority_; }
+  const std::pmr::string &userinfo() const { return userinfo_; }
+  const std::pmr::string &host() const { return host_; }
   const std::optional<uint16_t> &port() const { return port_; }
-  const std::string &path() const { return path_; }
-  const std::string &query() const { return query_; }
-  const std::string &fragment() const { return fragment_; }
+  const std::pmr::string &path() const { return path_; }
+  const std::pmr::string &query() const { return query_; }
+  const std::pmr::string &fragment() const { return fragment_; }
 
   // Setters with validation
-  void set_scheme(const std::string &scheme);
-  void set_authority(const std::string &authority);
-  void set_userinfo(const std::string &userinfo);
-  void set_host(const std::string &host);
+  void set_scheme(std::string_view scheme);
+  void set_authority(std::string_view authority);
+  void set_userinfo(std::string_view userinfo);
+  void set_host(std::string_view host);
   void set_port(const std::optional<uint16_t> &port);
-  void set_path(const std::string &path);
-  void set_query(const std::string &query);
-  void set_fragment(const std::string &fragment);
+  void set_path(std::string_view path);
+  void set_query(std::string_view query);
+  void set_fragment(std::string_view fragment);
 
   // String representation
   std::string to_string() const;
 
   // Component builders
-  static std::string build_authority(const std::string &userinfo,
-                                     const std::string &host,
+  static std::string build_authority(std::string_view userinfo,
+                                     std::string_view host,
                                      const std::optional<uint16_t> &port);
 
   // Validation helpers
-  static bool is_valid_scheme(const std::string &scheme);
-  static bool is_valid_host(const std::string &host);
+  static bool is_valid_scheme(std::string_view scheme);
+  static bool is_valid_host(std::string_view host);
   static bool is_valid_port(uint16_t port);
 
 private:
-  std::string scheme_;
-  std::string authority_;
-  std::string userinfo_;
-  std::string host_;
+  friend class URIView;
+
+  std::pmr::string scheme_;
+  std::pmr::string authority_;
+  std::pmr::string userinfo_;
+  std::pmr::string host_;
   std::optional<uint16_t> port_;
-  std::string path_;
-  std::string query_;
-  std::string fragment_;
+  std::pmr::string path_;
+  std::pmr::string query_;
+  std::pmr::string fragment_;
 
   // Validation helpers
   // static bool is_valid_scheme(const std::string &scheme);
@@ -81,6 +137,127 @@ private:
   // static bool is_valid_port(uint16_t port);
 };
 
+// A parsed URI that refers to the string it was parsed from instead of
+// owning copies of its components, so parsing allocates nothing. The string
+// must outlive the view. The scheme is as written, to_uri() lower-cases it.
+class URIView {
+public:
+  URIView() = default;
+
+  // Getters
+  std::string_view scheme() const { return component(scheme_); }
+  std::string_view authority() const { return component(authority_); }
+  std::string_view userinfo() const { return component(userinfo_); }
+  std::string_view host() const { return component(host_); }
+  const std::optional<uint16_t> &port() const { return port_; }
+  std::string_view path() const { return component(path_); }
+  std::string_view query() const { return component(query_); }
+  std::string_view fragment() const { return component(fragment_); }
+
+  // The whole string the view was parsed from
+  std::string_view source() const { return source_; }
+
+  // Copies the components into an owning URI, allocated from alloc
+  URI to_uri(const URI::allocator_type &alloc = {}) const;
+
+private:
+  friend class URIParser;
+  friend class URIBatch;
+
+  // Position of a component in source_
+  struct Span {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+  };
+
+  std::string_view component(Span span) const {
+    return source_.substr(span.offset, span.length);
+  }
+
+  std::string_view source_;
+  Span scheme_;
+  Span authority_;
+  Span userinfo_;
+  Span host_;
+  std::optional<uint16_t> port_;
+  Span path_;
+  Span query_;
+  Span fragment_;
+};
+
+// Many parsed uris as columns, one array per component: row i of every
+// column describes input i of the batch. Offsets and lengths are into that
+// input, which must outlive the batch for components to be read back.
+// Schemes and hosts are also dictionary-encoded, lower-cased.
+class URIBatch {
+public:
+  // Where a component lies in each row, zero for rows without it
+  struct Column {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+
+    std::string_view in(std::string_view input, size_t row) const {
+      return input.substr(offsets[row], lengths[row]);
+    }
+  };
+
+  size_t size() const { return rows_; }
+  size_t valid_count() const;
+  bool is_valid(size_t row) const {
+    return validity_[row / 64] >> (row % 64) & 1;
+  }
+  // Bit i % 64 of word i / 64 is set if row i parsed
+  const std::vector<uint64_t> &validity() const { return validity_; }
+
+  // Component columns
+  const Column &scheme() const { return scheme_; }
+  const Column &authority() const { return authority_; }
+  const Column &userinfo() const { return userinfo_; }
+  const Column &host() const { return host_; }
+  const Column &path() const { return path_; }
+  const Column &query() const { return query_; }
+  const Column &fragment() const { return fragment_; }
+  // 0 for rows without a port
+  const std::vector<uint16_t> &port() const { return port_; }
+
+  // Dictionary codes and their values, code 0 standing for none
+  const std::vector<uint32_t> &scheme_codes() const { return scheme_codes_; }
+  const std::vector<std::string> &scheme_dictionary() const {
+    return scheme_dictionary_;
+  }
+  const std::vector<uint32_t> &host_codes() const { return host_codes_; }
+  const std::vector<std::string> &host_dictionary() const {
+    return host_dictionary_;
+  }
+
+  // The invalid rows and why, by row
+  const std::vector<std::pair<size_t, URIError>> &errors() const {
+    return errors_;
+  }
+
+  // The row as a view, input being the string the row was parsed from
+  URIView row(size_t row, std::string_view input) const;
+
+private:
+  friend class URIParser;
+
+  size_t rows_ = 0;
+  std::vector<uint64_t> validity_;
+  Column scheme_;
+  Column authority_;
+  Column userinfo_;
+  Column host_;
+  Column path_;
+  Column query_;
+  Column fragment_;
+  std::vector<uint16_t> port_;
+  std::vector<uint32_t> scheme_codes_;
+  std::vector<std::string> scheme_dictionary_;
+  std::vector<uint32_t> host_codes_;
+  std::vector<std::string> host_dictionary_;
+  std::vector<std::pair<size_t, URIError>> errors_;
+};
+
 class URIParser {
 
 public:
@@ -90,44 +267,67 @@ public:
   // Parse from string
   std::unique_ptr<URI> parse(const std::string &uri_string) const;
 
-  // Parse from stream
+  // Parse without copying, the view points into uri_string
+  URIView parse_view(std::string_view uri_string) const;
+
+  // Parse without throwing: an invalid uri is an error value
+  std::expected<URI, URIError>
+  try_parse(std::string_view uri_string,
+            const URI::allocator_type &alloc = {}) const;
+  std::expected<URIView, URIError>
+  try_parse_view(std::string_view uri_string) const noexcept;
+
+  // Parse many uris into columns, on threads threads (0 for one per core)
+  URIBatch parse_batch(std::span<const std::string_view> inputs,
+                       unsigned threads = 0) const;
+
+  // Parse the rest of the stream as one uri
   std::unique_ptr<URI> parse(std::istream &input) const;
 
-  // Character classification
-  static bool is_unreserved(char c);
-  static bool is_gen_delim(char c);
-  static bool is_sub_delim(char c);
-  static bool is_reserved(char c);
-  static bool is_scheme_char(char c);
-  static bool is_userinfo_char(char c);
-  static bool is_host_char(char c);
-  static bool is_port_char(char c);
-  static bool is_path_char(char c);
-  static bool is_query_char(char c);
-  static bool is_fragment_char(char c);
+  // Character classification, by table lookup
+  static constexpr bool is_unreserved(char c) {
+    return uri_char_class::is(c, uri_char_class::UNRESERVED);
+  }
+  static constexpr bool is_gen_delim(char c) {
+    return uri_char_class::is(c, uri_char_class::GEN_DELIM);
+  }
+  static constexpr bool is_sub_delim(char c) {
+    return uri_char_class::is(c, uri_char_class::SUB_DELIM);
+  }
+  static constexpr bool is_reserved(char c) {
+    return uri_char_class::is(c, uri_char_class::GEN_DELIM |
+                                     uri_char_class::SUB_DELIM);
+  }
+  static constexpr bool is_scheme_char(char c) {
+    return uri_char_class::is(c, uri_char_class::SCHEME);
+  }
+  static constexpr bool is_userinfo_char(char c) {
+    return uri_char_class::is(c, uri_char_class::USERINFO);
+  }
+  static constexpr bool is_host_char(char c) {
+    return uri_char_class::is(c, uri_char_class::HOST);
+  }
+  static constexpr bool is_port_char(char c) {
+    return uri_char_class::is(c, uri_char_class::DIGIT);
+  }
+  static constexpr bool is_path_char(char c) {
+    return uri_char_class::is(c, uri_char_class::PATH);
+  }
+  static constexpr bool is_query_char(char c) {
+    return uri_char_class::is(c, uri_char_class::QUERY);
+  }
+  static constexpr bool is_fragment_char(char c) {
+    return uri_char_class::is(c, uri_char_class::FRAGMENT);
+  }
+  static constexpr bool is_hex_digit(char c) {
+    return uri_char_class::is(c, uri_char_class::HEX_DIGIT);
+  }
 
   // Percent decoding
   static std::string percent_decode(const std::string &input);
   static unsigned char hex_to_char(char high, char low);
 
-  // Parsing helpers
-  bool parse_scheme(std::istream &input, URI &uri) const;
-  bool parse_host(std::istream &input, URI &uri) const;
-  bool parse_authority(std::istream &input, URI &uri) const;
-  void parse_userinfo_host_port(const std::string &authority, URI &uri) const;
-  bool parse_path(std::istream &input, URI &uri) const;
-  bool parse_query(std::istream &input, URI &uri) const;
-  bool parse_fragment(std::istream &input, URI &uri) const;
-
 private:
-  // Parsing helpers
-  // bool parse_scheme(std::istream &input, URI &uri) const;
-  // bool parse_authority(std::istream &input, URI &uri) const;
-  // void parse_userinfo_host_port(const std::string &authority, URI &uri)
-  // const; bool parse_path(std::istream &input, URI &uri) const; bool
-  // parse_query(std::istream &input, URI &uri) const; bool
-  // parse_fragment(std::istream &input, URI &uri) const;
-
   // Character classification
   // static bool is_unreserved(char c);
   // static bool is_gen_delim(char c);
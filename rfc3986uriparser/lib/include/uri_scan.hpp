@@ -0,0 +1,44 @@
+/*
+ * Author : Hyun Wo
+ * Purpose : This software is free for use and modification by any third party.
+ * No warranty is provided and the user is responsible for any consequences of
+ * its use.
+ * Date : 5th September 2025
+ */
+#ifndef URI_SCAN_HPP
+#define URI_SCAN_HPP
+#include <cstdint>
+
+// Skipping runs of characters of one class, 32 or 16 bytes at a time with
+// AVX2 or SSE4.2 when the CPU has them, one byte at a time otherwise
+namespace uri_scan {
+
+// A set of ASCII characters: c is in it if bit (c >> 4) of low[c & 15] is
+// set. Bytes from 0x80 never are. A '%' in the set stands for a
+// percent-encoded octet, so the two characters after it must be hex digits.
+struct alignas(16) CharSet {
+  uint8_t low[16];
+
+  constexpr bool contains(unsigned char c) const {
+    return c < 0x80 && (low[c & 15] >> (c >> 4)) & 1;
+  }
+};
+
+enum class Kernel { SCALAR, SSE42, AVX2 };
+
+// the fastest kernel the CPU supports
+Kernel best_kernel();
+
+bool is_supported(Kernel kernel);
+
+/**
+ * @return the first character from p that is not in set, or end; a '%' that
+ * does not start a percent-encoded octet is not in any set
+ */
+const char *skip(const char *p, const char *end, const CharSet &set);
+
+// skip with the given kernel, which must be supported
+const char *skip_with(Kernel kernel, const char *p, const char *end,
+                      const CharSet &set);
+} // namespace uri_scan
+#endif
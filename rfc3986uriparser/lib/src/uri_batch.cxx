@@ -0,0 +1,232 @@
+#include "../include/uri_parser.hpp"
+#include <bit>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+// rows a thread parses at the least
+constexpr size_t MIN_ROWS_PER_THREAD = 4096;
+
+char lower(char c) { return c >= 'A' && c <= 'Z' ? c + 32 : c; }
+
+// ascii case-insensitive hashing and equality, so that dictionaries can be
+// keyed by views into the input
+struct CaseInsensitiveHash {
+  size_t operator()(std::string_view s) const {
+    uint64_t hash = 14695981039346656037ull; // FNV-1a
+    for (char c : s) {
+      hash ^= static_cast<unsigned char>(lower(c));
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+};
+
+struct CaseInsensitiveEqual {
+  bool operator()(std::string_view a, std::string_view b) const {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(),
+                      [](char x, char y) { return lower(x) == lower(y); });
+  }
+};
+
+using DictionaryIndex = std::unordered_map<std::string_view, uint32_t,
+                                           CaseInsensitiveHash,
+                                           CaseInsensitiveEqual>;
+
+// the values one thread has seen, coded by first appearance from 1, 0
+// being none
+class LocalDictionary {
+public:
+  uint32_t encode(std::string_view value) {
+    if (value.empty())
+      return 0;
+    auto [entry, inserted] =
+        codes_.try_emplace(value, static_cast<uint32_t>(values_.size() + 1));
+    if (inserted)
+      values_.push_back(value);
+    return entry->second;
+  }
+
+  const std::vector<std::string_view> &values() const { return values_; }
+
+private:
+  DictionaryIndex codes_;
+  std::vector<std::string_view> values_;
+};
+
+// the rows one thread parses, [first, last)
+struct Chunk {
+  size_t first = 0;
+  size_t last = 0;
+  LocalDictionary schemes;
+  LocalDictionary hosts;
+  std::vector<std::pair<size_t, URIError>> errors;
+};
+
+// runs work(0) to work(count - 1) each on its own thread, the last on this one
+template <typename Work> void run_on_threads(size_t count, Work work) {
+  std::vector<std::jthread> threads;
+  for (size_t i = 0; i + 1 < count; ++i)
+    threads.emplace_back(work, i);
+  if (count > 0)
+    work(count - 1);
+}
+
+/**
+ * merges the dictionaries the threads built into one
+ *
+ * codes keep the order of first appearance over the whole batch, so the
+ * result does not depend on the number of threads
+ *
+ * @param chunks the chunks, in row order
+ * @param local the dictionary of a chunk to merge
+ * @param remaps set to, per chunk, the global code of each local code
+ * @return the lower-cased values, "" first
+ */
+std::vector<std::string> merge(const std::vector<Chunk> &chunks,
+                               LocalDictionary Chunk::*local,
+                               std::vector<std::vector<uint32_t>> &remaps) {
+  std::vector<std::string> dictionary{""};
+  DictionaryIndex index;
+  remaps.assign(chunks.size(), {0});
+
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    for (std::string_view value : (chunks[i].*local).values()) {
+      auto [entry, inserted] = index.try_emplace(
+          value, static_cast<uint32_t>(dictionary.size()));
+      if (inserted) {
+        std::string &lowered = dictionary.emplace_back(value);
+        std::transform(lowered.begin(), lowered.end(), lowered.begin(), lower);
+      }
+      remaps[i].push_back(entry->second);
+    }
+  }
+  return dictionary;
+}
+
+void resize(URIBatch::Column &column, size_t rows) {
+  column.offsets.resize(rows);
+  column.lengths.resize(rows);
+}
+
+} // namespace
+
+size_t URIBatch::valid_count() const {
+  size_t count = 0;
+  for (uint64_t word : validity_) {
+    count += std::popcount(word);
+  }
+  return count;
+}
+
+URIView URIBatch::row(size_t row, std::string_view input) const {
+  auto span = [row](const Column &column) {
+    return URIView::Span{column.offsets[row], column.lengths[row]};
+  };
+
+  URIView view;
+  view.source_ = input;
+  view.scheme_ = span(scheme_);
+  view.authority_ = span(authority_);
+  view.userinfo_ = span(userinfo_);
+  view.host_ = span(host_);
+  if (port_[row] != 0) {
+    view.port_ = port_[row];
+  }
+  view.path_ = span(path_);
+  view.query_ = span(query_);
+  view.fragment_ = span(fragment_);
+  return view;
+}
+
+/**
+ * parses many uris into columns
+ *
+ * the rows are split into one chunk per thread, each a multiple of 64 rows
+ * so that no two threads write the same validity word. each thread writes
+ * its rows' columns in place and codes schemes and hosts with a dictionary
+ * of its own; the dictionaries are then merged and the codes of the later
+ * chunks rewritten, again in parallel.
+ *
+ * @param inputs the uris, which must outlive the batch for its components to
+ * be read back
+ * @param threads threads to parse on, 0 for one per hardware thread
+ * @return the columns, with invalid rows zero and their errors listed
+ */
+URIBatch URIParser::parse_batch(std::span<const std::string_view> inputs,
+                                unsigned threads) const {
+  URIBatch batch;
+  size_t rows = inputs.size();
+  batch.rows_ = rows;
+  batch.validity_.assign((rows + 63) / 64, 0);
+  for (URIBatch::Column *column :
+       {&batch.scheme_, &batch.authority_, &batch.userinfo_, &batch.host_,
+        &batch.path_, &batch.query_, &batch.fragment_}) {
+    resize(*column, rows);
+  }
+  batch.port_.resize(rows);
+  batch.scheme_codes_.resize(rows);
+  batch.host_codes_.resize(rows);
+
+  size_t thread_count =
+      threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+  thread_count = std::clamp<size_t>(rows / MIN_ROWS_PER_THREAD, 1, thread_count);
+  size_t rows_per_thread = ((rows + thread_count - 1) / thread_count + 63) / 64 * 64;
+
+  std::vector<Chunk> chunks(thread_count);
+  for (size_t i = 0; i < thread_count; ++i) {
+    chunks[i].first = std::min(rows, i * rows_per_thread);
+    chunks[i].last = std::min(rows, chunks[i].first + rows_per_thread);
+  }
+
+  auto store = [](URIBatch::Column &column, size_t row, URIView::Span span) {
+    column.offsets[row] = span.offset;
+    column.lengths[row] = span.length;
+  };
+
+  run_on_threads(thread_count, [&](size_t i) {
+    Chunk &chunk = chunks[i];
+    for (size_t row = chunk.first; row < chunk.last; ++row) {
+      std::expected<URIView, URIError> view = try_parse_view(inputs[row]);
+      if (!view) {
+        chunk.errors.emplace_back(row, view.error());
+        continue;
+      }
+      batch.validity_[row / 64] |= uint64_t(1) << (row % 64);
+      store(batch.scheme_, row, view->scheme_);
+      store(batch.authority_, row, view->authority_);
+      store(batch.userinfo_, row, view->userinfo_);
+      store(batch.host_, row, view->host_);
+      store(batch.path_, row, view->path_);
+      store(batch.query_, row, view->query_);
+      store(batch.fragment_, row, view->fragment_);
+      batch.port_[row] = view->port_.value_or(0);
+      batch.scheme_codes_[row] = chunk.schemes.encode(view->scheme());
+      batch.host_codes_[row] = chunk.hosts.encode(view->host());
+    }
+  });
+
+  std::vector<std::vector<uint32_t>> scheme_remaps, host_remaps;
+  batch.scheme_dictionary_ = merge(chunks, &Chunk::schemes, scheme_remaps);
+  batch.host_dictionary_ = merge(chunks, &Chunk::hosts, host_remaps);
+
+  // the first chunk's codes are already the merged ones
+  if (thread_count > 1) {
+    run_on_threads(thread_count - 1, [&](size_t i) {
+      const Chunk &chunk = chunks[i + 1];
+      for (size_t row = chunk.first; row < chunk.last; ++row) {
+        batch.scheme_codes_[row] =
+            scheme_remaps[i + 1][batch.scheme_codes_[row]];
+        batch.host_codes_[row] = host_remaps[i + 1][batch.host_codes_[row]];
+      }
+    });
+  }
+
+  for (Chunk &chunk : chunks) {
+    batch.errors_.insert(batch.errors_.end(), chunk.errors.begin(),
+                         chunk.errors.end());
+  }
+  return batch;
+}
@@ -1,27 +1,54 @@
 #include "../include/uri_parser.hpp"
+#include "../include/uri_scan.hpp"
 #include <algorithm>
-#include <cctype>
+#include <array>
 #include <cstdint>
-#include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <sstream>
 
-void URI::set_scheme(const std::string &scheme) {
+// copies an ascii string, lower-cased
+static void assign_lower(std::pmr::string &out, std::string_view in) {
+  out.resize(in.size());
+  std::transform(in.begin(), in.end(), out.begin(),
+                 [](char c) { return c >= 'A' && c <= 'Z' ? c + 32 : c; });
+}
+
+URI::URI(const allocator_type &alloc)
+    : scheme_(alloc), authority_(alloc), userinfo_(alloc), host_(alloc),
+      path_(alloc), query_(alloc), fragment_(alloc) {}
+
+URI::URI(const URI &other, const allocator_type &alloc)
+    : scheme_(other.scheme_, alloc), authority_(other.authority_, alloc),
+      userinfo_(other.userinfo_, alloc), host_(other.host_, alloc),
+      port_(other.port_), path_(other.path_, alloc),
+      query_(other.query_, alloc), fragment_(other.fragment_, alloc) {}
+
+URI::URI(URI &&other, const allocator_type &alloc)
+    : scheme_(std::move(other.scheme_), alloc),
+      authority_(std::move(other.authority_), alloc),
+      userinfo_(std::move(other.userinfo_), alloc),
+      host_(std::move(other.host_), alloc), port_(other.port_),
+      path_(std::move(other.path_), alloc),
+      query_(std::move(other.query_), alloc),
+      fragment_(std::move(other.fragment_), alloc) {}
+
+void URI::set_scheme(std::string_view scheme) {
   if (!is_valid_scheme(scheme)) {
-    throw URIParseException("Invalid scheme: " + scheme);
+    throw URIParseException("Invalid scheme: " + std::string(scheme));
   }
-  scheme_ = uri_utils::to_lower(scheme);
+  assign_lower(scheme_, scheme);
 }
 
-void URI::set_authority(const std::string &authority) {
+void URI::set_authority(std::string_view authority) {
   authority_ = authority;
 }
 
-void URI::set_userinfo(const std::string &userinfo) { userinfo_ = userinfo; }
+void URI::set_userinfo(std::string_view userinfo) { userinfo_ = userinfo; }
 
-void URI::set_host(const std::string &host) {
+void URI::set_host(std::string_view host) {
   if (!is_valid_host(host)) {
-    throw URIParseException("Invalid host: " + host);
+    throw URIParseException("Invalid host: " + std::string(host));
   }
   host_ = host;
 }
@@ -33,11 +60,11 @@ void URI::set_port(const std::optional<uint16_t> &port) {
   port_ = port;
 }
 
-void URI::set_path(const std::string &path) { path_ = path; }
+void URI::set_path(std::string_view path) { path_ = path; }
 
-void URI::set_query(const std::string &query) { query_ = query; }
+void URI::set_query(std::string_view query) { query_ = query; }
 
-void URI::set_fragment(const std::string &fragment) { fragment_ = fragment; }
+void URI::set_fragment(std::string_view fragment) { fragment_ = fragment; }
 
 /**
  * String representation of the URI.
@@ -94,8 +121,8 @@ std::string URI::to_string() const {
  * @param port port part (can be empty)
  * @return constructed authority string
  */
-std::string URI::build_authority(const std::string &userinfo,
-                                 const std::string &host,
+std::string URI::build_authority(std::string_view userinfo,
+                                 std::string_view host,
                                  const std::optional<uint16_t> &port) {
   std::ostringstream oss;
 
@@ -112,10 +139,10 @@ std::string URI::build_authority(const std::string &userinfo,
   return oss.str();
 }
 
-bool URI::is_valid_scheme(const std::string &scheme) {
+bool URI::is_valid_scheme(std::string_view scheme) {
   if (scheme.empty())
     return false;
-  if (!std::isalpha(scheme[0]))
+  if (!uri_char_class::is(scheme[0], uri_char_class::ALPHA))
     return false;
 
   for (char c : scheme) {
@@ -126,339 +153,633 @@ bool URI::is_valid_scheme(const std::string &scheme) {
   return true;
 }
 
-bool URI::is_valid_host(const std::string &host) { return !host.empty(); }
+bool URI::is_valid_host(std::string_view host) { return !host.empty(); }
 
 bool URI::is_valid_port(uint16_t port) { return port > 0; }
 
 /**
- * parses a uri from a given string
+ * copies the components of the view into an owning uri
  *
- * @param uri_string string representing the uri to parse
- * @return a pointer to the parsed uri object
+ * the parser has validated them, so they are assigned without the checks
+ * of the setters
+ *
+ * @param alloc allocates the components of the uri
+ * @return the uri, with its scheme lower-cased
  */
-std::unique_ptr<URI> URIParser::parse(const std::string &uri_string) const {
-  std::istringstream iss(uri_string);
-  return parse(iss);
+URI URIView::to_uri(const URI::allocator_type &alloc) const {
+  URI uri(alloc);
+  assign_lower(uri.scheme_, scheme());
+  uri.authority_ = authority();
+  uri.userinfo_ = userinfo();
+  uri.host_ = host();
+  uri.port_ = port_;
+  uri.path_ = path();
+  uri.query_ = query();
+  uri.fragment_ = fragment();
+  return uri;
+}
+
+const char *URIError::message() const {
+  switch (code) {
+  case URIErrorCode::MISSING_SCHEME:
+    return "Missing scheme";
+  case URIErrorCode::INVALID_PATH:
+    return "Invalid path character";
+  case URIErrorCode::INVALID_QUERY:
+    return "Invalid query character";
+  case URIErrorCode::INVALID_FRAGMENT:
+    return "Invalid fragment character";
+  case URIErrorCode::INVALID_USERINFO:
+    return "Invalid userinfo character";
+  case URIErrorCode::INVALID_HOST:
+    return "Invalid host";
+  case URIErrorCode::INVALID_PORT:
+    return "Invalid port";
+  case URIErrorCode::INVALID_IP_LITERAL:
+    return "Invalid IP literal";
+  case URIErrorCode::INVALID_PERCENT_ENCODING:
+    return "Invalid percent-encoding";
+  case URIErrorCode::TOO_LONG:
+    return "URI too long";
+  }
+  return "Invalid URI";
+}
+
+std::string URIError::to_string() const {
+  return std::string(message()) + " at offset " + std::to_string(offset);
 }
 
 /**
- * reads a uri from a given input stream and returns a pointer to the parsed
- * uri object
+ * parses a uri from a given string
  *
- * @param input the input stream to read from
+ * @param uri_string string representing the uri to parse
  * @return a pointer to the parsed uri object
- * @throws URIParseException if the input stream is empty or the uri is invalid
+ * @throws URIParseException if the uri is invalid
  */
-std::unique_ptr<URI> URIParser::parse(std::istream &input) const {
-  auto uri = std::make_unique<URI>();
-  std::istream::pos_type start_pos = input.tellg();
-
-  try {
-    // Parse scheme
-    if (!parse_scheme(input, *uri)) {
-      input.seekg(start_pos);
-    }
-
-    // Check for authority / host after (//)
-    if (input.peek() == '/') {
-      input.get();
-
-      if (input.peek() == '/') {
-        input.get();
-        // input.unget(); // Put back the first '/'
-        parse_authority(input, *uri);
-      } else {
-        input.seekg(-1, std::ios_base::cur); // Put back the character
-      }
-    }
-
-    // Parse path
-    parse_path(input, *uri);
-
-    // Parse query
-    if (input.peek() == '?') {
-      input.get(); // Consume '?'
-      parse_query(input, *uri);
-    }
-
-    // Parse fragment
-    if (input.peek() == '#') {
-      input.get(); // Consume '#'
-      parse_fragment(input, *uri);
-    }
-  } catch (const std::exception &e) {
-    throw URIParseException(std::string("Failed to parse URI: ") + e.what());
+std::unique_ptr<URI> URIParser::parse(const std::string &uri_string) const {
+  std::expected<URI, URIError> uri = try_parse(uri_string);
+  if (!uri) {
+    throw URIParseException(uri.error());
   }
-
-  return uri;
+  return std::make_unique<URI>(std::move(*uri));
 }
 
 /**
- * reads a uri scheme from an input stream
+ * parses a uri or relative reference without copying it
  *
- * @param input input stream with the uri to parse
- * @param uri uri object to store the parsed scheme
- * @return true if a scheme was parsed, false otherwise
- * @throws URIParseException if the input stream is empty or a uri component
- * is invalid
+ * @param uri_string the string to parse, which must outlive the view
+ * @return a view of the components of uri_string
+ * @throws URIParseException if the uri is invalid
  */
-bool URIParser::parse_scheme(std::istream &input, URI &uri) const {
-
-  std::string scheme;
-  char c;
-
-  // rfc3986 needs first char to be alpha
-  bool first_char_trip = true;
-
-  while (input.get(c)) {
-    if (first_char_trip) {
-      if (!std::isalpha(c)) {
-        input.unget();
-        throw URIParseException("Invalid scheme");
-        return false;
-      }
-      scheme += c;
-      first_char_trip = false;
-    } else {
-      if (c == ':') {
-        uri.set_scheme(scheme);
-        return true;
-      } else if (is_scheme_char(c)) {
-        scheme += c;
-      } else {
-        // Not a scheme character, rewind
-        for (int i = 0; i < static_cast<int>(scheme.size()) + 1; ++i) {
-          input.unget();
-        }
-        return false;
-      }
-    }
-  }
-
-  // End of stream before ':'
-  for (int i = 0; i < static_cast<int>(scheme.size()); ++i) {
-    input.unget();
+URIView URIParser::parse_view(std::string_view uri_string) const {
+  std::expected<URIView, URIError> view = try_parse_view(uri_string);
+  if (!view) {
+    throw URIParseException(view.error());
   }
-
-  return false;
+  return *view;
 }
 
 /**
- * parses a uri authority from an input stream
+ * parses a uri from a given string without throwing on invalid input
  *
- * @param input input stream with the uri to parse
- * @param uri uri object to store the parsed authority
- * @return true if an authority was parsed, false otherwise
- * @throws URIParseException if the input stream is empty or a uri component
- * is invalid
+ * @param uri_string string representing the uri to parse
+ * @param alloc allocates the components of the uri
+ * @return the parsed uri, or where and why parsing failed
  */
-bool URIParser::parse_authority(std::istream &input, URI &uri) const {
-
-  std::string authority;
-  char c;
-
-  while (input.get(c)) {
-    if (c == '/' || c == '?' || c == '#' || c == '\0') {
-      input.unget(); // Put back the delimiter
-      break;
-    }
-    authority += c;
+std::expected<URI, URIError>
+URIParser::try_parse(std::string_view uri_string,
+                     const URI::allocator_type &alloc) const {
+  std::expected<URIView, URIError> view = try_parse_view(uri_string);
+  if (!view) {
+    return std::unexpected(view.error());
   }
+  return view->to_uri(alloc);
+}
 
-  if (!authority.empty()) {
-    uri.set_authority(authority);
-    parse_userinfo_host_port(authority, uri);
-    return true;
+namespace {
+
+// character classes the state machine tells apart
+enum CharClass : uint8_t {
+  ALPHA,         // A-Z a-z
+  DIGIT,         // 0-9
+  SCHEME_MARK,   // + - .
+  COLON,         // :
+  SLASH,         // /
+  QUESTION,      // ?
+  HASH,          // #
+  AT,            // @
+  OPEN_BRACKET,  // [
+  CLOSE_BRACKET, // ]
+  PERCENT,       // %
+  OTHER,         // the rest of unreserved and sub-delims
+  INVALID,       // allowed nowhere in a uri
+  END,           // past the last character
+  CHAR_CLASS_COUNT
+};
+
+// where the parser is in the RFC 3986 grammar
+enum State : uint8_t {
+  START,            // nothing read yet
+  SCHEME,           // letters that are a scheme if a ':' follows
+  FIRST_SEGMENT,    // first segment of a relative path, which has no ':'
+  AFTER_SCHEME,     // just after "scheme:"
+  SLASH_START,      // a leading '/', which starts an authority if doubled
+  AUTHORITY_START,  // just after "//"
+  HOST_OR_USERINFO, // before any ':' or '@' in the authority
+  PORT_OR_PASSWORD, // digits after a ':', before any '@'
+  PASSWORD,         // userinfo after a ':', an '@' must follow
+  HOST_START,       // just after "userinfo@"
+  HOST,             // registered name or IPv4 address
+  PORT,             // after the host's ':'
+  IP_LITERAL,       // inside "[...]"
+  AFTER_IP_LITERAL, // just after ']'
+  PATH,
+  QUERY,
+  FRAGMENT,
+  FAILED,
+  STATE_COUNT
+};
+
+using enum URIErrorCode;
+
+// what a transition records, run in this order
+enum Action : uint16_t {
+  END_SCHEME = 1 << 0,
+  BEGIN_AUTHORITY = 1 << 1,
+  HOST_COLON = 1 << 2,
+  END_USERINFO = 1 << 3,
+  PORT_DIGIT = 1 << 4,
+  BEGIN_IP_LITERAL = 1 << 5,
+  END_IP_LITERAL = 1 << 6,
+  END_AUTHORITY = 1 << 7,
+  END_PATH = 1 << 8,
+  BEGIN_QUERY = 1 << 9,
+  END_QUERY = 1 << 10,
+  BEGIN_FRAGMENT = 1 << 11,
+  END_FRAGMENT = 1 << 12,
+  ESCAPE = 1 << 13, // '%' and two hex digits
+};
+
+struct Transition {
+  State next;
+  URIErrorCode error; // why the character is rejected if next is FAILED
+  uint16_t actions;
+};
+
+using CharClassTable = std::array<CharClass, 256>;
+using TransitionTable =
+    std::array<std::array<Transition, CHAR_CLASS_COUNT>, STATE_COUNT>;
+
+// derived from the character class bits
+constexpr CharClassTable make_char_classes() {
+  CharClassTable classes{};
+  for (int c = 0; c < 256; ++c) {
+    uint16_t bits = uri_char_class::TABLE[c];
+    if (bits & uri_char_class::ALPHA)
+      classes[c] = ALPHA;
+    else if (bits & uri_char_class::DIGIT)
+      classes[c] = DIGIT;
+    else if (bits & (uri_char_class::UNRESERVED | uri_char_class::SUB_DELIM))
+      classes[c] = OTHER;
+    else
+      classes[c] = INVALID;
   }
-
-  return false;
+  for (char c : std::string_view("+-."))
+    classes[static_cast<unsigned char>(c)] = SCHEME_MARK;
+  classes[':'] = COLON;
+  classes['/'] = SLASH;
+  classes['?'] = QUESTION;
+  classes['#'] = HASH;
+  classes['@'] = AT;
+  classes['['] = OPEN_BRACKET;
+  classes[']'] = CLOSE_BRACKET;
+  classes['%'] = PERCENT;
+  return classes;
 }
 
-/**
- * extracts userinfo, host and port from the authority
- *
- * the format is [userinfo@]host[:port]
- *
- * @param authority the authority string to extract from
- * @param uri the uri object to store the parsed userinfo, host and port
- */
-void URIParser::parse_userinfo_host_port(const std::string &authority,
-                                         URI &uri) const {
-  std::string userinfo, host;
-  std::optional<uint16_t> port;
-
-  size_t at_pos = authority.find('@');
-
-  if (at_pos != std::string::npos) {
-    userinfo = authority.substr(0, at_pos);
-    host = authority.substr(at_pos + 1);
-  } else {
-    host = authority;
-  }
+constexpr TransitionTable make_transitions() {
+  TransitionTable table{};
 
-  size_t port_colon_pos = std::string::npos;
+  // every class of a state fails with error unless a transition is set
+  auto fail = [&](State state, URIErrorCode error) {
+    table[state].fill({FAILED, error, 0});
+  };
+  auto on = [&](State state, std::initializer_list<CharClass> classes,
+                State next, uint16_t actions = 0) {
+    for (CharClass c : classes)
+      table[state][c] = {next, URIErrorCode{}, actions};
+  };
+  auto reject = [&](State state, std::initializer_list<CharClass> classes,
+                    URIErrorCode error) {
+    for (CharClass c : classes)
+      table[state][c] = {FAILED, error, 0};
+  };
 
-  // if [ipv6] the end is ] else the end is :
-  if (host[0] == '[') {
-    port_colon_pos = host.find(']') + 1;
-  } else {
-    port_colon_pos = host.find(':');
-  }
+  // pchar other than pct-encoded, and reg-name other than pct-encoded
+  const auto pchar = {ALPHA, DIGIT, SCHEME_MARK, COLON, AT, OTHER};
+  const auto reg_name = {ALPHA, DIGIT, SCHEME_MARK, OTHER};
 
-  if (port_colon_pos < host.size() && host[host.size()] != ':') {
-    if (port_colon_pos != std::string::npos) {
+  // '?', '#' and the end of input close a path
+  auto end_path = [&](State state) {
+    on(state, {QUESTION}, QUERY, END_PATH | BEGIN_QUERY);
+    on(state, {HASH}, FRAGMENT, END_PATH | BEGIN_FRAGMENT);
+    on(state, {END}, state, END_PATH);
+  };
+  // so do '/', '?', '#' and the end of input an authority
+  auto end_authority = [&](State state) {
+    on(state, {SLASH}, PATH, END_AUTHORITY);
+    on(state, {QUESTION}, QUERY, END_AUTHORITY | END_PATH | BEGIN_QUERY);
+    on(state, {HASH}, FRAGMENT, END_AUTHORITY | END_PATH | BEGIN_FRAGMENT);
+    on(state, {END}, state, END_AUTHORITY | END_PATH);
+  };
 
-      std::string port_str = host.substr(port_colon_pos + 1);
-      host = host.substr(0, port_colon_pos);
+  fail(START, INVALID_PATH);
+  on(START, {ALPHA}, SCHEME);
+  on(START, {DIGIT, SCHEME_MARK, AT, OTHER}, FIRST_SEGMENT);
+  on(START, {PERCENT}, FIRST_SEGMENT, ESCAPE);
+  on(START, {SLASH}, SLASH_START);
+  reject(START, {COLON}, MISSING_SCHEME);
+  end_path(START);
+
+  fail(SCHEME, INVALID_PATH);
+  on(SCHEME, {ALPHA, DIGIT, SCHEME_MARK}, SCHEME);
+  on(SCHEME, {COLON}, AFTER_SCHEME, END_SCHEME);
+  on(SCHEME, {AT, OTHER}, FIRST_SEGMENT);
+  on(SCHEME, {PERCENT}, FIRST_SEGMENT, ESCAPE);
+  on(SCHEME, {SLASH}, PATH);
+  end_path(SCHEME);
+
+  fail(FIRST_SEGMENT, INVALID_PATH);
+  on(FIRST_SEGMENT, {ALPHA, DIGIT, SCHEME_MARK, AT, OTHER}, FIRST_SEGMENT);
+  on(FIRST_SEGMENT, {PERCENT}, FIRST_SEGMENT, ESCAPE);
+  on(FIRST_SEGMENT, {SLASH}, PATH);
+  reject(FIRST_SEGMENT, {COLON}, MISSING_SCHEME);
+  end_path(FIRST_SEGMENT);
+
+  fail(AFTER_SCHEME, INVALID_PATH);
+  on(AFTER_SCHEME, pchar, PATH);
+  on(AFTER_SCHEME, {PERCENT}, PATH, ESCAPE);
+  on(AFTER_SCHEME, {SLASH}, SLASH_START);
+  end_path(AFTER_SCHEME);
+
+  fail(SLASH_START, INVALID_PATH);
+  on(SLASH_START, pchar, PATH);
+  on(SLASH_START, {PERCENT}, PATH, ESCAPE);
+  on(SLASH_START, {SLASH}, AUTHORITY_START, BEGIN_AUTHORITY);
+  end_path(SLASH_START);
+
+  fail(AUTHORITY_START, INVALID_HOST);
+  on(AUTHORITY_START, reg_name, HOST_OR_USERINFO);
+  on(AUTHORITY_START, {PERCENT}, HOST_OR_USERINFO, ESCAPE);
+  on(AUTHORITY_START, {COLON}, PORT_OR_PASSWORD, HOST_COLON);
+  on(AUTHORITY_START, {AT}, HOST_START, END_USERINFO);
+  on(AUTHORITY_START, {OPEN_BRACKET}, IP_LITERAL, BEGIN_IP_LITERAL);
+  end_authority(AUTHORITY_START);
+
+  fail(HOST_OR_USERINFO, INVALID_HOST);
+  on(HOST_OR_USERINFO, reg_name, HOST_OR_USERINFO);
+  on(HOST_OR_USERINFO, {PERCENT}, HOST_OR_USERINFO, ESCAPE);
+  on(HOST_OR_USERINFO, {COLON}, PORT_OR_PASSWORD, HOST_COLON);
+  on(HOST_OR_USERINFO, {AT}, HOST_START, END_USERINFO);
+  end_authority(HOST_OR_USERINFO);
+
+  fail(PORT_OR_PASSWORD, INVALID_USERINFO);
+  on(PORT_OR_PASSWORD, {DIGIT}, PORT_OR_PASSWORD, PORT_DIGIT);
+  on(PORT_OR_PASSWORD, {ALPHA, SCHEME_MARK, COLON, OTHER}, PASSWORD);
+  on(PORT_OR_PASSWORD, {PERCENT}, PASSWORD, ESCAPE);
+  on(PORT_OR_PASSWORD, {AT}, HOST_START, END_USERINFO);
+  end_authority(PORT_OR_PASSWORD);
+
+  fail(PASSWORD, INVALID_USERINFO);
+  on(PASSWORD, {ALPHA, DIGIT, SCHEME_MARK, COLON, OTHER}, PASSWORD);
+  on(PASSWORD, {PERCENT}, PASSWORD, ESCAPE);
+  on(PASSWORD, {AT}, HOST_START, END_USERINFO);
+  // without an '@', what followed the ':' was a port
+  reject(PASSWORD, {SLASH, QUESTION, HASH, END}, INVALID_PORT);
+
+  fail(HOST_START, INVALID_HOST);
+  on(HOST_START, reg_name, HOST);
+  on(HOST_START, {PERCENT}, HOST, ESCAPE);
+  on(HOST_START, {COLON}, PORT, HOST_COLON);
+  on(HOST_START, {OPEN_BRACKET}, IP_LITERAL, BEGIN_IP_LITERAL);
+  end_authority(HOST_START);
+
+  fail(HOST, INVALID_HOST);
+  on(HOST, reg_name, HOST);
+  on(HOST, {PERCENT}, HOST, ESCAPE);
+  on(HOST, {COLON}, PORT, HOST_COLON);
+  end_authority(HOST);
+
+  fail(PORT, INVALID_PORT);
+  on(PORT, {DIGIT}, PORT, PORT_DIGIT);
+  end_authority(PORT);
+
+  // checked as IPv6 or IPvFuture at the ']'
+  fail(IP_LITERAL, INVALID_IP_LITERAL);
+  on(IP_LITERAL, {ALPHA, DIGIT, SCHEME_MARK, COLON, OTHER}, IP_LITERAL);
+  on(IP_LITERAL, {CLOSE_BRACKET}, AFTER_IP_LITERAL, END_IP_LITERAL);
+
+  fail(AFTER_IP_LITERAL, INVALID_HOST);
+  on(AFTER_IP_LITERAL, {COLON}, PORT, HOST_COLON);
+  end_authority(AFTER_IP_LITERAL);
+
+  fail(PATH, INVALID_PATH);
+  on(PATH, pchar, PATH);
+  on(PATH, {SLASH}, PATH);
+  on(PATH, {PERCENT}, PATH, ESCAPE);
+  end_path(PATH);
+
+  fail(QUERY, INVALID_QUERY);
+  on(QUERY, pchar, QUERY);
+  on(QUERY, {SLASH, QUESTION}, QUERY);
+  on(QUERY, {PERCENT}, QUERY, ESCAPE);
+  on(QUERY, {HASH}, FRAGMENT, END_QUERY | BEGIN_FRAGMENT);
+  on(QUERY, {END}, QUERY, END_QUERY);
+
+  fail(FRAGMENT, INVALID_FRAGMENT);
+  on(FRAGMENT, pchar, FRAGMENT);
+  on(FRAGMENT, {SLASH, QUESTION}, FRAGMENT);
+  on(FRAGMENT, {PERCENT}, FRAGMENT, ESCAPE);
+  on(FRAGMENT, {END}, FRAGMENT, END_FRAGMENT);
+
+  fail(FAILED, URIErrorCode{});
+  return table;
+}
 
-      try {
-        int port_num = std::stoi(port_str);
-        if (port_num > 0 && port_num <= 65535) {
-          port = static_cast<uint16_t>(port_num);
-        }
-      } catch (...) {
-        // Invalid port, ignore
+constexpr CharClassTable CHAR_CLASSES = make_char_classes();
+constexpr TransitionTable TRANSITIONS = make_transitions();
+
+// the characters that leave a state where it is with nothing to record, such
+// as a path's pchars and '/', which the parser skips in bulk; '%' is in the
+// run if escapes are
+struct Runs {
+  std::array<uri_scan::CharSet, STATE_COUNT> sets{};
+  std::array<bool, STATE_COUNT> any{};
+};
+
+constexpr Runs make_runs() {
+  Runs runs;
+  for (int state = 0; state < FAILED; ++state) {
+    for (int c = 0; c < 0x80; ++c) {
+      const Transition &transition = TRANSITIONS[state][CHAR_CLASSES[c]];
+      if (transition.next == state &&
+          (transition.actions == 0 ||
+           (c == '%' && transition.actions == ESCAPE))) {
+        runs.sets[state].low[c & 15] |= 1 << (c >> 4);
+        runs.any[state] = true;
       }
     }
   }
+  return runs;
+}
 
-  uri.set_userinfo(userinfo);
-  uri.set_host(host);
-  uri.set_port(port);
+constexpr Runs RUNS = make_runs();
+
+// below this many bytes left, stepping the state machine is cheaper than
+// calling a scan kernel
+constexpr ptrdiff_t MIN_SKIP = 64;
+
+// dec-octet "." dec-octet "." dec-octet "." dec-octet, no leading zeros
+bool is_ipv4_address(std::string_view s) {
+  for (int octet = 0; octet < 4; ++octet) {
+    if (octet > 0) {
+      if (s.empty() || s.front() != '.')
+        return false;
+      s.remove_prefix(1);
+    }
+    size_t digits = 0;
+    unsigned value = 0;
+    while (digits < s.size() && digits < 3 &&
+           URIParser::is_port_char(s[digits])) {
+      value = value * 10 + (s[digits] - '0');
+      ++digits;
+    }
+    if (digits == 0 || value > 255 || (digits > 1 && s.front() == '0'))
+      return false;
+    s.remove_prefix(digits);
+  }
+  return s.empty();
 }
 
-/**
- * read the path part of a uri from an input stream
- *
- * read the path part from an input stream and store it in the given uri
- * object. stops when a '?' or '#' character is encountered or when the end of
- * the stream is reached.
- *
- * @param input the input stream to read from
- * @param uri the uri object to store the parsed path in
- * @return true if the path part was successfully parsed, false otherwise
- */
-bool URIParser::parse_path(std::istream &input, URI &uri) const {
-  std::string path;
-  char c;
+// eight groups of 1 to 4 hex digits, "::" standing in for one or more zero
+// groups and a trailing IPv4 address for the last two
+bool is_ipv6_address(std::string_view s) {
+  int groups = 0;
+  bool compressed = false;
+  size_t i = 0;
+
+  if (s.starts_with("::")) {
+    compressed = true;
+    i = 2;
+  } else if (s.starts_with(":")) {
+    return false;
+  }
 
-  while (input.get(c)) {
-    if (c == '?' || c == '#' || c == '\0') {
-      input.unget(); // Put back the delimiter
+  while (i < s.size()) {
+    size_t j = i;
+    while (j < s.size() && j - i < 5 && URIParser::is_hex_digit(s[j]))
+      ++j;
+    if (j < s.size() && s[j] == '.') {
+      if (!is_ipv4_address(s.substr(i)))
+        return false;
+      groups += 2;
       break;
     }
-    if (is_path_char(c)) {
-      path += c;
+    if (j == i || j - i > 4)
+      return false;
+    ++groups;
+    i = j;
+    if (i == s.size())
+      break;
+    if (s[i] != ':' || ++i == s.size())
+      return false;
+    if (s[i] == ':') {
+      if (compressed)
+        return false;
+      compressed = true;
+      ++i;
     }
   }
+  return compressed ? groups < 8 : groups == 8;
+}
 
-  uri.set_path(path);
-  return !path.empty();
+// "v" 1*HEXDIG "." 1*( unreserved / sub-delims / ":" )
+bool is_ipvfuture(std::string_view s) {
+  if (s.size() < 4 || (s[0] != 'v' && s[0] != 'V'))
+    return false;
+  size_t i = 1;
+  while (i < s.size() && URIParser::is_hex_digit(s[i]))
+    ++i;
+  if (i == 1 || i + 1 >= s.size() || s[i] != '.')
+    return false;
+  for (++i; i < s.size(); ++i) {
+    if (!URIParser::is_unreserved(s[i]) && !URIParser::is_sub_delim(s[i]) &&
+        s[i] != ':')
+      return false;
+  }
+  return true;
 }
 
+} // namespace
+
 /**
- * parses a uri query from an input stream
+ * parses a uri or relative reference without copying it or throwing
  *
- * this function reads the query part from an input stream and stores it in the
- * given uri object. it stops when a '#' character is encountered or when the
- * end of the stream is reached.
+ * a table-driven state machine makes one forward pass over the bytes: each
+ * character's class and the current state select the next state and the
+ * component boundaries to record, nothing is read twice and nothing is
+ * allocated. characters that are not allowed in a component are an error
+ * rather than dropped. runs of characters that keep the state, such as most
+ * of a long query, are validated 32 or 16 bytes at a time by uri_scan.
  *
- * @param input the input stream to read from
- * @param uri the uri object to store the parsed query in
- * @return true if the query part was successfully parsed, false otherwise
+ * @param uri_string the string to parse, which must outlive the view
+ * @return a view of the components of uri_string, or where and why parsing
+ * failed
  */
-bool URIParser::parse_query(std::istream &input, URI &uri) const {
-  std::string query;
-  char c;
+std::expected<URIView, URIError>
+URIParser::try_parse_view(std::string_view uri_string) const noexcept {
+  if (uri_string.size() > UINT32_MAX) {
+    return std::unexpected(URIError{TOO_LONG, size_t(UINT32_MAX)});
+  }
+
+  URIView view;
+  view.source_ = uri_string;
+  const char *begin = uri_string.data();
+  const char *end = begin + uri_string.size();
+  auto span = [begin](const char *first, const char *last) {
+    return URIView::Span{static_cast<uint32_t>(first - begin),
+                         static_cast<uint32_t>(last - first)};
+  };
+  auto fail = [begin](URIErrorCode code, const char *at) {
+    return std::unexpected(URIError{code, static_cast<size_t>(at - begin)});
+  };
+
+  // component boundaries found so far
+  const char *path = begin;
+  const char *authority = nullptr;
+  const char *host = nullptr;
+  const char *colon = nullptr;
+  const char *literal = nullptr;
+  const char *query = nullptr;
+  const char *fragment = nullptr;
+  uint32_t port = 0;
+
+  State state = START;
+  for (const char *p = begin;; ++p) {
+    CharClass c = p != end ? CHAR_CLASSES[static_cast<unsigned char>(*p)] : END;
+    const Transition &transition = TRANSITIONS[state][c];
+    if (transition.next == FAILED) {
+      if (transition.error == INVALID_PORT) {
+        // a port read as a password fails only at its end, so point at the
+        // first character after the ':' that is not a digit
+        p = std::find_if(colon + 1, p, [](char d) {
+          return CHAR_CLASSES[static_cast<unsigned char>(d)] != DIGIT;
+        });
+      }
+      return fail(transition.error, p);
+    }
+
+    if (uint16_t actions = transition.actions) {
+      if (actions & END_SCHEME) {
+        view.scheme_ = span(begin, p);
+        path = p + 1;
+      }
+      if (actions & BEGIN_AUTHORITY) {
+        authority = host = p + 1;
+      }
+      if (actions & HOST_COLON) {
+        colon = p;
+        port = 0;
+      }
+      if (actions & END_USERINFO) {
+        view.userinfo_ = span(authority, p);
+        host = p + 1;
+        colon = nullptr;
+      }
+      if (actions & PORT_DIGIT) {
+        // a password may be any number of digits, so saturate
+        port = std::min<uint32_t>(port * 10 + (*p - '0'), UINT16_MAX + 1);
+      }
+      if (actions & BEGIN_IP_LITERAL) {
+        literal = p;
+      }
+      if (actions & END_IP_LITERAL) {
+        std::string_view address(literal + 1, p - literal - 1);
+        if (!is_ipv6_address(address) && !is_ipvfuture(address)) {
+          return fail(INVALID_IP_LITERAL, literal);
+        }
+      }
+      if (actions & END_AUTHORITY) {
+        view.authority_ = span(authority, p);
+        if (p != authority) {
+          const char *host_end = colon ? colon : p;
+          if (host_end == host) {
+            return fail(INVALID_HOST, host);
+          }
+          view.host_ = span(host, host_end);
+          if (colon && colon + 1 != p) {
+            if (port > UINT16_MAX ||
+                !URI::is_valid_port(static_cast<uint16_t>(port))) {
+              return fail(INVALID_PORT, colon + 1);
+            }
+            view.port_ = static_cast<uint16_t>(port);
+          }
+        }
+        path = p;
+      }
+      if (actions & END_PATH) {
+        view.path_ = span(path, p);
+      }
+      if (actions & BEGIN_QUERY) {
+        query = p + 1;
+      }
+      if (actions & END_QUERY) {
+        view.query_ = span(query, p);
+      }
+      if (actions & BEGIN_FRAGMENT) {
+        fragment = p + 1;
+      }
+      if (actions & END_FRAGMENT) {
+        view.fragment_ = span(fragment, p);
+      }
+      if (actions & ESCAPE) {
+        if (end - p < 3 || !is_hex_digit(p[1]) || !is_hex_digit(p[2])) {
+          return fail(INVALID_PERCENT_ENCODING, p);
+        }
+        p += 2;
+      }
+    }
 
-  while (input.get(c)) {
-    if (c == '#' || c == '\0') {
-      input.unget(); // Put back the delimiter
+    if (p == end) {
       break;
     }
-    if (is_query_char(c)) {
-      query += c;
+    state = transition.next;
+    if (RUNS.any[state] && end - p > MIN_SKIP) {
+      p = uri_scan::skip(p + 1, end, RUNS.sets[state]) - 1;
     }
   }
 
-  uri.set_query(query);
-  return !query.empty();
+  return view;
 }
 
 /**
- * parses a uri fragment from an input stream
- *
- * this function reads the fragment part from an input stream and stores it
- * in the given uri object. it stops when the end of the stream is reached.
+ * reads the rest of a given input stream as one uri and returns a pointer to
+ * the parsed uri object; a single trailing line ending is ignored
  *
  * @param input the input stream to read from
- * @param uri the uri object to store the parsed fragment in
- * @return true if the fragment was successfully parsed, false otherwise
+ * @return a pointer to the parsed uri object
+ * @throws URIParseException if the uri is invalid
  */
-bool URIParser::parse_fragment(std::istream &input, URI &uri) const {
-  std::string fragment;
-  char c;
-
-  while (input.get(c)) {
-    if (c == '\0') {
-      break;
-    }
-    if (is_fragment_char(c)) {
-      fragment += c;
+std::unique_ptr<URI> URIParser::parse(std::istream &input) const {
+  std::string uri_string{std::istreambuf_iterator<char>(input),
+                         std::istreambuf_iterator<char>()};
+  if (!uri_string.empty() && uri_string.back() == '\n') {
+    uri_string.pop_back();
+    if (!uri_string.empty() && uri_string.back() == '\r') {
+      uri_string.pop_back();
     }
   }
-
-  uri.set_fragment(fragment);
-  return !fragment.empty();
-}
-
-// Character classification methods
-bool URIParser::is_unreserved(char c) {
-  return std::isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~';
-}
-
-bool URIParser::is_gen_delim(char c) {
-  return c == ':' || c == '/' || c == '?' || c == '#' || c == '[' || c == ']' ||
-         c == '@';
-}
-
-bool URIParser::is_sub_delim(char c) {
-  return c == '!' || c == '$' || c == '&' || c == '\'' || c == '(' ||
-         c == ')' || c == '*' || c == '+' || c == ',' || c == ';' || c == '=';
-}
-
-bool URIParser::is_reserved(char c) {
-  return is_gen_delim(c) || is_sub_delim(c);
-}
-
-bool URIParser::is_scheme_char(char c) {
-  return std::isalnum(c) || c == '+' || c == '-' || c == '.';
-}
-
-bool URIParser::is_userinfo_char(char c) {
-  return is_unreserved(c) || is_sub_delim(c) || c == ':' || c == '%';
-}
-
-bool URIParser::is_host_char(char c) {
-  return is_unreserved(c) || is_sub_delim(c) || c == ':' || c == '[' ||
-         c == ']' || c == '%';
-}
-
-bool URIParser::is_port_char(char c) { return std::isdigit(c); }
-
-bool URIParser::is_path_char(char c) {
-  return is_unreserved(c) || is_sub_delim(c) || c == ':' || c == '@' ||
-         c == '/' || c == '%';
-}
-
-bool URIParser::is_query_char(char c) {
-  return is_unreserved(c) || is_sub_delim(c) || c == ':' || c == '@' ||
-         c == '/' || c == '?' || c == '%';
-}
-
-bool URIParser::is_fragment_char(char c) {
-  return is_unreserved(c) || is_sub_delim(c) || c == ':' || c == '@' ||
-         c == '/' || c == '?' || c == '%';
+  return parse(uri_string);
 }
 
 std::string URIParser::percent_decode(const std::string &input) {
@@ -468,7 +789,7 @@ std::string URIParser::percent_decode(const std::string &input) {
     if (input[i] == '%' && i + 2 < input.size()) {
       char high = input[i + 1];
       char low = input[i + 2];
-      if (std::isxdigit(high) && std::isxdigit(low)) {
+      if (is_hex_digit(high) && is_hex_digit(low)) {
         output += hex_to_char(high, low);
         i += 2;
         continue;
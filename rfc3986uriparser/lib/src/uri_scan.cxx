@@ -0,0 +1,166 @@
+#include "../include/uri_scan.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define URI_SCAN_X86
+#endif
+
+namespace uri_scan {
+
+namespace {
+
+bool is_hex(char c) {
+  return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+// whether the '%' at p starts a percent-encoded octet
+bool is_escape(const char *p, const char *end) {
+  return end - p >= 3 && is_hex(p[1]) && is_hex(p[2]);
+}
+
+const char *skip_scalar(const char *p, const char *end, const CharSet &set) {
+  while (p != end && set.contains(static_cast<unsigned char>(*p))) {
+    if (*p == '%') {
+      if (!is_escape(p, end))
+        break;
+      p += 2;
+    }
+    ++p;
+  }
+  return p;
+}
+
+#ifdef URI_SCAN_X86
+/**
+ * where the run ends within a block scanned by a vector kernel
+ *
+ * @param block start of the block
+ * @param end end of the input
+ * @param outside bit i set if byte i is not in the set
+ * @param percents bit i set if byte i is '%'
+ * @param width bytes in the block
+ * @return offset of the first byte outside the set or '%' that does not
+ * start an escape, width if there is none
+ */
+inline unsigned block_end(const char *block, const char *end, uint32_t outside,
+                          uint32_t percents, unsigned width) {
+  unsigned stop = outside ? __builtin_ctz(outside) : width;
+  percents &= stop < 32 ? (1u << stop) - 1 : ~0u;
+  for (; percents; percents &= percents - 1) {
+    unsigned i = __builtin_ctz(percents);
+    if (!is_escape(block + i, end))
+      return i;
+  }
+  return stop;
+}
+
+// Each byte is looked up twice with pshufb: its low nibble selects the set's
+// row of high nibbles, its high nibble the bit in that row. The high nibbles
+// of bytes from 0x80 select no bit, so they are never in the set.
+
+__attribute__((target("sse4.2"))) const char *
+skip_sse42(const char *p, const char *end, const CharSet &set) {
+  const __m128i low_table =
+      _mm_load_si128(reinterpret_cast<const __m128i *>(set.low));
+  const __m128i high_bits =
+      _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  const __m128i percent = _mm_set1_epi8('%');
+
+  while (end - p >= 16) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i rows = _mm_shuffle_epi8(low_table, _mm_and_si128(bytes, nibble));
+    __m128i bits = _mm_shuffle_epi8(
+        high_bits, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble));
+    uint32_t outside = _mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_and_si128(rows, bits), _mm_setzero_si128()));
+    uint32_t percents = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, percent));
+    if (outside | percents) {
+      unsigned stop = block_end(p, end, outside, percents, 16);
+      if (stop < 16)
+        return p + stop;
+    }
+    p += 16;
+  }
+  return skip_scalar(p, end, set);
+}
+
+__attribute__((target("avx2"))) const char *
+skip_avx2(const char *p, const char *end, const CharSet &set) {
+  const __m256i low_table = _mm256_broadcastsi128_si256(
+      _mm_load_si128(reinterpret_cast<const __m128i *>(set.low)));
+  const __m256i high_bits = _mm256_setr_epi8(
+      1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32,
+      64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  const __m256i percent = _mm256_set1_epi8('%');
+
+  while (end - p >= 32) {
+    __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i rows =
+        _mm256_shuffle_epi8(low_table, _mm256_and_si256(bytes, nibble));
+    __m256i bits = _mm256_shuffle_epi8(
+        high_bits, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble));
+    uint32_t outside = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+        _mm256_and_si256(rows, bits), _mm256_setzero_si256()));
+    uint32_t percents =
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, percent));
+    if (outside | percents) {
+      unsigned stop = block_end(p, end, outside, percents, 32);
+      if (stop < 32)
+        return p + stop;
+    }
+    p += 32;
+  }
+  // the tail stays in this function: calling legacy SSE code with the upper
+  // halves of the ymm registers dirty costs more than the scan
+  return skip_scalar(p, end, set);
+}
+#endif
+
+} // namespace
+
+Kernel best_kernel() {
+  static const Kernel best = [] {
+    if (is_supported(Kernel::AVX2))
+      return Kernel::AVX2;
+    if (is_supported(Kernel::SSE42))
+      return Kernel::SSE42;
+    return Kernel::SCALAR;
+  }();
+  return best;
+}
+
+bool is_supported(Kernel kernel) {
+  switch (kernel) {
+#ifdef URI_SCAN_X86
+  case Kernel::AVX2:
+    return __builtin_cpu_supports("avx2");
+  case Kernel::SSE42:
+    return __builtin_cpu_supports("sse4.2");
+#endif
+  case Kernel::SCALAR:
+    return true;
+  default:
+    return false;
+  }
+}
+
+const char *skip(const char *p, const char *end, const CharSet &set) {
+  return skip_with(best_kernel(), p, end, set);
+}
+
+const char *skip_with(Kernel kernel, const char *p, const char *end,
+                      const CharSet &set) {
+  switch (kernel) {
+#ifdef URI_SCAN_X86
+  case Kernel::AVX2:
+    return skip_avx2(p, end, set);
+  case Kernel::SSE42:
+    return skip_sse42(p, end, set);
+#endif
+  default:
+    return skip_scalar(p, end, set);
+  }
+}
+} // namespace uri_scan
@@ -9,6 +9,11 @@
 #define PARSING_EDGE_CASE_TESTS
 #define RFC_3986_CASES_TESTS
 #define URI_COMPONENT_TESTS
+#define URI_VIEW_TESTS
+#define URI_SCAN_TESTS
+#define URI_ERROR_TESTS
+#define URI_BATCH_TESTS
+#define URI_ALLOCATOR_TESTS
 #endif
 
 class URIParserTest : public ::testing::Test {
@@ -24,6 +29,11 @@ protected:
 #include "parsing_edge_case_tests.cxx"
 #include "rfc_3986_cases_tests.cxx"
 #include "uri_component_tests.cxx"
+#include "uri_view_tests.cxx"
+#include "uri_scan_tests.cxx"
+#include "uri_error_tests.cxx"
+#include "uri_batch_tests.cxx"
+#include "uri_allocator_tests.cxx"
 
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
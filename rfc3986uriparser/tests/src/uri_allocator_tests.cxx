@@ -0,0 +1,62 @@
+#include "../include/test_common.hpp"
+#ifdef URI_ALLOCATOR_TESTS
+#include <memory_resource>
+// Allocator-aware URI tests
+TEST_F(URIParserTest, TryParseAllocatesFromTheGivenResource) {
+  // long enough that no component fits in the small string buffer
+  std::string target = "https://user-name-of-some-length@api.example.com:8443"
+                       "/api/v1/users/12345/orders?status=open&limit=50"
+                       "#a-fragment-that-is-long";
+  alignas(std::max_align_t) char buffer[64 * 1024];
+  std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer),
+                                            std::pmr::null_memory_resource());
+
+  std::pmr::vector<URI> uris(&arena);
+  uris.reserve(48);
+  for (size_t i = 0; i < 48; ++i) {
+    auto uri = parser_->try_parse(target, &arena);
+    ASSERT_TRUE(uri.has_value());
+    uris.push_back(std::move(*uri));
+  }
+
+  for (const URI &uri : uris) {
+    EXPECT_EQ(uri.get_allocator().resource(), &arena);
+    EXPECT_EQ(uri.userinfo(), "user-name-of-some-length");
+    EXPECT_EQ(uri.host(), "api.example.com");
+    EXPECT_EQ(uri.port().value(), 8443);
+    EXPECT_EQ(uri.path(), "/api/v1/users/12345/orders");
+    EXPECT_EQ(uri.query(), "status=open&limit=50");
+    EXPECT_EQ(uri.fragment(), "a-fragment-that-is-long");
+    EXPECT_EQ(uri.to_string(), target);
+  }
+}
+
+TEST_F(URIParserTest, UriCopiesAndMovesBetweenResources) {
+  std::pmr::monotonic_buffer_resource arena;
+  std::pmr::monotonic_buffer_resource other;
+  URI uri = parser_->parse_view("http://example.com/a/path/longer/than/sso")
+                .to_uri(&arena);
+  const char *path = uri.path().data();
+
+  URI moved(std::move(uri), &arena);
+  EXPECT_EQ(moved.path().data(), path);
+
+  URI copied(moved, &other);
+  EXPECT_EQ(copied.get_allocator().resource(), &other);
+  EXPECT_NE(copied.path().data(), path);
+  EXPECT_EQ(copied.path(), moved.path());
+
+  URI elsewhere(std::move(moved), &other);
+  EXPECT_EQ(elsewhere.get_allocator().resource(), &other);
+  EXPECT_EQ(elsewhere.path(), "/a/path/longer/than/sso");
+}
+
+TEST_F(URIParserTest, UriUsesTheDefaultResource) {
+  URI uri;
+  EXPECT_EQ(uri.get_allocator().resource(), std::pmr::get_default_resource());
+
+  auto parsed = parser_->parse("http://example.com/");
+  EXPECT_EQ(parsed->get_allocator().resource(),
+            std::pmr::get_default_resource());
+}
+#endif
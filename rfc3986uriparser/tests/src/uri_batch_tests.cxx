@@ -0,0 +1,119 @@
+#include "../include/test_common.hpp"
+#ifdef URI_BATCH_TESTS
+#include <span>
+// Columnar batch parse tests
+TEST_F(URIParserTest, BatchParsesIntoColumns) {
+  std::vector<std::string_view> inputs = {
+      "https://user@example.com:8443/a/b?q=1#top",
+      "http://example.com/search?q=two words",
+      "urn:isbn:0451450523",
+  };
+  URIBatch batch = parser_->parse_batch(inputs);
+
+  ASSERT_EQ(batch.size(), 3);
+  EXPECT_EQ(batch.valid_count(), 2);
+  EXPECT_TRUE(batch.is_valid(0));
+  EXPECT_FALSE(batch.is_valid(1));
+  EXPECT_TRUE(batch.is_valid(2));
+  EXPECT_EQ(batch.validity()[0], 0b101u);
+
+  EXPECT_EQ(batch.scheme().in(inputs[0], 0), "https");
+  EXPECT_EQ(batch.authority().in(inputs[0], 0), "user@example.com:8443");
+  EXPECT_EQ(batch.userinfo().in(inputs[0], 0), "user");
+  EXPECT_EQ(batch.host().in(inputs[0], 0), "example.com");
+  EXPECT_EQ(batch.port()[0], 8443);
+  EXPECT_EQ(batch.path().in(inputs[0], 0), "/a/b");
+  EXPECT_EQ(batch.query().in(inputs[0], 0), "q=1");
+  EXPECT_EQ(batch.fragment().in(inputs[0], 0), "top");
+
+  EXPECT_EQ(batch.path().in(inputs[2], 2), "isbn:0451450523");
+  EXPECT_EQ(batch.host().lengths[2], 0);
+  EXPECT_EQ(batch.port()[2], 0);
+
+  // invalid rows are zero
+  EXPECT_EQ(batch.scheme().lengths[1], 0);
+  EXPECT_EQ(batch.path().lengths[1], 0);
+
+  ASSERT_EQ(batch.errors().size(), 1);
+  EXPECT_EQ(batch.errors()[0].first, 1);
+  EXPECT_EQ(batch.errors()[0].second.code, URIErrorCode::INVALID_QUERY);
+}
+
+TEST_F(URIParserTest, BatchDictionariesIgnoreCase) {
+  std::vector<std::string_view> inputs = {
+      "http://Example.COM/", "HTTP://example.com/a", "https://other.org/",
+      "mailto:someone@example.com", "http://EXAMPLE.com:80/"};
+  URIBatch batch = parser_->parse_batch(inputs);
+
+  EXPECT_EQ(batch.scheme_dictionary(),
+            (std::vector<std::string>{"", "http", "https", "mailto"}));
+  EXPECT_EQ(batch.scheme_codes(), (std::vector<uint32_t>{1, 1, 2, 3, 1}));
+  EXPECT_EQ(batch.host_dictionary(),
+            (std::vector<std::string>{"", "example.com", "other.org"}));
+  EXPECT_EQ(batch.host_codes(), (std::vector<uint32_t>{1, 1, 2, 0, 1}));
+  // the host column keeps the case of the input
+  EXPECT_EQ(batch.host().in(inputs[0], 0), "Example.COM");
+}
+
+TEST_F(URIParserTest, BatchIsTheSameOnAnyNumberOfThreads) {
+  std::vector<std::string> uris;
+  for (size_t i = 0; i < 20000; ++i) {
+    if (i % 7 == 0)
+      uris.push_back("http://bad host/" + std::to_string(i));
+    else
+      uris.push_back((i % 3 ? "http://" : "HTTPS://") + std::string("h") +
+                     std::to_string(i % 500) + ".example.com:" +
+                     std::to_string(i % 1000 + 1) + "/p/" + std::to_string(i));
+  }
+  std::vector<std::string_view> inputs(uris.begin(), uris.end());
+
+  URIBatch one = parser_->parse_batch(inputs, 1);
+  URIBatch four = parser_->parse_batch(inputs, 4);
+
+  EXPECT_EQ(one.valid_count(), 20000 - (20000 + 6) / 7);
+  EXPECT_EQ(one.validity(), four.validity());
+  EXPECT_EQ(one.path().offsets, four.path().offsets);
+  EXPECT_EQ(one.path().lengths, four.path().lengths);
+  EXPECT_EQ(one.port(), four.port());
+  EXPECT_EQ(one.scheme_codes(), four.scheme_codes());
+  EXPECT_EQ(one.scheme_dictionary(), four.scheme_dictionary());
+  EXPECT_EQ(one.host_codes(), four.host_codes());
+  EXPECT_EQ(one.host_dictionary(), four.host_dictionary());
+  EXPECT_EQ(one.host_dictionary().size(), 501);
+  ASSERT_EQ(one.errors().size(), four.errors().size());
+  for (size_t i = 0; i < one.errors().size(); ++i) {
+    EXPECT_EQ(one.errors()[i].first, four.errors()[i].first);
+    EXPECT_EQ(four.errors()[i].first, i * 7);
+  }
+
+  for (size_t row : {1, 5055, 5056, 19998}) {
+    EXPECT_EQ(four.host_dictionary()[four.host_codes()[row]],
+              parser_->parse_view(inputs[row]).host());
+  }
+}
+
+TEST_F(URIParserTest, BatchRowIsTheParsedView) {
+  std::vector<std::string_view> inputs = {"ftp://a:b@[::1]:21/x?y#z"};
+  URIBatch batch = parser_->parse_batch(inputs);
+
+  URIView row = batch.row(0, inputs[0]);
+  URIView view = parser_->parse_view(inputs[0]);
+  EXPECT_EQ(row.scheme(), view.scheme());
+  EXPECT_EQ(row.authority(), view.authority());
+  EXPECT_EQ(row.userinfo(), view.userinfo());
+  EXPECT_EQ(row.host(), view.host());
+  EXPECT_EQ(row.port(), view.port());
+  EXPECT_EQ(row.path(), view.path());
+  EXPECT_EQ(row.query(), view.query());
+  EXPECT_EQ(row.fragment(), view.fragment());
+}
+
+TEST_F(URIParserTest, BatchOfNothing) {
+  URIBatch batch = parser_->parse_batch({});
+
+  EXPECT_EQ(batch.size(), 0);
+  EXPECT_EQ(batch.valid_count(), 0);
+  EXPECT_TRUE(batch.errors().empty());
+  EXPECT_EQ(batch.host_dictionary(), std::vector<std::string>{""});
+}
+#endif
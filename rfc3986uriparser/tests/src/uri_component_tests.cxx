@@ -67,6 +67,17 @@ TEST_F(URIParserTest, ParsesFromStream) {
   EXPECT_EQ(uri->path(), "/path");
 }
 
+TEST_F(URIParserTest, ParsesWholeStream) {
+  std::istringstream iss("http://example.com/path?query#fragment\r\n");
+  auto uri = parser_->parse(iss);
+
+  EXPECT_EQ(uri->fragment(), "fragment");
+  EXPECT_EQ(iss.peek(), std::char_traits<char>::eof());
+
+  std::istringstream two("http://example1.com/path1\nhttps://example2.com/");
+  EXPECT_THROW(parser_->parse(two), URIParseException);
+}
+
 TEST_F(URIParserTest, ParsesMultipleFromStream) {
   std::istringstream iss(
       "http://example1.com/path1\nhttps://example2.com/path2");
@@ -99,4 +110,23 @@ TEST_F(URIParserTest, CharacterClassification) {
   EXPECT_TRUE(URIParser::is_scheme_char('.'));
   EXPECT_FALSE(URIParser::is_scheme_char(' '));
 }
+
+TEST_F(URIParserTest, CharacterClassesAreConstexpr) {
+  static_assert(URIParser::is_unreserved('~'));
+  static_assert(!URIParser::is_unreserved('%'));
+  static_assert(URIParser::is_reserved('@') && URIParser::is_reserved('='));
+  static_assert(URIParser::is_path_char('/') && !URIParser::is_path_char('?'));
+  static_assert(URIParser::is_query_char('?') && !URIParser::is_query_char('#'));
+  static_assert(URIParser::is_hex_digit('f') && !URIParser::is_hex_digit('g'));
+  static_assert(URIParser::is_port_char('9') && !URIParser::is_port_char('a'));
+}
+
+TEST_F(URIParserTest, CharacterClassesIgnoreNonAscii) {
+  for (int c = 0x80; c < 0x100; ++c) {
+    char ch = static_cast<char>(c);
+    EXPECT_FALSE(URIParser::is_unreserved(ch) || URIParser::is_reserved(ch) ||
+                 URIParser::is_host_char(ch) || URIParser::is_fragment_char(ch))
+        << c;
+  }
+}
 #endif
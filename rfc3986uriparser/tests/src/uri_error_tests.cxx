@@ -0,0 +1,61 @@
+#include "../include/test_common.hpp"
+#ifdef URI_ERROR_TESTS
+// Non-throwing parse tests
+TEST_F(URIParserTest, TryParseReturnsUri) {
+  auto uri = parser_->try_parse("HTTPS://example.com:8443/a?b#c");
+
+  ASSERT_TRUE(uri.has_value());
+  EXPECT_EQ(uri->scheme(), "https");
+  EXPECT_EQ(uri->host(), "example.com");
+  EXPECT_EQ(uri->port().value(), 8443);
+  EXPECT_EQ(uri->path(), "/a");
+  EXPECT_EQ(uri->query(), "b");
+  EXPECT_EQ(uri->fragment(), "c");
+}
+
+TEST_F(URIParserTest, TryParseReportsCodeAndOffset) {
+  struct Case {
+    const char *input;
+    URIErrorCode code;
+    size_t offset;
+  } cases[] = {
+      {"://example.com", URIErrorCode::MISSING_SCHEME, 0},
+      {"a1/b:c d", URIErrorCode::INVALID_PATH, 6},
+      {"http://example.com/?a b", URIErrorCode::INVALID_QUERY, 21},
+      {"http://example.com/#a#b", URIErrorCode::INVALID_FRAGMENT, 21},
+      {"http://us[er@example.com/", URIErrorCode::INVALID_HOST, 9},
+      {"http://a:b[@example.com/", URIErrorCode::INVALID_USERINFO, 10},
+      {"http://user@/", URIErrorCode::INVALID_HOST, 12},
+      {"http://example.com:8o/", URIErrorCode::INVALID_PORT, 20},
+      {"http://user@example.com:8o/", URIErrorCode::INVALID_PORT, 25},
+      {"http://example.com:65536/", URIErrorCode::INVALID_PORT, 19},
+      {"http://[::1::2]/", URIErrorCode::INVALID_IP_LITERAL, 7},
+      {"http://[::1/", URIErrorCode::INVALID_IP_LITERAL, 11},
+      {"http://example.com/%2x", URIErrorCode::INVALID_PERCENT_ENCODING, 19},
+  };
+
+  for (const Case &c : cases) {
+    auto uri = parser_->try_parse(c.input);
+    ASSERT_FALSE(uri.has_value()) << c.input;
+    EXPECT_EQ(uri.error().code, c.code) << c.input;
+    EXPECT_EQ(uri.error().offset, c.offset) << c.input;
+
+    auto view = parser_->try_parse_view(c.input);
+    ASSERT_FALSE(view.has_value()) << c.input;
+    EXPECT_EQ(view.error().code, c.code) << c.input;
+    EXPECT_EQ(view.error().offset, c.offset) << c.input;
+  }
+}
+
+TEST_F(URIParserTest, ParseExceptionCarriesError) {
+  try {
+    parser_->parse("http://example.com:8o/");
+    FAIL() << "no exception";
+  } catch (const URIParseException &e) {
+    ASSERT_TRUE(e.error().has_value());
+    EXPECT_EQ(e.error()->code, URIErrorCode::INVALID_PORT);
+    EXPECT_EQ(e.error()->offset, 20u);
+    EXPECT_STREQ(e.what(), "Failed to parse URI: Invalid port at offset 20");
+  }
+}
+#endif
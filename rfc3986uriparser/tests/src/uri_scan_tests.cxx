@@ -0,0 +1,74 @@
+#include "../include/test_common.hpp"
+#include "../../lib/include/uri_scan.hpp"
+#ifdef URI_SCAN_TESTS
+#include <random>
+
+// Scan kernel and long URI tests
+static uri_scan::CharSet query_set() {
+  uri_scan::CharSet set{};
+  for (int c = 0; c < 0x80; ++c) {
+    if (URIParser::is_query_char(static_cast<char>(c)))
+      set.low[c & 15] |= 1 << (c >> 4);
+  }
+  return set;
+}
+
+TEST_F(URIParserTest, ScanKernelsAgreeWithScalar) {
+  const uri_scan::CharSet set = query_set();
+  const std::string alphabet = "aZ09-._~!$&=/?:@%%%#[] \x7f\x80\xff";
+  std::mt19937 rng(7);
+
+  for (int round = 0; round < 20000; ++round) {
+    std::string input(rng() % 100, 'a');
+    for (char &c : input) {
+      // mostly run characters, so runs cross block boundaries
+      c = rng() % 8 ? 'a' + rng() % 6 : alphabet[rng() % alphabet.size()];
+    }
+    const char *begin = input.data();
+    const char *end = begin + input.size();
+    const char *expected =
+        uri_scan::skip_with(uri_scan::Kernel::SCALAR, begin, end, set);
+    for (auto kernel : {uri_scan::Kernel::SSE42, uri_scan::Kernel::AVX2}) {
+      if (!uri_scan::is_supported(kernel))
+        continue;
+      EXPECT_EQ(uri_scan::skip_with(kernel, begin, end, set) - begin,
+                expected - begin)
+          << input;
+    }
+  }
+}
+
+TEST_F(URIParserTest, ParsesLongQuery) {
+  std::string query;
+  while (query.size() < 8000)
+    query += "utm_source=newsletter&payload=%7B%22id%22%3A42%7D&";
+  std::string input = "https://example.com/landing?" + query + "#top";
+
+  URIView view = parser_->parse_view(input);
+  EXPECT_EQ(view.path(), "/landing");
+  EXPECT_EQ(view.query(), query);
+  EXPECT_EQ(view.fragment(), "top");
+}
+
+TEST_F(URIParserTest, LongQueryErrorOffsets) {
+  std::string input = "https://example.com/?" + std::string(5000, 'q');
+  const size_t bad = 21 + 4321;
+
+  for (std::string_view replacement : {" ", "\x80", "%4g", "[", "{"}) {
+    std::string broken = input;
+    broken.replace(bad, replacement.size(), replacement);
+    try {
+      parser_->parse_view(broken);
+      ADD_FAILURE() << "accepted " << replacement;
+    } catch (const URIParseException &e) {
+      EXPECT_NE(std::string(e.what()).find("offset " + std::to_string(bad)),
+                std::string::npos)
+          << e.what();
+    }
+  }
+
+  // an escape cut off by the end of the input
+  EXPECT_THROW(parser_->parse_view(input + "%4"), URIParseException);
+  EXPECT_NO_THROW(parser_->parse_view(input + "%4F"));
+}
+#endif